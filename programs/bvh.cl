@@ -14,10 +14,10 @@ typedef struct BVHTraversal {
 } BVHTraversal;
 
 float2 IntersectBVHNode(global BVHNode* node, global Ray* ray);
-void IntersectBVHTree(global BVHNode* nodes, global Triangle* triangles, global uint* primitiveIndices, global Ray* ray);
+void IntersectBVHTree(global BVHNode* nodes, global TriangleIsect* isects, global Ray* ray);
 
 inline float2 IntersectBVHNodeRay(global BVHNode* node, Ray* ray);
-inline void IntersectBVHTreeRay(global BVHNode* nodes, global Triangle* triangles, global uint* primitiveIndices, Ray* ray);
+inline void IntersectBVHTreeRay(global BVHNode* nodes, global TriangleIsect* isects, Ray* ray);
 
 inline float2 IntersectBVHNode(global BVHNode* node, global Ray* ray)
 {
@@ -53,7 +53,7 @@ inline float2 IntersectBVHNodeRay(global BVHNode* node, Ray* ray)
     return (float2)(tmin, tmax);
 }
 
-inline void IntersectBVHTree(global BVHNode* nodes, global Triangle* triangles, global uint* primitiveIndices, global Ray* ray)
+inline void IntersectBVHTree(global BVHNode* nodes, global TriangleIsect* isects, global Ray* ray)
 {
     struct BVHTraversal todo[64];
     int stackptr = 0;
@@ -88,8 +88,7 @@ inline void IntersectBVHTree(global BVHNode* nodes, global Triangle* triangles,
             steps++;
 #endif
             for (int idx = 0; idx < node->count; idx++) {
-                const int primIdx = primitiveIndices[node->leftFirst + idx];
-                IntersectTriangle(ray, &triangles[primIdx]);
+                IntersectTriangle(ray, &isects[node->leftFirst + idx]);
             }
         } else { // Not a leaf
             t1NearFar = IntersectBVHNode(&nodes[node->leftFirst], ray);
@@ -126,7 +125,7 @@ inline void IntersectBVHTree(global BVHNode* nodes, global Triangle* triangles,
 #endif
 }
 
-inline void IntersectBVHTreeRay(global BVHNode* nodes, global Triangle* triangles, global uint* primitiveIndices, Ray* ray)
+inline void IntersectBVHTreeRay(global BVHNode* nodes, global TriangleIsect* isects, Ray* ray)
 {
     struct BVHTraversal todo[64];
     int stackptr = 0;
@@ -161,8 +160,7 @@ inline void IntersectBVHTreeRay(global BVHNode* nodes, global Triangle* triangle
             steps++;
 #endif
             for (int idx = 0; idx < node->count; idx++) {
-                const int primIdx = primitiveIndices[node->leftFirst + idx];
-                IntersectTriangleRay(ray, &triangles[primIdx]);
+                IntersectTriangleRay(ray, &isects[node->leftFirst + idx]);
             }
         } else { // Not a leaf
             t1NearFar = IntersectBVHNodeRay(&nodes[node->leftFirst], ray);
@@ -0,0 +1,59 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+float3 SampleSky(global AliasEntry* skyTable, global float* skyPdf, global TextureInfo* skyInfo, uint* seed,
+                 float* pdf);
+float SkyPdf(global float* skyPdf, global TextureInfo* skyInfo, float3 dir);
+float3 SkyColor(global float3* skyDome, global TextureInfo* skyInfo, float3 dir);
+int SkyTexel(global TextureInfo* skyInfo, float3 dir);
+
+// Index of the texel dir falls into, shared by the radiance lookup and the pdf so both see the same texel,
+// see core::EnvironmentSampler::DirectionToTexel
+inline int SkyTexel(global TextureInfo* skyInfo, float3 dir)
+{
+    const float u = (1.0f + atan2(dir.x, -dir.z) / PI) * 0.5f;
+    const float v = 1.0f - acos(clamp(dir.y, -1.0f, 1.0f)) / PI;
+    const int x = clamp((int)(u * (float)skyInfo->width), 0, skyInfo->width - 1);
+    const int y = clamp((int)(v * (float)skyInfo->height), 0, skyInfo->height - 1);
+    return x + y * skyInfo->width;
+}
+
+inline float3 SkyColor(global float3* skyDome, global TextureInfo* skyInfo, float3 dir)
+{
+    return skyDome[SkyTexel(skyInfo, dir)];
+}
+
+// Picks a direction proportional to the brightness of the sky dome, see core::EnvironmentSampler.
+// skyTable holds the marginal table over the rows followed by a conditional table per row.
+inline float3 SampleSky(global AliasEntry* skyTable, global float* skyPdf, global TextureInfo* skyInfo, uint* seed,
+                        float* pdf)
+{
+    const int width = skyInfo->width;
+    const int height = skyInfo->height;
+    const float r0 = RandomFloat(seed);
+    const int y = SampleAlias(skyTable, height, r0, RandomFloat(seed));
+    const float r1 = RandomFloat(seed);
+    const int x = SampleAlias(skyTable + height + y * width, width, r1, RandomFloat(seed));
+
+    // uniform within the texel
+    const float u = ((float)x + RandomFloat(seed)) / (float)width;
+    const float v = ((float)y + RandomFloat(seed)) / (float)height;
+    const float theta = (1.0f - v) * PI;
+    const float phi = (2.0f * u - 1.0f) * PI;
+
+    const float sinTheta = sin(theta);
+    *pdf = sinTheta > 0.0f ? skyPdf[x + y * width] / sinTheta : 0.0f;
+    return (float3)(sinTheta * sin(phi), cos(theta), -sinTheta * cos(phi));
+}
+
+// Solid angle pdf of SampleSky returning dir
+inline float SkyPdf(global float* skyPdf, global TextureInfo* skyInfo, float3 dir)
+{
+    const float sinTheta = sqrt(max(1.0f - dir.y * dir.y, 0.0f));
+    if (sinTheta <= 0.0f)
+        return 0.0f;
+
+    return skyPdf[SkyTexel(skyInfo, dir)] / sinTheta;
+}
+
+#endif
@@ -6,50 +6,62 @@ typedef float4 vec4;
 // clang-format off
 #include "../src/Shared.h"
 #include "randomnumbers.cl"
+#include "light.cl"
 #include "material.cl"
+#include "environment.cl"
 #include "ray.cl"
 #include "camera.cl"
 #include "triangle.cl"
 #include "sphere.cl"
 #include "bvh.cl"
 #include "mbvh.cl"
+#include "instance.cl"
 #include "microfacet.cl"
 // clang-format on
 
-void TraceBVH(global Ray* ray, global Triangle* triangles, global BVHNode* nodes, global uint* primitiveIndices);
+void TraceBVH(global Ray* ray, global BVHNode* nodes, global TriangleIsect* isects);
 
-void TraceBVHRay(Ray* ray, global Triangle* triangles, global BVHNode* nodes, global uint* primitiveIndices);
+void TraceBVHRay(Ray* ray, global BVHNode* nodes, global TriangleIsect* isects);
 
-void Trace(global Ray* ray, global Triangle* triangles, global BVHNode* node, global MBVHNode* mNodes, global uint* primitiveIndices);
+// With MBVH enabled the BVHNode buffer holds the top-level tree over the instances
+void Trace(global Ray* ray, global BVHNode* node, global MBVHNode* mNodes, global TriangleIsect* isects,
+    global Instance* instances);
 
-void TraceRay(Ray* ray, global Triangle* triangles, global BVHNode* node, global MBVHNode* mNodes, global uint* primitiveIndices);
+void TraceRay(Ray* ray, global BVHNode* node, global MBVHNode* mNodes, global TriangleIsect* isects,
+    global Instance* instances);
 
 #include "path-tracer.cl"
 
-inline void TraceBVH(global Ray* ray, global Triangle* triangles, global BVHNode* nodes, global uint* primitiveIndices)
+inline void TraceBVH(global Ray* ray, global BVHNode* nodes, global TriangleIsect* isects)
 {
-    IntersectBVHTree(nodes, triangles, primitiveIndices, ray);
+    IntersectBVHTree(nodes, isects, ray);
 }
 
-inline void TraceBVHRay(Ray* ray, global Triangle* triangles, global BVHNode* nodes, global uint* primitiveIndices)
+inline void TraceBVHRay(Ray* ray, global BVHNode* nodes, global TriangleIsect* isects)
 {
-    IntersectBVHTreeRay(nodes, triangles, primitiveIndices, ray);
+    IntersectBVHTreeRay(nodes, isects, ray);
 }
 
-inline void Trace(global Ray* ray, global Triangle* triangles, global BVHNode* node, global MBVHNode* mNodes, global uint* primitiveIndices)
+inline void Trace(global Ray* ray, global BVHNode* node, global MBVHNode* mNodes, global TriangleIsect* isects,
+    global Instance* instances)
 {
 #if MBVH
-    IntersectMBVHTree(mNodes, triangles, primitiveIndices, ray);
+    Ray r = *ray;
+    IntersectInstances(node, instances, mNodes, isects, &r);
+    ray->t = r.t;
+    ray->hit_idx = r.hit_idx;
+    ray->inst_idx = r.inst_idx;
 #else
-    TraceBVH(ray, triangles, node, primitiveIndices);
+    TraceBVH(ray, node, isects);
 #endif
 }
 
-inline void TraceRay(Ray* ray, global Triangle* triangles, global BVHNode* node, global MBVHNode* mNodes, global uint* primitiveIndices)
+inline void TraceRay(Ray* ray, global BVHNode* node, global MBVHNode* mNodes, global TriangleIsect* isects,
+    global Instance* instances)
 {
 #if MBVH
-    IntersectMBVHTreeRay(mNodes, triangles, primitiveIndices, ray);
+    IntersectInstances(node, instances, mNodes, isects, ray);
 #else
-    TraceBVHRay(ray, triangles, node, primitiveIndices);
+    TraceBVHRay(ray, node, isects);
 #endif
 }
\ No newline at end of file
@@ -0,0 +1,114 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#define TLAS_STACK_SIZE 32 // bvh::GpuTopLevelBVH limits the TLAS depth so traversal never needs more
+
+// Mirrors bvh::GpuInstance, matrices are column major like glm
+typedef struct Instance {
+    float4 transform[4]; // world to object, 64
+    float4 inverse[4]; // object to world, 128
+    int nodeOffset; // 132
+    int isectOffset; // 136
+    int dummy0, dummy1; // 144
+} Instance;
+
+float3 TransformPoint(global float4* matrix, float3 p);
+float3 TransformVector(global float4* matrix, float3 v);
+float3 TransformNormal(global float4* worldToObject, float3 n);
+
+void IntersectInstance(global Instance* instance, int instIdx, global MBVHNode* mNodes,
+    global TriangleIsect* isects, Ray* ray);
+void IntersectInstances(global BVHNode* nodes, global Instance* instances, global MBVHNode* mNodes,
+    global TriangleIsect* isects, Ray* ray);
+
+ShadingTriangle GetHitTriangle(global Triangle* triangles, global PackedVertex* vertices, global Instance* instances,
+    const Ray* ray);
+
+inline float3 TransformPoint(global float4* matrix, float3 p)
+{
+    return (matrix[0] * p.x + matrix[1] * p.y + matrix[2] * p.z + matrix[3]).xyz;
+}
+
+inline float3 TransformVector(global float4* matrix, float3 v)
+{
+    return (matrix[0] * v.x + matrix[1] * v.y + matrix[2] * v.z).xyz;
+}
+
+// Object to world for normals: the inverse transpose of object to world, which is the transpose of world to object.
+// Keeps normals perpendicular to the surface under non-uniform scale and shear.
+inline float3 TransformNormal(global float4* worldToObject, float3 n)
+{
+    return (float3)(dot(worldToObject[0].xyz, n), dot(worldToObject[1].xyz, n), dot(worldToObject[2].xyz, n));
+}
+
+inline void IntersectInstance(global Instance* instance, int instIdx, global MBVHNode* mNodes,
+    global TriangleIsect* isects, Ray* ray)
+{
+    // the direction is not normalized so t stays the same in object space
+    Ray r;
+    r.origin = TransformPoint(instance->transform, ray->origin);
+    r.direction = TransformVector(instance->transform, ray->direction);
+    r.t = ray->t;
+    r.hit_idx = -1;
+
+    IntersectMBVHTreeRay(mNodes + instance->nodeOffset, isects + instance->isectOffset, &r);
+
+    if (r.hit_idx >= 0) {
+        ray->t = r.t;
+        ray->hit_idx = r.hit_idx;
+        ray->inst_idx = instIdx;
+    }
+}
+
+inline void IntersectInstances(global BVHNode* nodes, global Instance* instances, global MBVHNode* mNodes,
+    global TriangleIsect* isects, Ray* ray)
+{
+    struct BVHTraversal todo[TLAS_STACK_SIZE];
+    int stackptr = 0;
+
+    todo[0].nodeIdx = 0;
+
+    while (stackptr >= 0) {
+        const uint nodeIdx = todo[stackptr].nodeIdx;
+        stackptr--;
+
+        global BVHNode* node = &nodes[nodeIdx];
+        const float2 tNearFar = IntersectBVHNodeRay(node, ray);
+        if (tNearFar.y < tNearFar.x || tNearFar.y < 0.0f || tNearFar.x > ray->t)
+            continue;
+
+        if (node->count > -1) {
+            for (int i = 0; i < node->count; i++) {
+                const int instIdx = node->leftFirst + i;
+                IntersectInstance(&instances[instIdx], instIdx, mNodes, isects, ray);
+            }
+            continue;
+        }
+
+        // unreachable for trees built on the host, a deeper tree loses geometry instead of corrupting memory
+        if (stackptr + 2 >= TLAS_STACK_SIZE)
+            continue;
+
+        todo[++stackptr].nodeIdx = node->leftFirst;
+        todo[++stackptr].nodeIdx = node->leftFirst + 1;
+    }
+}
+
+// Returns the hit triangle in world space so shading code does not need to know about instances
+inline ShadingTriangle GetHitTriangle(global Triangle* triangles, global PackedVertex* vertices,
+    global Instance* instances, const Ray* ray)
+{
+    ShadingTriangle triangle = GetShadingTriangle(&triangles[ray->hit_idx], vertices);
+#if MBVH
+    global Instance* instance = &instances[ray->inst_idx];
+    triangle.p0 = TransformPoint(instance->inverse, triangle.p0);
+    triangle.p1 = TransformPoint(instance->inverse, triangle.p1);
+    triangle.p2 = TransformPoint(instance->inverse, triangle.p2);
+    triangle.n0 = normalize(TransformNormal(instance->transform, triangle.n0));
+    triangle.n1 = normalize(TransformNormal(instance->transform, triangle.n1));
+    triangle.n2 = normalize(TransformNormal(instance->transform, triangle.n2));
+#endif
+    return triangle;
+}
+
+#endif
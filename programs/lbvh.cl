@@ -0,0 +1,374 @@
+#define PI 3.14159265358979323846f
+#define INVPI (1.0f / PI)
+#define LEAF_SIZE 4
+#define RADIX_BITS 4
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define SORT_BLOCK 64
+#define SCAN_GROUP_SIZE 256
+
+// clang-format off
+#include "../src/Shared.h"
+#include "randomnumbers.cl"
+#include "material.cl"
+#include "ray.cl"
+#include "triangle.cl"
+#include "mbvh.cl"
+// clang-format on
+
+// Linear BVH as described by Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees".
+// Internal nodes are stored at [0, n - 1), leaves at [n - 1, 2n - 1).
+typedef struct LBVHNode
+{
+	float4 bmin; // 16
+	float4 bmax; // 32
+	int left;	// 36
+	int right;   // 40
+	int first;   // 44, first sorted primitive covered by this node
+	int count;   // 48, number of sorted primitives covered by this node
+} LBVHNode;
+
+inline int FloatToOrderedInt(float f)
+{
+	const int i = as_int(f);
+	return i >= 0 ? i : i ^ 0x7FFFFFFF;
+}
+
+inline float OrderedIntToFloat(int i) { return as_float(i >= 0 ? i : i ^ 0x7FFFFFFF); }
+
+inline uint ExpandBits(uint v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+inline uint Morton3D(float3 p)
+{
+	p = clamp(p * 1024.0f, 0.0f, 1023.0f);
+	return ExpandBits((uint)p.x) * 4 + ExpandBits((uint)p.y) * 2 + ExpandBits((uint)p.z);
+}
+
+inline float3 TriangleCentroid(global Triangle *triangle) { return (triangle->p0 + triangle->p1 + triangle->p2) / 3.0f; }
+
+// Length of the common prefix of keys i and j, duplicate keys are made unique by their index
+inline int Delta(global uint *codes, int n, int i, int j)
+{
+	if (j < 0 || j >= n)
+		return -1;
+
+	const uint a = codes[i];
+	const uint b = codes[j];
+	if (a == b)
+		return 32 + clz((uint)(i ^ j));
+	return clz(a ^ b);
+}
+
+kernel void computeBounds(global Triangle *triangles, global int *sceneBounds, int n)
+{
+	const int i = get_global_id(0);
+	if (i >= n)
+		return;
+
+	const float3 c = TriangleCentroid(&triangles[i]);
+	atomic_min(&sceneBounds[0], FloatToOrderedInt(c.x));
+	atomic_min(&sceneBounds[1], FloatToOrderedInt(c.y));
+	atomic_min(&sceneBounds[2], FloatToOrderedInt(c.z));
+	atomic_max(&sceneBounds[3], FloatToOrderedInt(c.x));
+	atomic_max(&sceneBounds[4], FloatToOrderedInt(c.y));
+	atomic_max(&sceneBounds[5], FloatToOrderedInt(c.z));
+}
+
+kernel void computeMortonCodes(global Triangle *triangles, global int *sceneBounds, global uint *codes,
+							   global uint *primIndices, int n)
+{
+	const int i = get_global_id(0);
+	if (i >= n)
+		return;
+
+	const float3 bmin = (float3)(OrderedIntToFloat(sceneBounds[0]), OrderedIntToFloat(sceneBounds[1]),
+								 OrderedIntToFloat(sceneBounds[2]));
+	const float3 bmax = (float3)(OrderedIntToFloat(sceneBounds[3]), OrderedIntToFloat(sceneBounds[4]),
+								 OrderedIntToFloat(sceneBounds[5]));
+	const float3 extent = fmax(bmax - bmin, (float3)(1e-6f, 1e-6f, 1e-6f));
+
+	codes[i] = Morton3D((TriangleCentroid(&triangles[i]) - bmin) / extent);
+	primIndices[i] = i;
+}
+
+// Every work item owns SORT_BLOCK consecutive keys, histograms are stored digit-major so that an exclusive
+// scan over the whole array yields the scatter offset of every (digit, block) pair.
+kernel void radixHistogram(global uint *keys, global uint *histograms, int n, int shift, int blockCount)
+{
+	const int block = get_global_id(0);
+	if (block >= blockCount)
+		return;
+
+	uint counts[RADIX_SIZE];
+	for (int d = 0; d < RADIX_SIZE; d++)
+		counts[d] = 0;
+
+	const int end = min(n, (block + 1) * SORT_BLOCK);
+	for (int i = block * SORT_BLOCK; i < end; i++)
+		counts[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+
+	for (int d = 0; d < RADIX_SIZE; d++)
+		histograms[d * blockCount + block] = counts[d];
+}
+
+// Exclusive scan, must be launched as a single work group of SCAN_GROUP_SIZE work items
+kernel void radixScan(global uint *histograms, int count)
+{
+	local uint sums[SCAN_GROUP_SIZE];
+	const int lid = get_local_id(0);
+	const int chunk = (count + SCAN_GROUP_SIZE - 1) / SCAN_GROUP_SIZE;
+	const int start = min(count, lid * chunk);
+	const int end = min(count, start + chunk);
+
+	uint sum = 0;
+	for (int i = start; i < end; i++)
+		sum += histograms[i];
+
+	sums[lid] = sum;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int offset = 1; offset < SCAN_GROUP_SIZE; offset <<= 1)
+	{
+		const uint value = lid >= offset ? sums[lid - offset] : 0;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		sums[lid] += value;
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	uint running = sums[lid] - sum;
+	for (int i = start; i < end; i++)
+	{
+		const uint value = histograms[i];
+		histograms[i] = running;
+		running += value;
+	}
+}
+
+kernel void radixScatter(global uint *keysIn, global uint *valuesIn, global uint *keysOut, global uint *valuesOut,
+						 global uint *histograms, int n, int shift, int blockCount)
+{
+	const int block = get_global_id(0);
+	if (block >= blockCount)
+		return;
+
+	uint offsets[RADIX_SIZE];
+	for (int d = 0; d < RADIX_SIZE; d++)
+		offsets[d] = histograms[d * blockCount + block];
+
+	const int end = min(n, (block + 1) * SORT_BLOCK);
+	for (int i = block * SORT_BLOCK; i < end; i++)
+	{
+		const uint key = keysIn[i];
+		const uint pos = offsets[(key >> shift) & (RADIX_SIZE - 1)]++;
+		keysOut[pos] = key;
+		valuesOut[pos] = valuesIn[i];
+	}
+}
+
+kernel void emitHierarchy(global uint *codes, global LBVHNode *nodes, global int *parents, int n)
+{
+	const int i = get_global_id(0);
+	if (i >= n - 1)
+		return;
+
+	// direction of the range covered by this node
+	const int d = (Delta(codes, n, i, i + 1) - Delta(codes, n, i, i - 1)) >= 0 ? 1 : -1;
+	const int deltaMin = Delta(codes, n, i, i - d);
+
+	// upper bound for the length of the range
+	int lMax = 2;
+	while (Delta(codes, n, i, i + lMax * d) > deltaMin)
+		lMax <<= 1;
+
+	// find the other end using binary search
+	int l = 0;
+	for (int t = lMax >> 1; t >= 1; t >>= 1)
+	{
+		if (Delta(codes, n, i, i + (l + t) * d) > deltaMin)
+			l += t;
+	}
+	const int j = i + l * d;
+
+	// find the split position using binary search
+	const int deltaNode = Delta(codes, n, i, j);
+	int s = 0;
+	int t = l;
+	do
+	{
+		t = (t + 1) >> 1;
+		if (Delta(codes, n, i, i + (s + t) * d) > deltaNode)
+			s += t;
+	} while (t > 1);
+
+	const int gamma = i + s * d + min(d, 0);
+	const int first = min(i, j);
+	const int last = max(i, j);
+
+	const int left = (first == gamma) ? (n - 1 + gamma) : gamma;
+	const int right = (last == gamma + 1) ? (n - 1 + gamma + 1) : gamma + 1;
+
+	nodes[i].left = left;
+	nodes[i].right = right;
+	nodes[i].first = first;
+	nodes[i].count = last - first + 1;
+
+	parents[left] = i;
+	parents[right] = i;
+	if (i == 0)
+		parents[0] = -1;
+}
+
+// Computes leaf bounds and propagates them to the root, the second child to arrive at a node computes its bounds
+kernel void refitBounds(global Triangle *triangles, global uint *primIndices, volatile global LBVHNode *nodes,
+						global int *parents, global uint *flags, int n)
+{
+	const int i = get_global_id(0);
+	if (i >= n)
+		return;
+
+	global Triangle *triangle = &triangles[primIndices[i]];
+	const int leafIdx = n - 1 + i;
+	nodes[leafIdx].bmin = (float4)(fmin(fmin(triangle->p0, triangle->p1), triangle->p2) - EPSILON, 0.0f);
+	nodes[leafIdx].bmax = (float4)(fmax(fmax(triangle->p0, triangle->p1), triangle->p2) + EPSILON, 0.0f);
+	nodes[leafIdx].left = -1;
+	nodes[leafIdx].right = -1;
+	nodes[leafIdx].first = i;
+	nodes[leafIdx].count = 1;
+
+	if (n == 1)
+		return;
+
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+	int current = parents[leafIdx];
+	while (current >= 0)
+	{
+		if (atomic_inc(&flags[current]) == 0)
+			return; // sibling has not been processed yet, it will continue upwards
+
+		const int left = nodes[current].left;
+		const int right = nodes[current].right;
+		nodes[current].bmin = fmin(nodes[left].bmin, nodes[right].bmin);
+		nodes[current].bmax = fmax(nodes[left].bmax, nodes[right].bmax);
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+
+		current = parents[current];
+	}
+}
+
+inline float HalfArea(LBVHNode node)
+{
+	const float4 e = node.bmax - node.bmin;
+	return e.x * e.y + e.x * e.z + e.y * e.z;
+}
+
+// Collapses one level of the binary tree into MBVH nodes, every task is a (LBVH node, MBVH node) pair.
+// counters[0] holds the number of tasks for the next level, counters[1] the number of allocated MBVH nodes.
+kernel void collapseMBVH(global LBVHNode *nodes, global MBVHNode *mNodes, global int2 *tasksIn, global int2 *tasksOut,
+						 global uint *counters, int taskCount)
+{
+	const int i = get_global_id(0);
+	if (i >= taskCount)
+		return;
+
+	const int2 task = tasksIn[i];
+	int children[4];
+	int childCount = 1;
+	children[0] = task.x;
+
+	if (nodes[task.x].count > LEAF_SIZE)
+	{
+		children[0] = nodes[task.x].left;
+		children[1] = nodes[task.x].right;
+		childCount = 2;
+
+		// open up the child with the largest surface area until all 4 slots are used
+		while (childCount < 4)
+		{
+			int best = -1;
+			float bestArea = -1.0f;
+			for (int c = 0; c < childCount; c++)
+			{
+				if (nodes[children[c]].count <= LEAF_SIZE)
+					continue;
+
+				const float area = HalfArea(nodes[children[c]]);
+				if (area > bestArea)
+				{
+					best = c;
+					bestArea = area;
+				}
+			}
+
+			if (best < 0)
+				break;
+
+			const int idx = children[best];
+			children[best] = nodes[idx].left;
+			children[childCount++] = nodes[idx].right;
+		}
+	}
+
+	float minx[4], miny[4], minz[4], maxx[4], maxy[4], maxz[4];
+	global MBVHNode *mNode = &mNodes[task.y];
+	for (int c = 0; c < 4; c++)
+	{
+		if (c >= childCount)
+		{
+			// invalidate any remaining children
+			minx[c] = miny[c] = minz[c] = 1e34f;
+			maxx[c] = maxy[c] = maxz[c] = -1e34f;
+			mNode->child[c] = 0;
+			mNode->count[c] = 0;
+			continue;
+		}
+
+		const LBVHNode child = nodes[children[c]];
+		minx[c] = child.bmin.x;
+		miny[c] = child.bmin.y;
+		minz[c] = child.bmin.z;
+		maxx[c] = child.bmax.x;
+		maxy[c] = child.bmax.y;
+		maxz[c] = child.bmax.z;
+
+		if (child.count <= LEAF_SIZE)
+		{
+			mNode->child[c] = child.first;
+			mNode->count[c] = child.count;
+		}
+		else
+		{
+			const int newIdx = atomic_inc(&counters[1]);
+			mNode->child[c] = newIdx;
+			mNode->count[c] = -1;
+			tasksOut[atomic_inc(&counters[0])] = (int2)(children[c], newIdx);
+		}
+	}
+
+	mNode->minx = (float4)(minx[0], minx[1], minx[2], minx[3]);
+	mNode->miny = (float4)(miny[0], miny[1], miny[2], miny[3]);
+	mNode->minz = (float4)(minz[0], minz[1], minz[2], minz[3]);
+	mNode->maxx = (float4)(maxx[0], maxx[1], maxx[2], maxx[3]);
+	mNode->maxy = (float4)(maxy[0], maxy[1], maxy[2], maxy[3]);
+	mNode->maxz = (float4)(maxz[0], maxz[1], maxz[2], maxz[3]);
+}
+
+// Stores the intersection data of every triangle in sorted order, MBVH leaves index this array directly
+kernel void emitIsects(global Triangle *triangles, global uint *primIndices, global TriangleIsect *isects, int n)
+{
+	const int i = get_global_id(0);
+	if (i >= n)
+		return;
+
+	const uint primIdx = primIndices[i];
+	global Triangle *triangle = &triangles[primIdx];
+	isects[i].p0 = triangle->p0;
+	isects[i].edge1 = triangle->p1 - triangle->p0;
+	isects[i].edge2 = triangle->p2 - triangle->p0;
+	isects[i].prim_idx = primIdx;
+}
@@ -0,0 +1,153 @@
+// Needs to match utils::AliasEntry
+typedef struct AliasEntry
+{
+    float probability;
+    int alias;
+} AliasEntry;
+
+int SampleAlias(global AliasEntry* table, int count, float r, float coin);
+int SampleLight(global AliasEntry* table, int count, uint* seed);
+
+// Maps two uniform random numbers in [0, 1) to an entry in O(1), r picks it and coin decides between it and its
+// alias, see utils::AliasTable
+inline int SampleAlias(global AliasEntry* table, int count, float r, float coin)
+{
+    const int idx = min((int)(r * (float)count), count - 1);
+    const AliasEntry entry = table[idx];
+    return coin < entry.probability ? idx : entry.alias;
+}
+
+// Picks a light proportional to its area
+inline int SampleLight(global AliasEntry* table, int count, uint* seed)
+{
+    const float r = RandomFloat(seed);
+    return SampleAlias(table, count, r, RandomFloat(seed));
+}
+
+// Needs to match bvh::LightNode
+typedef struct LightNode
+{
+    float minX, minY, minZ;
+    float phi; // 16
+    float maxX, maxY, maxZ;
+    float cosThetaO; // 32
+    float axisX, axisY, axisZ;
+    float cosThetaE; // 48
+    int firstChild; // -1 for leaves
+    int lightIdx;   // -1 for interior nodes
+    int dummy0, dummy1; // 64
+} LightNode;
+
+float CosSubClamped(float sinA, float cosA, float sinB, float cosB);
+float SinSubClamped(float sinA, float cosA, float sinB, float cosB);
+float LightImportance(global LightNode* node, float3 p, float3 n);
+int SampleLightTree(global LightNode* nodes, float3 p, float3 n, uint* seed, float* pmf);
+float LightTreePmf(global LightNode* nodes, global ulong* trails, float3 p, float3 n, int lightIdx);
+
+// cos(max(0, a - b)) from the sines and cosines of a and b
+inline float CosSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+    return cosA > cosB ? 1.0f : cosA * cosB + sinA * sinB;
+}
+
+// sin(max(0, a - b)) from the sines and cosines of a and b
+inline float SinSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+    return cosA > cosB ? 0.0f : sinA * cosB - cosA * sinB;
+}
+
+// Estimate of how much the lights in node contribute to p, see bvh::LightBVH::Importance
+inline float LightImportance(global LightNode* node, float3 p, float3 n)
+{
+    const float3 bmin = (float3)(node->minX, node->minY, node->minZ);
+    const float3 bmax = (float3)(node->maxX, node->maxY, node->maxZ);
+    const float3 axis = (float3)(node->axisX, node->axisY, node->axisZ);
+
+    const float3 center = (bmin + bmax) * 0.5f;
+    const float3 toPoint = p - center;
+    const float distance2 = dot(toPoint, toPoint);
+    const float radius2 = dot(bmax - center, bmax - center);
+    const float3 wi = distance2 > 0.0f ? toPoint / sqrt(distance2) : axis;
+
+    const float cosThetaW = dot(axis, wi);
+    const float sinThetaW = sqrt(max(1.0f - cosThetaW * cosThetaW, 0.0f));
+    const float sinThetaO = sqrt(max(1.0f - node->cosThetaO * node->cosThetaO, 0.0f));
+    const float cosThetaX = CosSubClamped(sinThetaW, cosThetaW, sinThetaO, node->cosThetaO);
+    const float sinThetaX = SinSubClamped(sinThetaW, cosThetaW, sinThetaO, node->cosThetaO);
+
+    const float cosThetaB = distance2 < radius2 ? -1.0f : sqrt(max(1.0f - radius2 / distance2, 0.0f));
+    const float sinThetaB = sqrt(max(1.0f - cosThetaB * cosThetaB, 0.0f));
+    const float cosThetaP = CosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+    if (cosThetaP <= node->cosThetaE)
+        return 0.0f;
+
+    const float cosThetaI = dot(-wi, n);
+    const float sinThetaI = sqrt(max(1.0f - cosThetaI * cosThetaI, 0.0f));
+    const float importance = node->phi * cosThetaP / max(distance2, sqrt(radius2));
+    return max(importance * CosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB), 0.0f);
+}
+
+// Walks the light tree from the root picking children proportional to their importance,
+// returns -1 if no light can reach p
+int SampleLightTree(global LightNode* nodes, float3 p, float3 n, uint* seed, float* pmf)
+{
+    *pmf = 0.0f;
+    if (LightImportance(&nodes[0], p, n) <= 0.0f)
+        return -1;
+
+    float r = RandomFloat(seed);
+    float probability = 1.0f;
+    int nodeIdx = 0;
+    while (nodes[nodeIdx].firstChild >= 0)
+    {
+        const int child = nodes[nodeIdx].firstChild;
+        const float importance0 = LightImportance(&nodes[child], p, n);
+        const float importance1 = LightImportance(&nodes[child + 1], p, n);
+        if (importance0 <= 0.0f && importance1 <= 0.0f)
+            return -1;
+
+        // reuse the random number, remapped to [0, 1) within the chosen child
+        const float p0 = importance0 / (importance0 + importance1);
+        if (r < p0)
+        {
+            r = min(r / p0, 0.99999994f);
+            probability *= p0;
+            nodeIdx = child;
+        }
+        else
+        {
+            r = min((r - p0) / (1.0f - p0), 0.99999994f);
+            probability *= 1.0f - p0;
+            nodeIdx = child + 1;
+        }
+    }
+
+    *pmf = probability;
+    return nodes[nodeIdx].lightIdx;
+}
+
+// Probability of SampleLightTree picking lightIdx at p
+float LightTreePmf(global LightNode* nodes, global ulong* trails, float3 p, float3 n, int lightIdx)
+{
+    if (lightIdx < 0 || LightImportance(&nodes[0], p, n) <= 0.0f)
+        return 0.0f;
+
+    ulong trail = trails[lightIdx];
+    float probability = 1.0f;
+    int nodeIdx = 0;
+    while (nodes[nodeIdx].firstChild >= 0)
+    {
+        const int child = nodes[nodeIdx].firstChild;
+        const float importance0 = LightImportance(&nodes[child], p, n);
+        const float importance1 = LightImportance(&nodes[child + 1], p, n);
+        if (importance0 <= 0.0f && importance1 <= 0.0f)
+            return 0.0f;
+
+        const int second = (int)(trail & 1);
+        probability *= (second ? importance1 : importance0) / (importance0 + importance1);
+        nodeIdx = child + second;
+        trail >>= 1;
+    }
+
+    return probability;
+}
@@ -1,9 +1,11 @@
 #ifndef MATERIAL_H
 #define MATERIAL_H
 
+#define TILE_SIZE 8 // needs to match TEXTURE_TILE_SIZE in src/Materials/MipTexture.h
+
 typedef struct TextureInfo
 {
-    int width, height, offset, dummy;
+    int width, height, offset, levels;
 } TextureInfo;
 
 typedef struct Material
@@ -33,22 +35,85 @@ typedef struct Material
     float dummy;
 } Material;
 
-float3 GetDiffuseColor(Material mat, global float3 *textures, global TextureInfo *texInfo, float2 texCoords);
+float3 GetDiffuseColor(Material mat, global uint *textures, global TextureInfo *texInfo, float2 texCoords, float uvLod);
+float ConeUVLod(float uvRatio, float coneWidth, float cosTheta);
+int MipLevelSize(int width, int height);
+float3 FetchTexel(global uint *textures, int offset, int width, int height, int x, int y);
+float3 SampleBilinear(global uint *textures, int offset, int width, int height, float2 texCoords);
 
-inline float3 GetDiffuseColor(Material mat, global float3 *textures, global TextureInfo *texInfo,
-                              float2 texCoords)
+// Mip level of a hit for a texture of a single texel, the texture adds 0.5 * log2(width * height).
+// Without a cone (width 0) this ends up at the full resolution level.
+inline float ConeUVLod(float uvRatio, float coneWidth, float cosTheta)
 {
-    if (mat.textureIdx > -1)
-    {
-        const uint x = min(texInfo->width, max(0, (int)(texCoords.x * texInfo[mat.textureIdx].width) - 1));
-        const uint y = min(texInfo->height, max(0, (int)(texCoords.y * texInfo[mat.textureIdx].height) - 1));
-        const uint idx = texInfo[mat.textureIdx].offset + y * texInfo[mat.textureIdx].width + x;
-        return textures[idx];
-    }
-    else
-    {
+    if (!(uvRatio > 0.0f) || coneWidth <= 0.0f || cosTheta <= 0.0f)
+        return -INFINITY;
+    return 0.5f * log2(uvRatio) + log2(coneWidth / cosTheta);
+}
+
+// Texels in a mip level, every level is padded to whole tiles
+inline int MipLevelSize(int width, int height)
+{
+    return ((width + TILE_SIZE - 1) / TILE_SIZE) * ((height + TILE_SIZE - 1) / TILE_SIZE) * TILE_SIZE * TILE_SIZE;
+}
+
+inline float3 FetchTexel(global uint *textures, int offset, int width, int height, int x, int y)
+{
+    x = clamp(x, 0, width - 1);
+    y = clamp(y, 0, height - 1);
+
+    // tiles are stored row by row, texels within a tile in Morton order
+    const int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    const int tile = (x / TILE_SIZE) + (y / TILE_SIZE) * tilesX;
+    const uint tx = x % TILE_SIZE, ty = y % TILE_SIZE;
+    const uint morton =
+        (tx & 1) | ((ty & 1) << 1) | ((tx & 2) << 1) | ((ty & 2) << 2) | ((tx & 4) << 2) | ((ty & 4) << 3);
+
+    const uint texel = textures[offset + tile * TILE_SIZE * TILE_SIZE + morton];
+    return (float3)(texel & 0xFF, (texel >> 8) & 0xFF, (texel >> 16) & 0xFF) * (1.0f / 255.0f);
+}
+
+inline float3 SampleBilinear(global uint *textures, int offset, int width, int height, float2 texCoords)
+{
+    const float s = clamp(texCoords.x, 0.0f, 1.0f) * (float)width - 0.5f;
+    const float t = clamp(texCoords.y, 0.0f, 1.0f) * (float)height - 0.5f;
+    const float fs = floor(s), ft = floor(t);
+    const int x = (int)fs, y = (int)ft;
+    const float wx = s - fs, wy = t - ft;
+
+    const float3 top = mix(FetchTexel(textures, offset, width, height, x, y),
+                           FetchTexel(textures, offset, width, height, x + 1, y), wx);
+    const float3 bottom = mix(FetchTexel(textures, offset, width, height, x, y + 1),
+                              FetchTexel(textures, offset, width, height, x + 1, y + 1), wx);
+    return mix(top, bottom, wy);
+}
+
+inline float3 GetDiffuseColor(Material mat, global uint *textures, global TextureInfo *texInfo, float2 texCoords,
+                              float uvLod)
+{
+    if (mat.textureIdx < 0)
         return mat.diffuse;
+
+    const TextureInfo info = texInfo[mat.textureIdx];
+    const float lod = clamp(uvLod + 0.5f * log2((float)(info.width * info.height)), 0.0f, (float)(info.levels - 1));
+    const int level = (int)lod;
+    const float f = lod - (float)level;
+
+    // walk down the pyramid to the first level we need
+    int offset = info.offset;
+    int width = info.width, height = info.height;
+    for (int i = 0; i < level; i++)
+    {
+        offset += MipLevelSize(width, height);
+        width = max(width / 2, 1);
+        height = max(height / 2, 1);
     }
+
+    const float3 color = SampleBilinear(textures, offset, width, height, texCoords);
+    if (f <= 0.0f)
+        return color;
+
+    offset += MipLevelSize(width, height);
+    return mix(color, SampleBilinear(textures, offset, max(width / 2, 1), max(height / 2, 1), texCoords), f);
 }
 
 #endif
\ No newline at end of file
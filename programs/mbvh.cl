@@ -34,9 +34,8 @@ typedef struct MBVHHit
 
 MBVHHit IntersectMBVHNode(global MBVHNode *node, global Ray *ray);
 MBVHHit IntersectMBVHNodeRay(global MBVHNode *node, Ray *ray);
-void IntersectMBVHTree(global MBVHNode *nodes, global Triangle *triangles, global uint *primitiveIndices,
-					   global Ray *ray);
-void IntersectMBVHTreeRay(global MBVHNode *nodes, global Triangle *triangles, global uint *primitiveIndices, Ray *ray);
+void IntersectMBVHTree(global MBVHNode *nodes, global TriangleIsect *isects, global Ray *ray);
+void IntersectMBVHTreeRay(global MBVHNode *nodes, global TriangleIsect *isects, Ray *ray);
 
 inline MBVHHit IntersectMBVHNode(global MBVHNode *node, global Ray *ray)
 {
@@ -192,8 +191,7 @@ inline MBVHHit IntersectMBVHNodeRay(global MBVHNode *node, Ray *ray)
 	return hit;
 }
 
-inline void IntersectMBVHTree(global MBVHNode *nodes, global Triangle *triangles, global uint *primitiveIndices,
-							  global Ray *ray)
+inline void IntersectMBVHTree(global MBVHNode *nodes, global TriangleIsect *isects, global Ray *ray)
 {
 	struct MBVHTraversal todo[64];
 	struct MBVHHit hit;
@@ -217,8 +215,7 @@ inline void IntersectMBVHTree(global MBVHNode *nodes, global Triangle *triangles
 		{ // leaf node
 			for (int i = 0; i < mTodo.count; i++)
 			{
-				const int primIdx = primitiveIndices[mTodo.leftFirst + i];
-				IntersectTriangle(ray, &triangles[primIdx]);
+				IntersectTriangle(ray, &isects[mTodo.leftFirst + i]);
 			}
 			continue;
 		}
@@ -244,8 +241,7 @@ inline void IntersectMBVHTree(global MBVHNode *nodes, global Triangle *triangles
 #endif
 }
 
-inline void IntersectMBVHTreeRay(global MBVHNode *nodes, global Triangle *triangles, global uint *primitiveIndices,
-								 Ray *ray)
+inline void IntersectMBVHTreeRay(global MBVHNode *nodes, global TriangleIsect *isects, Ray *ray)
 {
 	struct MBVHTraversal todo[64];
 	struct MBVHHit hit;
@@ -269,8 +265,7 @@ inline void IntersectMBVHTreeRay(global MBVHNode *nodes, global Triangle *triang
 		{ // leaf node
 			for (int i = 0; i < mTodo.count; i++)
 			{
-				const int primIdx = primitiveIndices[mTodo.leftFirst + i];
-				IntersectTriangleRay(ray, &triangles[primIdx]);
+				IntersectTriangleRay(ray, &isects[mTodo.leftFirst + i]);
 			}
 			continue;
 		}
@@ -1,27 +1,32 @@
 #ifndef PATH_TRACER_H
 #define PATH_TRACER_H
 
-float3 SampleReference(global Ray *ray, global Material *materials, global Triangle *triangles, global BVHNode *nodes,
-                       global MBVHNode *mNodes, global uint *primitiveIndices, global float3 *textureBuffer,
+float3 SampleReference(global Ray *ray, global Material *materials, global Triangle *triangles,
+                       global PackedVertex *vertices, global BVHNode *nodes, global MBVHNode *mNodes,
+                       global TriangleIsect *isects, global Instance *instances, global uint *textureBuffer,
                        global TextureInfo *textureInfo, global float3 *skyDome, global TextureInfo *skyInfo,
                        int hasSkyDome, uint *seed);
 
-float3 SampleNEE_MIS(global Ray *ray, global Material *materials, global Triangle *triangles, global BVHNode *nodes,
-                     global MBVHNode *mNodes, global uint *primitiveIndices, global uint *lightIndices,
-                     global float *lightLotteryTickets, global float3 *textureBuffer, global TextureInfo *textureInfo,
+float3 SampleNEE_MIS(global Ray *ray, global Material *materials, global Triangle *triangles,
+                     global PackedVertex *vertices, global BVHNode *nodes, global MBVHNode *mNodes,
+                     global TriangleIsect *isects, global Instance *instances, global uint *lightIndices,
+                     global AliasEntry *lightTable, global uint *textureBuffer, global TextureInfo *textureInfo,
                      global float3 *skyDome, global TextureInfo *skyInfo, int hasSkyDome, float lightArea,
-                     int lightCount, uint *seed);
+                     int lightCount, global LightNode *lightNodes, global ulong *lightTrails,
+                     global AliasEntry *skyTable, global float *skyPdf, uint *seed);
 
-float3 SampleMicrofacet(global Ray *ray, global Material *materials, global Triangle *triangles, global BVHNode *nodes,
-                        global MBVHNode *mNodes, global uint *primitiveIndices, global uint *lightIndices,
-                        global float *lightLotteryTickets, global float3 *textureBuffer,
-                        global TextureInfo *textureInfo, global float3 *skyDome, global TextureInfo *skyInfo,
-                        global Microfacet *microfacets, int hasSkyDome, float lightArea, int lightCount, uint *seed);
+float3 SampleMicrofacet(global Ray *ray, global Material *materials, global Triangle *triangles,
+                        global PackedVertex *vertices, global BVHNode *nodes, global MBVHNode *mNodes,
+                        global TriangleIsect *isects, global Instance *instances, global uint *lightIndices,
+                        global AliasEntry *lightTable, global uint *textureBuffer, global TextureInfo *textureInfo,
+                        global float3 *skyDome, global TextureInfo *skyInfo, global Microfacet *microfacets,
+                        int hasSkyDome, float lightArea, int lightCount, uint *seed);
 
 inline float3 SampleReference(global Ray *ray, global Material *materials, global Triangle *triangles,
-                              global BVHNode *nodes, global MBVHNode *mNodes, global uint *primitiveIndices,
-                              global float3 *textureBuffer, global TextureInfo *textureInfo, global float3 *skyDome,
-                              global TextureInfo *skyInfo, int hasSkyDome, uint *seed)
+                              global PackedVertex *vertices, global BVHNode *nodes, global MBVHNode *mNodes,
+                              global TriangleIsect *isects, global Instance *instances, global uint *textureBuffer,
+                              global TextureInfo *textureInfo, global float3 *skyDome, global TextureInfo *skyInfo,
+                              int hasSkyDome, uint *seed)
 {
     float3 E = (float3)(0, 0, 0);
     float3 throughput;
@@ -37,7 +42,7 @@ inline float3 SampleReference(global Ray *ray, global Material *materials, globa
         {
             r.t = 1e34f;
             r.hit_idx = -1;
-            TraceRay(&r, triangles, nodes, mNodes, primitiveIndices);
+            TraceRay(&r, nodes, mNodes, isects, instances);
             if (r.hit_idx < 0)
             {
                 if (hasSkyDome)
@@ -52,7 +57,7 @@ inline float3 SampleReference(global Ray *ray, global Material *materials, globa
                 break;
             }
 
-            Triangle t = triangles[r.hit_idx];
+            ShadingTriangle t = GetHitTriangle(triangles, vertices, instances, &r);
             float3 hitPoint = r.origin + r.t * r.direction;
             Material mat = materials[t.mat_idx];
 
@@ -64,12 +69,14 @@ inline float3 SampleReference(global Ray *ray, global Material *materials, globa
 
             const float3 bary = GetBaryCentricCoordinatesTriangleLocal(hitPoint, t);
             float3 normal = normalize(bary.x * t.n0 + bary.y * t.n1 + bary.z * t.n2);
+            const float3 geometricNormal = GetGeometricNormalLocal(t);
 
-            float2 t0 = (float2)(t.t0x, t.t0y);
-            float2 t1 = (float2)(t.t1x, t.t1y);
-            float2 t2 = (float2)(t.t2x, t.t2y);
-            float2 texCoords = bary.x * t0 + bary.y * t1 + bary.z * t2;
-            float3 diffuseColor = GetDiffuseColor(mat, textureBuffer, textureInfo, texCoords);
+            float2 texCoords = bary.x * t.t0 + bary.y * t.t1 + bary.z * t.t2;
+
+            // the cone keeps growing along the path, so later bounces fetch coarser mips
+            const float coneWidth = r.coneWidth + r.coneSpread * r.t;
+            const float uvLod = ConeUVLod(t.uv_ratio, coneWidth, fabs(dot(normal, r.direction)));
+            float3 diffuseColor = GetDiffuseColor(mat, textureBuffer, textureInfo, texCoords, uvLod);
 
             int flipNormal = dot(normal, r.direction) > 0.f ? 1 : 0;
             normal = normal * (1.0f - 2.0f * (float)flipNormal);
@@ -81,7 +88,8 @@ inline float3 SampleReference(global Ray *ray, global Material *materials, globa
             {
                 float3 absorption;
                 r.direction = normalize(Refract(flipNormal, mat, r.direction, normal, seed, &absorption, r.t));
-                r.origin += EPSILON * r.direction;
+                r.origin = OffsetRayOrigin(hitPoint, geometricNormal, r.direction);
+                r.coneWidth = coneWidth;
                 throughput *= diffuseColor * absorption;
                 continue;
             }
@@ -91,7 +99,8 @@ inline float3 SampleReference(global Ray *ray, global Material *materials, globa
                 if (lottery > mat.diffuse_intensity)
                 {
                     r.direction = normalize(Reflect(r.direction, normal));
-                    r.origin += EPSILON * r.direction;
+                    r.origin = OffsetRayOrigin(hitPoint, geometricNormal, r.direction);
+                    r.coneWidth = coneWidth;
                     throughput *= diffuseColor;
                     continue;
                 }
@@ -100,18 +109,22 @@ inline float3 SampleReference(global Ray *ray, global Material *materials, globa
             // diffuse
             r.direction = normalize(DiffuseReflection(normal, seed));
             throughput *= (diffuseColor * INVPI) * dot(r.direction, normal) / PDF;
-            r.origin += EPSILON * r.direction;
+            r.origin = OffsetRayOrigin(hitPoint, geometricNormal, r.direction);
+            r.coneWidth = coneWidth;
+            r.coneSpread += DIFFUSE_CONE_SPREAD;
         }
     }
 
     return E;
 }
 
-float3 SampleNEE_MIS(global Ray *ray, global Material *materials, global Triangle *triangles, global BVHNode *nodes,
-                     global MBVHNode *mNodes, global uint *primitiveIndices, global uint *lightIndices,
-                     global float *lightLotteryTickets, global float3 *textureBuffer, global TextureInfo *textureInfo,
+float3 SampleNEE_MIS(global Ray *ray, global Material *materials, global Triangle *triangles,
+                     global PackedVertex *vertices, global BVHNode *nodes, global MBVHNode *mNodes,
+                     global TriangleIsect *isects, global Instance *instances, global uint *lightIndices,
+                     global AliasEntry *lightTable, global uint *textureBuffer, global TextureInfo *textureInfo,
                      global float3 *skyDome, global TextureInfo *skyInfo, int hasSkyDome, float lightArea,
-                     int lightCount, uint *seed)
+                     int lightCount, global LightNode *lightNodes, global ulong *lightTrails,
+                     global AliasEntry *skyTable, global float *skyPdf, uint *seed)
 {
     float3 E = (float3)(0, 0, 0), normal;
     float3 throughput, tUpdate, BRDF;
@@ -128,22 +141,19 @@ float3 SampleNEE_MIS(global Ray *ray, global Material *materials, global Triangl
         {
             r.t = 1e34f;
             r.hit_idx = -1;
-            TraceRay(&r, triangles, nodes, mNodes, primitiveIndices);
+            TraceRay(&r, nodes, mNodes, isects, instances);
             if (r.hit_idx < 0)
             {
                 if (hasSkyDome)
                 {
-                    const float u = (1.0f + atan2(r.direction.x, -r.direction.z) / PI) / 2.0f;
-                    const float v = 1.0f - acos(r.direction.y) / PI;
-                    const uint px = (u * (skyInfo->width - 1));
-                    const uint py = (v * (skyInfo->height - 1));
-                    const uint idx = px + py * skyInfo->width;
-                    E += throughput * skyDome[idx] * tUpdate;
+                    // the sky is also sampled by NEE, weight the BRDF sample against that
+                    const float weight = specular ? 1.0f : PDF / (PDF + SkyPdf(skyPdf, skyInfo, r.direction));
+                    E += throughput * SkyColor(skyDome, skyInfo, r.direction) * tUpdate * weight;
                 }
                 break;
             }
 
-            Triangle t = triangles[r.hit_idx];
+            ShadingTriangle t = GetHitTriangle(triangles, vertices, instances, &r);
             Material mat = materials[t.mat_idx];
             float3 hitPoint = r.origin + r.t * r.direction;
 
@@ -167,17 +177,19 @@ float3 SampleNEE_MIS(global Ray *ray, global Material *materials, global Triangl
                     const float NdotL = dot(normal, r.direction);
                     const float LNdotL = dot(lightNormal, -r.direction);
                     const float SolidAngle = LNdotL * t.m_Area / squaredDistance;
-                    const float InversePDFnee = lightArea / t.m_Area;
-                    const float lightPDF = 1.0f / SolidAngle;
                     const float brdfPDF = NdotL / PI;
 
-                    if (lightPDF > 0.0f && brdfPDF > 0.0f)
+                    if (SolidAngle > 0.0f && brdfPDF > 0.0f)
                     {
-                        float3 Ld = BRDF * mat.emission * NdotL * InversePDFnee;
-
-                        const float w1 = brdfPDF / (brdfPDF + lightPDF);
-                        const float w2 = lightPDF / (brdfPDF + lightPDF);
-                        E += throughput * Ld / (w1 * brdfPDF + w2 * lightPDF);
+                        // pdf of NEE picking this light and point as seen from the previous vertex
+#if LIGHT_TREE
+                        const float pickPDF = LightTreePmf(lightNodes, lightTrails, r.origin, normal, t.light_idx);
+#else
+                        const float pickPDF = t.light_idx >= 0 ? t.m_Area / lightArea : 0.0f;
+#endif
+                        const float lightPDF = pickPDF / SolidAngle;
+                        const float3 Ld = BRDF * mat.emission * NdotL;
+                        E += throughput * Ld / (brdfPDF + lightPDF);
                     }
                 }
                 break;
@@ -188,12 +200,14 @@ float3 SampleNEE_MIS(global Ray *ray, global Material *materials, global Triangl
 
             const float3 bary = GetBaryCentricCoordinatesTriangleLocal(hitPoint, t);
             normal = normalize(bary.x * t.n0 + bary.y * t.n1 + bary.z * t.n2);
+            const float3 geometricNormal = GetGeometricNormalLocal(t);
 
-            const float2 t0 = (float2)(t.t0x, t.t0y);
-            const float2 t1 = (float2)(t.t1x, t.t1y);
-            const float2 t2 = (float2)(t.t2x, t.t2y);
-            const float2 texCoords = bary.x * t0 + bary.y * t1 + bary.z * t2;
-            float3 diffuseColor = GetDiffuseColor(mat, textureBuffer, textureInfo, texCoords);
+            const float2 texCoords = bary.x * t.t0 + bary.y * t.t1 + bary.z * t.t2;
+
+            // the cone keeps growing along the path, so later bounces fetch coarser mips
+            const float coneWidth = r.coneWidth + r.coneSpread * r.t;
+            const float uvLod = ConeUVLod(t.uv_ratio, coneWidth, fabs(dot(normal, r.direction)));
+            float3 diffuseColor = GetDiffuseColor(mat, textureBuffer, textureInfo, texCoords, uvLod);
 
             BRDF = mat.diffuse * INVPI;
 
@@ -206,7 +220,8 @@ float3 SampleNEE_MIS(global Ray *ray, global Material *materials, global Triangl
             {
                 float3 absorption;
                 r.direction = normalize(Refract(flipNormal, mat, r.direction, normal, seed, &absorption, r.t));
-                r.origin += EPSILON * r.direction;
+                r.origin = OffsetRayOrigin(hitPoint, geometricNormal, r.direction);
+                r.coneWidth = coneWidth;
                 throughput *= diffuseColor * absorption;
                 specular = 1;
                 continue;
@@ -217,7 +232,8 @@ float3 SampleNEE_MIS(global Ray *ray, global Material *materials, global Triangl
                 if (lottery > mat.diffuse_intensity)
                 {
                     r.direction = normalize(Reflect(r.direction, normal));
-                    r.origin += EPSILON * r.direction;
+                    r.origin = OffsetRayOrigin(hitPoint, geometricNormal, r.direction);
+                    r.coneWidth = coneWidth;
                     throughput = throughput * diffuseColor;
                     specular = 1;
                     continue;
@@ -225,23 +241,19 @@ float3 SampleNEE_MIS(global Ray *ray, global Material *materials, global Triangl
             }
 
             // diffuse
-            if (lightCount > 0)
+#if LIGHT_TREE
+            float pickPDF;
+            const int winningIdx = lightCount > 0 ? SampleLightTree(lightNodes, hitPoint, normal, seed, &pickPDF) : -1;
+#else
+            const int winningIdx = lightCount > 0 ? SampleLight(lightTable, lightCount, seed) : -1;
+#endif
+            if (winningIdx >= 0)
             {
-                float randomf = RandomFloat(seed);
-                float previous = 0.f;
-                int winningIdx = 0;
-                for (int i = 0; i < lightCount; i++)
-                {
-                    if (lightLotteryTickets[i] > previous && randomf <= lightLotteryTickets[i])
-                    {
-                        winningIdx = i;
-                        break;
-                    }
-                    previous = lightLotteryTickets[i];
-                }
-
-                Triangle triangle = triangles[lightIndices[winningIdx]];
+                ShadingTriangle triangle = GetShadingTriangle(&triangles[lightIndices[winningIdx]], vertices);
                 Material material = materials[triangle.mat_idx];
+#if !LIGHT_TREE
+                const float pickPDF = triangle.m_Area / lightArea;
+#endif
 
                 const float3 RandomPointOnLight = RandomPointOnTriangleLocal(triangle, seed);
                 const float3 lightNormal = GetTriangleNormalLocal(RandomPointOnLight, triangle);
@@ -254,33 +266,50 @@ float3 SampleNEE_MIS(global Ray *ray, global Material *materials, global Triangl
 
                 if (NdotL > 0.f && LNdotL > 0.f)
                 {
-                    r.origin = hitPoint + EPSILON * L;
+                    r.origin = OffsetRayOrigin(hitPoint, geometricNormal, L);
                     r.direction = L;
                     r.t = 1e34f;
                     r.hit_idx = -1;
-                    TraceRay(&r, triangles, nodes, mNodes, primitiveIndices);
+                    TraceRay(&r, nodes, mNodes, isects, instances);
                     if (r.hit_idx == lightIndices[winningIdx])
                     {
                         const float SolidAngle = LNdotL * triangle.m_Area / squaredDistance;
-                        const float3 lightColor = material.emission;
-                        const float3 Ld = BRDF * lightColor * NdotL * lightArea / triangle.m_Area;
+                        const float3 Ld = BRDF * material.emission * NdotL;
 
+                        // balance heuristic, the light pdf includes the probability of picking this light
                         const float bPDF = NdotL / PI;
-                        const float lightPDF = 1.0f / SolidAngle;
+                        const float lightPDF = pickPDF / SolidAngle;
+                        if (lightPDF > 0.0f)
+                            E += throughput * Ld / (bPDF + lightPDF);
+                    }
+                }
+            }
 
-                        if (lightPDF > 0.0f && bPDF > 0.0f)
-                        {
-                            const float w1 = bPDF / (bPDF + lightPDF);
-                            const float w2 = lightPDF / (bPDF + lightPDF);
-                            E += throughput * Ld / (w1 * bPDF + w2 * lightPDF);
-                        }
+            // the sky is sampled as a separate light
+            if (hasSkyDome)
+            {
+                float skyPDF;
+                const float3 L = SampleSky(skyTable, skyPdf, skyInfo, seed, &skyPDF);
+                const float NdotL = dot(normal, L);
+                if (NdotL > 0.0f && skyPDF > 0.0f)
+                {
+                    r.origin = OffsetRayOrigin(hitPoint, geometricNormal, L);
+                    r.direction = L;
+                    r.t = 1e34f;
+                    r.hit_idx = -1;
+                    TraceRay(&r, nodes, mNodes, isects, instances);
+                    if (r.hit_idx < 0)
+                    {
+                        const float3 Ld = BRDF * SkyColor(skyDome, skyInfo, L) * NdotL;
+                        E += throughput * Ld / (NdotL / PI + skyPDF);
                     }
                 }
             }
 
-            r.origin = hitPoint;
             r.direction = normalize(DiffuseReflectionCosWeighted(normal, seed));
-            r.origin += EPSILON * r.direction;
+            r.origin = OffsetRayOrigin(hitPoint, geometricNormal, r.direction);
+            r.coneWidth = coneWidth;
+            r.coneSpread += DIFFUSE_CONE_SPREAD;
 
             specular = 0;
             const float NdotR = dot(normal, r.direction);
@@ -305,11 +334,12 @@ float3 SampleNEE_MIS(global Ray *ray, global Material *materials, global Triangl
 }
 
 inline float3 SampleMicrofacet(global Ray *r, global Material *materials, global Triangle *triangles,
-                               global BVHNode *nodes, global MBVHNode *mNodes, global uint *primitiveIndices,
-                               global uint *lightIndices, global float *lightLotteryTickets,
-                               global float3 *textureBuffer, global TextureInfo *textureInfo, global float3 *skyDome,
-                               global TextureInfo *skyInfo, global Microfacet *microfacets, int hasSkyDome,
-                               float lightArea, int lightCount, uint *seed)
+                               global PackedVertex *vertices, global BVHNode *nodes, global MBVHNode *mNodes,
+                               global TriangleIsect *isects, global Instance *instances, global uint *lightIndices,
+                               global AliasEntry *lightTable, global uint *textureBuffer,
+                               global TextureInfo *textureInfo, global float3 *skyDome, global TextureInfo *skyInfo,
+                               global Microfacet *microfacets, int hasSkyDome, float lightArea, int lightCount,
+                               uint *seed)
 {
     float3 E = (float3)(0, 0, 0);
     float3 throughput;
@@ -323,7 +353,7 @@ inline float3 SampleMicrofacet(global Ray *r, global Material *materials, global
         {
             ray.t = 1e34f;
             ray.hit_idx = -1;
-            TraceRay(&ray, triangles, nodes, mNodes, primitiveIndices);
+            TraceRay(&ray, nodes, mNodes, isects, instances);
             if (ray.hit_idx < 0)
             {
                 if (hasSkyDome)
@@ -338,7 +368,7 @@ inline float3 SampleMicrofacet(global Ray *r, global Material *materials, global
                 break;
             }
 
-            Triangle t = triangles[ray.hit_idx];
+            ShadingTriangle t = GetHitTriangle(triangles, vertices, instances, &ray);
             Material mat = materials[t.mat_idx];
             Microfacet mf = microfacets[t.mat_idx];
             float3 hitPoint = ray.origin + ray.t * ray.direction;
@@ -351,12 +381,14 @@ inline float3 SampleMicrofacet(global Ray *r, global Material *materials, global
 
             const float3 bary = GetBaryCentricCoordinatesTriangleLocal(hitPoint, t);
             float3 normal = normalize(bary.x * t.n0 + bary.y * t.n1 + bary.z * t.n2);
+            const float3 geometricNormal = GetGeometricNormalLocal(t);
+
+            float2 texCoords = bary.x * t.t0 + bary.y * t.t1 + bary.z * t.t2;
 
-            float2 t0 = (float2)(t.t0x, t.t0y);
-            float2 t1 = (float2)(t.t1x, t.t1y);
-            float2 t2 = (float2)(t.t2x, t.t2y);
-            float2 texCoords = bary.x * t0 + bary.y * t1 + bary.z * t2;
-            float3 diffuseColor = GetDiffuseColor(mat, textureBuffer, textureInfo, texCoords);
+            // the cone keeps growing along the path, so later bounces fetch coarser mips
+            const float coneWidth = ray.coneWidth + ray.coneSpread * ray.t;
+            const float uvLod = ConeUVLod(t.uv_ratio, coneWidth, fabs(dot(normal, ray.direction)));
+            float3 diffuseColor = GetDiffuseColor(mat, textureBuffer, textureInfo, texCoords, uvLod);
 
             int flipNormal = dot(normal, ray.direction) > 0.0f ? 1 : 0;
             normal = normal * (1.0f - 2.0f * (float)flipNormal);
@@ -414,8 +446,10 @@ inline float3 SampleMicrofacet(global Ray *r, global Material *materials, global
             weight = mf_weight(mf, woLocal, wiLocal, wmLocal);
             float3 wo = localToWorldMicro(woLocal, u, v, w);
             throughput *= diffuseColor * weight;
-            ray.origin = hitPoint + EPSILON * wo;
+            ray.origin = OffsetRayOrigin(hitPoint, geometricNormal, wo);
             ray.direction = wo;
+            ray.coneWidth = coneWidth;
+            ray.coneSpread += min(sqrt(mf.AlphaX * mf.AlphaY), 1.0f) * DIFFUSE_CONE_SPREAD;
         }
     }
 
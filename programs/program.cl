@@ -10,7 +10,7 @@
 #include "include.cl"
 
 kernel void generateRays(global Ray *rays, global GpuCamera *camera, global uint *seeds, float3 horizontal,
-                         float3 vertical, int width, int height)
+                         float3 vertical, int width, int height, float pixelSpread)
 {
     unsigned int intx = get_global_id(0);
     unsigned int inty = get_global_id(1);
@@ -33,6 +33,8 @@ kernel void generateRays(global Ray *rays, global GpuCamera *camera, global uint
     rays[pixelIdx].hit_idx = -1;
     rays[pixelIdx].t = 1e34f;
     rays[pixelIdx].color = (float3)(1, 1, 1);
+    rays[pixelIdx].coneWidth = 0.0f;
+    rays[pixelIdx].coneSpread = pixelSpread;
 
     seeds[pixelIdx] = seed;
 }
@@ -42,12 +44,12 @@ kernel void intersectRaysMF(global Ray *rays,                  // 0
                             global Triangle *triangles,        // 2
                             global BVHNode *nodes,             // 3
                             global MBVHNode *mNodes,           // 4
-                            global uint *primitiveIndices,     // 5
+                            global TriangleIsect *isects,      // 5
                             global uint *seeds,                // 6
                             global float4 *colorBuffer,        // 7
                             global uint *lightIndices,         // 8
-                            global float *lightLotteryTickets, // 9
-                            global float3 *textureBuffer,      // 10
+                            global AliasEntry *lightTable,     // 9
+                            global uint *textureBuffer,        // 10
                             global TextureInfo *textureInfo,   // 11
                             global float3 *skyDome,            // 12
                             global TextureInfo *skyInfo,       // 13
@@ -56,7 +58,13 @@ kernel void intersectRaysMF(global Ray *rays,                  // 0
                             float lightArea,                   // 16
                             int lightCount,                    // 17
                             int width,                         // 18
-                            int height                         // 19
+                            int height,                        // 19
+                            global Instance *instances,        // 20
+                            global LightNode *lightNodes,      // 21
+                            global ulong *lightTrails,         // 22
+                            global AliasEntry *skyTable,       // 23
+                            global float *skyPdf,              // 24
+                            global PackedVertex *vertices      // 25
 )
 {
     const uint x = get_global_id(0);
@@ -69,9 +77,9 @@ kernel void intersectRaysMF(global Ray *rays,                  // 0
 
     global Ray *ray = &rays[pixelIdx];
 
-    const float3 E = SampleMicrofacet(ray, materials, triangles, nodes, mNodes, primitiveIndices, lightIndices,
-                                      lightLotteryTickets, textureBuffer, textureInfo, skyDome, skyInfo, microfacets,
-                                      hasSkyDome, lightArea, lightCount, &seed);
+    const float3 E = SampleMicrofacet(ray, materials, triangles, vertices, nodes, mNodes, isects, instances,
+                                      lightIndices, lightTable, textureBuffer, textureInfo, skyDome, skyInfo,
+                                      microfacets, hasSkyDome, lightArea, lightCount, &seed);
 
     seeds[pixelIdx] = seed; // update seed
     colorBuffer[pixelIdx] = (float4)(E, 1.0f);
@@ -82,12 +90,12 @@ kernel void intersectRays(global Ray *rays,                  // 0
                           global Triangle *triangles,        // 2
                           global BVHNode *nodes,             // 3
                           global MBVHNode *mNodes,           // 4
-                          global uint *primitiveIndices,     // 5
+                          global TriangleIsect *isects,      // 5
                           global uint *seeds,                // 6
                           global float4 *colorBuffer,        // 7
                           global uint *lightIndices,         // 8
-                          global float *lightLotteryTickets, // 9
-                          global float3 *textureBuffer,      // 10
+                          global AliasEntry *lightTable,     // 9
+                          global uint *textureBuffer,        // 10
                           global TextureInfo *textureInfo,   // 11
                           global float3 *skyDome,            // 12
                           global TextureInfo *skyInfo,       // 13
@@ -96,7 +104,13 @@ kernel void intersectRays(global Ray *rays,                  // 0
                           float lightArea,                   // 16
                           int lightCount,                    // 17
                           int width,                         // 18
-                          int height                         // 19
+                          int height,                        // 19
+                          global Instance *instances,        // 20
+                          global LightNode *lightNodes,      // 21
+                          global ulong *lightTrails,         // 22
+                          global AliasEntry *skyTable,       // 23
+                          global float *skyPdf,              // 24
+                          global PackedVertex *vertices      // 25
 )
 {
     const uint x = get_global_id(0);
@@ -109,8 +123,8 @@ kernel void intersectRays(global Ray *rays,                  // 0
 
     global Ray *ray = &rays[pixelIdx];
 
-    const float3 E = SampleReference(ray, materials, triangles, nodes, mNodes, primitiveIndices, textureBuffer,
-                                     textureInfo, skyDome, skyInfo, hasSkyDome, &seed);
+    const float3 E = SampleReference(ray, materials, triangles, vertices, nodes, mNodes, isects, instances,
+                                     textureBuffer, textureInfo, skyDome, skyInfo, hasSkyDome, &seed);
 
     seeds[pixelIdx] = seed; // update seed
     colorBuffer[pixelIdx] = (float4)(E, 1.0f);
@@ -121,12 +135,12 @@ kernel void intersectRaysOpt(global Ray *rays,                  // 0
                              global Triangle *triangles,        // 2
                              global BVHNode *nodes,             // 3
                              global MBVHNode *mNodes,           // 4
-                             global uint *primitiveIndices,     // 5
+                             global TriangleIsect *isects,      // 5
                              global uint *seeds,                // 6
                              global float4 *colorBuffer,        // 7
                              global uint *lightIndices,         // 8
-                             global float *lightLotteryTickets, // 9
-                             global float3 *textureBuffer,      // 10
+                             global AliasEntry *lightTable,     // 9
+                             global uint *textureBuffer,        // 10
                              global TextureInfo *textureInfo,   // 11
                              global float3 *skyDome,            // 12
                              global TextureInfo *skyInfo,       // 13
@@ -135,7 +149,13 @@ kernel void intersectRaysOpt(global Ray *rays,                  // 0
                              float lightArea,                   // 16
                              int lightCount,                    // 17
                              int width,                         // 18
-                             int height                         // 19
+                             int height,                        // 19
+                             global Instance *instances,        // 20
+                             global LightNode *lightNodes,      // 21
+                             global ulong *lightTrails,         // 22
+                             global AliasEntry *skyTable,       // 23
+                             global float *skyPdf,              // 24
+                             global PackedVertex *vertices      // 25
 )
 {
     const uint x = get_global_id(0);
@@ -149,8 +169,9 @@ kernel void intersectRaysOpt(global Ray *rays,                  // 0
     global Ray *ray = &rays[pixelIdx];
 
     const float3 E =
-        SampleNEE_MIS(ray, materials, triangles, nodes, mNodes, primitiveIndices, lightIndices, lightLotteryTickets,
-                      textureBuffer, textureInfo, skyDome, skyInfo, hasSkyDome, lightArea, lightCount, &seed);
+        SampleNEE_MIS(ray, materials, triangles, vertices, nodes, mNodes, isects, instances, lightIndices, lightTable,
+                      textureBuffer, textureInfo, skyDome, skyInfo, hasSkyDome, lightArea, lightCount,
+                      lightNodes, lightTrails, skyTable, skyPdf, &seed);
 
     seeds[pixelIdx] = seed; // update seed
     colorBuffer[pixelIdx] = (float4)(E, 1.0f);
@@ -161,12 +182,12 @@ kernel void intersectRaysBVH(global Ray *rays,                  // 0
                              global Triangle *triangles,        // 2
                              global BVHNode *nodes,             // 3
                              global MBVHNode *mNodes,           // 4
-                             global uint *primitiveIndices,     // 5
+                             global TriangleIsect *isects,      // 5
                              global uint *seeds,                // 6
                              global float4 *colorBuffer,        // 7
                              global uint *lightIndices,         // 8
-                             global float *lightLotteryTickets, // 9
-                             global float3 *textureBuffer,      // 10
+                             global AliasEntry *lightTable,     // 9
+                             global uint *textureBuffer,        // 10
                              global TextureInfo *textureInfo,   // 11
                              global float3 *skyDome,            // 12
                              global TextureInfo *skyInfo,       // 13
@@ -175,7 +196,13 @@ kernel void intersectRaysBVH(global Ray *rays,                  // 0
                              float lightArea,                   // 16
                              int lightCount,                    // 17
                              int width,                         // 18
-                             int height                         // 19
+                             int height,                        // 19
+                             global Instance *instances,        // 20
+                             global LightNode *lightNodes,      // 21
+                             global ulong *lightTrails,         // 22
+                             global AliasEntry *skyTable,       // 23
+                             global float *skyPdf,              // 24
+                             global PackedVertex *vertices      // 25
 )
 {
     const uint x = get_global_id(0);
@@ -188,7 +215,7 @@ kernel void intersectRaysBVH(global Ray *rays,                  // 0
 
     global Ray *ray = &rays[pixelIdx];
 
-    Trace(ray, triangles, nodes, mNodes, primitiveIndices);
+    Trace(ray, nodes, mNodes, isects, instances);
     if (ray->t > 0.0f)
     {
         colorBuffer[pixelIdx] = (float4)(rays[pixelIdx].t / 64.f, 1.0f - rays[pixelIdx].t / 48.f, 0, 1);
@@ -234,12 +261,12 @@ kernel void intersect(global Ray *rays,                  // 0
                       global Triangle *triangles,        // 2
                       global BVHNode *nodes,             // 3
                       global MBVHNode *mNodes,           // 4
-                      global uint *primitiveIndices,     // 5
+                      global TriangleIsect *isects,      // 5
                       global uint *seeds,                // 6
                       global float4 *colorBuffer,        // 7
                       global uint *lightIndices,         // 8
-                      global float *lightLotteryTickets, // 9
-                      global float3 *textureBuffer,      // 10
+                      global AliasEntry *lightTable,     // 9
+                      global uint *textureBuffer,        // 10
                       global TextureInfo *textureInfo,   // 11
                       global float3 *skyDome,            // 12
                       global TextureInfo *skyInfo,       // 13
@@ -248,7 +275,13 @@ kernel void intersect(global Ray *rays,                  // 0
                       float lightArea,                   // 16
                       int lightCount,                    // 17
                       int width,                         // 18
-                      int height                         // 19
+                      int height,                        // 19
+                      global Instance *instances,        // 20
+                      global LightNode *lightNodes,      // 21
+                      global ulong *lightTrails,         // 22
+                      global AliasEntry *skyTable,       // 23
+                      global float *skyPdf,              // 24
+                      global PackedVertex *vertices      // 25
 )
 {
     const int x = get_global_id(0);
@@ -261,7 +294,7 @@ kernel void intersect(global Ray *rays,                  // 0
     if (ray.t < 0.0f)
         return;
 
-    TraceRay(&ray, triangles, nodes, mNodes, primitiveIndices);
+    TraceRay(&ray, nodes, mNodes, isects, instances);
     if (ray.hit_idx < 0)
     {
         ray.t = -1.0f;
@@ -275,12 +308,12 @@ kernel void shade(global Ray *rays,                  // 0
                   global Triangle *triangles,        // 2
                   global BVHNode *nodes,             // 3
                   global MBVHNode *mNodes,           // 4
-                  global uint *primitiveIndices,     // 5
+                  global TriangleIsect *isects,      // 5
                   global uint *seeds,                // 6
                   global float4 *colorBuffer,        // 7
                   global uint *lightIndices,         // 8
-                  global float *lightLotteryTickets, // 9
-                  global float3 *textureBuffer,      // 10
+                  global AliasEntry *lightTable,     // 9
+                  global uint *textureBuffer,        // 10
                   global TextureInfo *textureInfo,   // 11
                   global float3 *skyDome,            // 12
                   global TextureInfo *skyInfo,       // 13
@@ -289,7 +322,13 @@ kernel void shade(global Ray *rays,                  // 0
                   float lightArea,                   // 16
                   int lightCount,                    // 17
                   int width,                         // 18
-                  int height                         // 19
+                  int height,                        // 19
+                  global Instance *instances,        // 20
+                  global LightNode *lightNodes,      // 21
+                  global ulong *lightTrails,         // 22
+                  global AliasEntry *skyTable,       // 23
+                  global float *skyPdf,              // 24
+                  global PackedVertex *vertices      // 25
 )
 {
     const int x = get_global_id(0);
@@ -317,7 +356,7 @@ kernel void shade(global Ray *rays,                  // 0
         return;
     }
 
-    Triangle triangle = triangles[ray.hit_idx];
+    ShadingTriangle triangle = GetHitTriangle(triangles, vertices, instances, &ray);
     Material mat = materials[triangle.mat_idx];
     float3 hitPoint = ray.origin + ray.t * ray.direction;
 
@@ -332,18 +371,23 @@ kernel void shade(global Ray *rays,                  // 0
     // Calculate triangle normal
     const float3 bary = GetBaryCentricCoordinatesTriangleLocal(hitPoint, triangle);
     float3 normal = normalize(bary.x * triangle.n0 + bary.y * triangle.n1 + bary.z * triangle.n2);
+    const float3 geometricNormal = GetGeometricNormalLocal(triangle);
 
     // Get texture coordinates
-    float2 texCoords = bary.x * (float2)(triangle.t0x, triangle.t0y);
-    texCoords += bary.y * (float2)(triangle.t1x, triangle.t1y);
-    texCoords += bary.z * (float2)(triangle.t2x, triangle.t2y);
+    const float2 texCoords = bary.x * triangle.t0 + bary.y * triangle.t1 + bary.z * triangle.t2;
+
+    // Footprint of the ray cone at the hit
+    const float coneWidth = ray.coneWidth + ray.coneSpread * ray.t;
+    const float uvLod = ConeUVLod(triangle.uv_ratio, coneWidth, fabs(dot(normal, ray.direction)));
 
     // Set new origin and direction
-    ray.origin = hitPoint + EPSILON * normal;
     ray.direction = normalize(DiffuseReflection(normal, seed));
+    ray.origin = OffsetRayOrigin(hitPoint, geometricNormal, ray.direction);
+    ray.coneWidth = coneWidth;
+    ray.coneSpread += DIFFUSE_CONE_SPREAD;
 
     // Update throughput
-    ray.color *= GetDiffuseColor(mat, textureBuffer, textureInfo, texCoords);
+    ray.color *= GetDiffuseColor(mat, textureBuffer, textureInfo, texCoords, uvLod);
     ray.color *= INVPI * dot(ray.direction, normal);
     ray.color *= 2.0f * PI;
 
@@ -19,8 +19,21 @@ typedef struct Ray
             int hit_idx; // 40
         };
     };
-    float3 color;
-} Ray; // 48
+    union {
+        float3 color; // 48
+        struct
+        {
+            float colR, colG, colB;
+            int inst_idx; // instance of the closest hit, only valid right after tracing
+        };
+    };
+    float coneWidth;  // 52, width of the ray cone at the origin
+    float coneSpread; // 56, spread angle of the ray cone
+    float pad0, pad1; // 64
+} Ray; // 64
+
+// spread angle added by a diffuse bounce, same as the CPU path tracer
+#define DIFFUSE_CONE_SPREAD 0.25f
 
 float3 World2Local(float3 V, float3 N);
 float3 DiffuseReflectionCosWeighted(float3 normal, uint *seed);
@@ -31,6 +44,7 @@ float3 cosineWeightedSample(float r1, float r2);
 void createCoordinateSystem(float3 *N, float3 *Nt, float3 *Nb);
 float3 localToWorld(float3 sample, float3 Nt, float3 Nb, float3 normal);
 float3 DiffuseReflection(float3 normal, uint *seed);
+float3 OffsetRayOrigin(float3 p, float3 n, float3 direction);
 
 float3 World2Local(float3 V, float3 N)
 {
@@ -52,6 +66,17 @@ float3 DiffuseReflectionCosWeighted(float3 normal, uint *seed)
 
 float3 Reflect(float3 A, float3 B) { return A - 2.0f * B * dot(A, B); }
 
+// p moved off its surface with normal n to the side the new ray leaves to, by a fixed number of ulps or a fixed
+// distance close to 0, same as utils::OffsetRayOrigin on the CPU (Waechter and Binder, Ray Tracing Gems, 2019)
+float3 OffsetRayOrigin(float3 p, float3 n, float3 direction)
+{
+    n = dot(direction, n) < 0.0f ? -n : n;
+    const int3 offset = convert_int3(OFFSET_INT_SCALE * n);
+    const int3 bits = as_int3(p);
+    const float3 moved = as_float3(bits + select(offset, -offset, bits < 0));
+    return select(moved, p + OFFSET_FLOAT_SCALE * n, fabs(p) < OFFSET_ORIGIN_BAND);
+}
+
 inline float3 Refract(int inside, Material mat, float3 D, float3 N, uint *seed, float3 *absorption, float t)
 {
     *absorption = (float3)(1, 1, 1);
@@ -1,40 +1,127 @@
 #ifndef TRIANGLE_H
 #define TRIANGLE_H
 
+// Mirrors prims::GpuTriangle, the w lanes of the positions index the vertex attributes
 typedef struct Triangle {
-    float3 p0; // 16
-    float3 p1; // 32
-    float3 p2; // 48
-    float3 n0; // 64
-    float3 n1; // 80
-    float3 n2; // 96
-    float3 normal; // 112
-    uint mat_idx; // 116
-    uint hit_idx; // 120
-    float m_Area; // 124
-    float dummy; // 128
-    float t0x, t0y; // 136
-    float t1x, t1y; // 144
-    float t2x, t2y; // 152
-    float d156, d160; // 160
+    union {
+        float3 p0; // 16
+        struct {
+            float p0x, p0y, p0z;
+            uint v0;
+        };
+    };
+    union {
+        float3 p1; // 32
+        struct {
+            float p1x, p1y, p1z;
+            uint v1;
+        };
+    };
+    union {
+        float3 p2; // 48
+        struct {
+            float p2x, p2y, p2z;
+            uint v2;
+        };
+    };
+    uint mat_idx; // 52
+    float m_Area; // 56
+    int light_idx; // 60, index into the light indices or -1
+    float uv_ratio; // 64, texture space area divided by world space area
 } Triangle;
 
+// Mirrors prims::PackedVertex, shared by all triangles around a vertex
+typedef struct PackedVertex {
+    uint normal; // octahedral, two 16 bit snorms with x in the low half
+    uint tex_coords; // two 16 bit unorms with u in the low half
+} PackedVertex;
+
+// A triangle with the attributes of its vertices decoded, only built for the closest hit and sampled lights
+typedef struct ShadingTriangle {
+    float3 p0, p1, p2;
+    float3 n0, n1, n2;
+    float2 t0, t1, t2;
+    uint mat_idx;
+    float m_Area;
+    int light_idx;
+    float uv_ratio;
+} ShadingTriangle;
+
+// Intersection-only data, stored in BVH leaf order so traversal never touches the full triangle
+typedef struct TriangleIsect {
+    union {
+        float3 p0; // 16
+        struct {
+            float p0x, p0y, p0z;
+            int prim_idx;
+        };
+    };
+    float3 edge1; // 32
+    float3 edge2; // 48
+} TriangleIsect;
+
+float3 DecodeNormal(uint packed);
+float2 DecodeTexCoords(uint packed);
+ShadingTriangle GetShadingTriangle(global Triangle* triangle, global PackedVertex* vertices);
+
 float3 GetBaryCentricCoordinatesTriangle(float3 hitPoint, global Triangle* triangle);
-float3 GetBaryCentricCoordinatesTriangleLocal(float3 hitPoint, Triangle triangle);
+float3 GetBaryCentricCoordinatesTriangleLocal(float3 hitPoint, ShadingTriangle triangle);
 
-float3 GetTriangleNormal(float3 hitPoint, global Triangle* triangle);
-float3 GetTriangleNormalLocal(float3 hitPoint, Triangle triangle);
+float3 GetTriangleNormal(float3 hitPoint, global Triangle* triangle, global PackedVertex* vertices);
+float3 GetTriangleNormalLocal(float3 hitPoint, ShadingTriangle triangle);
+float3 GetGeometricNormalLocal(ShadingTriangle triangle);
 
 float3 RandomPointOnTriangle(global Triangle* triangle, uint* seed);
-float3 RandomPointOnTriangleLocal(Triangle triangle, uint* seed);
+float3 RandomPointOnTriangleLocal(ShadingTriangle triangle, uint* seed);
+
+void IntersectTriangle(global Ray* ray, global TriangleIsect* triangle);
+void IntersectTriangleRay(Ray* ray, global TriangleIsect* triangle);
 
-void IntersectTriangle(global Ray* ray, global Triangle* triangle);
-void IntersectTriangleRay(Ray* ray, global Triangle* triangle);
+// Same octahedral decode as prims::DecodeNormal
+inline float3 DecodeNormal(uint packed)
+{
+    const float2 p = max((float2)((short)(packed & 0xFFFF), (short)(packed >> 16)) / 32767.0f, -1.0f);
+    float3 n = (float3)(p.x, p.y, 1.0f - fabs(p.x) - fabs(p.y));
+
+    // unfolds the lower half
+    const float t = max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
+inline float2 DecodeTexCoords(uint packed)
+{
+    return (float2)((float)(packed & 0xFFFFu), (float)(packed >> 16)) * (1.0f / 65535.0f);
+}
+
+inline ShadingTriangle GetShadingTriangle(global Triangle* triangle, global PackedVertex* vertices)
+{
+    const PackedVertex a = vertices[triangle->v0];
+    const PackedVertex b = vertices[triangle->v1];
+    const PackedVertex c = vertices[triangle->v2];
+
+    ShadingTriangle t;
+    t.p0 = triangle->p0;
+    t.p1 = triangle->p1;
+    t.p2 = triangle->p2;
+    t.n0 = DecodeNormal(a.normal);
+    t.n1 = DecodeNormal(b.normal);
+    t.n2 = DecodeNormal(c.normal);
+    t.t0 = DecodeTexCoords(a.tex_coords);
+    t.t1 = DecodeTexCoords(b.tex_coords);
+    t.t2 = DecodeTexCoords(c.tex_coords);
+    t.mat_idx = triangle->mat_idx;
+    t.m_Area = triangle->m_Area;
+    t.light_idx = triangle->light_idx;
+    t.uv_ratio = triangle->uv_ratio;
+    return t;
+}
 
 inline float3 GetBaryCentricCoordinatesTriangle(float3 hitPoint, global Triangle* triangle)
 {
-    float3 n = (triangle->n0 + triangle->n1 + triangle->n2) / 3.0f;
-    const float areaABC = dot(n, cross(triangle->p1 - triangle->p0, triangle->p2 - triangle->p0));
+    const float3 n = cross(triangle->p1 - triangle->p0, triangle->p2 - triangle->p0);
+    const float areaABC = dot(n, n);
     const float areaPBC = dot(n, cross(triangle->p1 - hitPoint, triangle->p2 - hitPoint));
     const float areaPCA = dot(n, cross(triangle->p2 - hitPoint, triangle->p0 - hitPoint));
 
@@ -45,10 +132,10 @@ inline float3 GetBaryCentricCoordinatesTriangle(float3 hitPoint, global Triangle
     return (float3)(alpha, beta, gamma);
 }
 
-inline float3 GetBaryCentricCoordinatesTriangleLocal(float3 hitPoint, Triangle triangle)
+inline float3 GetBaryCentricCoordinatesTriangleLocal(float3 hitPoint, ShadingTriangle triangle)
 {
-    float3 n = (triangle.n0 + triangle.n1 + triangle.n2) / 3.0f;
-    const float areaABC = dot(n, cross(triangle.p1 - triangle.p0, triangle.p2 - triangle.p0));
+    const float3 n = cross(triangle.p1 - triangle.p0, triangle.p2 - triangle.p0);
+    const float areaABC = dot(n, n);
     const float areaPBC = dot(n, cross(triangle.p1 - hitPoint, triangle.p2 - hitPoint));
     const float areaPCA = dot(n, cross(triangle.p2 - hitPoint, triangle.p0 - hitPoint));
 
@@ -59,18 +146,27 @@ inline float3 GetBaryCentricCoordinatesTriangleLocal(float3 hitPoint, Triangle t
     return (float3)(alpha, beta, gamma);
 }
 
-inline float3 GetTriangleNormal(float3 hitPoint, global Triangle* triangle)
+inline float3 GetTriangleNormal(float3 hitPoint, global Triangle* triangle, global PackedVertex* vertices)
 {
     const float3 bary = GetBaryCentricCoordinatesTriangle(hitPoint, triangle);
-    return normalize(bary.x * triangle->n0 + bary.y * triangle->n1 + bary.z * triangle->n2);
+    const float3 n0 = DecodeNormal(vertices[triangle->v0].normal);
+    const float3 n1 = DecodeNormal(vertices[triangle->v1].normal);
+    const float3 n2 = DecodeNormal(vertices[triangle->v2].normal);
+    return normalize(bary.x * n0 + bary.y * n1 + bary.z * n2);
 }
 
-inline float3 GetTriangleNormalLocal(float3 hitPoint, Triangle triangle)
+inline float3 GetTriangleNormalLocal(float3 hitPoint, ShadingTriangle triangle)
 {
     const float3 bary = GetBaryCentricCoordinatesTriangleLocal(hitPoint, triangle);
     return normalize(bary.x * triangle.n0 + bary.y * triangle.n1 + bary.z * triangle.n2);
 }
 
+// Normal of the plane of the triangle, rays leaving it are offset along this instead of the interpolated normal
+inline float3 GetGeometricNormalLocal(ShadingTriangle triangle)
+{
+    return normalize(cross(triangle.p1 - triangle.p0, triangle.p2 - triangle.p0));
+}
+
 inline float3 RandomPointOnTriangle(global Triangle* triangle, uint* seed)
 {
     float r1, r2;
@@ -87,7 +183,7 @@ inline float3 RandomPointOnTriangle(global Triangle* triangle, uint* seed)
     return triangle->p0 + r1 * (triangle->p1 - triangle->p0) + r2 * (triangle->p2 - triangle->p0);
 }
 
-inline float3 RandomPointOnTriangleLocal(Triangle triangle, uint* seed)
+inline float3 RandomPointOnTriangleLocal(ShadingTriangle triangle, uint* seed)
 {
     float r1, r2;
     r1 = RandomFloat(seed);
@@ -103,10 +199,10 @@ inline float3 RandomPointOnTriangleLocal(Triangle triangle, uint* seed)
     return triangle.p0 + r1 * (triangle.p1 - triangle.p0) + r2 * (triangle.p2 - triangle.p0);
 }
 
-void IntersectTriangle(global Ray* ray, global Triangle* triangle)
+void IntersectTriangle(global Ray* ray, global TriangleIsect* triangle)
 {
-    const float3 edge1 = triangle->p1 - triangle->p0;
-    const float3 edge2 = triangle->p2 - triangle->p0;
+    const float3 edge1 = triangle->edge1;
+    const float3 edge2 = triangle->edge2;
 
     const float3 h = cross(ray->direction, edge2);
 
@@ -132,14 +228,14 @@ void IntersectTriangle(global Ray* ray, global Triangle* triangle)
     {
         // ray intersection
         ray->t = t;
-        ray->hit_idx = triangle->hit_idx;
+        ray->hit_idx = triangle->prim_idx;
     }
 }
 
-void IntersectTriangleRay(Ray* ray, global Triangle* triangle)
+void IntersectTriangleRay(Ray* ray, global TriangleIsect* triangle)
 {
-    const float3 edge1 = triangle->p1 - triangle->p0;
-    const float3 edge2 = triangle->p2 - triangle->p0;
+    const float3 edge1 = triangle->edge1;
+    const float3 edge2 = triangle->edge2;
 
     const float3 h = cross(ray->direction, edge2);
 
@@ -165,7 +261,7 @@ void IntersectTriangleRay(Ray* ray, global Triangle* triangle)
     {
         // ray intersection
         ray->t = t;
-        ray->hit_idx = triangle->hit_idx;
+        ray->hit_idx = triangle->prim_idx;
     }
 }
 
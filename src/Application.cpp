@@ -46,7 +46,8 @@ Application::Application(utils::Window *window, RendererType type, int width, in
 	if (m_Type == CPU || m_Type == CPU_RAYTRACER)
 	{
 		if (scene != nullptr)
-			prims::Load(scene, defaultMaterial, glm::vec3(0.0f), 1.0f, m_ObjectList);
+			prims::Load(scene, defaultMaterial, glm::vec3(0.0f), 1.0f, m_ObjectList, glm::mat4(1.0f),
+							prims::SceneTriangleTest());
 		else
 			Dragon(m_ObjectList);
 	}
@@ -191,19 +192,35 @@ Application::Application(utils::Window *window, RendererType type, int width, in
 	const unsigned int teapotMaterial =
 		static_cast<unsigned int>(mManager->AddMaterial(material::Material(.8f, glm::vec3(.3f, .3f, .6f), 8.0f)));
 
-	auto *teapotList = new SceneObjectList();
-	auto *teapotListSmall = new SceneObjectList();
+	prims::WorldScene *teapotBVH, *teapotSmallBVH;
+	if (m_Type == GPU)
+	{
+		// the GPU tracer builds the BVH of every mesh itself
+		auto *teapotList = new prims::GpuTriangleList();
+		auto *teapotListSmall = new prims::GpuTriangleList();
+
+		prims::Load("models/teapot.obj", teapotMaterial, vec3(0.f, 0.f, 0.f), 1.f, teapotList);
+		prims::Load("models/teapot.obj", teapotMaterial, vec3(0.f, 0.f, 0.f), .3f, teapotListSmall);
 
-	model::Load("models/teapot.obj", teapotMaterial, vec3(0.f, 0.f, 0.f), 1.f, teapotList);
-	model::Load("models/teapot.obj", teapotMaterial, vec3(0.f, 0.f, 0.f), .3f, teapotListSmall);
+		teapotBVH = teapotList;
+		teapotSmallBVH = teapotListSmall;
+	}
+	else
+	{
+		auto *teapotList = new SceneObjectList();
+		auto *teapotListSmall = new SceneObjectList();
 
-	auto *teapotBVHStatic = new bvh::StaticBVHTree(teapotList, bvh::BVHType::SAH_BINNING, m_TPool);
-	teapotBVHStatic->ConstructBVH();
-	auto *teapotBVH = new bvh::MBVHTree(teapotBVHStatic);
+		model::Load("models/teapot.obj", teapotMaterial, vec3(0.f, 0.f, 0.f), 1.f, teapotList);
+		model::Load("models/teapot.obj", teapotMaterial, vec3(0.f, 0.f, 0.f), .3f, teapotListSmall);
 
-	auto *teapotSmallBVHStatic = new StaticBVHTree(teapotListSmall, BVHType::SAH_BINNING, m_TPool);
-	teapotSmallBVHStatic->ConstructBVH();
-	auto *teapotSmallBVH = new bvh::MBVHTree(teapotSmallBVHStatic);
+		auto *teapotBVHStatic = new bvh::StaticBVHTree(teapotList, bvh::SceneBuildConfig(), m_TPool);
+		teapotBVHStatic->ConstructBVH();
+		teapotBVH = new bvh::MBVHTree(teapotBVHStatic);
+
+		auto *teapotSmallBVHStatic = new StaticBVHTree(teapotListSmall, SceneBuildConfig(), m_TPool);
+		teapotSmallBVHStatic->ConstructBVH();
+		teapotSmallBVH = new bvh::MBVHTree(teapotSmallBVHStatic);
+	}
 
 	auto *teapot0 = new bvh::GameObject(teapotBVH);
 	auto *teapot1 = new bvh::GameObject(teapotSmallBVH);
@@ -230,15 +247,30 @@ Application::Application(utils::Window *window, RendererType type, int width, in
 	{
 	case (GPU):
 	{
-		std::cout << "Primitive count: " << m_GpuList->GetTriangles().size() << std::endl;
-		m_Renderer =
-			new core::GpuTracer(m_GpuList, m_OutputTexture[0], m_OutputTexture[1], &m_Camera, m_Skybox, m_TPool);
+		if (gameObjects->empty() && cl::Kernel::GetDeviceCount() > 1)
+		{
+			std::cout << "Primitive count: " << m_GpuList->GetTriangles().size() << std::endl;
+			m_Renderer = new core::MultiGpuTracer(m_GpuList, m_Width, m_Height, &m_Camera, m_Skybox,
+												  m_OutputTexture[0], m_TPool);
+		}
+		else if (gameObjects->empty())
+		{
+			std::cout << "Primitive count: " << m_GpuList->GetTriangles().size() << std::endl;
+			m_Renderer =
+				new core::GpuTracer(m_GpuList, m_OutputTexture[0], m_OutputTexture[1], &m_Camera, m_Skybox, m_TPool);
+		}
+		else
+		{
+			m_GpuScene = new bvh::GpuTopLevelBVH(m_GpuList, gameObjects, bvh::SceneBuildConfig(), m_TPool);
+			std::cout << "Primitive count: " << m_GpuScene->GetTriangleList()->GetTriangles().size() << std::endl;
+			m_Renderer = new core::GpuTracer(m_GpuScene, m_OutputTexture[0], m_OutputTexture[1], &m_Camera, m_Skybox);
+		}
 		m_Renderer->SetMode(core::Mode::ReferenceMicrofacet);
 		break;
 	}
 	case (CPU_RAYTRACER):
 	{
-		m_Scene = new bvh::TopLevelBVH(m_ObjectList, gameObjects, bvh::BVHType::SAH_BINNING, m_TPool);
+		m_Scene = new bvh::TopLevelBVH(m_ObjectList, gameObjects, bvh::SceneBuildConfig(), m_TPool);
 		std::cout << "Primitive count: " << m_Scene->GetPrimitiveCount() << std::endl;
 		m_Renderer = new core::RayTracer(m_Scene, vec3(0.0f), vec3(0.01f), 16, &m_Camera, m_Width, m_Height);
 		m_BVHRenderer = new core::BVHRenderer(m_Scene, &m_Camera, m_Width, m_Height);
@@ -247,7 +279,7 @@ Application::Application(utils::Window *window, RendererType type, int width, in
 	case (CPU):
 	{
 	default:
-		m_Scene = new bvh::TopLevelBVH(m_ObjectList, gameObjects, bvh::BVHType::SAH_BINNING, m_TPool);
+		m_Scene = new bvh::TopLevelBVH(m_ObjectList, gameObjects, bvh::SceneBuildConfig(), m_TPool);
 		std::cout << "Primitive count: " << m_Scene->GetPrimitiveCount() << std::endl;
 		m_Renderer = new core::PathTracer(m_Scene, m_Width, m_Height, &m_Camera, m_Skybox);
 		m_Renderer->SetMode(core::Mode::ReferenceMicrofacet);
@@ -271,11 +303,33 @@ Application::~Application()
 	delete m_Renderer;
 	delete m_Skybox;
 	delete m_Scene;
+	delete m_GpuScene;
+}
+
+static void AnimateGameObjects(float deltaTime)
+{
+#if TEAPOT
+	motherGameObject->Rotate(glm::radians(deltaTime / 100.f), vec3(0, 1, 0));
+	motherGameObject->Move(vec3(0.f, deltaTime / 3000.f, 0.f));
+#endif
+#if CUBES
+	motherGameObject->Rotate(glm::radians(deltaTime / 60.f), vec3(0, 1, 0.3f));
+	cubeMother1->Rotate(glm::radians(deltaTime / 10.f), vec3(0.4f, 1, 0));
+	cubeMother2->Rotate(glm::radians(deltaTime / 20.f), vec3(0.3f, 1, 0));
+	cubeMother3->Rotate(glm::radians(-deltaTime / 30.f), vec3(0.2f, 1, 0));
+	cubeMother4->Rotate(glm::radians(-deltaTime / 40.f), vec3(0.1f, 1, 0));
+#endif
 }
 
 void Application::Tick(float deltaTime) noexcept
 {
-	if (!m_DynamicLocked && (m_Type == CPU || m_Type == CPU_RAYTRACER))
+	if (!m_DynamicLocked && m_Type == GPU && m_GpuScene != nullptr)
+	{
+		// the top-level BVH only contains a handful of instances, rebuilding it every frame is cheap
+		AnimateGameObjects(deltaTime);
+		((core::GpuTracer *)m_Renderer)->UpdateInstances();
+	}
+	else if (!m_DynamicLocked && (m_Type == CPU || m_Type == CPU_RAYTRACER))
 	{
 		if (m_DBVHBuildTimer.elapsed() > 1000.0f)
 		{
@@ -293,17 +347,7 @@ void Application::Tick(float deltaTime) noexcept
 
 			m_DBVHBuildTimer.reset();
 		}
-#if TEAPOT
-		motherGameObject->Rotate(glm::radians(deltaTime / 100.f), vec3(0, 1, 0));
-		motherGameObject->Move(vec3(0.f, deltaTime / 3000.f, 0.f));
-#endif
-#if CUBES
-		motherGameObject->Rotate(glm::radians(deltaTime / 60.f), vec3(0, 1, 0.3f));
-		cubeMother1->Rotate(glm::radians(deltaTime / 10.f), vec3(0.4f, 1, 0));
-		cubeMother2->Rotate(glm::radians(deltaTime / 20.f), vec3(0.3f, 1, 0));
-		cubeMother3->Rotate(glm::radians(-deltaTime / 30.f), vec3(0.2f, 1, 0));
-		cubeMother4->Rotate(glm::radians(-deltaTime / 40.f), vec3(0.1f, 1, 0));
-#endif
+		AnimateGameObjects(deltaTime);
 		m_Scene->UpdateDynamic(*m_Renderer);
 	}
 }
@@ -387,6 +431,13 @@ void Application::HandleKeys(float deltaTime) noexcept
 		}
 	}
 
+	// page up & down move the lights of a triangle list scene, the GPU tracers rebuild their BVH every frame it moves
+	if (m_Type == GPU && m_GpuScene == nullptr && (m_KeyStatus[GLFW_KEY_PAGE_UP] || m_KeyStatus[GLFW_KEY_PAGE_DOWN]))
+	{
+		MoveLights(vec3(0.0f, m_KeyStatus[GLFW_KEY_PAGE_UP] ? movementSpeed : -movementSpeed, 0.0f));
+		resetSamples = true;
+	}
+
 	if (m_KeyStatus[GLFW_KEY_M])
 	{
 		SwitchDynamicLocked();
@@ -408,6 +459,18 @@ void Application::HandleKeys(float deltaTime) noexcept
 	}
 }
 
+void Application::MoveLights(const glm::vec3 &offset)
+{
+	for (const uint idx : m_GpuList->GetLightIndices())
+	{
+		prims::GpuTriangle triangle = m_GpuList->GetTriangle(idx);
+		triangle.p0 += offset;
+		triangle.p1 += offset;
+		triangle.p2 += offset;
+		m_GpuList->UpdateTriangle(idx, triangle);
+	}
+}
+
 void Application::MouseScroll(bool x, bool y)
 {
 	if (!m_MovementLocked)
@@ -446,6 +509,8 @@ void Application::MouseMove(float x, float y)
 
 void Application::Draw(float deltaTime)
 {
+	// everything counted since the previous call, deltaTime covers the same frame
+	m_FrameStats = utils::stats::EndFrame(deltaTime);
 	HandleKeys(deltaTime);
 
 	if (frametimes.size() >= FPS_FRAMES)
@@ -467,6 +532,18 @@ void Application::Draw(float deltaTime)
 	if (ImGui::Button("Reset"))
 		m_Renderer->Reset();
 
+	ImGui::SameLine();
+	if (ImGui::Button("Save EXR"))
+	{
+		const core::FrameBuffer *frame = m_Renderer->GetFrameBuffer();
+		if (frame != nullptr)
+		{
+			const std::string path = "render_" + std::to_string(m_Renderer->GetSamples()) + ".exr";
+			m_ImageWriter.Write(path, frame->GetWidth(), frame->GetHeight(), frame->GetLayer(core::AOV::Color),
+								frame->GetScale());
+		}
+	}
+
 	if (m_BVHDebugMode && m_BVHRenderer != nullptr)
 	{
 		ImGui::Text("Renderer: %s, Mode: BVH", (m_Type == CPU || m_Type == CPU_RAYTRACER) ? "CPU" : "GPU");
@@ -494,8 +571,12 @@ void Application::Draw(float deltaTime)
 	ImGui::ListBox("Mode", &renderMode, modes.data(), modes.size());
 	if (lastMode != renderMode)
 		m_Renderer->SetMode(modes[renderMode]), m_Renderer->Reset();
+
+	if (ImGui::CollapsingHeader("Frame statistics"))
+		DrawFrameStats();
 	ImGui::End();
 
+	utils::stats::ScopedTimer presentTimer(utils::stats::Stage::Present);
 	if (m_Type == CPU || m_Type == CPU_RAYTRACER)
 		m_OutputTexture[m_tIndex]->flushData();
 
@@ -512,6 +593,27 @@ void Application::Draw(float deltaTime)
 	}
 }
 
+void Application::DrawFrameStats() const
+{
+	using namespace utils::stats;
+	const FrameStats &s = m_FrameStats;
+	const double rays = double(std::max(s.GetRays(), uint64_t(1)));
+
+	ImGui::Text("Rays: %.3fM (primary %.3fM, bounce %.3fM, shadow %.3fM)", double(s.GetRays()) * 1e-6,
+				double(s.Get(Counter::PrimaryRays)) * 1e-6, double(s.Get(Counter::BounceRays)) * 1e-6,
+				double(s.Get(Counter::ShadowRays)) * 1e-6);
+	ImGui::Text("Node visits: %.1f per ray, primitive tests: %.1f per ray", double(s.Get(Counter::NodeVisits)) / rays,
+				double(s.Get(Counter::PrimitiveTests)) / rays);
+	ImGui::Text("Shadow rays occluded: %.1f%%", 100.0 * s.Ratio(Counter::OccludedShadowRays, Counter::ShadowRays));
+	ImGui::Text("Average path length: %.2f, roulette kills: %.1f%%", s.GetAveragePathLength(),
+				100.0 * s.Ratio(Counter::RouletteKills, Counter::RouletteTests));
+
+	// summed over all threads, so a stage can take longer than the frame
+	ImGui::Text("Stage times (thread ms, frame %.2f ms):", double(s.frameMs));
+	for (int i = 0; i < int(Stage::Count); i++)
+		ImGui::BulletText("%s: %.2f", GetStageName(Stage(i)), s.GetMs(Stage(i)));
+}
+
 void Application::Resize(int newWidth, int newHeight)
 {
 	glFinish();
@@ -548,8 +650,9 @@ void Application::Resize(int newWidth, int newHeight)
 
 		if (m_Renderer)
 		{
-			((core::GpuTracer *)m_Renderer)->Resize(m_OutputTexture[0]);
-			((core::GpuTracer *)m_Renderer)->SetOutput(m_OutputTexture[0], m_OutputTexture[1]);
+			m_Renderer->Resize(m_OutputTexture[0]);
+			if (auto *gpuTracer = dynamic_cast<core::GpuTracer *>(m_Renderer))
+				gpuTracer->SetOutput(m_OutputTexture[0], m_OutputTexture[1]);
 		}
 	}
 }
\ No newline at end of file
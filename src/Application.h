@@ -1,12 +1,14 @@
 #pragma once
 
 #include "BVH/GameObject.h"
+#include "BVH/GpuTopLevelBVH.h"
 #include "BVH/TopLevelBVH.h"
 #include <GLFW/glfw3.h>
 
 #include "Core/BVHRenderer.h"
 #include "Core/Camera.h"
 #include "Core/GpuTracer.h"
+#include "Core/MultiGpuTracer.h"
 #include "Core/PathTracer.h"
 #include "Core/RayTracer.h"
 #include "Core/Scenes.h"
@@ -14,7 +16,9 @@
 
 #include "Materials/MaterialManager.h"
 
+#include "Utils/ImageWriter.h"
 #include "Utils/Messages.h"
+#include "Utils/Stats.h"
 #include "Utils/Timer.h"
 #include "Utils/ctpl.h"
 #include "Utils/Window.h"
@@ -76,6 +80,9 @@ class Application
 
 	void HandleKeys(float deltaTime) noexcept;
 
+	// Moves every light triangle of the GPU triangle list
+	void MoveLights(const glm::vec3 &offset);
+
 	void SwitchMovementLocked()
 	{
 		if (m_MovementTimer.elapsed() >= 250.0f)
@@ -108,6 +115,9 @@ class Application
 	inline int GetHeight() { return m_Height; }
 
   private:
+	// Counters and stage times of the previous frame in the Information window
+	void DrawFrameStats() const;
+
 	RendererType m_Type;
 	core::Renderer *m_Renderer = nullptr;
 
@@ -130,6 +140,7 @@ class Application
 	prims::SceneObjectList *m_ObjectList;
 	prims::GpuTriangleList *m_GpuList;
 	bvh::TopLevelBVH *m_Scene = nullptr;
+	bvh::GpuTopLevelBVH *m_GpuScene = nullptr;
 
 	ctpl::ThreadPool *m_TPool;
 	std::future<void> m_RebuildThread;
@@ -138,5 +149,8 @@ class Application
 	bool m_BVHDebugMode = false;
 	core::BVHRenderer *m_BVHRenderer = nullptr;
 
+	utils::AsyncImageWriter m_ImageWriter; // saves the accumulated image without stalling the frame
+	utils::stats::FrameStats m_FrameStats; // counters of the previous frame
+
 	utils::Window *m_Window;
 };
@@ -0,0 +1,573 @@
+#include "BVH/BVHAnalysis.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <future>
+
+#include <glm/gtc/constants.hpp>
+
+#include "BVH/MBVHTree.h"
+#include "BVH/StaticBVHTree.h"
+#include "BVH/TopLevelBVH.h"
+#include "Core/Camera.h"
+#include "Primitives/GpuTriangleList.h"
+#include "Primitives/Triangle.h"
+#include "Utils/Stats.h"
+#include "Utils/Timer.h"
+#include "Utils/Xor128.h"
+#include "Utils/ctpl.h"
+
+#define EPO_BATCH 4096 // primitives per task of the EPO computation
+
+namespace bvh
+{
+namespace
+{
+// Tree independent copy of a BVH. Leaves reference a range of the primitive order, every builder partitions that
+// order in place, so the range of an interior node covers exactly the leaves below it.
+struct Node
+{
+	AABB bounds;
+	int first = 0, count = 0;
+	int depth = 0;
+	std::vector<int> children;
+
+	inline bool IsLeaf() const { return children.empty(); }
+};
+
+struct Primitive
+{
+	AABB bounds;
+	bool triangle = false;
+	glm::vec3 p0, p1, p2;
+	float area = 0.0f; // full surface area, AABB::Area is half of it
+};
+
+Primitive MakeTriangle(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2)
+{
+	Primitive primitive;
+	primitive.bounds = AABB(glm::min(p0, glm::min(p1, p2)), glm::max(p0, glm::max(p1, p2)));
+	primitive.triangle = true;
+	primitive.p0 = p0, primitive.p1 = p1, primitive.p2 = p2;
+	primitive.area = 0.5f * glm::length(glm::cross(p1 - p0, p2 - p0));
+	return primitive;
+}
+
+Primitive MakeBox(const AABB &bounds)
+{
+	Primitive primitive;
+	primitive.bounds = bounds;
+	primitive.area = 2.0f * bounds.Area();
+	return primitive;
+}
+
+std::vector<Primitive> GetPrimitives(const prims::SceneObjectList *objectList)
+{
+	std::vector<Primitive> primitives;
+	primitives.reserve(objectList->GetObjects().size());
+	for (const prims::SceneObject *object : objectList->GetObjects())
+	{
+		const auto *triangle = dynamic_cast<const prims::Triangle *>(object);
+		if (triangle != nullptr)
+			primitives.push_back(MakeTriangle(triangle->p0, triangle->p1, triangle->p2));
+		else
+			primitives.push_back(MakeBox(object->GetBounds()));
+	}
+	return primitives;
+}
+
+std::vector<Primitive> GetPrimitives(const StaticBVHTree &tree)
+{
+	if (tree.m_ObjectList != nullptr)
+		return GetPrimitives(tree.m_ObjectList);
+
+	std::vector<Primitive> primitives;
+	if (tree.m_TriangleList != nullptr)
+	{
+		for (const prims::GpuTriangle &triangle : tree.m_TriangleList->GetTriangles())
+			primitives.push_back(MakeTriangle(triangle.p0, triangle.p1, triangle.p2));
+	}
+	return primitives;
+}
+
+// Covers the primitive ranges of the children, empty leaves can point anywhere
+void SetRange(std::vector<Node> &nodes, int index)
+{
+	int first = INT_MAX, count = 0;
+	for (const int child : nodes[index].children)
+	{
+		if (nodes[child].count == 0)
+			continue;
+		first = std::min(first, nodes[child].first);
+		count += nodes[child].count;
+	}
+
+	nodes[index].first = count > 0 ? first : 0;
+	nodes[index].count = count;
+}
+
+int AddBinaryNode(const std::vector<BVHNode> &pool, int index, int depth, std::vector<Node> &nodes)
+{
+	const BVHNode &source = pool[index];
+	const int id = int(nodes.size());
+	nodes.emplace_back();
+	nodes[id].bounds = source.bounds;
+	nodes[id].depth = depth;
+
+	if (source.IsLeaf())
+	{
+		nodes[id].first = source.GetLeftFirst();
+		nodes[id].count = source.GetCount();
+		return id;
+	}
+
+	// nodes grows while the children are added, only keep indices
+	const int left = AddBinaryNode(pool, source.GetLeftFirst(), depth + 1, nodes);
+	const int right = AddBinaryNode(pool, source.GetLeftFirst() + 1, depth + 1, nodes);
+	nodes[id].children = {left, right};
+	SetRange(nodes, id);
+	return id;
+}
+
+int AddMBVHNode(const std::vector<MBVHNode> &tree, int index, const AABB &bounds, int depth, std::vector<Node> &nodes)
+{
+	const MBVHNode &source = tree[index];
+	const int id = int(nodes.size());
+	nodes.emplace_back();
+	nodes[id].bounds = bounds;
+	nodes[id].depth = depth;
+
+	std::vector<int> children;
+	for (int i = 0; i < 4; i++)
+	{
+		if (source.count[i] == 0) // unused slot
+			continue;
+
+		const AABB childBounds = AABB(glm::vec3(source.bminx[i], source.bminy[i], source.bminz[i]),
+									  glm::vec3(source.bmaxx[i], source.bmaxy[i], source.bmaxz[i]));
+		if (source.count[i] > 0)
+		{
+			const int leaf = int(nodes.size());
+			nodes.emplace_back();
+			nodes[leaf].bounds = childBounds;
+			nodes[leaf].depth = depth + 1;
+			nodes[leaf].first = source.child[i];
+			nodes[leaf].count = source.count[i];
+			children.push_back(leaf);
+		}
+		else
+		{
+			children.push_back(AddMBVHNode(tree, source.child[i], childBounds, depth + 1, nodes));
+		}
+	}
+
+	nodes[id].children = std::move(children);
+	SetRange(nodes, id);
+	return id;
+}
+
+inline bool Overlaps(const AABB &a, const AABB &b)
+{
+	return a.bmin[0] <= b.bmax[0] && b.bmin[0] <= a.bmax[0] && a.bmin[1] <= b.bmax[1] && b.bmin[1] <= a.bmax[1] &&
+		   a.bmin[2] <= b.bmax[2] && b.bmin[2] <= a.bmax[2];
+}
+
+// Surface area of primitive inside box
+float ClippedArea(const Primitive &primitive, const AABB &box)
+{
+	if (!primitive.triangle)
+	{
+		const float boundsArea = primitive.bounds.Area();
+		return boundsArea > 0.0f ? primitive.area * primitive.bounds.Intersection(box).Area() / boundsArea : 0.0f;
+	}
+
+	// Sutherland-Hodgman against the 6 planes of the box, every plane adds at most one vertex
+	glm::vec3 polygons[2][9] = {{primitive.p0, primitive.p1, primitive.p2}};
+	int count = 3, current = 0;
+	for (int plane = 0; plane < 6 && count > 0; plane++)
+	{
+		const int axis = plane >> 1;
+		const bool lower = (plane & 1) == 0;
+		const float bound = lower ? box.bmin[axis] : box.bmax[axis];
+		const glm::vec3 *in = polygons[current];
+		glm::vec3 *out = polygons[1 - current];
+
+		int outCount = 0;
+		for (int i = 0; i < count; i++)
+		{
+			const glm::vec3 &a = in[(i + count - 1) % count];
+			const glm::vec3 &b = in[i];
+			const bool insideA = lower ? a[axis] >= bound : a[axis] <= bound;
+			const bool insideB = lower ? b[axis] >= bound : b[axis] <= bound;
+			if (insideA != insideB)
+			{
+				glm::vec3 p = a + (b - a) * ((bound - a[axis]) / (b[axis] - a[axis]));
+				p[axis] = bound;
+				out[outCount++] = p;
+			}
+			if (insideB)
+				out[outCount++] = b;
+		}
+
+		count = outCount;
+		current = 1 - current;
+	}
+
+	glm::vec3 sum = glm::vec3(0.0f);
+	const glm::vec3 *polygon = polygons[current];
+	for (int i = 1; i + 1 < count; i++)
+		sum += glm::cross(polygon[i] - polygon[0], polygon[i + 1] - polygon[0]);
+	return 0.5f * glm::length(sum);
+}
+
+inline float GetCost(const Node &node)
+{
+	return node.IsLeaf() ? REPORT_INTERSECTION_COST * float(node.count) : REPORT_TRAVERSAL_COST;
+}
+
+// Weighted area of the primitives at positions [begin, end) of order inside nodes that do not contain them
+double GetOverlap(const std::vector<Node> &nodes, const std::vector<unsigned int> &order,
+				  const std::vector<Primitive> &primitives, int begin, int end)
+{
+	double overlap = 0.0;
+	std::vector<int> stack;
+	for (int position = begin; position < end; position++)
+	{
+		const Primitive &primitive = primitives[order[position]];
+		stack.assign(1, 0);
+		while (!stack.empty())
+		{
+			const Node &node = nodes[stack.back()];
+			stack.pop_back();
+			if (node.count == 0 || !Overlaps(node.bounds, primitive.bounds))
+				continue;
+
+			if (position < node.first || position >= node.first + node.count)
+				overlap += double(GetCost(node)) * double(ClippedArea(primitive, node.bounds));
+			stack.insert(stack.end(), node.children.begin(), node.children.end());
+		}
+	}
+	return overlap;
+}
+
+BVHReport Summarize(const std::string &name, int arity, const std::vector<Node> &nodes,
+					const std::vector<unsigned int> &order, const std::vector<Primitive> &primitives,
+					ctpl::ThreadPool *pool)
+{
+	BVHReport report;
+	report.name = name;
+	report.arity = arity;
+	if (nodes.empty())
+		return report;
+
+	double weightedArea = 0.0, depthSum = 0.0;
+	for (const Node &node : nodes)
+	{
+		if (!node.IsLeaf())
+		{
+			report.interiorNodes++;
+			weightedArea += double(GetCost(node)) * double(node.bounds.Area());
+			continue;
+		}
+
+		report.leaves++;
+		report.primitives += size_t(node.count);
+		report.maxDepth = std::max(report.maxDepth, node.depth);
+		depthSum += double(node.depth);
+
+		if (size_t(node.count) >= report.leafSizes.size())
+			report.leafSizes.resize(size_t(node.count) + 1, 0);
+		report.leafSizes[node.count]++;
+		if (size_t(node.depth) >= report.leafDepths.size())
+			report.leafDepths.resize(size_t(node.depth) + 1, 0);
+		report.leafDepths[node.depth]++;
+
+		// empty leaves are never filled in by the builders, their bounds mean nothing
+		if (node.count == 0)
+			report.emptyLeaves++;
+		else
+			weightedArea += double(GetCost(node)) * double(node.bounds.Area());
+	}
+
+	report.averageLeafDepth = float(depthSum / double(report.leaves));
+	const double rootArea = double(nodes[0].bounds.Area());
+	report.sahCost = rootArea > 0.0 ? float(weightedArea / rootArea) : 0.0f;
+
+	// every primitive walks down the nodes its bounds overlap, batches are summed up in order so the result does
+	// not depend on the number of threads
+	const int count = int(order.size());
+	std::vector<double> overlaps;
+	if (pool != nullptr)
+	{
+		std::vector<std::future<double>> batches;
+		for (int begin = 0; begin < count; begin += EPO_BATCH)
+		{
+			const int end = std::min(begin + EPO_BATCH, count);
+			batches.push_back(pool->push([&nodes, &order, &primitives, begin, end](int) {
+				return GetOverlap(nodes, order, primitives, begin, end);
+			}));
+		}
+		for (auto &batch : batches)
+			overlaps.push_back(batch.get());
+	}
+	else
+	{
+		for (int begin = 0; begin < count; begin += EPO_BATCH)
+			overlaps.push_back(GetOverlap(nodes, order, primitives, begin, std::min(begin + EPO_BATCH, count)));
+	}
+
+	double overlap = 0.0, totalArea = 0.0;
+	for (const double value : overlaps)
+		overlap += value;
+	for (const unsigned int index : order)
+		totalArea += double(primitives[index].area);
+	report.epo = totalArea > 0.0 ? float(overlap / totalArea) : 0.0f;
+
+	return report;
+}
+
+const char *GetBVHTypeName(BVHType type)
+{
+	switch (type)
+	{
+	case (CENTRAL_SPLIT):
+		return "central split";
+	case (SAH):
+		return "SAH";
+	case (SAH_BINNING):
+	default:
+		return "binned SAH";
+	}
+}
+
+// e.g. "binned SAH, leaf size 3, 11 bins"
+std::string GetConfigName(const BVHBuildConfig &config)
+{
+	char buffer[64];
+	if (config.type == SAH_BINNING)
+		snprintf(buffer, sizeof(buffer), ", leaf size %i, %i bins", config.maxLeafSize, config.bins);
+	else
+		snprintf(buffer, sizeof(buffer), ", leaf size %i", config.maxLeafSize);
+	return GetBVHTypeName(config.type) + std::string(buffer);
+}
+
+void AppendHistogram(std::string &text, const std::vector<size_t> &histogram, bool json)
+{
+	char buffer[64];
+	bool first = true;
+	for (size_t i = 0; i < histogram.size(); i++)
+	{
+		if (histogram[i] == 0)
+			continue;
+		if (json)
+			snprintf(buffer, sizeof(buffer), "%s\"%zu\":%zu", first ? "" : ",", i, histogram[i]);
+		else
+			snprintf(buffer, sizeof(buffer), "%s%zu: %zu", first ? "" : ", ", i, histogram[i]);
+		text += buffer;
+		first = false;
+	}
+}
+} // namespace
+
+std::string BVHReport::ToString() const
+{
+	char buffer[256];
+	std::string text;
+
+	snprintf(buffer, sizeof(buffer), "%s: %zu interior nodes, %zu leaves (%zu empty), %zu primitives\n", name.c_str(),
+			 interiorNodes, leaves, emptyLeaves, primitives);
+	text += buffer;
+	snprintf(buffer, sizeof(buffer), "  depth %i, leaves at %.2f on average, %.2f primitives per leaf\n", maxDepth,
+			 double(averageLeafDepth), leaves > emptyLeaves ? double(primitives) / double(leaves - emptyLeaves) : 0.0);
+	text += buffer;
+	snprintf(buffer, sizeof(buffer), "  SAH cost %.2f, EPO %.2f (%i-wide, traversal %.1f, intersection %.1f)\n",
+			 double(sahCost), double(epo), arity, double(REPORT_TRAVERSAL_COST), double(REPORT_INTERSECTION_COST));
+	text += buffer;
+	snprintf(buffer, sizeof(buffer), "  memory %.2f MB used, %.2f MB reserved\n", double(memoryUsed) / 1048576.0,
+			 double(memoryReserved) / 1048576.0);
+	text += buffer;
+
+	text += "  leaf sizes: ";
+	AppendHistogram(text, leafSizes, false);
+	text += "\n  leaf depths: ";
+	AppendHistogram(text, leafDepths, false);
+	text += "\n";
+
+	for (const TraversalReport &traversal : traversals)
+	{
+		snprintf(buffer, sizeof(buffer),
+				 "  %s: %zu rays, %.1f%% hit, %.2f nodes and %.2f primitives per ray, %.2f MRays/s\n",
+				 traversal.name.c_str(), traversal.rays, 100.0 * double(traversal.hitRatio),
+				 double(traversal.nodesPerRay), double(traversal.primitivesPerRay), double(traversal.mraysPerSecond));
+		text += buffer;
+	}
+
+	return text;
+}
+
+std::string BVHReport::ToJSON() const
+{
+	char buffer[256];
+	std::string json;
+	json.reserve(1024);
+
+	snprintf(buffer, sizeof(buffer), "{\"bvh\":\"%s\",\"arity\":%i,\"interior_nodes\":%zu,\"leaves\":%zu", name.c_str(),
+			 arity, interiorNodes, leaves);
+	json += buffer;
+	snprintf(buffer, sizeof(buffer), ",\"empty_leaves\":%zu,\"primitives\":%zu,\"memory_used\":%zu", emptyLeaves,
+			 primitives, memoryUsed);
+	json += buffer;
+	snprintf(buffer, sizeof(buffer), ",\"memory_reserved\":%zu,\"max_depth\":%i,\"avg_leaf_depth\":%.3f",
+			 memoryReserved, maxDepth, double(averageLeafDepth));
+	json += buffer;
+	snprintf(buffer, sizeof(buffer), ",\"sah_cost\":%.4f,\"epo\":%.4f", double(sahCost), double(epo));
+	json += buffer;
+
+	json += ",\"leaf_sizes\":{";
+	AppendHistogram(json, leafSizes, true);
+	json += "},\"leaf_depths\":{";
+	AppendHistogram(json, leafDepths, true);
+	json += "},\"traversal\":{";
+
+	for (size_t i = 0; i < traversals.size(); i++)
+	{
+		const TraversalReport &traversal = traversals[i];
+		snprintf(buffer, sizeof(buffer),
+				 "%s\"%s\":{\"rays\":%zu,\"hit_ratio\":%.4f,\"nodes_per_ray\":%.3f,\"primitives_per_ray\":%.3f,"
+				 "\"mrays_per_second\":%.3f}",
+				 i > 0 ? "," : "", traversal.name.c_str(), traversal.rays, double(traversal.hitRatio),
+				 double(traversal.nodesPerRay), double(traversal.primitivesPerRay), double(traversal.mraysPerSecond));
+		json += buffer;
+	}
+	json += "}}";
+	return json;
+}
+
+BVHReport Analyze(const StaticBVHTree &tree, ctpl::ThreadPool *pool)
+{
+	std::vector<Node> nodes;
+	if (tree.CanUseBVH)
+		AddBinaryNode(tree.m_BVHPool, 0, 0, nodes);
+
+	BVHReport report = Summarize("binary " + GetConfigName(tree.GetConfig()), 2, nodes, tree.m_PrimitiveIndices,
+								 GetPrimitives(tree), pool);
+
+	// slot 1 is never used, the children of the root start at 2
+	const size_t usedNodes = nodes.size() > 1 ? nodes.size() + 1 : nodes.size();
+	report.memoryUsed = usedNodes * sizeof(BVHNode) + tree.m_PrimitiveIndices.size() * sizeof(unsigned int);
+	report.memoryReserved = tree.m_BVHPool.capacity() * sizeof(BVHNode) +
+							tree.m_PrimitiveIndices.capacity() * sizeof(unsigned int);
+	return report;
+}
+
+BVHReport Analyze(const MBVHTree &tree, ctpl::ThreadPool *pool)
+{
+	std::vector<Node> nodes;
+	if (tree.m_CanUseBVH)
+		AddMBVHNode(tree.m_Tree, 0, tree.m_Bounds, 0, nodes);
+
+	BVHReport report = Summarize("MBVH " + GetConfigName(tree.m_OriginalTree->GetConfig()), 4, nodes,
+								 tree.m_PrimitiveIndices, GetPrimitives(tree.m_ObjectList), pool);
+
+	report.memoryUsed = report.interiorNodes * sizeof(MBVHNode) + tree.m_PrimitiveIndices.size() * sizeof(unsigned int);
+	report.memoryReserved =
+		tree.m_Tree.capacity() * sizeof(MBVHNode) + tree.m_PrimitiveIndices.capacity() * sizeof(unsigned int);
+	return report;
+}
+
+BVHReport AnalyzeDynamic(const TopLevelBVH &scene, ctpl::ThreadPool *pool)
+{
+	const std::vector<BVHNode> &tree = scene.GetDynamicTree();
+	const std::vector<unsigned int> &indices = scene.GetDynamicIndices();
+
+	std::vector<Node> nodes;
+	if (!tree.empty())
+		AddBinaryNode(tree, 0, 0, nodes);
+
+	std::vector<Primitive> instances;
+	instances.reserve(scene.m_DynamicNodes.size());
+	for (const GameObjectNode &node : scene.m_DynamicNodes)
+		instances.push_back(MakeBox(node.boundsWorldSpace));
+
+	BVHReport report = Summarize("top level", 2, nodes, indices, instances, pool);
+	report.memoryUsed = nodes.size() * sizeof(BVHNode) + indices.size() * sizeof(unsigned int) +
+						scene.m_DynamicNodes.size() * sizeof(GameObjectNode);
+	report.memoryReserved = tree.capacity() * sizeof(BVHNode) + indices.capacity() * sizeof(unsigned int) +
+							scene.m_DynamicNodes.capacity() * sizeof(GameObjectNode);
+	return report;
+}
+
+std::vector<core::Ray> GenerateCameraRays(const core::Camera &camera, int width, int height, int count)
+{
+	// square pixels of a grid that has about count cells
+	const float step = sqrtf(float(width) * float(height) / float(std::max(count, 1)));
+
+	std::vector<core::Ray> rays;
+	rays.reserve(size_t(count));
+	for (float y = 0.5f * step; y < float(height); y += step)
+	{
+		for (float x = 0.5f * step; x < float(width); x += step)
+			rays.push_back(camera.GenerateRay(x, y));
+	}
+	return rays;
+}
+
+std::vector<core::Ray> GenerateRandomRays(const AABB &bounds, int count)
+{
+	Xor128 rng;
+	const glm::vec3 min = glm::vec3(bounds.bmin[0], bounds.bmin[1], bounds.bmin[2]);
+	const glm::vec3 extent = bounds.Lengths();
+
+	std::vector<core::Ray> rays;
+	rays.reserve(size_t(count));
+	for (int i = 0; i < count; i++)
+	{
+		const glm::vec3 origin = min + extent * glm::vec3(rng.Rand(), rng.Rand(), rng.Rand());
+		const float z = 1.0f - 2.0f * rng.Rand();
+		const float r = sqrtf(glm::max(0.0f, 1.0f - z * z));
+		const float phi = 2.0f * glm::pi<float>() * rng.Rand();
+		rays.emplace_back(origin, glm::vec3(r * cosf(phi), r * sinf(phi), z));
+	}
+	return rays;
+}
+
+void MeasureTraversal(const prims::WorldScene &scene, const std::vector<core::Ray> &rays, const std::string &name,
+					  BVHReport &report)
+{
+	using namespace utils::stats;
+
+	// the counters of this thread are only written by this thread, the difference is the work of these rays
+	const ThreadStats &counters = Local();
+	const uint64_t nodes = counters.counters[int(Counter::NodeVisits)].load(std::memory_order_relaxed);
+	const uint64_t tests = counters.counters[int(Counter::PrimitiveTests)].load(std::memory_order_relaxed);
+
+	size_t hits = 0;
+	const utils::Timer timer;
+	for (core::Ray ray : rays)
+	{
+		ray.Reset();
+		scene.TraceRay(ray);
+		if (ray.IsValid())
+			hits++;
+	}
+	const float elapsed = timer.elapsed();
+
+	TraversalReport traversal;
+	traversal.name = name;
+	traversal.rays = rays.size();
+	if (!rays.empty())
+	{
+		const double count = double(rays.size());
+		traversal.hitRatio = float(double(hits) / count);
+		traversal.nodesPerRay =
+			float(double(counters.counters[int(Counter::NodeVisits)].load(std::memory_order_relaxed) - nodes) / count);
+		traversal.primitivesPerRay =
+			float(double(counters.counters[int(Counter::PrimitiveTests)].load(std::memory_order_relaxed) - tests) /
+				  count);
+		traversal.mraysPerSecond = elapsed > 0.0f ? float(count / (double(elapsed) * 1000.0)) : 0.0f;
+	}
+
+	report.traversals.push_back(traversal);
+}
+} // namespace bvh
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "BVH/AABB.h"
+#include "Core/Ray.h"
+
+namespace ctpl
+{
+class ThreadPool;
+}
+
+namespace core
+{
+class Camera;
+}
+
+namespace prims
+{
+class WorldScene;
+}
+
+namespace bvh
+{
+class MBVHTree;
+class StaticBVHTree;
+class TopLevelBVH;
+
+// Cost of a node visit and a primitive test relative to each other, used for the SAH cost and EPO of a report.
+// The builders only compare area times primitive count, so they do not account for node visits at all.
+constexpr float REPORT_TRAVERSAL_COST = 1.0f;
+constexpr float REPORT_INTERSECTION_COST = 1.0f;
+
+// Work done for a set of sample rays, see MeasureTraversal
+struct TraversalReport
+{
+	std::string name;
+	size_t rays = 0;
+	float hitRatio = 0.0f;
+	float nodesPerRay = 0.0f;	   // interior nodes visited, a 4-wide MBVH node counts once
+	float primitivesPerRay = 0.0f; // primitives tested
+	float mraysPerSecond = 0.0f;   // single thread, counting included
+};
+
+// Quality numbers of a BVH, to pick build types and leaf sizes per scene with numbers instead of heat maps
+struct BVHReport
+{
+	std::string name;
+	int arity = 2;
+	size_t interiorNodes = 0;
+	size_t leaves = 0;
+	size_t emptyLeaves = 0;
+	size_t primitives = 0; // primitive references in leaves
+	size_t memoryUsed = 0; // bytes of reachable nodes and primitive indices
+	size_t memoryReserved = 0; // bytes allocated for them
+	int maxDepth = 0;
+	float averageLeafDepth = 0.0f;
+
+	// Expected cost of a ray that hits the root: node and leaf areas relative to the root, weighted by the costs above.
+	// Only comparable between trees of the same arity.
+	float sahCost = 0.0f;
+
+	// End point overlap (Aila et al. 2013): surface area of primitives that lies inside nodes that do not contain
+	// them, weighted like the SAH cost and relative to the total surface area. Counts the work SAH does not see.
+	// Triangles are clipped exactly, other primitives count with the surface of their bounds.
+	float epo = 0.0f;
+
+	std::vector<size_t> leafSizes;	// leaves by primitive count
+	std::vector<size_t> leafDepths; // leaves by depth, the root has depth 0
+
+	std::vector<TraversalReport> traversals;
+
+	// Multiple lines of text
+	std::string ToString() const;
+
+	// Single line JSON object
+	std::string ToJSON() const;
+};
+
+// Binary tree, the pool spreads the EPO computation over its threads
+BVHReport Analyze(const StaticBVHTree &tree, ctpl::ThreadPool *pool = nullptr);
+
+BVHReport Analyze(const MBVHTree &tree, ctpl::ThreadPool *pool = nullptr);
+
+// The top level over the game objects of scene, every instance counts as a primitive with the area of its bounds.
+// The static tree below it is analyzed on its own.
+BVHReport AnalyzeDynamic(const TopLevelBVH &scene, ctpl::ThreadPool *pool = nullptr);
+
+// Rays through a grid of count pixels spread over the image of camera
+std::vector<core::Ray> GenerateCameraRays(const core::Camera &camera, int width, int height, int count);
+
+// Rays starting at uniform random points inside bounds in uniform random directions, a stand-in for bounces.
+// The sequence is the same on every call, so trees can be compared ray for ray.
+std::vector<core::Ray> GenerateRandomRays(const AABB &bounds, int count);
+
+// Traces rays through scene on the calling thread and adds the work per ray to report. Node visits and primitive
+// tests are taken from the counters in Utils/Stats.h, they stay 0 with STATS disabled.
+void MeasureTraversal(const prims::WorldScene &scene, const std::vector<core::Ray> &rays, const std::string &name,
+					  BVHReport &report);
+} // namespace bvh
@@ -0,0 +1,36 @@
+#pragma once
+
+namespace bvh
+{
+enum BVHType
+{
+	CENTRAL_SPLIT = 0,
+	SAH = 1,
+	SAH_BINNING = 2
+};
+
+// Parameters of the binary builds. An MBVH is collapsed from a binary tree and uses the config of that tree.
+struct BVHBuildConfig
+{
+	BVHType type = SAH;
+	int maxLeafSize = 3; // larger nodes are split, unless the SAH finds no better split
+	int maxDepth = 64;
+	int bins = 11;		   // split planes per axis are bins - 1, binned SAH and the dynamic trees only
+	bool threading = true; // subdivide and collapse to an MBVH on the thread pool of the tree, if it has one
+	bool printBuildTime = true;
+
+	// Replaces maxLeafSize and bins by the candidates that trace fastest on a sample of the scene, see BVHTuning.h
+	bool autoTune = false;
+
+	BVHBuildConfig() = default;
+
+	explicit BVHBuildConfig(BVHType buildType) : type(buildType) {}
+};
+
+// Config of the scene BVHs, set from the command line
+inline BVHBuildConfig &SceneBuildConfig()
+{
+	static BVHBuildConfig config(SAH_BINNING);
+	return config;
+}
+} // namespace bvh
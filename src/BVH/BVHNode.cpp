@@ -1,9 +1,7 @@
 #include "BVHNode.h"
 #include "StaticBVHTree.h"
-
-#define MAX_PRIMS 4
-#define MAX_DEPTH 64
-#define BINS 11
+#include "Utils/Stats.h"
+#include "Utils/Timeline.h"
 
 const __m128 QuadOne = _mm_set1_ps(1.f);
 
@@ -200,13 +198,13 @@ unsigned int bvh::BVHNode::TraverseDebug(core::Ray& r, const std::vector<bvh::Ga
             depth += bvhTree[bounds.leftFirst + 1].TraverseDebug(r, objectList, bvhTree, primIndices);
             if (r.t < tNearLeft && r.IsValid())
                 return depth;
-            depth += bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices);
+            depth += bvhTree[bounds.leftFirst].TraverseDebug(r, objectList, bvhTree, primIndices);
         }
     } else {
         if (hitLeft)
-            depth += bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices);
+            depth += bvhTree[bounds.leftFirst].TraverseDebug(r, objectList, bvhTree, primIndices);
         else if (hitRight)
-            depth += bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices);
+            depth += bvhTree[bounds.leftFirst + 1].TraverseDebug(r, objectList, bvhTree, primIndices);
     }
 
     return depth;
@@ -215,14 +213,17 @@ unsigned int bvh::BVHNode::TraverseDebug(core::Ray& r, const std::vector<bvh::Ga
 void bvh::BVHNode::Traverse(
     core::Ray& r,
     const std::vector<prims::SceneObject*>& objectList,
-    const bvh::StaticBVHTree* bvhTree) const
+    const bvh::StaticBVHTree* bvhTree,
+    utils::stats::TraversalCounts& counts) const
 {
     if (this->IsLeaf()) {
+        counts.primitiveTests += bounds.count;
         for (int idx = 0; idx < bounds.count; idx++) {
             objectList[bvhTree->m_PrimitiveIndices[bounds.leftFirst + idx]]
                 ->Intersect(r);
         }
     } else {
+        counts.nodeVisits++;
         float tNearLeft, tFarLeft;
         float tNearRight, tFarRight;
         const bool hitLeft = bvhTree->m_BVHPool[bounds.leftFirst].IntersectSIMD(r, tNearLeft, tFarLeft);
@@ -231,21 +232,21 @@ void bvh::BVHNode::Traverse(
 
         if (hitLeft && hitRight) {
             if (tNearLeft < tNearRight) {
-                bvhTree->m_BVHPool[bounds.leftFirst].Traverse(r, objectList, bvhTree);
+                bvhTree->m_BVHPool[bounds.leftFirst].Traverse(r, objectList, bvhTree, counts);
                 if (r.t < tNearRight && r.IsValid())
                     return;
-                bvhTree->m_BVHPool[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree);
+                bvhTree->m_BVHPool[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, counts);
             } else {
-                bvhTree->m_BVHPool[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree);
+                bvhTree->m_BVHPool[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, counts);
                 if (r.t < tNearLeft && r.IsValid())
                     return;
-                bvhTree->m_BVHPool[bounds.leftFirst].Traverse(r, objectList, bvhTree);
+                bvhTree->m_BVHPool[bounds.leftFirst].Traverse(r, objectList, bvhTree, counts);
             }
         } else {
             if (hitLeft)
-                bvhTree->m_BVHPool[bounds.leftFirst].Traverse(r, objectList, bvhTree);
+                bvhTree->m_BVHPool[bounds.leftFirst].Traverse(r, objectList, bvhTree, counts);
             else if (hitRight)
-                bvhTree->m_BVHPool[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree);
+                bvhTree->m_BVHPool[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, counts);
         }
     }
 }
@@ -254,14 +255,17 @@ void bvh::BVHNode::Traverse(
     core::Ray& r,
     const std::vector<prims::SceneObject*>& objectList,
     const std::vector<bvh::BVHNode>& bvhTree,
-    const std::vector<unsigned int>& primIndices) const
+    const std::vector<unsigned int>& primIndices,
+    utils::stats::TraversalCounts& counts) const
 {
     if (this->IsLeaf()) {
+        counts.primitiveTests += bounds.count;
         for (int idx = 0; idx < bounds.count; idx++) {
             objectList[primIndices[bounds.leftFirst + idx]]
                 ->Intersect(r);
         }
     } else {
+        counts.nodeVisits++;
         float tNearLeft, tFarLeft;
         float tNearRight, tFarRight;
         const bool hitLeft = bvhTree[bounds.leftFirst].IntersectSIMD(r, tNearLeft, tFarLeft);
@@ -270,21 +274,21 @@ void bvh::BVHNode::Traverse(
 
         if (hitLeft && hitRight) {
             if (tNearLeft < tNearRight) {
-                bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices);
+                bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices, counts);
                 if (r.t < tNearRight && r.IsValid())
                     return;
-                bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices);
+                bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices, counts);
             } else {
-                bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices);
+                bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices, counts);
                 if (r.t < tNearLeft && r.IsValid())
                     return;
-                bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices);
+                bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices, counts);
             }
         } else {
             if (hitLeft)
-                bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices);
+                bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices, counts);
             else if (hitRight)
-                bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices);
+                bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices, counts);
         }
     }
 }
@@ -293,7 +297,8 @@ int bvh::BVHNode::Traverse(
     core::Ray& r,
     const std::vector<bvh::GameObjectNode>& objectList,
     const std::vector<bvh::BVHNode>& bvhTree,
-    const std::vector<unsigned int>& primIndices) const
+    const std::vector<unsigned int>& primIndices,
+    utils::stats::TraversalCounts& counts) const
 {
     int i = -1;
     if (this->IsLeaf()) {
@@ -307,6 +312,7 @@ int bvh::BVHNode::Traverse(
         return i;
     }
 
+    counts.nodeVisits++;
     float tNearLeft, tFarLeft;
     float tNearRight, tFarRight;
     const bool hitLeft = bvhTree[bounds.leftFirst].Intersect(r, tNearLeft, tFarLeft);
@@ -314,21 +320,21 @@ int bvh::BVHNode::Traverse(
 
     if (hitLeft && hitRight) {
         if (tNearLeft < tNearRight) {
-            i = bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices);
+            i = bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices, counts);
             if (r.t < tNearRight && r.IsValid())
                 return i;
-            i = bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices);
+            i = bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices, counts);
         } else {
-            i = bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices);
+            i = bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices, counts);
             if (r.t < tNearLeft && r.IsValid())
                 return i;
-            i = bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices);
+            i = bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices, counts);
         }
     } else {
         if (hitLeft)
-            i = bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices);
+            i = bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices, counts);
         else if (hitRight)
-            i = bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices);
+            i = bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices, counts);
     }
 
     return i;
@@ -338,7 +344,8 @@ int bvh::BVHNode::TraverseShadow(
     core::Ray& r,
     const std::vector<bvh::GameObjectNode>& objectList,
     const std::vector<bvh::BVHNode>& bvhTree,
-    const std::vector<unsigned int>& primIndices) const
+    const std::vector<unsigned int>& primIndices,
+    utils::stats::TraversalCounts& counts) const
 {
     int i = -1;
     if (this->IsLeaf()) {
@@ -359,21 +366,21 @@ int bvh::BVHNode::TraverseShadow(
 
     if (hitLeft && hitRight) {
         if (tNearLeft < tNearRight) {
-            i = bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices);
+            i = bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices, counts);
             if (r.t < tNearRight && r.IsValid())
                 return i;
-            i = bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices);
+            i = bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices, counts);
         } else {
-            i = bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices);
+            i = bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices, counts);
             if (r.t < tNearLeft && r.IsValid())
                 return i;
-            i = bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices);
+            i = bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices, counts);
         }
     } else {
         if (hitLeft)
-            i = bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices);
+            i = bvhTree[bounds.leftFirst].Traverse(r, objectList, bvhTree, primIndices, counts);
         else if (hitRight)
-            i = bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices);
+            i = bvhTree[bounds.leftFirst + 1].Traverse(r, objectList, bvhTree, primIndices, counts);
     }
 
     return i;
@@ -383,7 +390,8 @@ void bvh::BVHNode::Subdivide(const std::vector<AABB>& aabbs, StaticBVHTree* bvhT
     unsigned int depth)
 {
     depth++;
-    if (GetCount() < MAX_PRIMS || depth >= MAX_DEPTH)
+    const BVHBuildConfig& config = bvhTree->m_Config;
+    if (GetCount() <= config.maxLeafSize || depth >= unsigned(config.maxDepth))
         return; // this is a leaf node
 
     int left;
@@ -421,7 +429,8 @@ bool bvh::BVHNode::Partition(const std::vector<AABB>& aabbs, StaticBVHTree* bvhT
     float parentNodeCost{}, lowestNodeCost = 1e34f, bestCoord{};
     int bestAxis{};
 
-    switch (bvhTree->m_Type) {
+    const int bins = bvhTree->m_Config.bins;
+    switch (bvhTree->m_Config.type) {
     case (SAH): {
         parentNodeCost = bounds.Area() * bounds.count;
         for (int idx = 0; idx < bounds.count; idx++) {
@@ -459,9 +468,9 @@ bool bvh::BVHNode::Partition(const std::vector<AABB>& aabbs, StaticBVHTree* bvhT
     case (SAH_BINNING): {
         parentNodeCost = bounds.Area() * bounds.count;
         const vec3 lengths = this->bounds.Lengths();
-        for (int i = 1; i < BINS; i++) {
+        for (int i = 1; i < bins; i++) {
             for (int axis = 0; axis < 3; axis++) {
-                const float splitCoord = bounds.bmin[axis] + lengths[axis] * (float(i) / float(BINS));
+                const float splitCoord = bounds.bmin[axis] + lengths[axis] * (float(i) / float(bins));
                 int leftCount = 0, rightCount = 0;
                 AABB leftBox = AABB(vec3(1e34f), vec3(-1e34f));
                 AABB rightBox = AABB(vec3(1e34f), vec3(-1e34f));
@@ -513,7 +522,7 @@ bool bvh::BVHNode::Partition(const std::vector<AABB>& aabbs, StaticBVHTree* bvhT
     }
 
     bvhTree->m_PoolPtrMutex.lock();
-    if (bvhTree->m_PoolPtr + 2 >= (aabbs.size() * 2)) {
+    if (bvhTree->m_PoolPtr + 2 > bvhTree->m_BVHPool.size()) {
         bvhTree->m_PoolPtrMutex.unlock();
         return false;
     }
@@ -553,12 +562,14 @@ void bvh::BVHNode::SubdivideMT(
     unsigned int depth)
 {
     depth++;
-    if (GetCount() < MAX_PRIMS || depth >= MAX_DEPTH)
+    const BVHBuildConfig& config = bvhTree->m_Config;
+    if (GetCount() <= config.maxLeafSize || depth >= unsigned(config.maxDepth))
         return; // This is a leaf node
 
     int left = -1;
     int right = -1;
 
+    utils::timeline::ScopedEvent event("subdivide", "bvh");
     if (!Partition(aabbs, bvhTree, left, right))
         return;
 
@@ -592,6 +603,7 @@ void bvh::BVHNode::SubdivideMT(
 
         rightNode->CalculateBounds(aabbs, bvhTree->m_PrimitiveIndices);
         rightNode->SubdivideMT(aabbs, bvhTree, depth);
+        utils::timeline::ScopedEvent wait("wait for left child", "bvh");
         leftThread.get();
     } else {
         if (subLeft) {
@@ -610,16 +622,17 @@ void bvh::BVHNode::Subdivide(
     const std::vector<AABB>& aabbs,
     std::vector<bvh::BVHNode>& bvhTree,
     std::vector<unsigned int>& primIndices,
+    const BVHBuildConfig& config,
     unsigned int depth)
 {
     depth++;
-    if (GetCount() < MAX_PRIMS || depth >= MAX_DEPTH)
+    if (GetCount() <= config.maxLeafSize || depth >= unsigned(config.maxDepth))
         return; // this is a leaf node
 
     int left = -1;
     int right = -1;
 
-    if (!Partition(&aabbs, &bvhTree, &primIndices, left, right)) {
+    if (!Partition(&aabbs, &bvhTree, &primIndices, config.bins, left, right)) {
         return;
     }
 
@@ -631,12 +644,12 @@ void bvh::BVHNode::Subdivide(
 
     if (leftNode.bounds.count > 0) {
         leftNode.CalculateBounds(aabbs, primIndices);
-        leftNode.Subdivide(aabbs, bvhTree, primIndices, depth);
+        leftNode.Subdivide(aabbs, bvhTree, primIndices, config, depth);
     }
 
     if (rightNode.bounds.count > 0) {
         rightNode.CalculateBounds(aabbs, primIndices);
-        rightNode.Subdivide(aabbs, bvhTree, primIndices, depth);
+        rightNode.Subdivide(aabbs, bvhTree, primIndices, config, depth);
     }
 }
 
@@ -644,6 +657,7 @@ void bvh::BVHNode::SubdivideMT(
     const std::vector<AABB>* aabbs,
     std::vector<bvh::BVHNode>* bvhTree,
     std::vector<unsigned int>* primIndices,
+    const BVHBuildConfig* config,
     ctpl::ThreadPool* tPool,
     std::mutex* threadMutex,
     std::mutex* partitionMutex,
@@ -651,13 +665,14 @@ void bvh::BVHNode::SubdivideMT(
     unsigned int depth)
 {
     depth++;
-    if (GetCount() < MAX_PRIMS || depth >= MAX_DEPTH)
+    if (GetCount() <= config->maxLeafSize || depth >= unsigned(config->maxDepth))
         return; // this is a leaf node
 
     int left = -1;
     int right = -1;
 
-    if (!Partition(aabbs, bvhTree, primIndices, partitionMutex, left, right))
+    utils::timeline::ScopedEvent event("subdivide", "bvh");
+    if (!Partition(aabbs, bvhTree, primIndices, config->bins, partitionMutex, left, right))
         return;
 
     this->bounds.leftFirst = left; // set pointer to children
@@ -677,23 +692,24 @@ void bvh::BVHNode::SubdivideMT(
 
         threadMutex->unlock();
 
-        auto leftThread = tPool->push([aabbs, bvhTree, primIndices, tPool, threadMutex, partitionMutex, threadCount, depth, leftNode](int) -> void {
+        auto leftThread = tPool->push([aabbs, bvhTree, primIndices, config, tPool, threadMutex, partitionMutex, threadCount, depth, leftNode](int) -> void {
             leftNode->CalculateBounds(*aabbs, *primIndices);
-            leftNode->SubdivideMT(aabbs, bvhTree, primIndices, tPool, threadMutex, partitionMutex, threadCount, depth);
+            leftNode->SubdivideMT(aabbs, bvhTree, primIndices, config, tPool, threadMutex, partitionMutex, threadCount, depth);
         });
 
         rightNode->CalculateBounds(*aabbs, *primIndices);
-        rightNode->SubdivideMT(aabbs, bvhTree, primIndices, tPool, threadMutex, partitionMutex, threadCount, depth);
+        rightNode->SubdivideMT(aabbs, bvhTree, primIndices, config, tPool, threadMutex, partitionMutex, threadCount, depth);
+        utils::timeline::ScopedEvent wait("wait for left child", "bvh");
         leftThread.get();
     } else {
         if (subLeft) {
             leftNode->CalculateBounds(*aabbs, *primIndices);
-            leftNode->Subdivide(*aabbs, *bvhTree, *primIndices, depth);
+            leftNode->Subdivide(*aabbs, *bvhTree, *primIndices, *config, depth);
         }
 
         if (subRight) {
             rightNode->CalculateBounds(*aabbs, *primIndices);
-            rightNode->Subdivide(*aabbs, *bvhTree, *primIndices, depth);
+            rightNode->Subdivide(*aabbs, *bvhTree, *primIndices, *config, depth);
         }
     }
 }
@@ -702,6 +718,7 @@ bool bvh::BVHNode::Partition(
     const std::vector<AABB>* aabbs,
     std::vector<bvh::BVHNode>* bvhTree,
     std::vector<unsigned int>* primIndices,
+    int bins,
     std::mutex* partitionMutex,
     int& left,
     int& right)
@@ -716,8 +733,8 @@ bool bvh::BVHNode::Partition(
 
     parentNodeCost = bounds.Area() * bounds.count;
     const vec3 lengths = this->bounds.Lengths();
-    for (int i = 1; i < BINS; i++) {
-        const auto binOffset = float(i) / float(BINS);
+    for (int i = 1; i < bins; i++) {
+        const auto binOffset = float(i) / float(bins);
         for (int axis = 0; axis < 3; axis++) {
             const float splitCoord = bounds.bmin[axis] + lengths[axis] * binOffset;
             int leftCount = 0, rightCount = 0;
@@ -774,7 +791,7 @@ bool bvh::BVHNode::Partition(
 
     return true;
 }
-bool bvh::BVHNode::Partition(const std::vector<AABB>* aabbs, std::vector<bvh::BVHNode>* bvhTree, std::vector<unsigned int>* primIndices, int& left, int& right)
+bool bvh::BVHNode::Partition(const std::vector<AABB>* aabbs, std::vector<bvh::BVHNode>* bvhTree, std::vector<unsigned int>* primIndices, int bins, int& left, int& right)
 {
     const int lFirst = bounds.leftFirst;
     int lCount = 0;
@@ -786,8 +803,8 @@ bool bvh::BVHNode::Partition(const std::vector<AABB>* aabbs, std::vector<bvh::BV
 
     parentNodeCost = bounds.Area() * bounds.count;
     const vec3 lengths = this->bounds.Lengths();
-    for (int i = 1; i < BINS; i++) {
-        const auto binOffset = float(i) / float(BINS);
+    for (int i = 1; i < bins; i++) {
+        const auto binOffset = float(i) / float(bins);
         for (int axis = 0; axis < 3; axis++) {
             const float splitCoord = bounds.bmin[axis] + lengths[axis] * binOffset;
             int leftCount = 0, rightCount = 0;
@@ -7,20 +7,15 @@
 #include <vector>
 
 #include "BVH/AABB.h"
+#include "BVH/BVHBuildConfig.h"
 #include "GameObjectNode.h"
+#include "Utils/Stats.h"
 
 namespace bvh
 {
 class StaticBVHTree;
 class TopLevelBVH;
 
-enum BVHType
-{
-	CENTRAL_SPLIT = 0,
-	SAH = 1,
-	SAH_BINNING = 2
-};
-
 struct BVHNode
 {
   public:
@@ -58,17 +53,21 @@ struct BVHNode
 							   const std::vector<bvh::BVHNode> &bvhTree,
 							   const std::vector<unsigned int> &primIndices) const;
 
+	// The traversals count visited nodes and tested primitives into counts, the caller adds them to the stats
 	void Traverse(core::Ray &r, const std::vector<prims::SceneObject *> &objectList,
-				  const bvh::StaticBVHTree *bvhTree) const;
+				  const bvh::StaticBVHTree *bvhTree, utils::stats::TraversalCounts &counts) const;
 
 	void Traverse(core::Ray &r, const std::vector<prims::SceneObject *> &objectList,
-				  const std::vector<BVHNode> &bvhTree, const std::vector<unsigned int> &primIndices) const;
+				  const std::vector<BVHNode> &bvhTree, const std::vector<unsigned int> &primIndices,
+				  utils::stats::TraversalCounts &counts) const;
 
 	int Traverse(core::Ray &r, const std::vector<bvh::GameObjectNode> &objectList,
-				 const std::vector<bvh::BVHNode> &bvhTree, const std::vector<unsigned int> &primIndices) const;
+				 const std::vector<bvh::BVHNode> &bvhTree, const std::vector<unsigned int> &primIndices,
+				 utils::stats::TraversalCounts &counts) const;
 
 	int TraverseShadow(core::Ray &r, const std::vector<bvh::GameObjectNode> &objectList,
-					   const std::vector<bvh::BVHNode> &bvhTree, const std::vector<unsigned int> &primIndices) const;
+					   const std::vector<bvh::BVHNode> &bvhTree, const std::vector<unsigned int> &primIndices,
+					   utils::stats::TraversalCounts &counts) const;
 
 	void Subdivide(const std::vector<AABB> &aabbs, bvh::StaticBVHTree *bvhTree, unsigned int depth);
 
@@ -77,17 +76,19 @@ struct BVHNode
 	bool Partition(const std::vector<AABB> &aabbs, bvh::StaticBVHTree *bvhTree, int &left, int &right);
 
 	void Subdivide(const std::vector<AABB> &aabbs, std::vector<BVHNode> &bvhTree,
-				   std::vector<unsigned int> &primIndices, unsigned int depth);
+				   std::vector<unsigned int> &primIndices, const BVHBuildConfig &config, unsigned int depth);
 
 	void SubdivideMT(const std::vector<AABB> *aabbs, std::vector<BVHNode> *bvhTree,
-					 std::vector<unsigned int> *primIndices, ctpl::ThreadPool *tPool, std::mutex *threadMutex,
-					 std::mutex *partitionMutex, unsigned int *threadCount, unsigned int depth);
+					 std::vector<unsigned int> *primIndices, const BVHBuildConfig *config, ctpl::ThreadPool *tPool,
+					 std::mutex *threadMutex, std::mutex *partitionMutex, unsigned int *threadCount,
+					 unsigned int depth);
 
 	bool Partition(const std::vector<AABB> *aabbs, std::vector<BVHNode> *bvhTree,
-				   std::vector<unsigned int> *primIndices, std::mutex *partitionMutex, int &left, int &right);
+				   std::vector<unsigned int> *primIndices, int bins, std::mutex *partitionMutex, int &left,
+				   int &right);
 
 	bool Partition(const std::vector<AABB> *aabbs, std::vector<BVHNode> *bvhTree,
-				   std::vector<unsigned int> *primIndices, int &left, int &right);
+				   std::vector<unsigned int> *primIndices, int bins, int &left, int &right);
 
 	void CalculateBounds(const std::vector<AABB> &aabbs, const std::vector<unsigned int> &primitiveIndices);
 
@@ -0,0 +1,120 @@
+#include "BVH/BVHTuning.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "BVH/BVHAnalysis.h"
+#include "BVH/MBVHTree.h"
+#include "BVH/StaticBVHTree.h"
+#include "Utils/Timeline.h"
+#include "Utils/Timer.h"
+
+#define TUNE_SAMPLE_SIZE 16384	// primitives the candidates are built over, larger scenes are sampled
+#define TUNE_SAH_SAMPLE_SIZE 2048 // full SAH builds are quadratic in the primitive count
+#define TUNE_PROBE_RAYS 8192
+#define TUNE_REPETITIONS 3 // the fastest run counts, so other work on the machine does not pick the tree
+
+namespace bvh
+{
+namespace
+{
+// Nanoseconds per probe ray through the MBVH of a candidate
+double MeasureCandidate(prims::SceneObjectList *objectList, const std::vector<unsigned int> &sample,
+						const BVHBuildConfig &config, const std::vector<core::Ray> &probes)
+{
+	StaticBVHTree candidate(objectList, sample, config);
+	candidate.ConstructBVH();
+	const MBVHTree tree(&candidate);
+
+	double best = 1e34;
+	for (int i = 0; i < TUNE_REPETITIONS; i++)
+	{
+		utils::Timer timer;
+		for (const core::Ray &probe : probes)
+		{
+			core::Ray ray = probe;
+			tree.TraceRay(ray);
+		}
+		best = std::min(best, double(timer.elapsed()));
+	}
+
+	return best * 1e6 / double(probes.size());
+}
+} // namespace
+
+BVHBuildConfig TuneBuildConfig(const StaticBVHTree &tree)
+{
+	BVHBuildConfig result = tree.GetConfig();
+	result.autoTune = false;
+
+	prims::SceneObjectList *objectList = tree.m_ObjectList;
+	const std::vector<unsigned int> &indices = tree.m_PrimitiveIndices;
+	if (objectList == nullptr || indices.empty())
+		return result;
+
+	utils::timeline::ScopedEvent event("tune BVH", "bvh");
+	utils::Timer timer;
+
+	// a fixed stride keeps the sample spread over every mesh of the scene
+	const size_t sampleSize = result.type == SAH ? TUNE_SAH_SAMPLE_SIZE : TUNE_SAMPLE_SIZE;
+	const size_t stride = (indices.size() + sampleSize - 1) / sampleSize;
+	const std::vector<AABB> &aabbs = objectList->GetAABBs();
+	std::vector<unsigned int> sample;
+	AABB bounds = {glm::vec3(1e34f), glm::vec3(-1e34f)};
+	for (size_t i = 0; i < indices.size(); i += stride)
+	{
+		sample.push_back(indices[i]);
+		bounds.Grow(aabbs[indices[i]]);
+	}
+
+	const std::vector<core::Ray> probes = GenerateRandomRays(bounds, TUNE_PROBE_RAYS);
+
+	BVHBuildConfig candidate = result;
+	candidate.threading = false;
+	candidate.printBuildTime = false;
+
+	const double givenTime = MeasureCandidate(objectList, sample, candidate, probes);
+	double bestTime = givenTime;
+
+	// the leaf size matters most, bins are tuned for the best leaf size only instead of trying every combination
+	for (const int leafSize : {1, 2, 3, 4, 6, 8})
+	{
+		if (leafSize == result.maxLeafSize)
+			continue; // measured above
+
+		candidate.maxLeafSize = leafSize;
+		const double time = MeasureCandidate(objectList, sample, candidate, probes);
+		if (time < bestTime)
+		{
+			bestTime = time;
+			result.maxLeafSize = leafSize;
+		}
+	}
+
+	if (result.type == SAH_BINNING)
+	{
+		candidate.maxLeafSize = result.maxLeafSize;
+		for (const int bins : {6, 8, 16, 24})
+		{
+			if (bins == result.bins)
+				continue;
+
+			candidate.bins = bins;
+			const double time = MeasureCandidate(objectList, sample, candidate, probes);
+			if (time < bestTime)
+			{
+				bestTime = time;
+				result.bins = bins;
+			}
+		}
+	}
+
+	if (result.printBuildTime)
+	{
+		printf("Tuning BVH took: %.2f ms, leaf size %i, %i bins: %.1f ns per probe ray (%.1f as configured).\n",
+			   double(timer.elapsed()), result.maxLeafSize, result.bins, bestTime, givenTime);
+	}
+
+	return result;
+}
+} // namespace bvh
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "BVH/BVHBuildConfig.h"
+
+namespace bvh
+{
+class StaticBVHTree;
+
+// Builds candidate trees over a sample of the primitives of tree, collapses them to MBVHs like the scenes are traced
+// and returns the config of tree with the leaf size and bin count that traced a set of probe rays fastest.
+// Bin counts are only tried for binned SAH. Everything runs on the calling thread, so timings are comparable.
+BVHBuildConfig TuneBuildConfig(const StaticBVHTree &tree);
+} // namespace bvh
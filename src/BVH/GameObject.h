@@ -9,11 +9,13 @@
 namespace bvh
 {
 class GameObjectNode;
+class GpuTopLevelBVH;
 class TopLevelBVH;
 
 class GameObject
 {
 	friend class GameObjectNode;
+	friend class GpuTopLevelBVH;
 	friend class TopLevelBVH;
 
   public:
@@ -69,6 +69,8 @@ void GameObjectNode::Traverse(core::Ray &rOrg) const
 		rOrg.obj = r.obj;
 		const vec4 normal = inverseMat * vec4(r.obj->GetNormal(r.GetHitpoint()), 0.f);
 		rOrg.normal = normalize(vec3(normal.x, normal.y, normal.z));
+		const vec4 geometricNormal = inverseMat * vec4(r.geometricNormal, 0.f);
+		rOrg.geometricNormal = normalize(vec3(geometricNormal.x, geometricNormal.y, geometricNormal.z));
 	}
 }
 
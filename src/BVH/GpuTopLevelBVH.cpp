@@ -0,0 +1,223 @@
+#include "BVH/GpuTopLevelBVH.h"
+
+#include <algorithm>
+
+#include "BVH/MBVHTree.h"
+#include "BVH/StaticBVHTree.h"
+#include "Shared.h"
+#include "Utils/Messages.h"
+
+#define TLAS_LEAF_SIZE 2
+#define TLAS_MAX_DEPTH 30 // traversal in programs/instance.cl keeps at most depth + 1 nodes on its 32 entry stack
+
+namespace bvh
+{
+GpuInstance::GpuInstance(glm::mat4 transformationMat, glm::mat4 inverseMat, int nodeOffset, int isectOffset)
+	: transformationMat(transformationMat), inverseMat(inverseMat), nodeOffset(nodeOffset), isectOffset(isectOffset),
+	  dummy0(0), dummy1(0)
+{
+}
+
+GpuTopLevelBVH::GpuTopLevelBVH(prims::GpuTriangleList *staticList, std::vector<GameObject *> *gameObjects,
+							   const BVHBuildConfig &config, ctpl::ThreadPool *pool)
+	: m_Config(config), m_ThreadPool(pool), m_StaticList(staticList), m_GameObjects(gameObjects)
+{
+	// the static scene is always the first mesh and gets an identity instance
+	AddMesh(m_StaticList);
+	for (GameObject *gameObject : *m_GameObjects)
+		AddMeshes(gameObject);
+
+	UpdateInstances();
+}
+
+GpuTopLevelBVH::~GpuTopLevelBVH()
+{
+	for (auto *tree : m_MBVHTrees)
+		delete tree;
+	for (auto *tree : m_BVHTrees)
+		delete tree;
+}
+
+void GpuTopLevelBVH::UpdateInstances()
+{
+	std::vector<GpuInstance> instances;
+	std::vector<AABB> aabbs;
+
+	const Mesh &staticMesh = m_Meshes.at(m_StaticList);
+	instances.emplace_back(glm::mat4(1.f), glm::mat4(1.f), staticMesh.nodeOffset, staticMesh.isectOffset);
+	aabbs.push_back(staticMesh.bounds);
+
+	for (GameObject *gameObject : *m_GameObjects)
+		FlattenGameObjects(gameObject, gameObject->m_TransformationMat, gameObject->m_InverseMat, instances, aabbs);
+
+	const auto instanceCount = static_cast<unsigned int>(instances.size());
+	std::vector<unsigned int> indices(instanceCount);
+	for (unsigned int i = 0; i < instanceCount; i++)
+		indices[i] = i;
+
+	m_TLASNodes.clear();
+	m_TLASNodes.reserve(instanceCount * 2);
+	m_TLASNodes.emplace_back();
+	Subdivide(0, 0, instanceCount, 0, aabbs, indices);
+
+	// store instances in leaf order so TLAS leaves can index them directly
+	m_Instances.resize(instanceCount);
+	for (unsigned int i = 0; i < instanceCount; i++)
+		m_Instances[i] = instances[indices[i]];
+}
+
+void GpuTopLevelBVH::AddMesh(prims::GpuTriangleList *mesh)
+{
+	if (m_Meshes.find(mesh) != m_Meshes.end())
+		return;
+
+	if (mesh->GetPrimitiveCount() == 0)
+		utils::FatalError(__FILE__, __LINE__, "Cannot instance an empty mesh.", "GpuTopLevelBVH");
+
+	auto *bvhTree = new StaticBVHTree(mesh, m_Config, m_ThreadPool);
+	bvhTree->ConstructBVH();
+	auto *mbvhTree = new MBVHTree(bvhTree);
+	m_BVHTrees.push_back(bvhTree);
+	m_MBVHTrees.push_back(mbvhTree);
+
+	Mesh m{};
+	m.nodeOffset = static_cast<int>(m_MBVHNodes.size());
+	m.isectOffset = static_cast<int>(m_Isects.size());
+	m.bounds.Reset();
+	for (const auto &aabb : mesh->GetAABBs())
+		m.bounds.Grow(aabb);
+
+	// lights are only sampled from the static scene since light sampling has no notion of instances
+	const auto triangleOffset = static_cast<unsigned int>(m_Triangles.GetTriangles().size());
+	const auto &triangles = mesh->GetTriangles();
+	std::vector<bool> isLight(triangles.size(), false);
+	if (mesh == m_StaticList)
+	{
+		for (const auto idx : mesh->GetLightIndices())
+			isLight[idx] = true;
+	}
+
+	// the vertices of the mesh follow the ones already merged
+	const unsigned int vertexOffset = m_Triangles.GetAttributes().Append(mesh->GetAttributes());
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		prims::GpuTriangle triangle = triangles[i];
+		triangle.v0 += vertexOffset;
+		triangle.v1 += vertexOffset;
+		triangle.v2 += vertexOffset;
+		if (isLight[i])
+			m_Triangles.AddLight(triangle);
+		else
+			m_Triangles.AddTriangle(triangle);
+	}
+
+	// BLAS leaves index the intersection triangles relative to their mesh,
+	// the primitive index stored in them points into the combined triangle list
+	for (auto isect : mesh->GetIsectTriangles(bvhTree->m_PrimitiveIndices))
+	{
+		isect.primIdx += triangleOffset;
+		m_Isects.push_back(isect);
+	}
+
+	m_MBVHNodes.insert(m_MBVHNodes.end(), mbvhTree->m_Tree.begin(), mbvhTree->m_Tree.end());
+
+	m_Meshes[mesh] = m;
+}
+
+void GpuTopLevelBVH::AddMeshes(GameObject *currentObject)
+{
+	if (currentObject->IsLeaf())
+	{
+		auto *mesh = dynamic_cast<prims::GpuTriangleList *>(currentObject->m_BVHTree);
+		if (mesh == nullptr)
+			utils::FatalError(__FILE__, __LINE__, "GPU game objects need to reference a GpuTriangleList.",
+							  "GpuTopLevelBVH");
+		AddMesh(mesh);
+	}
+	else
+	{
+		for (GameObject *gameObject : *currentObject->m_Children)
+			AddMeshes(gameObject);
+	}
+}
+
+void GpuTopLevelBVH::FlattenGameObjects(GameObject *currentObject, glm::mat4 currentTransform,
+										glm::mat4 currentInverse, std::vector<GpuInstance> &instances,
+										std::vector<AABB> &aabbs) const
+{
+	// same transform accumulation as TopLevelBVH so both renderers show the same scene
+	if (currentObject->IsLeaf())
+	{
+		const Mesh &mesh = m_Meshes.at(currentObject->m_BVHTree);
+		const glm::mat4 transformationMat = currentObject->m_TransformationMat * currentTransform;
+		const glm::mat4 inverseMat = currentInverse * currentObject->m_InverseMat;
+
+		instances.emplace_back(transformationMat, inverseMat, mesh.nodeOffset, mesh.isectOffset);
+		aabbs.push_back(TransformBounds(mesh.bounds, inverseMat));
+	}
+	else
+	{
+		for (GameObject *gameObject : *currentObject->m_Children)
+		{
+			FlattenGameObjects(gameObject, gameObject->m_TransformationMat * currentTransform,
+							   currentInverse * gameObject->m_InverseMat, instances, aabbs);
+		}
+	}
+}
+
+void GpuTopLevelBVH::Subdivide(unsigned int nodeIdx, unsigned int first, unsigned int count, unsigned int depth,
+							   const std::vector<AABB> &aabbs, std::vector<unsigned int> &indices)
+{
+	AABB bounds, centroidBounds;
+	bounds.Reset();
+	centroidBounds.Reset();
+	for (unsigned int i = first; i < first + count; i++)
+	{
+		bounds.Grow(aabbs[indices[i]]);
+		centroidBounds.Grow(aabbs[indices[i]].Centroid());
+	}
+
+	m_TLASNodes[nodeIdx].bounds = bounds;
+	// median splits only get this deep past a billion instances, larger leaves are still traversed correctly
+	if (count <= TLAS_LEAF_SIZE || depth >= TLAS_MAX_DEPTH)
+	{
+		m_TLASNodes[nodeIdx].SetLeftFirst(first);
+		m_TLASNodes[nodeIdx].SetCount(static_cast<int>(count));
+		return;
+	}
+
+	// a median split is good enough for the handful of instances in a scene
+	const int axis = centroidBounds.LongestAxis();
+	const unsigned int half = count / 2;
+	std::nth_element(indices.begin() + first, indices.begin() + first + half, indices.begin() + first + count,
+					 [&aabbs, axis](unsigned int a, unsigned int b) {
+						 return aabbs[a].Centroid()[axis] < aabbs[b].Centroid()[axis];
+					 });
+
+	const auto left = static_cast<unsigned int>(m_TLASNodes.size());
+	m_TLASNodes[nodeIdx].SetLeftFirst(left);
+	m_TLASNodes[nodeIdx].SetCount(-1);
+	m_TLASNodes.emplace_back();
+	m_TLASNodes.emplace_back();
+
+	Subdivide(left, first, half, depth + 1, aabbs, indices);
+	Subdivide(left + 1, first + half, count - half, depth + 1, aabbs, indices);
+}
+
+AABB GpuTopLevelBVH::TransformBounds(const AABB &bounds, const glm::mat4 &matrix)
+{
+	AABB result;
+	result.Reset();
+	for (int i = 0; i < 8; i++)
+	{
+		const glm::vec4 corner = glm::vec4((i & 1) ? bounds.bmax[0] : bounds.bmin[0],
+										   (i & 2) ? bounds.bmax[1] : bounds.bmin[1],
+										   (i & 4) ? bounds.bmax[2] : bounds.bmin[2], 1.f);
+		result.Grow(glm::vec3(matrix * corner));
+	}
+
+	const glm::vec3 min = glm::vec3(result.bmin[0], result.bmin[1], result.bmin[2]);
+	const glm::vec3 max = glm::vec3(result.bmax[0], result.bmax[1], result.bmax[2]);
+	return {min - EPSILON, max + EPSILON};
+}
+} // namespace bvh
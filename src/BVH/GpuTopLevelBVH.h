@@ -0,0 +1,95 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "BVH/AABB.h"
+#include "BVH/BVHNode.h"
+#include "BVH/GameObject.h"
+#include "BVH/MBVHNode.h"
+#include "Primitives/GpuTriangleList.h"
+#include "Utils/ctpl.h"
+
+namespace bvh
+{
+class MBVHTree;
+class StaticBVHTree;
+
+// Device copy of a GameObjectNode, needs to match Instance in programs/instance.cl
+struct GpuInstance
+{
+	glm::mat4 transformationMat; // world to object, 64
+	glm::mat4 inverseMat;		 // object to world, 128
+	int nodeOffset;				 // 132
+	int isectOffset;			 // 136
+	int dummy0, dummy1;			 // 144
+
+	GpuInstance() = default;
+	GpuInstance(glm::mat4 transformationMat, glm::mat4 inverseMat, int nodeOffset, int isectOffset);
+};
+
+// Two-level acceleration structure for the GPU tracer.
+// Every mesh gets its own MBVH (BLAS), all of them are stored back to back in a single node and triangle list.
+// Leaf GameObjects referencing a mesh become instances, a small BVH over the instances (TLAS) is rebuilt every update.
+class GpuTopLevelBVH
+{
+  public:
+	// config is used for the BLAS of every mesh
+	GpuTopLevelBVH(prims::GpuTriangleList *staticList, std::vector<GameObject *> *gameObjects,
+				   const BVHBuildConfig &config, ctpl::ThreadPool *pool = nullptr);
+	~GpuTopLevelBVH();
+
+	// Flattens the GameObjects into instances and rebuilds the TLAS over their world space bounds
+	void UpdateInstances();
+
+	// All meshes concatenated, triangle indices stored in the intersection triangles point into this list
+	inline prims::GpuTriangleList *GetTriangleList() { return &m_Triangles; }
+
+	inline const std::vector<MBVHNode> &GetMBVHNodes() const { return m_MBVHNodes; }
+
+	inline const std::vector<prims::GpuTriangleIsect> &GetIsects() const { return m_Isects; }
+
+	// Instances are stored in TLAS leaf order
+	inline const std::vector<GpuInstance> &GetInstances() const { return m_Instances; }
+
+	inline const std::vector<BVHNode> &GetTLASNodes() const { return m_TLASNodes; }
+
+  private:
+	struct Mesh
+	{
+		int nodeOffset;
+		int isectOffset;
+		AABB bounds;
+	};
+
+	void AddMesh(prims::GpuTriangleList *mesh);
+
+	void AddMeshes(GameObject *currentObject);
+
+	void FlattenGameObjects(GameObject *currentObject, glm::mat4 currentTransform, glm::mat4 currentInverse,
+							std::vector<GpuInstance> &instances, std::vector<AABB> &aabbs) const;
+
+	void Subdivide(unsigned int nodeIdx, unsigned int first, unsigned int count, unsigned int depth,
+				   const std::vector<AABB> &aabbs, std::vector<unsigned int> &indices);
+
+	static AABB TransformBounds(const AABB &bounds, const glm::mat4 &matrix);
+
+	BVHBuildConfig m_Config{};
+	ctpl::ThreadPool *m_ThreadPool = nullptr;
+	prims::GpuTriangleList *m_StaticList = nullptr;
+	std::vector<GameObject *> *m_GameObjects = nullptr;
+
+	std::map<const prims::WorldScene *, Mesh> m_Meshes;
+	std::vector<StaticBVHTree *> m_BVHTrees;
+	std::vector<MBVHTree *> m_MBVHTrees;
+
+	prims::GpuTriangleList m_Triangles;
+	std::vector<MBVHNode> m_MBVHNodes;
+	std::vector<prims::GpuTriangleIsect> m_Isects;
+
+	std::vector<GpuInstance> m_Instances;
+	std::vector<BVHNode> m_TLASNodes;
+};
+} // namespace bvh
@@ -0,0 +1,225 @@
+#include "BVH/LBVHBuilder.h"
+
+#include <cstring>
+
+#include "BVH/MBVHNode.h"
+#include "Primitives/GpuTriangleList.h"
+#include "Utils/Timer.h"
+
+// these need to match the defines in programs/lbvh.cl
+#define RADIX_BITS 4
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define SORT_BLOCK 64
+#define SCAN_GROUP_SIZE 256
+#define LBVH_NODE_SIZE 48
+
+using namespace cl;
+
+namespace bvh
+{
+static int FloatToOrderedInt(float f)
+{
+	int i;
+	memcpy(&i, &f, sizeof(float));
+	return i >= 0 ? i : i ^ 0x7FFFFFFF;
+}
+
+LBVHBuilder::LBVHBuilder(cl::Buffer *triangleBuffer, unsigned int primCount, const BVHBuildConfig &config)
+	: m_Config(config), m_Triangles(triangleBuffer), m_PrimCount(primCount)
+{
+	const unsigned int n = glm::max(primCount, 1u);
+	m_BlockCount = (n + SORT_BLOCK - 1) / SORT_BLOCK;
+
+	m_SceneBounds = new Buffer(8 * sizeof(int));
+	m_Codes[0] = new Buffer(n * sizeof(unsigned int));
+	m_Codes[1] = new Buffer(n * sizeof(unsigned int));
+	m_PrimIndices[0] = new Buffer(n * sizeof(unsigned int));
+	m_PrimIndices[1] = new Buffer(n * sizeof(unsigned int));
+	m_Histograms = new Buffer(m_BlockCount * RADIX_SIZE * sizeof(unsigned int));
+	m_Nodes = new Buffer((2 * n - 1) * LBVH_NODE_SIZE);
+	m_Parents = new Buffer((2 * n - 1) * sizeof(int));
+	m_Flags = new Buffer(n * sizeof(unsigned int));
+	m_Tasks[0] = new Buffer(n * 2 * sizeof(int));
+	m_Tasks[1] = new Buffer(n * 2 * sizeof(int));
+	m_Counters = new Buffer(2 * sizeof(unsigned int));
+	m_MBVHNodes = new Buffer(n * sizeof(MBVHNode));
+	m_Isects = new Buffer(n * sizeof(prims::GpuTriangleIsect));
+
+	const auto workSize = std::tuple<size_t, size_t, size_t>(n, 1, 1);
+	const auto localSize = std::tuple<size_t, size_t, size_t>(1, 1, 1);
+	m_BoundsKernel = new Kernel("programs/lbvh.cl", "computeBounds", workSize, localSize);
+	m_MortonKernel = new Kernel("programs/lbvh.cl", "computeMortonCodes", workSize, localSize);
+	m_HistogramKernel = new Kernel("programs/lbvh.cl", "radixHistogram", workSize, localSize);
+	m_ScanKernel = new Kernel("programs/lbvh.cl", "radixScan", workSize, localSize);
+	m_ScatterKernel = new Kernel("programs/lbvh.cl", "radixScatter", workSize, localSize);
+	m_HierarchyKernel = new Kernel("programs/lbvh.cl", "emitHierarchy", workSize, localSize);
+	m_RefitKernel = new Kernel("programs/lbvh.cl", "refitBounds", workSize, localSize);
+	m_CollapseKernel = new Kernel("programs/lbvh.cl", "collapseMBVH", workSize, localSize);
+	m_IsectKernel = new Kernel("programs/lbvh.cl", "emitIsects", workSize, localSize);
+
+	const int primCountArg = static_cast<int>(m_PrimCount);
+	const int blockCountArg = static_cast<int>(m_BlockCount);
+
+	m_BoundsKernel->SetArgument(0, m_Triangles);
+	m_BoundsKernel->SetArgument(1, m_SceneBounds);
+	m_BoundsKernel->SetArgument(2, primCountArg);
+
+	m_MortonKernel->SetArgument(0, m_Triangles);
+	m_MortonKernel->SetArgument(1, m_SceneBounds);
+	m_MortonKernel->SetArgument(2, m_Codes[0]);
+	m_MortonKernel->SetArgument(3, m_PrimIndices[0]);
+	m_MortonKernel->SetArgument(4, primCountArg);
+
+	m_HistogramKernel->SetArgument(1, m_Histograms);
+	m_HistogramKernel->SetArgument(2, primCountArg);
+	m_HistogramKernel->SetArgument(4, blockCountArg);
+
+	m_ScanKernel->SetArgument(0, m_Histograms);
+	m_ScanKernel->SetArgument(1, blockCountArg * RADIX_SIZE);
+
+	m_ScatterKernel->SetArgument(4, m_Histograms);
+	m_ScatterKernel->SetArgument(5, primCountArg);
+	m_ScatterKernel->SetArgument(7, blockCountArg);
+
+	// an even number of passes leaves the sorted keys in m_Codes[0] and m_PrimIndices[0]
+	m_HierarchyKernel->SetArgument(0, m_Codes[0]);
+	m_HierarchyKernel->SetArgument(1, m_Nodes);
+	m_HierarchyKernel->SetArgument(2, m_Parents);
+	m_HierarchyKernel->SetArgument(3, primCountArg);
+
+	m_RefitKernel->SetArgument(0, m_Triangles);
+	m_RefitKernel->SetArgument(1, m_PrimIndices[0]);
+	m_RefitKernel->SetArgument(2, m_Nodes);
+	m_RefitKernel->SetArgument(3, m_Parents);
+	m_RefitKernel->SetArgument(4, m_Flags);
+	m_RefitKernel->SetArgument(5, primCountArg);
+
+	m_CollapseKernel->SetArgument(0, m_Nodes);
+	m_CollapseKernel->SetArgument(1, m_MBVHNodes);
+	m_CollapseKernel->SetArgument(4, m_Counters);
+
+	m_IsectKernel->SetArgument(0, m_Triangles);
+	m_IsectKernel->SetArgument(1, m_PrimIndices[0]);
+	m_IsectKernel->SetArgument(2, m_Isects);
+	m_IsectKernel->SetArgument(3, primCountArg);
+}
+
+LBVHBuilder::~LBVHBuilder()
+{
+	delete m_BoundsKernel;
+	delete m_MortonKernel;
+	delete m_HistogramKernel;
+	delete m_ScanKernel;
+	delete m_ScatterKernel;
+	delete m_HierarchyKernel;
+	delete m_RefitKernel;
+	delete m_CollapseKernel;
+	delete m_IsectKernel;
+
+	delete m_SceneBounds;
+	delete m_Codes[0];
+	delete m_Codes[1];
+	delete m_PrimIndices[0];
+	delete m_PrimIndices[1];
+	delete m_Histograms;
+	delete m_Nodes;
+	delete m_Parents;
+	delete m_Flags;
+	delete m_Tasks[0];
+	delete m_Tasks[1];
+	delete m_Counters;
+	delete m_MBVHNodes;
+	delete m_Isects;
+}
+
+void LBVHBuilder::Build()
+{
+	if (m_PrimCount == 0)
+		return;
+
+	utils::Timer t{};
+
+	// scene bounds of all triangle centroids, stored as ints so they can be updated atomically
+	int *bounds = m_SceneBounds->GetHostPtr<int>();
+	for (int i = 0; i < 3; i++)
+	{
+		bounds[i] = FloatToOrderedInt(1e34f);
+		bounds[i + 3] = FloatToOrderedInt(-1e34f);
+	}
+	m_SceneBounds->CopyToDevice(false);
+
+	m_BoundsKernel->Run(m_PrimCount);
+	m_MortonKernel->Run(m_PrimCount);
+
+	SortMortonCodes();
+
+	if (m_PrimCount > 1)
+		m_HierarchyKernel->Run(m_PrimCount - 1);
+
+	m_Flags->Clear();
+	m_RefitKernel->Run(m_PrimCount);
+
+	Collapse();
+
+	m_IsectKernel->Run(m_PrimCount);
+	Kernel::SyncQueue();
+
+	if (m_Config.printBuildTime)
+		std::cout << "Building MBVH on device took: " << t.elapsed() << " ms." << std::endl;
+}
+
+void LBVHBuilder::SortMortonCodes()
+{
+	// LSD radix sort of the 30-bit Morton codes, primitive indices are moved along as values
+	for (int pass = 0; pass < 32 / RADIX_BITS; pass++)
+	{
+		const int shift = pass * RADIX_BITS;
+		const int in = pass & 1;
+		const int out = 1 - in;
+
+		m_HistogramKernel->SetArgument(0, m_Codes[in]);
+		m_HistogramKernel->SetArgument(3, shift);
+		m_HistogramKernel->Run(m_BlockCount);
+
+		m_ScanKernel->Run(SCAN_GROUP_SIZE, SCAN_GROUP_SIZE);
+
+		m_ScatterKernel->SetArgument(0, m_Codes[in]);
+		m_ScatterKernel->SetArgument(1, m_PrimIndices[in]);
+		m_ScatterKernel->SetArgument(2, m_Codes[out]);
+		m_ScatterKernel->SetArgument(3, m_PrimIndices[out]);
+		m_ScatterKernel->SetArgument(6, shift);
+		m_ScatterKernel->Run(m_BlockCount);
+	}
+}
+
+void LBVHBuilder::Collapse()
+{
+	// the root of the LBVH becomes MBVH node 0, every iteration collapses one level of the tree
+	int *task = m_Tasks[0]->GetHostPtr<int>();
+	task[0] = 0;
+	task[1] = 0;
+	m_Tasks[0]->CopyToDevice();
+
+	unsigned int *counters = m_Counters->GetHostPtr<unsigned int>();
+	counters[1] = 1;
+
+	int taskCount = 1;
+	int in = 0;
+	while (taskCount > 0)
+	{
+		counters[0] = 0;
+		m_Counters->CopyToDevice();
+
+		m_CollapseKernel->SetArgument(2, m_Tasks[in]);
+		m_CollapseKernel->SetArgument(3, m_Tasks[1 - in]);
+		m_CollapseKernel->SetArgument(5, taskCount);
+		m_CollapseKernel->Run(static_cast<size_t>(taskCount));
+
+		m_Counters->CopyFromDevice();
+		taskCount = static_cast<int>(counters[0]);
+		in = 1 - in;
+	}
+
+	m_NodeCount = counters[1];
+}
+} // namespace bvh
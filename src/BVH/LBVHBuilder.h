@@ -0,0 +1,59 @@
+#pragma once
+
+#include "BVH/BVHBuildConfig.h"
+#include "CL/Buffer.h"
+#include "CL/OpenCL.h"
+
+namespace bvh
+{
+// Builds an MBVH on the OpenCL device directly from a buffer of GpuTriangles:
+// Morton codes, radix sort, LBVH hierarchy emission, bottom-up bounds and a collapse to MBVHNodes.
+class LBVHBuilder
+{
+  public:
+	// only printBuildTime of the config applies, the layout of the tree is fixed by the kernels
+	LBVHBuilder(cl::Buffer *triangleBuffer, unsigned int primCount, const BVHBuildConfig &config);
+	~LBVHBuilder();
+
+	// (Re)builds the tree from the current device contents of the triangle buffer
+	void Build();
+
+	inline cl::Buffer *GetMBVHNodes() { return m_MBVHNodes; }
+
+	inline cl::Buffer *GetTriangleIsects() { return m_Isects; }
+
+	inline unsigned int GetNodeCount() const { return m_NodeCount; }
+
+  private:
+	void SortMortonCodes();
+	void Collapse();
+
+	BVHBuildConfig m_Config;
+	cl::Buffer *m_Triangles = nullptr;
+	unsigned int m_PrimCount = 0;
+	unsigned int m_BlockCount = 0;
+	unsigned int m_NodeCount = 0;
+
+	cl::Buffer *m_SceneBounds = nullptr;
+	cl::Buffer *m_Codes[2] = {nullptr, nullptr};
+	cl::Buffer *m_PrimIndices[2] = {nullptr, nullptr};
+	cl::Buffer *m_Histograms = nullptr;
+	cl::Buffer *m_Nodes = nullptr;
+	cl::Buffer *m_Parents = nullptr;
+	cl::Buffer *m_Flags = nullptr;
+	cl::Buffer *m_Tasks[2] = {nullptr, nullptr};
+	cl::Buffer *m_Counters = nullptr;
+	cl::Buffer *m_MBVHNodes = nullptr;
+	cl::Buffer *m_Isects = nullptr;
+
+	cl::Kernel *m_BoundsKernel = nullptr;
+	cl::Kernel *m_MortonKernel = nullptr;
+	cl::Kernel *m_HistogramKernel = nullptr;
+	cl::Kernel *m_ScanKernel = nullptr;
+	cl::Kernel *m_ScatterKernel = nullptr;
+	cl::Kernel *m_HierarchyKernel = nullptr;
+	cl::Kernel *m_RefitKernel = nullptr;
+	cl::Kernel *m_CollapseKernel = nullptr;
+	cl::Kernel *m_IsectKernel = nullptr;
+};
+} // namespace bvh
@@ -0,0 +1,343 @@
+#include "BVH/LightBVH.h"
+
+#include <algorithm>
+
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#define BUCKET_COUNT 12
+#define MEDIAN_SPLIT_DEPTH 32 // below this depth splits are balanced so a trail always fits in 64 bits
+
+namespace bvh
+{
+using namespace glm;
+
+static inline float SafeSqrt(float v) { return sqrtf(glm::max(v, 0.0f)); }
+
+static inline float SafeACos(float v) { return acosf(glm::clamp(v, -1.0f, 1.0f)); }
+
+// cos(max(0, a - b)) from the sines and cosines of a and b
+static inline float CosSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+	if (cosA > cosB)
+		return 1.0f;
+	return cosA * cosB + sinA * sinB;
+}
+
+// sin(max(0, a - b)) from the sines and cosines of a and b
+static inline float SinSubClamped(float sinA, float cosA, float sinB, float cosB)
+{
+	if (cosA > cosB)
+		return 0.0f;
+	return sinA * cosB - cosA * sinB;
+}
+
+static void UnionCones(const vec3 &axisA, float cosA, const vec3 &axisB, float cosB, vec3 &axis, float &cosTheta)
+{
+	const float thetaA = SafeACos(cosA);
+	const float thetaB = SafeACos(cosB);
+	const float thetaD = SafeACos(dot(axisA, axisB));
+
+	// one cone contains the other
+	if (glm::min(thetaD + thetaB, pi<float>()) <= thetaA)
+	{
+		axis = axisA, cosTheta = cosA;
+		return;
+	}
+	if (glm::min(thetaD + thetaA, pi<float>()) <= thetaB)
+	{
+		axis = axisB, cosTheta = cosB;
+		return;
+	}
+
+	const float thetaO = (thetaA + thetaD + thetaB) * 0.5f;
+	const vec3 rotationAxis = cross(axisA, axisB);
+	if (thetaO >= pi<float>() || dot(rotationAxis, rotationAxis) == 0.0f)
+	{
+		axis = axisA, cosTheta = -1.0f;
+		return;
+	}
+
+	// rotate the axis of a towards b so the new cone just contains both
+	axis = angleAxis(thetaO - thetaA, normalize(rotationAxis)) * axisA;
+	cosTheta = cosf(thetaO);
+}
+
+// Solid angle measure of the directions a set of lights emits into, see Conty & Kulla
+static float OrientationMeasure(float cosThetaO, float cosThetaE)
+{
+	const float thetaO = SafeACos(cosThetaO);
+	const float thetaE = SafeACos(cosThetaE);
+	const float thetaW = glm::min(thetaO + thetaE, pi<float>());
+	const float sinThetaO = SafeSqrt(1.0f - cosThetaO * cosThetaO);
+	return two_pi<float>() * (1.0f - cosThetaO) +
+		   half_pi<float>() * (2.0f * thetaW * sinThetaO - cosf(thetaO - 2.0f * thetaW) -
+							   2.0f * thetaO * sinThetaO + cosThetaO);
+}
+
+static inline float SurfaceArea(const vec3 &bmin, const vec3 &bmax)
+{
+	const vec3 d = bmax - bmin;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+LightBounds LightBounds::Union(const LightBounds &a, const LightBounds &b)
+{
+	if (a.phi <= 0.0f)
+		return b;
+	if (b.phi <= 0.0f)
+		return a;
+
+	LightBounds result;
+	result.bmin = glm::min(a.bmin, b.bmin);
+	result.bmax = glm::max(a.bmax, b.bmax);
+	UnionCones(a.axis, a.cosThetaO, b.axis, b.cosThetaO, result.axis, result.cosThetaO);
+	result.cosThetaE = glm::min(a.cosThetaE, b.cosThetaE);
+	result.phi = a.phi + b.phi;
+	return result;
+}
+
+void LightBVH::Build(const std::vector<LightBounds> &lights)
+{
+	m_Nodes.clear();
+	m_Trails.assign(lights.size(), 0);
+	if (lights.empty())
+		return;
+
+	m_Lights = &lights;
+	std::vector<unsigned int> indices(lights.size());
+	for (unsigned int i = 0; i < indices.size(); i++)
+		indices[i] = i;
+
+	m_Nodes.reserve(lights.size() * 2 - 1);
+	m_Nodes.emplace_back();
+	Subdivide(0, indices, 0, static_cast<unsigned int>(indices.size()), 0, 0);
+	m_Lights = nullptr;
+}
+
+void LightBVH::Subdivide(unsigned int nodeIdx, std::vector<unsigned int> &indices, unsigned int first,
+						 unsigned int count, uint64_t trail, int depth)
+{
+	const std::vector<LightBounds> &lights = *m_Lights;
+
+	LightBounds bounds = lights[indices[first]];
+	vec3 centroidMin = (bounds.bmin + bounds.bmax) * 0.5f, centroidMax = centroidMin;
+	for (unsigned int i = first + 1; i < first + count; i++)
+	{
+		const LightBounds &light = lights[indices[i]];
+		const vec3 centroid = (light.bmin + light.bmax) * 0.5f;
+		bounds = LightBounds::Union(bounds, light);
+		centroidMin = glm::min(centroidMin, centroid);
+		centroidMax = glm::max(centroidMax, centroid);
+	}
+
+	LightNode &node = m_Nodes[nodeIdx];
+	node.bmin = bounds.bmin, node.bmax = bounds.bmax;
+	node.axis = bounds.axis, node.cosThetaO = bounds.cosThetaO, node.cosThetaE = bounds.cosThetaE;
+	node.phi = bounds.phi;
+	node.firstChild = -1, node.lightIdx = -1;
+	node.dummy0 = node.dummy1 = 0;
+
+	if (count == 1)
+	{
+		node.lightIdx = static_cast<int>(indices[first]);
+		m_Trails[indices[first]] = trail;
+		return;
+	}
+
+	// surface area orientation heuristic over buckets of light centroids
+	int bestAxis = -1, bestBucket = -1;
+	float bestCost = 1e34f;
+	const vec3 extent = bounds.bmax - bounds.bmin;
+	const float maxExtent = glm::max(extent.x, glm::max(extent.y, extent.z));
+	for (int axis = 0; axis < 3 && depth < MEDIAN_SPLIT_DEPTH; axis++)
+	{
+		const float centroidExtent = centroidMax[axis] - centroidMin[axis];
+		if (centroidExtent <= 0.0f)
+			continue;
+
+		LightBounds buckets[BUCKET_COUNT];
+		bool used[BUCKET_COUNT] = {};
+		for (unsigned int i = first; i < first + count; i++)
+		{
+			const LightBounds &light = lights[indices[i]];
+			const float centroid = (light.bmin[axis] + light.bmax[axis]) * 0.5f;
+			const int b =
+				glm::min(int(BUCKET_COUNT * (centroid - centroidMin[axis]) / centroidExtent), BUCKET_COUNT - 1);
+			buckets[b] = used[b] ? LightBounds::Union(buckets[b], light) : light;
+			used[b] = true;
+		}
+
+		// long thin nodes are penalized along their short axes
+		const float kr = maxExtent / glm::max(extent[axis], 1e-6f);
+		for (int split = 0; split < BUCKET_COUNT - 1; split++)
+		{
+			LightBounds left{}, right{};
+			bool hasLeft = false, hasRight = false;
+			for (int b = 0; b <= split; b++)
+			{
+				if (!used[b])
+					continue;
+				left = hasLeft ? LightBounds::Union(left, buckets[b]) : buckets[b];
+				hasLeft = true;
+			}
+			for (int b = split + 1; b < BUCKET_COUNT; b++)
+			{
+				if (!used[b])
+					continue;
+				right = hasRight ? LightBounds::Union(right, buckets[b]) : buckets[b];
+				hasRight = true;
+			}
+			if (!hasLeft || !hasRight)
+				continue;
+
+			const float leftCost =
+				left.phi * OrientationMeasure(left.cosThetaO, left.cosThetaE) * SurfaceArea(left.bmin, left.bmax);
+			const float rightCost =
+				right.phi * OrientationMeasure(right.cosThetaO, right.cosThetaE) * SurfaceArea(right.bmin, right.bmax);
+			const float cost = kr * (leftCost + rightCost);
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestBucket = split;
+			}
+		}
+	}
+
+	auto begin = indices.begin() + first;
+	auto end = begin + count;
+	auto middle = begin + count / 2;
+	if (bestAxis >= 0)
+	{
+		const float centroidExtent = centroidMax[bestAxis] - centroidMin[bestAxis];
+		middle = std::partition(begin, end, [&](unsigned int idx) {
+			const float centroid = (lights[idx].bmin[bestAxis] + lights[idx].bmax[bestAxis]) * 0.5f;
+			const int b = glm::min(int(BUCKET_COUNT * (centroid - centroidMin[bestAxis]) / centroidExtent),
+								   BUCKET_COUNT - 1);
+			return b <= bestBucket;
+		});
+	}
+
+	if (middle == begin || middle == end)
+	{
+		// no useful split, fall back to a median split along the longest axis
+		int axis = 0;
+		const vec3 centroidExtent = centroidMax - centroidMin;
+		if (centroidExtent.y > centroidExtent[axis])
+			axis = 1;
+		if (centroidExtent.z > centroidExtent[axis])
+			axis = 2;
+		middle = begin + count / 2;
+		std::nth_element(begin, middle, end, [&](unsigned int a, unsigned int b) {
+			return lights[a].bmin[axis] + lights[a].bmax[axis] < lights[b].bmin[axis] + lights[b].bmax[axis];
+		});
+	}
+
+	const auto leftCount = static_cast<unsigned int>(middle - begin);
+	const auto firstChild = static_cast<unsigned int>(m_Nodes.size());
+	m_Nodes[nodeIdx].firstChild = static_cast<int>(firstChild);
+	m_Nodes.emplace_back();
+	m_Nodes.emplace_back();
+
+	Subdivide(firstChild, indices, first, leftCount, trail, depth + 1);
+	Subdivide(firstChild + 1, indices, first + leftCount, count - leftCount, trail | (uint64_t(1) << depth), depth + 1);
+}
+
+int LightBVH::Sample(const vec3 &p, const vec3 &n, float r, float &pmf) const
+{
+	pmf = 0.0f;
+	if (m_Nodes.empty() || Importance(m_Nodes[0], p, n) <= 0.0f)
+		return -1;
+
+	float probability = 1.0f;
+	int nodeIdx = 0;
+	while (!m_Nodes[nodeIdx].IsLeaf())
+	{
+		const int child = m_Nodes[nodeIdx].firstChild;
+		const float importance0 = Importance(m_Nodes[child], p, n);
+		const float importance1 = Importance(m_Nodes[child + 1], p, n);
+		if (importance0 <= 0.0f && importance1 <= 0.0f)
+			return -1;
+
+		// reuse the random number, remapped to [0, 1) within the chosen child
+		const float p0 = importance0 / (importance0 + importance1);
+		if (r < p0)
+		{
+			r = glm::min(r / p0, 0.99999994f);
+			probability *= p0;
+			nodeIdx = child;
+		}
+		else
+		{
+			r = glm::min((r - p0) / (1.0f - p0), 0.99999994f);
+			probability *= 1.0f - p0;
+			nodeIdx = child + 1;
+		}
+	}
+
+	pmf = probability;
+	return m_Nodes[nodeIdx].lightIdx;
+}
+
+float LightBVH::Pmf(const vec3 &p, const vec3 &n, unsigned int lightIdx) const
+{
+	if (m_Nodes.empty() || Importance(m_Nodes[0], p, n) <= 0.0f)
+		return 0.0f;
+
+	uint64_t trail = m_Trails[lightIdx];
+	float probability = 1.0f;
+	int nodeIdx = 0;
+	while (!m_Nodes[nodeIdx].IsLeaf())
+	{
+		const int child = m_Nodes[nodeIdx].firstChild;
+		const float importance0 = Importance(m_Nodes[child], p, n);
+		const float importance1 = Importance(m_Nodes[child + 1], p, n);
+		if (importance0 <= 0.0f && importance1 <= 0.0f)
+			return 0.0f;
+
+		nodeIdx = child + int(trail & 1u);
+		probability *= (trail & 1u ? importance1 : importance0) / (importance0 + importance1);
+		trail >>= 1u;
+	}
+
+	return probability;
+}
+
+float LightBVH::Importance(const LightNode &node, const vec3 &p, const vec3 &n)
+{
+	const vec3 center = (node.bmin + node.bmax) * 0.5f;
+	const vec3 toPoint = p - center;
+	const float distance2 = dot(toPoint, toPoint);
+	const float radius2 = dot(node.bmax - center, node.bmax - center);
+	const vec3 wi = distance2 > 0.0f ? toPoint / sqrtf(distance2) : node.axis;
+
+	// angle between the cone axis and the direction to p, reduced by the spread of the normals
+	const float cosThetaW = dot(node.axis, wi);
+	const float sinThetaW = SafeSqrt(1.0f - cosThetaW * cosThetaW);
+	const float sinThetaO = SafeSqrt(1.0f - node.cosThetaO * node.cosThetaO);
+	const float cosThetaX = CosSubClamped(sinThetaW, cosThetaW, sinThetaO, node.cosThetaO);
+	const float sinThetaX = SinSubClamped(sinThetaW, cosThetaW, sinThetaO, node.cosThetaO);
+
+	// and by the angle the bounds subtend as seen from p
+	const float cosThetaB = distance2 < radius2 ? -1.0f : SafeSqrt(1.0f - radius2 / distance2);
+	const float sinThetaB = SafeSqrt(1.0f - cosThetaB * cosThetaB);
+	const float cosThetaP = CosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+	if (cosThetaP <= node.cosThetaE)
+		return 0.0f;
+
+	// clamped so nodes containing p don't blow up
+	const float d2 = glm::max(distance2, sqrtf(radius2));
+	float importance = node.phi * cosThetaP / d2;
+
+	if (n != vec3(0.0f))
+	{
+		// the light has to be above the surface at p
+		const float cosThetaI = dot(-wi, n);
+		const float sinThetaI = SafeSqrt(1.0f - cosThetaI * cosThetaI);
+		importance *= CosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+	}
+
+	return glm::max(importance, 0.0f);
+}
+} // namespace bvh
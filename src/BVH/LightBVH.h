@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace bvh
+{
+// Spatial and directional bounds of one or more emitters
+struct LightBounds
+{
+	glm::vec3 bmin, bmax;
+	glm::vec3 axis;	 // center of the cone containing all surface normals
+	float cosThetaO; // spread of the normals around the axis
+	float cosThetaE; // emission falloff beyond the normals, 0 for one-sided area lights
+	float phi;		 // emitted power
+
+	static LightBounds Union(const LightBounds &a, const LightBounds &b);
+};
+
+// Needs to match LightNode in programs/light.cl
+struct LightNode
+{
+	glm::vec3 bmin; // 12
+	float phi;		// 16
+
+	glm::vec3 bmax;	 // 28
+	float cosThetaO; // 32
+
+	glm::vec3 axis;	 // 44
+	float cosThetaE; // 48
+
+	int firstChild; // children are stored next to each other, -1 for leaves
+	int lightIdx;	// index of the light in a leaf, -1 for interior nodes
+	int dummy0, dummy1; // 64
+
+	inline bool IsLeaf() const { return firstChild < 0; }
+};
+
+// Light hierarchy with orientation cones (Conty & Kulla, "Importance Sampling of Many Lights with Adaptive Tree
+// Splitting"). Every leaf holds one light, traversal picks a child proportional to an estimate of how much it
+// contributes to the shading point, so far away and back facing lights are rarely sampled.
+class LightBVH
+{
+  public:
+	LightBVH() = default;
+
+	void Build(const std::vector<LightBounds> &lights);
+
+	// Picks a light for shading point p with normal n, n may be 0 to skip the cosine at the receiver.
+	// Returns -1 if no light can contribute.
+	int Sample(const glm::vec3 &p, const glm::vec3 &n, float r, float &pmf) const;
+
+	// Probability of Sample returning lightIdx for shading point p
+	float Pmf(const glm::vec3 &p, const glm::vec3 &n, unsigned int lightIdx) const;
+
+	static float Importance(const LightNode &node, const glm::vec3 &p, const glm::vec3 &n);
+
+	inline const std::vector<LightNode> &GetNodes() const { return m_Nodes; }
+
+	// Path from the root to every light, bit i is set if the light is in the second child at depth i
+	inline const std::vector<uint64_t> &GetTrails() const { return m_Trails; }
+
+	inline bool IsEmpty() const { return m_Nodes.empty(); }
+
+  private:
+	void Subdivide(unsigned int nodeIdx, std::vector<unsigned int> &indices, unsigned int first, unsigned int count,
+				   uint64_t trail, int depth);
+
+	const std::vector<LightBounds> *m_Lights = nullptr;
+	std::vector<LightNode> m_Nodes;
+	std::vector<uint64_t> m_Trails;
+};
+} // namespace bvh
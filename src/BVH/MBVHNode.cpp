@@ -1,6 +1,7 @@
 #include "BVH/MBVHNode.h"
 #include "BVH/MBVHTree.h"
 #include "Utils/Messages.h"
+#include "Utils/Stats.h"
 
 namespace bvh
 {
@@ -125,8 +126,11 @@ static const __m128 zerops = _mm_set1_ps(EPSILON);
 void MBVHNode::Intersect(core::Ray &r, const __m128 &dirx4, const __m128 &diry4, const __m128 &dirz4,
 						 const __m128 &orgx4, const __m128 &orgy4, const __m128 &orgz4, const MBVHNode *pool,
 						 const std::vector<unsigned int> &primitiveIndices,
-						 const std::vector<prims::SceneObject *> &objectList) const
+						 const std::vector<prims::SceneObject *> &objectList,
+						 utils::stats::TraversalCounts &counts) const
 {
+	counts.nodeVisits++;
+
 	union {
 		__m128 tmin4;
 		float tmin[4];
@@ -202,6 +206,7 @@ void MBVHNode::Intersect(core::Ray &r, const __m128 &dirx4, const __m128 &diry4,
 			}
 			if (this->count[idx] > -1)
 			{ // leaf node
+				counts.primitiveTests += this->count[idx];
 				for (int i = 0; i < this->count[idx]; i++)
 				{
 					const uint &primIdx = primitiveIndices[i + this->child[idx]];
@@ -211,13 +216,13 @@ void MBVHNode::Intersect(core::Ray &r, const __m128 &dirx4, const __m128 &diry4,
 			else
 			{
 				pool[this->child[idx]].Intersect(r, dirx4, diry4, dirz4, orgx4, orgy4, orgz4, pool, primitiveIndices,
-												 objectList);
+												 objectList, counts);
 			}
 		}
 	}
 }
 
-void MBVHNode::MergeNodes(const BVHNode &node, const BVHNode *bvhPool, MBVHTree *bvhTree)
+void MBVHNode::MergeNode(const BVHNode &node, const std::vector<BVHNode> &bvhPool)
 {
 	int numChildren;
 	GetBVHNodeInfo(node, bvhPool, numChildren);
@@ -231,17 +236,8 @@ void MBVHNode::MergeNodes(const BVHNode &node, const BVHNode *bvhPool, MBVHTree
 			{
 				this->count[idx] = curNode.GetCount();
 				this->child[idx] = curNode.GetLeftFirst();
-				this->SetBounds(idx, curNode.bounds);
-			}
-			else
-			{
-				const uint newIdx = bvhTree->m_FinalPtr++;
-				MBVHNode &newNode = bvhTree->m_Tree[newIdx];
-				this->child[idx] = newIdx; // replace BVHNode idx with MBVHNode idx
-				this->count[idx] = -1;
-				this->SetBounds(idx, curNode.bounds);
-				newNode.MergeNodes(curNode, bvhPool, bvhTree);
 			}
+			this->SetBounds(idx, curNode.bounds);
 		}
 	}
 
@@ -253,169 +249,6 @@ void MBVHNode::MergeNodes(const BVHNode &node, const BVHNode *bvhPool, MBVHTree
 	}
 }
 
-void MBVHNode::MergeNodesMT(const BVHNode &node, const BVHNode *bvhPool, MBVHTree *bvhTree, bool thread)
-{
-	int numChildren;
-	GetBVHNodeInfo(node, bvhPool, numChildren);
-
-	int threadCount = 0;
-	std::vector<std::future<void>> threads{};
-
-	// invalidate any remaining children
-	for (int idx = numChildren; idx < 4; idx++)
-	{
-		this->SetBounds(idx, vec3(1e34f), vec3(-1e34f));
-		this->count[idx] = 0;
-	}
-
-	for (int idx = 0; idx < numChildren; idx++)
-	{
-		if (this->count[idx] == -1)
-		{ // not a leaf
-			const BVHNode *curNode = &bvhPool[this->child[idx]];
-
-			if (curNode->IsLeaf())
-			{
-				this->count[idx] = curNode->GetCount();
-				this->child[idx] = curNode->GetLeftFirst();
-				this->SetBounds(idx, curNode->bounds);
-				continue;
-			}
-
-			bvhTree->m_PoolPtrMutex.lock();
-			const auto newIdx = bvhTree->m_FinalPtr++;
-			bvhTree->m_PoolPtrMutex.unlock();
-
-			MBVHNode *newNode = &bvhTree->m_Tree[newIdx];
-			this->child[idx] = newIdx; // replace BVHNode idx with MBVHNode idx
-			this->count[idx] = -1;
-			this->SetBounds(idx, curNode->bounds);
-
-			if (bvhTree->m_ThreadLimitReached || !thread)
-			{
-				newNode->MergeNodesMT(*curNode, bvhPool, bvhTree, !thread);
-			}
-			else
-			{
-				bvhTree->m_ThreadMutex.lock();
-				bvhTree->m_BuildingThreads++;
-				if (bvhTree->m_BuildingThreads > ctpl::nr_of_cores)
-					bvhTree->m_ThreadLimitReached = true;
-				bvhTree->m_ThreadMutex.unlock();
-
-				threadCount++;
-				threads.push_back(bvhTree->m_OriginalTree->m_ThreadPool->push(
-					[newNode, curNode, bvhPool, bvhTree](int) { newNode->MergeNodesMT(*curNode, bvhPool, bvhTree); }));
-			}
-		}
-	}
-
-	for (int i = 0; i < threadCount; i++)
-	{
-		threads[i].get();
-	}
-}
-
-void MBVHNode::MergeNodes(const bvh::BVHNode &node, const std::vector<bvh::BVHNode> &bvhPool, bvh::MBVHTree *bvhTree)
-{
-	int numChildren;
-	GetBVHNodeInfo(node, bvhPool, numChildren);
-
-	for (int idx = 0; idx < numChildren; idx++)
-	{
-		if (this->count[idx] == -1)
-		{ // not a leaf
-			const BVHNode &curNode = bvhPool[this->child[idx]];
-			if (curNode.IsLeaf())
-			{
-				this->count[idx] = curNode.GetCount();
-				this->child[idx] = curNode.GetLeftFirst();
-				this->SetBounds(idx, curNode.bounds);
-			}
-			else
-			{
-				const uint newIdx = bvhTree->m_FinalPtr++;
-				MBVHNode &newNode = bvhTree->m_Tree[newIdx];
-				this->child[idx] = newIdx; // replace BVHNode idx with MBVHNode idx
-				this->count[idx] = -1;
-				this->SetBounds(idx, curNode.bounds);
-				newNode.MergeNodes(curNode, bvhPool, bvhTree);
-			}
-		}
-	}
-
-	// invalidate any remaining children
-	for (int idx = numChildren; idx < 4; idx++)
-	{
-		this->SetBounds(idx, vec3(1e34f), vec3(-1e34f));
-		this->count[idx] = 0;
-	}
-}
-
-void MBVHNode::MergeNodesMT(const bvh::BVHNode &node, const std::vector<bvh::BVHNode> &bvhPool, MBVHTree *bvhTree,
-							bool thread)
-{
-	int numChildren;
-	GetBVHNodeInfo(node, bvhPool, numChildren);
-
-	int threadCount = 0;
-	std::vector<std::future<void>> threads{};
-
-	// Invalidate any remaining children
-	for (int idx = numChildren; idx < 4; idx++)
-	{
-		this->SetBounds(idx, vec3(1e34f), vec3(-1e34f));
-		this->count[idx] = 0;
-	}
-
-	for (int idx = 0; idx < numChildren; idx++)
-	{
-		if (this->count[idx] == -1)
-		{ // not a leaf
-			const BVHNode *curNode = &bvhPool[this->child[idx]];
-
-			if (curNode->IsLeaf())
-			{
-				this->count[idx] = curNode->GetCount();
-				this->child[idx] = curNode->GetLeftFirst();
-				this->SetBounds(idx, curNode->bounds);
-				continue;
-			}
-
-			bvhTree->m_PoolPtrMutex.lock();
-			const auto newIdx = bvhTree->m_FinalPtr++;
-			bvhTree->m_PoolPtrMutex.unlock();
-
-			MBVHNode *newNode = &bvhTree->m_Tree[newIdx];
-			this->child[idx] = newIdx; // replace BVHNode idx with MBVHNode idx
-			this->count[idx] = -1;
-			this->SetBounds(idx, curNode->bounds);
-
-			if (bvhTree->m_ThreadLimitReached || !thread)
-			{
-				newNode->MergeNodesMT(*curNode, bvhPool, bvhTree, !thread);
-			}
-			else
-			{
-				bvhTree->m_ThreadMutex.lock();
-				bvhTree->m_BuildingThreads++;
-				if (bvhTree->m_BuildingThreads > ctpl::nr_of_cores)
-					bvhTree->m_ThreadLimitReached = true;
-				bvhTree->m_ThreadMutex.unlock();
-
-				threadCount++;
-				threads.push_back(bvhTree->m_OriginalTree->m_ThreadPool->push(
-					[newNode, curNode, bvhPool, bvhTree](int) { newNode->MergeNodesMT(*curNode, bvhPool, bvhTree); }));
-			}
-		}
-	}
-
-	for (int i = 0; i < threadCount; i++)
-	{
-		threads[i].get();
-	}
-}
-
 void MBVHNode::GetBVHNodeInfo(const BVHNode &node, const BVHNode *pool, int &numChildren)
 {
 	// Starting values
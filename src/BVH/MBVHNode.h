@@ -69,20 +69,14 @@ class MBVHNode
 	void Intersect(core::Ray &r, const __m128 &dirX, const __m128 &dirY, const __m128 &dirZ, const __m128 &orgX,
 				   const __m128 &orgY, const __m128 &orgZ, const bvh::MBVHNode *pool,
 				   const std::vector<unsigned int> &primitiveIndices,
-				   const std::vector<prims::SceneObject *> &objectList) const;
+				   const std::vector<prims::SceneObject *> &objectList, utils::stats::TraversalCounts &counts) const;
 
 	MBVHHit Intersect(core::Ray &r, const __m128 &dirX, const __m128 &dirY, const __m128 &dirZ, const __m128 &orgX,
 					  const __m128 &orgY, const __m128 &orgZ) const;
 
-	void MergeNodes(const bvh::BVHNode &node, const bvh::BVHNode *bvhPool, bvh::MBVHTree *bvhTree);
-
-	void MergeNodesMT(const bvh::BVHNode &node, const bvh::BVHNode *bvhPool, bvh::MBVHTree *bvhTree,
-					  bool thread = true);
-
-	void MergeNodes(const bvh::BVHNode &node, const std::vector<bvh::BVHNode> &bvhPool, bvh::MBVHTree *bvhTree);
-
-	void MergeNodesMT(const bvh::BVHNode &node, const std::vector<bvh::BVHNode> &bvhPool, bvh::MBVHTree *bvhTree,
-					  bool thread = true);
+	// Takes the up to 4 grandchildren of node as children. Interior children keep their index in bvhPool,
+	// MBVHTree replaces it by the index of their MBVH node.
+	void MergeNode(const bvh::BVHNode &node, const std::vector<bvh::BVHNode> &bvhPool);
 
 	void GetBVHNodeInfo(const bvh::BVHNode &node, const bvh::BVHNode *pool, int &numChildren);
 
@@ -1,12 +1,10 @@
 #include "MBVHTree.h"
 #include "MBVHNode.h"
+#include "Utils/Stats.h"
+#include "Utils/Timeline.h"
+#include "Utils/Timer.h"
 
-#define PRINT_BUILD_TIME 1
-#define THREADING 0
-
-#if PRINT_BUILD_TIME
-#include <Utils/Timer.h>
-#endif
+#define COLLAPSE_GRAIN 4096u // smallest subtree, in MBVH nodes, that is collapsed by a task of its own
 
 namespace bvh
 {
@@ -31,8 +29,10 @@ void MBVHTree::Traverse(core::Ray &r) const
 		const __m128 orgy4 = _mm_set1_ps(r.origin.y);
 		const __m128 orgz4 = _mm_set1_ps(r.origin.z);
 
+		utils::stats::TraversalCounts counts;
 		m_Tree[0].Intersect(r, dirx4, diry4, dirz4, orgx4, orgy4, orgz4, m_Tree.data(), m_PrimitiveIndices,
-							m_ObjectList->GetObjects());
+							m_ObjectList->GetObjects(), counts);
+		utils::stats::Add(counts);
 	}
 }
 
@@ -58,40 +58,130 @@ unsigned int MBVHTree::TraverseDebug(core::Ray &r) const
 void MBVHTree::ConstructBVH()
 {
 	m_Tree.clear();
-	m_Tree.resize(m_OriginalTree->m_PrimitiveCount * 2);
+	m_FinalPtr = 0;
+	m_CanUseBVH = false;
 	if (this->m_OriginalTree->GetPrimitiveCount() > 0)
 	{
-#if PRINT_BUILD_TIME
+		utils::timeline::ScopedEvent event("collapse MBVH", "bvh");
 		utils::Timer t{};
-#endif
-		m_FinalPtr = 1;
-		MBVHNode &mRootNode = m_Tree[0];
-		BVHNode &curNode = m_OriginalTree->GetNode(0);
-#if THREADING // threading is not actually faster here
-		// Only use threading when we have a large number of primitives,
-		// otherwise threading is actually slower
-		if (m_OriginalTree->m_ThreadPool != nullptr && m_OriginalTree->GetPrimitiveCount() >= 250000)
+		const BVHBuildConfig &config = m_OriginalTree->m_Config;
+		const std::vector<BVHNode> &bvhPool = m_OriginalTree->m_BVHPool;
+		const BVHNode &rootNode = bvhPool[0];
+
+		if (rootNode.IsLeaf())
 		{
-			m_ThreadLimitReached = false;
-			m_BuildingThreads = 0;
-			mRootNode.MergeNodesMT(curNode, this->m_OriginalTree->m_BVHPool, this);
+			// a single leaf still needs a node to be traversed
+			m_Tree.resize(1);
+			MBVHNode &node = m_Tree[0];
+			node.child[0] = rootNode.GetLeftFirst();
+			node.count[0] = rootNode.GetCount();
+			node.SetBounds(0, rootNode.bounds);
+			for (int idx = 1; idx < 4; idx++)
+			{
+				node.child[idx] = -1;
+				node.count[idx] = 0;
+				node.SetBounds(idx, vec3(1e34f), vec3(-1e34f));
+			}
 		}
 		else
 		{
-			mRootNode.MergeNodes(curNode, this->m_OriginalTree->m_BVHPool, this);
+			// with the size of every subtree known up front, nodes are written to their final place right away
+			// and subtrees can be collapsed in parallel without any locking
+			std::vector<unsigned int> sizes(bvhPool.size(), 0);
+			const unsigned int nodeCount = CountNodes(0, sizes);
+			m_Tree.resize(nodeCount);
+
+			// a few tasks per thread, small trees are not worth the overhead
+			ctpl::ThreadPool *pool = config.threading ? m_OriginalTree->m_ThreadPool : nullptr;
+			if (nodeCount < 2 * COLLAPSE_GRAIN)
+				pool = nullptr;
+			const unsigned int grain = glm::max(nodeCount / (4u * ctpl::nr_of_cores), COLLAPSE_GRAIN);
+
+			std::vector<std::future<void>> tasks;
+			Collapse(0, 0, sizes, pool, grain, tasks);
+			for (auto &task : tasks)
+				task.get();
 		}
-#else
-		mRootNode.MergeNodes(curNode, this->m_OriginalTree->m_BVHPool, this);
-#endif
-		m_Bounds = m_OriginalTree->GetNode(0).bounds;
 
-#if PRINT_BUILD_TIME
-		std::cout << "Building MBVH took: " << t.elapsed() << " ms." << std::endl;
-#endif
+		m_FinalPtr = static_cast<unsigned int>(m_Tree.size());
+		m_Bounds = rootNode.bounds;
+
+		if (config.printBuildTime)
+			std::cout << "Building MBVH took: " << t.elapsed() << " ms." << std::endl;
 		m_CanUseBVH = true;
 	}
 }
 
+unsigned int MBVHTree::CountNodes(int binaryIdx, std::vector<unsigned int> &sizes) const
+{
+	const std::vector<BVHNode> &bvhPool = m_OriginalTree->m_BVHPool;
+	const BVHNode &node = bvhPool[binaryIdx];
+
+	// the grandchildren become the children of this node, every interior one becomes a node of its own
+	unsigned int size = 1;
+	for (int i = 0; i < 2; i++)
+	{
+		const BVHNode &child = bvhPool[node.GetLeftFirst() + i];
+		if (child.IsLeaf())
+			continue;
+
+		for (int j = 0; j < 2; j++)
+		{
+			const int grandChild = child.GetLeftFirst() + j;
+			if (!bvhPool[grandChild].IsLeaf())
+				size += CountNodes(grandChild, sizes);
+		}
+	}
+
+	sizes[binaryIdx] = size;
+	return size;
+}
+
+void MBVHTree::Collapse(int binaryIdx, unsigned int index, const std::vector<unsigned int> &sizes,
+						ctpl::ThreadPool *pool, unsigned int grain, std::vector<std::future<void>> &tasks)
+{
+	if (pool != nullptr && sizes[binaryIdx] <= grain)
+	{
+		// tasks never wait for other tasks, so the pool cannot run out of threads
+		tasks.push_back(pool->push([this, binaryIdx, index, &sizes](int) {
+			utils::timeline::ScopedEvent event("collapse subtree", "bvh");
+			std::vector<std::future<void>> none;
+			Collapse(binaryIdx, index, sizes, nullptr, 0, none);
+		}));
+		return;
+	}
+
+	const std::vector<BVHNode> &bvhPool = m_OriginalTree->m_BVHPool;
+	MBVHNode &node = m_Tree[index];
+	node.MergeNode(bvhPool[binaryIdx], bvhPool);
+
+	// interior children by surface area, the largest one is the most likely to be visited next
+	int order[4];
+	float area[4];
+	int interior = 0;
+	for (int idx = 0; idx < 4; idx++)
+	{
+		if (node.count[idx] != -1)
+			continue;
+
+		area[idx] = bvhPool[node.child[idx]].bounds.Area();
+		int i = interior++;
+		for (; i > 0 && area[order[i - 1]] < area[idx]; i--)
+			order[i] = order[i - 1];
+		order[i] = idx;
+	}
+
+	unsigned int next = index + 1;
+	for (int i = 0; i < interior; i++)
+	{
+		const int idx = order[i];
+		const int child = node.child[idx];
+		node.child[idx] = static_cast<int>(next); // replace BVHNode idx with MBVHNode idx
+		Collapse(child, next, sizes, pool, grain, tasks);
+		next += sizes[child];
+	}
+}
+
 static const __m128 QuadOne = _mm_set1_ps(1.f);
 
 void MBVHTree::TraceRay(core::Ray &r) const
@@ -121,6 +211,7 @@ void MBVHTree::TraceRay(core::Ray &r) const
 		if (r.IsValid())
 		{
 			r.normal = r.obj->GetNormal(r.GetHitpoint());
+			r.geometricNormal = r.obj->GetGeometricNormal(r.GetHitpoint());
 		}
 	}
 }
@@ -223,6 +314,7 @@ void MBVHTree::TraverseWithStack(core::Ray &r) const
 	todo[0].leftFirst = 0;
 	todo[0].count = -1;
 	const std::vector<prims::SceneObject *> &objects = m_ObjectList->GetObjects();
+	utils::stats::TraversalCounts counts;
 
 	while (stackptr >= 0)
 	{
@@ -230,6 +322,7 @@ void MBVHTree::TraverseWithStack(core::Ray &r) const
 		stackptr--;
 		if (mTodo.count > -1)
 		{ // leaf node
+			counts.primitiveTests += mTodo.count;
 			for (int i = 0; i < mTodo.count; i++)
 			{
 				const int &primIdx = m_PrimitiveIndices[mTodo.leftFirst + i];
@@ -238,6 +331,7 @@ void MBVHTree::TraverseWithStack(core::Ray &r) const
 		}
 		else
 		{
+			counts.nodeVisits++;
 			const MBVHNode &n = this->m_Tree[mTodo.leftFirst];
 			mHit = m_Tree[mTodo.leftFirst].Intersect(r, dirx4, diry4, dirz4, orgx4, orgy4, orgz4);
 			if (mHit.result > 0)
@@ -255,5 +349,7 @@ void MBVHTree::TraverseWithStack(core::Ray &r) const
 			}
 		}
 	}
+
+	utils::stats::Add(counts);
 }
 } // namespace bvh
\ No newline at end of file
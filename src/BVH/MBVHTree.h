@@ -54,9 +54,12 @@ class MBVHTree : public prims::WorldScene
 	unsigned int TraceDebug(core::Ray &r) const override;
 
   private:
-	std::mutex m_PoolPtrMutex{};
-	std::mutex m_ThreadMutex{};
-	unsigned int m_BuildingThreads = 0;
-	bool m_ThreadLimitReached = false;
+	// Number of MBVH nodes the subtree of an interior node of the original tree collapses to
+	unsigned int CountNodes(int binaryIdx, std::vector<unsigned int> &sizes) const;
+
+	// Collapses the subtree of binaryIdx into the nodes from index on, depth first with the child of the largest
+	// surface area right after its parent. With a pool, subtrees of up to grain nodes are collapsed by tasks.
+	void Collapse(int binaryIdx, unsigned int index, const std::vector<unsigned int> &sizes, ctpl::ThreadPool *pool,
+				  unsigned int grain, std::vector<std::future<void>> &tasks);
 };
 } // namespace bvh
\ No newline at end of file
@@ -1,32 +1,59 @@
 #include "StaticBVHTree.h"
+#include "BVH/BVHTuning.h"
 #include "Primitives/GpuTriangleList.h"
+#include "Utils/Messages.h"
+#include "Utils/Timeline.h"
 #include "Utils/Timer.h"
 
-#define PRINT_BUILD_TIME 1
-#define THREADING 1
-
 namespace bvh
 {
 bvh::StaticBVHTree::StaticBVHTree(prims::SceneObjectList *objectList, BVHType type, ctpl::ThreadPool *pool)
+	: StaticBVHTree(objectList, BVHBuildConfig(type), pool)
+{
+}
+
+bvh::StaticBVHTree::StaticBVHTree(prims::GpuTriangleList *objectList, BVHType type, ctpl::ThreadPool *pool)
+	: StaticBVHTree(objectList, BVHBuildConfig(type), pool)
+{
+}
+
+bvh::StaticBVHTree::StaticBVHTree(prims::SceneObjectList *objectList, const BVHBuildConfig &config,
+								  ctpl::ThreadPool *pool)
 {
 	this->m_ObjectList = objectList;
-	this->m_Type = type;
+	this->m_Config = config;
 	this->m_ThreadPool = pool;
 	Reset();
 }
 
-bvh::StaticBVHTree::StaticBVHTree(prims::GpuTriangleList *objectList, BVHType type, ctpl::ThreadPool *pool)
+bvh::StaticBVHTree::StaticBVHTree(prims::GpuTriangleList *objectList, const BVHBuildConfig &config,
+								  ctpl::ThreadPool *pool)
 {
 	this->m_TriangleList = objectList;
-	this->m_Type = type;
+	this->m_Config = config;
 	this->m_ThreadPool = pool;
 	ResetGPU();
 }
 
+bvh::StaticBVHTree::StaticBVHTree(prims::SceneObjectList *objectList, std::vector<unsigned int> primitiveIndices,
+								  const BVHBuildConfig &config, ctpl::ThreadPool *pool)
+{
+	this->m_ObjectList = objectList;
+	this->m_Config = config;
+	this->m_ThreadPool = pool;
+	this->m_PrimitiveIndices = std::move(primitiveIndices);
+	this->m_PrimitiveCount = m_PrimitiveIndices.size();
+	m_BVHPool.resize(m_PrimitiveCount * 2);
+}
+
 void bvh::StaticBVHTree::ConstructBVH()
 {
 	if (this->m_ObjectList != nullptr)
 	{
+		// candidates are traced on the CPU, which needs the objects of a list
+		if (m_Config.autoTune)
+			m_Config = TuneBuildConfig(*this);
+
 		m_AABBs = m_ObjectList->GetAABBs();
 		BuildBVH();
 		return;
@@ -34,6 +61,10 @@ void bvh::StaticBVHTree::ConstructBVH()
 
 	if (this->m_TriangleList != nullptr)
 	{
+		if (m_Config.autoTune)
+			utils::WarningMessage(__FILE__, __LINE__, "Auto-tuning needs a scene object list, using the given config.",
+								  "BVH");
+
 		m_AABBs = m_TriangleList->GetAABBs();
 		BuildBVH();
 	}
@@ -46,18 +77,15 @@ void bvh::StaticBVHTree::BuildBVH()
 
 	if (m_PrimitiveCount > 0)
 	{
-#if PRINT_BUILD_TIME
+		utils::timeline::ScopedEvent event("build BVH", "bvh");
 		utils::Timer t;
-		t.reset();
-#endif
 		this->m_PoolPtr = 2;
 		auto &rootNode = m_BVHPool[0];
 		rootNode.bounds.leftFirst = 0; // setting first
 		rootNode.bounds.count = static_cast<int>(m_PrimitiveCount);
 		rootNode.CalculateBounds(m_AABBs, m_PrimitiveIndices);
 
-#if THREADING
-		if (m_ThreadPool != nullptr)
+		if (m_Config.threading && m_ThreadPool != nullptr)
 		{
 			rootNode.SubdivideMT(m_AABBs, this, 1);
 		}
@@ -65,9 +93,6 @@ void bvh::StaticBVHTree::BuildBVH()
 		{
 			rootNode.Subdivide(m_AABBs, this, 1);
 		}
-#else
-		rootNode.Subdivide(m_AABBs, this, 1);
-#endif
 
 		if (m_PoolPtr > 2)
 		{
@@ -79,9 +104,8 @@ void bvh::StaticBVHTree::BuildBVH()
 			rootNode.bounds.count = static_cast<int>(m_PrimitiveCount);
 		}
 
-#if PRINT_BUILD_TIME
-		std::cout << "Building BVH took: " << t.elapsed() << " ms." << std::endl;
-#endif
+		if (m_Config.printBuildTime)
+			std::cout << "Building BVH took: " << t.elapsed() << " ms." << std::endl;
 		CanUseBVH = true;
 	}
 }
@@ -120,7 +144,9 @@ void bvh::StaticBVHTree::TraceRay(core::Ray &r) const
 	{
 		if (m_BVHPool[0].IntersectSIMD(r))
 		{
-			m_BVHPool[0].Traverse(r, m_ObjectList->GetObjects(), this);
+			utils::stats::TraversalCounts counts;
+			m_BVHPool[0].Traverse(r, m_ObjectList->GetObjects(), this, counts);
+			utils::stats::Add(counts);
 		}
 	}
 	else
@@ -128,7 +154,11 @@ void bvh::StaticBVHTree::TraceRay(core::Ray &r) const
 		m_ObjectList->TraceRay(r);
 	}
 
-	r.normal = r.obj->GetNormal(r.GetHitpoint());
+	if (r.IsValid())
+	{
+		r.normal = r.obj->GetNormal(r.GetHitpoint());
+		r.geometricNormal = r.obj->GetGeometricNormal(r.GetHitpoint());
+	}
 }
 
 bool bvh::StaticBVHTree::TraceShadowRay(core::Ray &r, float tMax) const
@@ -137,7 +167,9 @@ bool bvh::StaticBVHTree::TraceShadowRay(core::Ray &r, float tMax) const
 	{
 		if (m_BVHPool[0].IntersectSIMD(r))
 		{
-			m_BVHPool[0].Traverse(r, m_ObjectList->GetObjects(), this);
+			utils::stats::TraversalCounts counts;
+			m_BVHPool[0].Traverse(r, m_ObjectList->GetObjects(), this, counts);
+			utils::stats::Add(counts);
 		}
 	}
 	else
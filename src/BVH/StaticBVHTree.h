@@ -26,12 +26,19 @@ class StaticBVHTree : public prims::WorldScene
 
 	explicit StaticBVHTree(prims::SceneObjectList *objectList, BVHType type = SAH, ctpl::ThreadPool *pool = nullptr);
 	explicit StaticBVHTree(prims::GpuTriangleList *objectList, BVHType type = SAH, ctpl::ThreadPool *pool = nullptr);
+	StaticBVHTree(prims::SceneObjectList *objectList, const BVHBuildConfig &config, ctpl::ThreadPool *pool = nullptr);
+	StaticBVHTree(prims::GpuTriangleList *objectList, const BVHBuildConfig &config, ctpl::ThreadPool *pool = nullptr);
+
+	// Tree over a subset of the primitives of the list, e.g. a sample to tune the config on
+	StaticBVHTree(prims::SceneObjectList *objectList, std::vector<unsigned int> primitiveIndices,
+				  const BVHBuildConfig &config, ctpl::ThreadPool *pool = nullptr);
 	StaticBVHTree() = default;
 
 	void ConstructBVH() override;
 	void BuildBVH();
 	void Reset();
 	void ResetGPU();
+
 	BVHNode &GetNode(unsigned int idx);
 	void TraceRay(core::Ray &r) const override;
 	bool TraceShadowRay(core::Ray &r, float tMax) const override;
@@ -42,6 +49,11 @@ class StaticBVHTree : public prims::WorldScene
 
 	unsigned int TraceDebug(core::Ray &r) const override;
 
+	inline BVHType GetType() const { return m_Config.type; }
+
+	// The tuned config after an auto-tuned build
+	inline const BVHBuildConfig &GetConfig() const { return m_Config; }
+
   public:
 	std::vector<BVHNode> m_BVHPool;
 	std::vector<unsigned int> m_PrimitiveIndices;
@@ -52,7 +64,7 @@ class StaticBVHTree : public prims::WorldScene
 	unsigned int m_PoolPtr = 0;
 
   private:
-	BVHType m_Type = SAH;
+	BVHBuildConfig m_Config{};
 	ctpl::ThreadPool *m_ThreadPool = nullptr;
 	std::mutex m_PoolPtrMutex{};
 	std::mutex m_ThreadMutex{};
@@ -1,14 +1,28 @@
 #include "BVH/TopLevelBVH.h"
 #include "BVH/GameObjectNode.h"
 #include "Core/Renderer.h"
+#include "Utils/Stats.h"
+#include "Utils/Timeline.h"
 #include "Utils/Timer.h"
 
 namespace bvh
 {
 TopLevelBVH::TopLevelBVH(prims::SceneObjectList *staticObjectList, std::vector<GameObject *> *gObjectList, BVHType type,
 						 ctpl::ThreadPool *tPool)
+	: TopLevelBVH(staticObjectList, gObjectList, BVHBuildConfig(type), tPool)
 {
-	this->m_Type = type;
+}
+
+TopLevelBVH::TopLevelBVH(prims::WorldScene *staticTree, prims::SceneObjectList *staticObjectList,
+						 std::vector<GameObject *> *gObjectList, BVHType type, ctpl::ThreadPool *tPool)
+	: TopLevelBVH(staticTree, staticObjectList, gObjectList, BVHBuildConfig(type), tPool)
+{
+}
+
+TopLevelBVH::TopLevelBVH(prims::SceneObjectList *staticObjectList, std::vector<GameObject *> *gObjectList,
+						 const BVHBuildConfig &config, ctpl::ThreadPool *tPool)
+{
+	this->m_Config = config;
 	this->m_ThreadPool = tPool;
 	this->m_StaticObjectList = staticObjectList;
 	this->gameObjectList = gObjectList;
@@ -18,9 +32,10 @@ TopLevelBVH::TopLevelBVH(prims::SceneObjectList *staticObjectList, std::vector<G
 }
 
 TopLevelBVH::TopLevelBVH(prims::WorldScene *staticTree, prims::SceneObjectList *staticObjectList,
-						 std::vector<GameObject *> *gObjectList, BVHType type, ctpl::ThreadPool *tPool)
+						 std::vector<GameObject *> *gObjectList, const BVHBuildConfig &config,
+						 ctpl::ThreadPool *tPool)
 {
-	this->m_Type = type;
+	this->m_Config = config;
 	this->m_ThreadPool = tPool;
 	this->m_StaticBVHTree = staticTree;
 	this->m_StaticObjectList = staticObjectList;
@@ -74,7 +89,11 @@ void TopLevelBVH::IntersectDynamic(core::Ray &r) const
 		const auto &dInidices = m_DynamicIndices[m_DynamicTreeIndex];
 
 		if (dTree[0].Intersect(r))
-			dTree[0].Traverse(r, m_DynamicNodes, dTree, dInidices);
+		{
+			utils::stats::TraversalCounts counts;
+			dTree[0].Traverse(r, m_DynamicNodes, dTree, dInidices, counts);
+			utils::stats::Add(counts);
+		}
 		return; // Early out
 	}
 
@@ -94,7 +113,11 @@ void TopLevelBVH::IntersectDynamicShadow(core::Ray &r) const
 		const auto &dInidices = m_DynamicIndices[m_DynamicTreeIndex];
 
 		if (dTree[0].Intersect(r))
-			dTree[0].Traverse(r, m_DynamicNodes, dTree, dInidices);
+		{
+			utils::stats::TraversalCounts counts;
+			dTree[0].Traverse(r, m_DynamicNodes, dTree, dInidices, counts);
+			utils::stats::Add(counts);
+		}
 		return; // Early out
 	}
 
@@ -111,6 +134,8 @@ void TopLevelBVH::UpdateDynamic(core::Renderer &renderer)
 	if (m_DynamicNodes.empty())
 		return;
 
+	utils::timeline::ScopedEvent event("refit dynamic BVH", "bvh");
+	utils::stats::ScopedTimer timer(utils::stats::Stage::BVHRefit);
 	FlattenGameObjects();
 
 	BVHNode *root = &m_DynamicBVHTree[m_DynamicTreeIndex][0];
@@ -132,6 +157,7 @@ void TopLevelBVH::UpdateDynamic(BVHNode *caller)
 
 		auto l = m_ThreadPool->push([left, this](int) -> void { UpdateDynamic(left); });
 		UpdateDynamic(right);
+		utils::timeline::ScopedEvent event("wait for left child", "bvh");
 		l.get();
 
 		caller->CalculateBounds(leftIndex, m_DynamicBVHTree[m_DynamicTreeIndex]);
@@ -177,7 +203,7 @@ void TopLevelBVH::ConstructBVH()
 
 	if (!this->m_StaticBVHTree)
 	{
-		auto *staticBVH = new StaticBVHTree(m_StaticObjectList, m_Type, m_ThreadPool);
+		auto *staticBVH = new StaticBVHTree(m_StaticObjectList, m_Config, m_ThreadPool);
 		staticBVH->ConstructBVH();
 		m_StaticBVHTree = new MBVHTree(staticBVH);
 	}
@@ -210,6 +236,8 @@ void TopLevelBVH::ConstructDynamicBVH(int newIndex)
 		return;
 	}
 
+	utils::timeline::ScopedEvent event("rebuild dynamic BVH", "bvh");
+	utils::stats::ScopedTimer timer(utils::stats::Stage::BVHRebuild);
 	utils::Timer t;
 	CanUseDynamicBVH[newIndex] = false;
 	m_DynamicIndices[newIndex].clear();
@@ -230,19 +258,20 @@ void TopLevelBVH::ConstructDynamicBVH(int newIndex)
 	rootNode.CalculateBounds(aabbs, m_DynamicIndices[newIndex]);
 	m_DynamicBVHTree[newIndex].push_back(rootNode);
 
-	if (m_ThreadPool != nullptr)
+	if (m_Config.threading && m_ThreadPool != nullptr)
 	{
 		unsigned int threadCount = 0;
-		rootNode.SubdivideMT(&aabbs, &m_DynamicBVHTree[newIndex], &m_DynamicIndices[newIndex], m_ThreadPool,
-							 &m_ThreadMutex, &m_PartitionMutex, &threadCount, 1);
+		rootNode.SubdivideMT(&aabbs, &m_DynamicBVHTree[newIndex], &m_DynamicIndices[newIndex], &m_Config,
+							 m_ThreadPool, &m_ThreadMutex, &m_PartitionMutex, &threadCount, 1);
 	}
 	else
 	{
-		rootNode.Subdivide(aabbs, m_DynamicBVHTree[newIndex], m_DynamicIndices[newIndex], 1);
+		rootNode.Subdivide(aabbs, m_DynamicBVHTree[newIndex], m_DynamicIndices[newIndex], m_Config, 1);
 	}
 
 	CanUseDynamicBVH[newIndex] = true;
-	std::cout << "Building dynamic BVH took: " << t.elapsed() << "ms." << std::endl;
+	if (m_Config.printBuildTime)
+		std::cout << "Building dynamic BVH took: " << t.elapsed() << "ms." << std::endl;
 }
 
 void TopLevelBVH::FlattenGameObjects(GameObject *currentObject, mat4 currentTransform, mat4 currentInverse,
@@ -25,6 +25,14 @@ class TopLevelBVH : public prims::WorldScene
 				std::vector<GameObject *> *gameObjectList, BVHType type = SAH_BINNING,
 				ctpl::ThreadPool *tPool = nullptr);
 
+	// The static tree and the tree over the game objects are built with config, only the static one is auto-tuned
+	TopLevelBVH(prims::SceneObjectList *staticObjectList, std::vector<GameObject *> *gameObjectList,
+				const BVHBuildConfig &config, ctpl::ThreadPool *tPool = nullptr);
+
+	TopLevelBVH(prims::WorldScene *staticTree, prims::SceneObjectList *staticObjectList,
+				std::vector<GameObject *> *gameObjectList, const BVHBuildConfig &config,
+				ctpl::ThreadPool *tPool = nullptr);
+
 	~TopLevelBVH() override;
 
 	void ConstructDynamicBVH(int newDynamicTreeIndex);
@@ -43,7 +51,7 @@ class TopLevelBVH : public prims::WorldScene
 
 	const std::vector<prims::SceneObject *> &GetLights() const override;
 
-	BVHType m_Type = SAH;
+	BVHBuildConfig m_Config{};
 	ctpl::ThreadPool *m_ThreadPool = nullptr;
 	WorldScene *m_StaticBVHTree = nullptr;
 	prims::SceneObjectList *m_StaticObjectList = nullptr;
@@ -55,6 +63,11 @@ class TopLevelBVH : public prims::WorldScene
 	int GetInActiveDynamicTreeIndex();
 	std::future<void> ConstructNewDynamicBVHParallel(int newIndex);
 
+	// Active tree over m_DynamicNodes, empty without game objects
+	inline const std::vector<BVHNode> &GetDynamicTree() const { return m_DynamicBVHTree[m_DynamicTreeIndex]; }
+
+	inline const std::vector<unsigned int> &GetDynamicIndices() const { return m_DynamicIndices[m_DynamicTreeIndex]; }
+
 	AABB GetNodeBounds(unsigned int index) override;
 	uint GetPrimitiveCount() override;
 
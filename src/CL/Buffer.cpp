@@ -12,23 +12,25 @@ namespace cl
 
 void Buffer::Write(void *dst)
 {
-	auto *data = (unsigned char *)clEnqueueMapBuffer(Kernel::GetQueue(), pinnedBuffer, CL_TRUE, CL_MAP_WRITE, 0, m_Size,
+	auto *data = (unsigned char *)clEnqueueMapBuffer(m_Queue, pinnedBuffer, CL_TRUE, CL_MAP_WRITE, 0, m_Size,
 													 0, nullptr, nullptr, nullptr);
 	memcpy(data, dst, m_Size);
-	clEnqueueWriteBuffer(Kernel::GetQueue(), deviceBuffer, CL_FALSE, 0, m_Size, data, 0, nullptr, nullptr);
+	clEnqueueWriteBuffer(m_Queue, deviceBuffer, CL_FALSE, 0, m_Size, data, 0, nullptr, nullptr);
 }
 
 void Buffer::Read(void *dst)
 {
-	auto *data = (unsigned char *)clEnqueueMapBuffer(Kernel::GetQueue(), pinnedBuffer, CL_TRUE, CL_MAP_READ, 0, m_Size,
+	auto *data = (unsigned char *)clEnqueueMapBuffer(m_Queue, pinnedBuffer, CL_TRUE, CL_MAP_READ, 0, m_Size,
 													 0, nullptr, nullptr, nullptr);
-	clEnqueueReadBuffer(Kernel::GetQueue(), deviceBuffer, CL_TRUE, 0, m_Size, data, 0, nullptr, nullptr);
+	clEnqueueReadBuffer(m_Queue, deviceBuffer, CL_TRUE, 0, m_Size, data, 0, nullptr, nullptr);
 	memcpy(dst, data, m_Size);
 }
 
 Buffer::Buffer(unsigned int size, void *ptr)
 {
 	ownData = false;
+	m_Queue = Kernel::GetQueue();
+	m_Type = 0;
 	m_Size = size;
 	sizeInQuads = size / 4;
 	m_TextureID = 0; // not representing a texture
@@ -48,14 +50,13 @@ Buffer::Buffer(unsigned int size, void *ptr)
 Buffer::Buffer(gl::Texture *texture, cl::BufferType t)
 {
 	m_TextureID = texture->GetID(); // representing texture N
-	m_Size = texture->GetWidth() * texture->GetHeight() * sizeof(unsigned int);
-	sizeInQuads = m_Size / 4;
-	ownData = true;
+	m_Queue = Kernel::GetQueue();
+	m_Type = t;
 	if (Kernel::canDoInterop)
 	{
-#ifdef USE_CPU_DEVICE
-		deviceBuffer = clCreateFromGLTexture2D(Kernel::GetContext(), CL_MEM_READ_WRITE, GL_TEXTURE_2D, 0, textureID, 0);
-#else
+		m_Size = texture->GetWidth() * texture->GetHeight() * sizeof(unsigned int);
+		sizeInQuads = m_Size / 4;
+		ownData = true;
 		if (t == TARGET)
 		{
 			deviceBuffer =
@@ -66,35 +67,55 @@ Buffer::Buffer(gl::Texture *texture, cl::BufferType t)
 			deviceBuffer =
 				clCreateFromGLTexture(Kernel::GetContext(), CL_MEM_READ_ONLY, GL_TEXTURE_2D, 0, m_TextureID, 0);
 		}
-#endif
 		hostBuffer = nullptr;
 	}
 	else
 	{
-		// can't directly generate buffer from texture
-		hostBuffer = new unsigned int[sizeInQuads];
-		cl_image_format format;
-		cl_image_desc desc;
-		desc.image_type = CL_MEM_OBJECT_IMAGE2D;
-		desc.image_width = texture->GetWidth();
-		desc.image_height = texture->GetHeight();
-		desc.image_depth = 0;
-		desc.image_array_size = 0;
-		desc.image_row_pitch = 0;
-		desc.image_slice_pitch = 0;
-		desc.num_mip_levels = 0;
-		desc.num_samples = 0;
-		desc.buffer = 0;
-		format.image_channel_order = CL_RGBA;
-		format.image_channel_data_type = CL_FLOAT;
-
-		if (t == TARGET)
-			deviceBuffer = clCreateImage(Kernel::GetContext(), CL_MEM_WRITE_ONLY, &format, &desc, hostBuffer, 0);
-		else
-			deviceBuffer = clCreateImage(Kernel::GetContext(), CL_MEM_READ_WRITE, &format, &desc, hostBuffer, 0);
+		// can't directly generate buffer from texture, contents get copied through host memory
+		CreateImage(texture->GetWidth(), texture->GetHeight(), t);
 	}
 }
 
+Buffer::Buffer(unsigned int width, unsigned int height, BufferType t)
+{
+	m_TextureID = 0; // not representing a texture
+	m_Queue = Kernel::GetQueue();
+	m_Type = t;
+	CreateImage(width, height, t);
+}
+
+void Buffer::CreateImage(unsigned int width, unsigned int height, BufferType t)
+{
+	m_Width = width;
+	m_Height = height;
+	m_Size = width * height * 4 * sizeof(float);
+	sizeInQuads = m_Size / 4;
+	ownData = true;
+	hostBuffer = new unsigned int[sizeInQuads];
+
+	cl_image_format format;
+	cl_image_desc desc;
+	desc.image_type = CL_MEM_OBJECT_IMAGE2D;
+	desc.image_width = width;
+	desc.image_height = height;
+	desc.image_depth = 0;
+	desc.image_array_size = 0;
+	desc.image_row_pitch = 0;
+	desc.image_slice_pitch = 0;
+	desc.num_mip_levels = 0;
+	desc.num_samples = 0;
+	desc.buffer = 0;
+	format.image_channel_order = CL_RGBA;
+	format.image_channel_data_type = CL_FLOAT;
+
+	cl_int error;
+	if (t == TARGET)
+		deviceBuffer = clCreateImage(Kernel::GetContext(), CL_MEM_WRITE_ONLY, &format, &desc, nullptr, &error);
+	else
+		deviceBuffer = clCreateImage(Kernel::GetContext(), CL_MEM_READ_WRITE, &format, &desc, nullptr, &error);
+	CheckCL(error, __FILE__, __LINE__);
+}
+
 Buffer::~Buffer()
 {
 	if (ownData)
@@ -105,26 +126,66 @@ Buffer::~Buffer()
 
 void Buffer::CopyToDevice(bool blocking)
 {
-	CheckCL(clEnqueueWriteBuffer(Kernel::GetQueue(), deviceBuffer, blocking, 0, m_Size, hostBuffer, 0, 0, 0), __FILE__,
+	if (m_Width > 0)
+	{
+		const size_t origin[3] = {0, 0, 0};
+		const size_t region[3] = {m_Width, m_Height, 1};
+		CheckCL(clEnqueueWriteImage(m_Queue, deviceBuffer, blocking, origin, region, 0, 0, hostBuffer, 0,
+									0, 0),
+				__FILE__, __LINE__);
+		return;
+	}
+
+	CheckCL(clEnqueueWriteBuffer(m_Queue, deviceBuffer, blocking, 0, m_Size, hostBuffer, 0, 0, 0), __FILE__,
 			__LINE__);
 }
 
 void Buffer::CopyFromDevice(bool blocking)
 {
-	CheckCL(clEnqueueReadBuffer(Kernel::GetQueue(), deviceBuffer, blocking, 0, m_Size, hostBuffer, 0, 0, 0), __FILE__,
+	if (m_Width > 0)
+	{
+		const size_t origin[3] = {0, 0, 0};
+		const size_t region[3] = {m_Width, m_Height, 1};
+		CheckCL(clEnqueueReadImage(m_Queue, deviceBuffer, blocking, origin, region, 0, 0, hostBuffer, 0, 0,
+								   0),
+				__FILE__, __LINE__);
+		return;
+	}
+
+	CheckCL(clEnqueueReadBuffer(m_Queue, deviceBuffer, blocking, 0, m_Size, hostBuffer, 0, 0, 0), __FILE__,
 			__LINE__);
 }
 
+void Buffer::CopyToDevice(unsigned int offset, unsigned int size, const void *src, bool blocking)
+{
+	CheckCL(clEnqueueWriteBuffer(m_Queue, deviceBuffer, blocking, offset, size, src, 0, 0, 0), __FILE__, __LINE__);
+}
+
+void Buffer::CopyFromDevice(unsigned int offset, unsigned int size, void *dst, bool blocking)
+{
+	CheckCL(clEnqueueReadBuffer(m_Queue, deviceBuffer, blocking, offset, size, dst, 0, 0, 0), __FILE__, __LINE__);
+}
+
+void Buffer::CopyToTexture()
+{
+	if (m_TextureID == 0 || m_Width == 0)
+		return;
+
+	glBindTexture(GL_TEXTURE_2D, m_TextureID);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_Width, m_Height, GL_RGBA, GL_FLOAT, hostBuffer);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 void Buffer::CopyTo(Buffer *buffer)
 {
-	CheckCL(clEnqueueCopyBuffer(Kernel::GetQueue(), deviceBuffer, buffer->deviceBuffer, 0, 0, m_Size, 0, 0, 0),
+	CheckCL(clEnqueueCopyBuffer(m_Queue, deviceBuffer, buffer->deviceBuffer, 0, 0, m_Size, 0, 0, 0),
 			__FILE__, __LINE__);
 }
 
 void Buffer::Clear()
 {
 	unsigned int value = 0;
-	CheckCL(clEnqueueFillBuffer(Kernel::GetQueue(), deviceBuffer, &value, 4, 0, m_Size, 0, nullptr, nullptr), __FILE__,
+	CheckCL(clEnqueueFillBuffer(m_Queue, deviceBuffer, &value, 4, 0, m_Size, 0, nullptr, nullptr), __FILE__,
 			__LINE__);
 }
 } // namespace cl
\ No newline at end of file
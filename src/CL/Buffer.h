@@ -37,10 +37,12 @@ class Buffer
 {
   public:
 	// constructor / destructor
-	Buffer() : hostBuffer(0) {}
+	Buffer() : m_Queue(nullptr), hostBuffer(0) {}
 
 	Buffer(unsigned int size, void *ptr = 0);
 	Buffer(gl::Texture *texture, BufferType t = TARGET);
+	// RGBA float image without a texture, used when running headless
+	Buffer(unsigned int width, unsigned int height, BufferType t);
 
 	~Buffer();
 
@@ -50,10 +52,19 @@ class Buffer
 
 	void CopyToDevice(bool blocking = true);
 
+	// Writes size bytes from src starting at offset, for host data that may have moved since construction
+	void CopyToDevice(unsigned int offset, unsigned int size, const void *src, bool blocking = true);
+
 	void CopyFromDevice(bool blocking = true);
 
+	// Reads size bytes starting at offset into dst
+	void CopyFromDevice(unsigned int offset, unsigned int size, void *dst, bool blocking = true);
+
 	void CopyTo(Buffer *buffer);
 
+	// Uploads the read back image to its texture, only needed without CL/GL interop
+	void CopyToTexture();
+
 	void Clear();
 
 	void Read(void *dst);
@@ -61,10 +72,15 @@ class Buffer
 	void Write(void *dst);
 
 	// data members
+	cl_command_queue m_Queue; // queue of the device this buffer lives on
 	cl_mem deviceBuffer, pinnedBuffer;
 	unsigned int *hostBuffer;
 	unsigned int m_Type, m_Size, m_TextureID;
 	unsigned int sizeInQuads;
+	unsigned int m_Width = 0, m_Height = 0; // only set for images backed by host memory
 	bool ownData;
+
+  private:
+	void CreateImage(unsigned int width, unsigned int height, BufferType t);
 };
 } // namespace cl
@@ -6,6 +6,7 @@
 #include "CL/OpenCL.h"
 #include "GL/Texture.h"
 #include "Shared.h"
+#include "Utils/Timeline.h"
 
 namespace cl
 {
@@ -16,6 +17,11 @@ char *Kernel::m_Log = nullptr;
 cl_context Kernel::m_Context;
 cl_command_queue Kernel::m_Queue;
 cl_device_id Kernel::m_Device;
+cl_device_type Kernel::m_DeviceType = CL_DEVICE_TYPE_GPU;
+std::string Kernel::m_PlatformName;
+bool Kernel::m_Headless = false;
+std::vector<Device> Kernel::m_Devices;
+int Kernel::m_CurrentDevice = 0;
 
 // source file information
 static int sourceFiles = 0;
@@ -37,7 +43,7 @@ static cl_device_id getFirstDevice(cl_context context)
 	return first;
 }
 
-static cl_int getPlatformID(cl_platform_id *platform)
+static cl_int getPlatformID(cl_platform_id *platform, cl_device_type deviceType, const std::string &platformName)
 {
 	char chBuffer[1024];
 	cl_uint num_platforms, devCount;
@@ -52,53 +58,53 @@ static cl_int getPlatformID(cl_platform_id *platform)
 
 	clPlatformIDs = (cl_platform_id *)malloc(num_platforms * sizeof(cl_platform_id));
 	CheckCL(clGetPlatformIDs(num_platforms, clPlatformIDs, nullptr), __FILE__, __LINE__);
-#ifdef USE_CPU_DEVICE
-	cl_uint deviceType[2] = {CL_DEVICE_TYPE_CPU, CL_DEVICE_TYPE_CPU};
-	char *deviceOrder[2][3] = {{"", "", ""}, {"", "", ""}};
-#else
-	//	cl_uint deviceType[2] = { CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_CPU };
-	cl_uint deviceType[1] = {CL_DEVICE_TYPE_GPU};
-	//	const char* deviceOrder[2][3] = {{"NVIDIA", "AMD", "" }, {"", "", "" }
-	//};
-	const char *deviceOrder[1][3] = {{"NVIDIA", "AMD", ""}};
-#endif
+
+	// GPUs of these vendors are preferred, CPU runtimes (POCL, Intel) are taken in the order they are listed
+	const char *gpuOrder[3] = {"NVIDIA", "AMD", ""};
+	const char *anyOrder[1] = {""};
+	const bool preferVendor = (deviceType == CL_DEVICE_TYPE_GPU) && platformName.empty();
+	const char **deviceOrder = preferVendor ? gpuOrder : anyOrder;
+	const int orderCount = preferVendor ? 3 : 1;
+
 	printf("available OpenCL platforms:\n");
 	for (cl_uint i = 0; i < num_platforms; ++i)
 	{
 		CheckCL(clGetPlatformInfo(clPlatformIDs[i], CL_PLATFORM_NAME, 1024, &chBuffer, nullptr), __FILE__, __LINE__);
 		printf("#%i: %s\n", i, chBuffer);
 	}
-	for (cl_uint j = 0; j < 2; j++)
+	for (int k = 0; k < orderCount && !*platform; k++)
 	{
-		for (int k = 0; k < 3; k++)
+		for (cl_uint i = 0; i < num_platforms; ++i)
 		{
-			for (cl_uint i = 0; i < num_platforms; ++i)
+			cl_int error = clGetDeviceIDs(clPlatformIDs[i], deviceType, 0, nullptr, &devCount);
+			if ((error != CL_SUCCESS) || (devCount == 0))
 			{
-				cl_int error = clGetDeviceIDs(clPlatformIDs[i], deviceType[j], 0, nullptr, &devCount);
-				if ((error != CL_SUCCESS) || (devCount == 0))
-				{
-					continue;
-				}
-
-				CheckCL(clGetPlatformInfo(clPlatformIDs[i], CL_PLATFORM_NAME, 1024, &chBuffer, nullptr), __FILE__,
-						__LINE__);
-				if (deviceOrder[j][k][0])
-				{
-					if (!strstr(chBuffer, deviceOrder[j][k]))
-					{
-						continue;
-					}
-				}
+				continue;
+			}
 
-				printf("OpenCL device: %s\n", chBuffer);
-				*platform = clPlatformIDs[i];
-				j = 2, k = 3;
-				break;
+			CheckCL(clGetPlatformInfo(clPlatformIDs[i], CL_PLATFORM_NAME, 1024, &chBuffer, nullptr), __FILE__,
+					__LINE__);
+			if (!platformName.empty() && !strstr(chBuffer, platformName.c_str()))
+			{
+				continue;
 			}
+			if (deviceOrder[k][0] && !strstr(chBuffer, deviceOrder[k]))
+			{
+				continue;
+			}
+
+			printf("OpenCL device: %s\n", chBuffer);
+			*platform = clPlatformIDs[i];
+			break;
 		}
 	}
 
 	free(clPlatformIDs);
+	if (!*platform)
+	{
+		FatalError(__FILE__, __LINE__, "No OpenCL platform found with a device of the requested type.",
+				   "OpenCL Init");
+	}
 	return CL_SUCCESS;
 }
 
@@ -230,6 +236,9 @@ Kernel::Kernel(const char *file, const char *entryPoint, std::tuple<size_t, size
 	}
 	m_Kernel = clCreateKernel(m_Program, entryPoint, &error);
 	CheckCL(error, __FILE__, __LINE__);
+	m_DeviceQueue = m_Queue;
+	m_DeviceIndex = m_CurrentDevice;
+	m_Name = utils::timeline::Intern(entryPoint);
 
 	m_WorkSize = new size_t[3];
 	m_WorkSize[0] = std::get<0>(workSize);
@@ -240,6 +249,9 @@ Kernel::Kernel(const char *file, const char *entryPoint, std::tuple<size_t, size
 	m_LocalSize[0] = std::get<0>(localSize);
 	m_LocalSize[1] = std::get<1>(localSize);
 	m_LocalSize[2] = std::get<2>(localSize);
+
+	m_WorkOffset = new size_t[3];
+	m_WorkOffset[0] = m_WorkOffset[1] = m_WorkOffset[2] = 0;
 }
 
 Kernel::~Kernel()
@@ -251,38 +263,35 @@ Kernel::~Kernel()
 
 	delete[] m_WorkSize;
 	delete[] m_LocalSize;
+	delete[] m_WorkOffset;
 }
 
 bool Kernel::InitCL()
 {
+	if (m_Initialized)
+		return true;
+
 	cl_platform_id platform;
 	cl_device_id *devices;
 	cl_uint devCount;
 	cl_int error;
 
-	if (!CheckCL(error = getPlatformID(&platform), __FILE__, __LINE__))
+	if (!CheckCL(error = getPlatformID(&platform, m_DeviceType, m_PlatformName), __FILE__, __LINE__))
 		return false;
-#ifdef __APPLE__
-	if (!CheckCL(error = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 0, nullptr, &devCount), __FILE__, __LINE__))
+	if (!CheckCL(error = clGetDeviceIDs(platform, m_DeviceType, 0, nullptr, &devCount), __FILE__, __LINE__))
 		return false;
 	devices = new cl_device_id[devCount];
-	if (!CheckCL(error = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, devCount, devices, nullptr), __FILE__, __LINE__))
+	if (!CheckCL(error = clGetDeviceIDs(platform, m_DeviceType, devCount, devices, nullptr), __FILE__, __LINE__))
 		return false;
-
-	if (devCount >= 2)
+#ifdef __APPLE__
+	if (m_DeviceType == CL_DEVICE_TYPE_GPU && devCount >= 2)
 	{
 		// swap devices so dGPU gets selected
 		std::swap(devices[0], devices[1]);
 	}
-#else
-	if (!CheckCL(error = clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 0, nullptr, &devCount), __FILE__, __LINE__))
-		return false;
-	devices = new cl_device_id[devCount];
-	if (!CheckCL(error = clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, devCount, devices, nullptr), __FILE__, __LINE__))
-		return false;
 #endif
 	uint deviceUsed = 0;
-	uint endDev = devCount;
+	uint endDev = m_Headless ? 0 : devCount; // there is no OpenGL context to share with when headless
 	bool canShare = false;
 
 	for (uint i = deviceUsed; (!canShare && (i < endDev)); ++i)
@@ -325,56 +334,55 @@ bool Kernel::InitCL()
 		}
 	}
 
+	canDoInterop = false;
 	if (canShare)
 	{
-		std::cout << "Using CL-GL Interop" << std::endl;
-	}
-	else
-	{
-		std::cout << "No device found that supports CL/GL context sharing" << std::endl;
-		return false;
-	}
-
 #ifdef _WIN32
-	cl_context_properties props[] = {CL_GL_CONTEXT_KHR,
-									 (cl_context_properties)wglGetCurrentContext(),
-									 CL_WGL_HDC_KHR,
-									 (cl_context_properties)wglGetCurrentDC(),
-									 CL_CONTEXT_PLATFORM,
-									 (cl_context_properties)platform,
-									 0};
+		cl_context_properties props[] = {CL_GL_CONTEXT_KHR,
+										 (cl_context_properties)wglGetCurrentContext(),
+										 CL_WGL_HDC_KHR,
+										 (cl_context_properties)wglGetCurrentDC(),
+										 CL_CONTEXT_PLATFORM,
+										 (cl_context_properties)platform,
+										 0};
 #elif defined(__APPLE__)
-	CGLContextObj kCGLContext = CGLGetCurrentContext();
-	CGLShareGroupObj kCGLShareGroup = CGLGetShareGroup(kCGLContext);
-	cl_context_properties props[] = {CL_CONTEXT_PROPERTY_USE_CGL_SHAREGROUP_APPLE,
-									 (cl_context_properties)kCGLShareGroup, CL_CONTEXT_PLATFORM,
-									 (cl_context_properties)platform, 0};
+		CGLContextObj kCGLContext = CGLGetCurrentContext();
+		CGLShareGroupObj kCGLShareGroup = CGLGetShareGroup(kCGLContext);
+		cl_context_properties props[] = {CL_CONTEXT_PROPERTY_USE_CGL_SHAREGROUP_APPLE,
+										 (cl_context_properties)kCGLShareGroup, CL_CONTEXT_PLATFORM,
+										 (cl_context_properties)platform, 0};
 #else // Linux
-	cl_context_properties props[] = {CL_GL_CONTEXT_KHR,
-									 (cl_context_properties)glXGetCurrentContext(),
-									 CL_GLX_DISPLAY_KHR,
-									 (cl_context_properties)glXGetCurrentDisplay(),
-									 CL_CONTEXT_PLATFORM,
-									 (cl_context_properties)platform,
-									 0};
+		cl_context_properties props[] = {CL_GL_CONTEXT_KHR,
+										 (cl_context_properties)glXGetCurrentContext(),
+										 CL_GLX_DISPLAY_KHR,
+										 (cl_context_properties)glXGetCurrentDisplay(),
+										 CL_CONTEXT_PLATFORM,
+										 (cl_context_properties)platform,
+										 0};
 #endif
 
-	// attempt to create a context with the requested features
-	canDoInterop = true;
-	m_Context = clCreateContext(props, 1, &devices[deviceUsed], nullptr, nullptr, &error);
-	if (error != 0)
+		// attempt to create a context with the requested features
+		m_Context = clCreateContext(props, 1, &devices[deviceUsed], nullptr, nullptr, &error);
+		canDoInterop = (error == CL_SUCCESS);
+	}
+
+	if (canDoInterop)
 	{
-		// that didn't work, let's take what we can get
-		cl_context_properties props[] = {0};
+		std::cout << "Using CL-GL Interop" << std::endl;
+	}
+	else
+	{
+		// that didn't work, let's take what we can get: output gets read back through host memory
+		std::cout << "No CL/GL context sharing, reading back output through host memory" << std::endl;
+		cl_context_properties props[] = {CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0};
 		m_Context = clCreateContext(props, 1, &devices[deviceUsed], nullptr, nullptr, &error);
-		canDoInterop = false;
 	}
 
-	m_Device = getFirstDevice(m_Context);
 	if (!CheckCL(error, __FILE__, __LINE__))
 	{
 		return false;
 	}
+	m_Device = getFirstDevice(m_Context);
 
 	// print device name
 	char device_string[1024];
@@ -391,14 +399,92 @@ bool Kernel::InitCL()
 	std::cout << "\tMax Work Item Sizes: " << l_size << std::endl;
 	std::cout << "\tMax Work Item Dimensions: " << d_size << std::endl;
 
-	// create a command-queue
-	m_Queue = clCreateCommandQueue(m_Context, devices[deviceUsed], 0, &error);
+	// create a command-queue, kernels are only timed for the timeline
+	m_Queue = clCreateCommandQueue(m_Context, devices[deviceUsed], GetQueueProperties(), &error);
+	utils::timeline::SetTrackName(utils::timeline::DEVICE_PROCESS, 0, device_string);
 
 	bool result = CheckCL(error, __FILE__, __LINE__);
+	if (result)
+		m_Devices.push_back({m_Device, m_Context, m_Queue, canDoInterop});
 	Kernel::m_Initialized = result;
 	return result;
 }
 
+int Kernel::InitDevices()
+{
+	if (m_Initialized)
+		return GetDeviceCount();
+
+	cl_uint platformCount;
+	CheckCL(clGetPlatformIDs(0, nullptr, &platformCount), __FILE__, __LINE__);
+	if (platformCount == 0)
+		FatalError(__FILE__, __LINE__, "No valid OpenCL platforms found.", "OpenCL Init");
+
+	std::vector<cl_platform_id> platforms(platformCount);
+	CheckCL(clGetPlatformIDs(platformCount, platforms.data(), nullptr), __FILE__, __LINE__);
+
+	char platformName[1024];
+	char deviceName[1024];
+	for (cl_platform_id platform : platforms)
+	{
+		CheckCL(clGetPlatformInfo(platform, CL_PLATFORM_NAME, 1024, platformName, nullptr), __FILE__, __LINE__);
+		if (!m_PlatformName.empty() && !strstr(platformName, m_PlatformName.c_str()))
+			continue;
+
+		cl_uint devCount = 0;
+		if (clGetDeviceIDs(platform, m_DeviceType, 0, nullptr, &devCount) != CL_SUCCESS || devCount == 0)
+			continue;
+		std::vector<cl_device_id> devices(devCount);
+		CheckCL(clGetDeviceIDs(platform, m_DeviceType, devCount, devices.data(), nullptr), __FILE__, __LINE__);
+
+		for (cl_device_id id : devices)
+		{
+			// memory objects can't be shared between devices of different platforms anyway,
+			// so every device gets its own context and copy of the scene
+			cl_int error;
+			cl_context_properties props[] = {CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0};
+			Device device{};
+			device.id = id;
+			device.canDoInterop = false;
+			device.context = clCreateContext(props, 1, &id, nullptr, nullptr, &error);
+			CheckCL(error, __FILE__, __LINE__);
+			device.queue = clCreateCommandQueue(device.context, id, GetQueueProperties(), &error);
+			CheckCL(error, __FILE__, __LINE__);
+
+			clGetDeviceInfo(id, CL_DEVICE_NAME, 1024, deviceName, nullptr);
+			printf("Device # %i, %s (%s)\n", GetDeviceCount(), deviceName, platformName);
+			utils::timeline::SetTrackName(utils::timeline::DEVICE_PROCESS, GetDeviceCount(), deviceName);
+			m_Devices.push_back(device);
+		}
+	}
+
+	if (m_Devices.empty())
+		FatalError(__FILE__, __LINE__, "No OpenCL devices found of the requested type.", "OpenCL Init");
+
+	m_Initialized = true;
+	SetCurrentDevice(0);
+	return GetDeviceCount();
+}
+
+void Kernel::SetCurrentDevice(int idx)
+{
+	const Device &device = m_Devices.at(idx);
+	m_Device = device.id;
+	m_Context = device.context;
+	m_Queue = device.queue;
+	canDoInterop = device.canDoInterop;
+	m_CurrentDevice = idx;
+}
+
+void Kernel::SelectDevice(cl_device_type deviceType, const std::string &platformName)
+{
+	if (m_Initialized)
+		WarningMessage(__FILE__, __LINE__, "OpenCL is already initialized, device selection is ignored.", "OpenCL");
+
+	m_DeviceType = deviceType;
+	m_PlatformName = platformName;
+}
+
 void Kernel::SetArgument(int idx, cl_mem *buffer) { clSetKernelArg(m_Kernel, idx, sizeof(cl_mem), buffer); }
 
 void Kernel::SetArgument(int idx, Buffer *buffer)
@@ -429,48 +515,115 @@ void Kernel::SetArgument(int idx, glm::vec4 value)
 
 void Kernel::Run()
 {
-	glFinish();
-	CheckCL(clEnqueueNDRangeKernel(m_Queue, m_Kernel, 2, 0, m_WorkSize, m_LocalSize, 0, 0, 0), __FILE__, __LINE__);
+	if (canDoInterop)
+		glFinish();
+	Enqueue(2, m_WorkOffset, m_WorkSize, m_LocalSize);
 }
 
 void Kernel::Run(cl_mem *buffers, int count)
 {
-	glFinish();
 	if (Kernel::canDoInterop)
 	{
-		CheckCL(clEnqueueAcquireGLObjects(m_Queue, count, buffers, 0, 0, 0), __FILE__, __LINE__);
-		CheckCL(clEnqueueNDRangeKernel(m_Queue, m_Kernel, 2, nullptr, m_WorkSize, m_LocalSize, 0, 0, 0), __FILE__,
-				__LINE__);
-		CheckCL(clEnqueueReleaseGLObjects(m_Queue, count, buffers, 0, 0, 0), __FILE__, __LINE__);
+		glFinish();
+		CheckCL(clEnqueueAcquireGLObjects(m_DeviceQueue, count, buffers, 0, 0, 0), __FILE__, __LINE__);
+		Enqueue(2, m_WorkOffset, m_WorkSize, m_LocalSize);
+		CheckCL(clEnqueueReleaseGLObjects(m_DeviceQueue, count, buffers, 0, 0, 0), __FILE__, __LINE__);
 	}
 	else
 	{
-		CheckCL(clEnqueueNDRangeKernel(m_Queue, m_Kernel, 2, nullptr, m_WorkSize, m_LocalSize, 0, 0, 0), __FILE__,
-				__LINE__);
+		Enqueue(2, m_WorkOffset, m_WorkSize, m_LocalSize);
 	}
 }
 
 void Kernel::Run(Buffer *buffer)
 {
-	glFinish();
 	if (Kernel::canDoInterop)
 	{
-		CheckCL(clEnqueueAcquireGLObjects(m_Queue, 1, buffer->GetDevicePtr(), 0, 0, 0), __FILE__, __LINE__);
-		CheckCL(clEnqueueNDRangeKernel(m_Queue, m_Kernel, 2, nullptr, m_WorkSize, m_LocalSize, 0, 0, 0), __FILE__,
-				__LINE__);
-		CheckCL(clEnqueueReleaseGLObjects(m_Queue, 1, buffer->GetDevicePtr(), 0, 0, 0), __FILE__, __LINE__);
+		glFinish();
+		CheckCL(clEnqueueAcquireGLObjects(m_DeviceQueue, 1, buffer->GetDevicePtr(), 0, 0, 0), __FILE__, __LINE__);
+		Enqueue(2, m_WorkOffset, m_WorkSize, m_LocalSize);
+		CheckCL(clEnqueueReleaseGLObjects(m_DeviceQueue, 1, buffer->GetDevicePtr(), 0, 0, 0), __FILE__, __LINE__);
 	}
 	else
 	{
-		CheckCL(clEnqueueNDRangeKernel(m_Queue, m_Kernel, 2, nullptr, m_WorkSize, m_LocalSize, 0, 0, 0), __FILE__,
-				__LINE__);
+		Enqueue(2, m_WorkOffset, m_WorkSize, m_LocalSize);
 	}
 }
 
 void Kernel::Run(const size_t count)
 {
-	CheckCL(clEnqueueNDRangeKernel(m_Queue, m_Kernel, 1, 0, &count, 0, 0, 0, 0), __FILE__, __LINE__);
+	Enqueue(1, nullptr, &count, nullptr);
+}
+
+void Kernel::Run(const size_t count, const size_t localSize)
+{
+	Enqueue(1, nullptr, &count, &localSize);
+}
+
+namespace
+{
+struct KernelProfile
+{
+	const char *name;
+	int device;
+	int64_t queued; // host time of the enqueue
+};
+
+void CL_CALLBACK OnKernelComplete(cl_event event, cl_int status, void *data)
+{
+	const auto *profile = static_cast<const KernelProfile *>(data);
+	cl_ulong queued, start, end;
+	if (status == CL_COMPLETE &&
+		clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &queued, nullptr) == CL_SUCCESS &&
+		clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, nullptr) == CL_SUCCESS &&
+		clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, nullptr) == CL_SUCCESS)
+	{
+		// device clocks have an origin of their own, the enqueue time lines them up with the CPU tracks
+		const int64_t offset = profile->queued - int64_t(queued);
+		utils::timeline::AddEvent(profile->name, "opencl", int64_t(start) + offset, int64_t(end - start),
+								  utils::timeline::DEVICE_PROCESS, profile->device);
+	}
+
+	clReleaseEvent(event);
+	delete profile;
+}
+} // namespace
+
+cl_command_queue_properties Kernel::GetQueueProperties()
+{
+	return utils::timeline::IsRecording() ? CL_QUEUE_PROFILING_ENABLE : 0;
+}
+
+void Kernel::Enqueue(cl_uint dimensions, const size_t *offset, const size_t *workSize, const size_t *localSize)
+{
+	if (!utils::timeline::IsRecording())
+	{
+		CheckCL(clEnqueueNDRangeKernel(m_DeviceQueue, m_Kernel, dimensions, offset, workSize, localSize, 0, nullptr,
+									   nullptr),
+				__FILE__, __LINE__);
+		return;
+	}
+
+	// the event is released by the callback once the kernel is done
+	cl_event event;
+	const int64_t queued = utils::timeline::Now();
+	CheckCL(clEnqueueNDRangeKernel(m_DeviceQueue, m_Kernel, dimensions, offset, workSize, localSize, 0, nullptr,
+								   &event),
+			__FILE__, __LINE__);
+
+	auto *profile = new KernelProfile{m_Name, m_DeviceIndex, queued};
+	if (clSetEventCallback(event, CL_COMPLETE, OnKernelComplete, profile) != CL_SUCCESS)
+	{
+		clReleaseEvent(event);
+		delete profile;
+	}
 }
 
 void Kernel::SyncQueue() { clFinish(m_Queue); }
+
+void Kernel::SyncDevices()
+{
+	for (const Device &device : m_Devices)
+		clFinish(device.queue);
+}
 } // namespace cl
\ No newline at end of file
@@ -2,7 +2,9 @@
 
 #include <algorithm>
 #include <iostream>
+#include <string>
 #include <tuple>
+#include <vector>
 
 #ifdef __APPLE__
 #define CL_SILENCE_DEPRECATION
@@ -25,8 +27,6 @@
 
 #include "Utils/Messages.h"
 
-// #define USE_CPU_DEVICE
-
 namespace cl
 {
 inline bool CheckCL(cl_int result, const char *file, int line)
@@ -189,6 +189,15 @@ inline bool CheckCL(cl_int result, const char *file, int line)
 
 class Buffer;
 
+// Context and queue of a single device, kernels and buffers belong to the device that was current on creation
+struct Device
+{
+	cl_device_id id;
+	cl_context context;
+	cl_command_queue queue;
+	bool canDoInterop;
+};
+
 class Kernel
 {
   public:
@@ -217,8 +226,13 @@ class Kernel
 
 	void Run(const size_t count);
 
+	void Run(const size_t count, const size_t localSize);
+
 	static void SyncQueue();
 
+	// Waits for the queues of all devices
+	static void SyncDevices();
+
 	void SetArgument(int idx, cl_mem *buffer);
 
 	void SetArgument(int idx, Buffer *buffer);
@@ -249,20 +263,60 @@ class Kernel
 		m_LocalSize[2] = z;
 	}
 
+	inline void SetWorkOffset(size_t x, size_t y, size_t z)
+	{
+		m_WorkOffset[0] = x;
+		m_WorkOffset[1] = y;
+		m_WorkOffset[2] = z;
+	}
+
 	static bool InitCL();
 
+	// Selects the device InitCL picks, needs to be called before the first kernel gets created.
+	// CPU devices are provided by runtimes like POCL or Intel's, an empty platform name takes the first match.
+	static void SelectDevice(cl_device_type deviceType, const std::string &platformName = "");
+
+	// Never touches OpenGL, kernel output has to be read back into host memory
+	static void SetHeadless(bool headless) { m_Headless = headless; }
+
+	static bool IsHeadless() { return m_Headless; }
+
+	// Creates a context and queue for every device of the selected type instead of picking a single one.
+	// Devices never share with OpenGL, returns the number of devices.
+	static int InitDevices();
+
+	static int GetDeviceCount() { return static_cast<int>(m_Devices.size()); }
+
+	// Kernels and buffers created after this call belong to the given device
+	static void SetCurrentDevice(int idx);
+
   private:
+	// Enqueues the kernel, while the timeline records its execution on the device ends up there as well
+	void Enqueue(cl_uint dimensions, const size_t *offset, const size_t *workSize, const size_t *localSize);
+
+	// Queues measure kernels only when they are created while the timeline records
+	static cl_command_queue_properties GetQueueProperties();
+
 	// data members
 	cl_kernel m_Kernel;
 	cl_program m_Program;
+	cl_command_queue m_DeviceQueue; // queue of the device this kernel was built for
+	int m_DeviceIndex;				// and its index in m_Devices
+	const char *m_Name;				// entry point
 	static bool m_Initialized;
 	static cl_device_id m_Device;
-	static cl_context m_Context; // simplifies some things, but limits us to one device
+	static cl_context m_Context; // context of the current device
 	static cl_command_queue m_Queue;
 	static char *m_Log;
+	static cl_device_type m_DeviceType;
+	static std::string m_PlatformName;
+	static bool m_Headless;
+	static std::vector<Device> m_Devices;
+	static int m_CurrentDevice;
 
 	size_t *m_WorkSize;
 	size_t *m_LocalSize;
+	size_t *m_WorkOffset;
 
   public:
 	static bool canDoInterop;
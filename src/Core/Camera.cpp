@@ -31,15 +31,9 @@ Ray Camera::GenerateRay(float x, float y) const
 
 	const vec3 pointAtDistanceOneFromPlane = w + horizontal * ScreenX + vertical * ScreenY;
 
-	return {m_Origin, normalize(pointAtDistanceOneFromPlane)};
-}
-
-Ray Camera::GenerateRandomRay(float x, float y, RandomGenerator &rng) const
-{
-	const float newX = x + rng.Rand(1.f) - .5f;
-	const float newY = y + rng.Rand(1.f) - .5f;
-
-	return GenerateRay(newX, newY);
+	Ray r = {m_Origin, normalize(pointAtDistanceOneFromPlane)};
+	r.coneSpread = GetPixelSpread();
+	return r;
 }
 
 void Camera::ProcessMouse(int x, int y) noexcept
@@ -22,7 +22,14 @@ class Camera
 
 	Ray GenerateRay(float x, float y) const;
 
-	Ray GenerateRandomRay(float x, float y, RandomGenerator &rng) const;
+	// Ray through a random point of pixel (x, y), Rng is the concrete generator type of the caller
+	template <typename Rng> inline Ray GenerateRandomRay(float x, float y, Rng &rng) const
+	{
+		const float newX = x + rng.Rand(1.f) - .5f;
+		const float newY = y + rng.Rand(1.f) - .5f;
+
+		return GenerateRay(newX, newY);
+	}
 
 	void ProcessMouse(int x, int y) noexcept;
 
@@ -66,6 +73,9 @@ class Camera
 
 	inline float GetAspectRatio() const noexcept { return m_AspectRatio; }
 
+	// Angle covered by a single pixel, the spread of the ray cones leaving the camera
+	inline float GetPixelSpread() const noexcept { return atanf(2.0f * m_FOV_Distance * m_InvHeight); }
+
 	inline glm::vec3 GetUp() const noexcept { return m_Up; }
 
 	inline void SetPosition(glm::vec3 position) noexcept { this->m_Origin = position; }
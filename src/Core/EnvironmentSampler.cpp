@@ -0,0 +1,84 @@
+#include "Core/EnvironmentSampler.h"
+
+#include <glm/gtc/constants.hpp>
+
+namespace core
+{
+using namespace glm;
+
+EnvironmentSampler::EnvironmentSampler(Surface *skyBox) : m_Width(skyBox->GetWidth()), m_Height(skyBox->GetHeight())
+{
+	const vec4 *texels = skyBox->GetTextureBuffer();
+	const vec3 luminance = vec3(0.2126f, 0.7152f, 0.0722f);
+
+	m_Rows.resize(m_Height);
+	std::vector<float> rowWeights(m_Height);
+	std::vector<float> weights(m_Width);
+	for (int y = 0; y < m_Height; y++)
+	{
+		// rows near the poles cover less solid angle
+		const float sinTheta = sinf((1.0f - (float(y) + 0.5f) / float(m_Height)) * pi<float>());
+		for (int x = 0; x < m_Width; x++)
+			weights[x] = dot(vec3(texels[x + y * m_Width]), luminance) * sinTheta;
+
+		m_Rows[y].Build(weights);
+		rowWeights[y] = m_Rows[y].GetTotalWeight();
+	}
+	m_Marginal.Build(rowWeights);
+
+	m_TexelPdfs.assign(m_Width * m_Height, 0.0f);
+	if (!IsValid())
+		return;
+
+	const float scale = float(m_Width) * float(m_Height) / (2.0f * pi<float>() * pi<float>());
+	for (int y = 0; y < m_Height; y++)
+	{
+		if (rowWeights[y] <= 0.0f)
+			continue;
+		for (int x = 0; x < m_Width; x++)
+			m_TexelPdfs[x + y * m_Width] = m_Marginal.Pdf(y) * m_Rows[y].Pdf(x) * scale;
+	}
+}
+
+vec3 EnvironmentSampler::SampleUniform(const vec4 &alias, const vec2 &texel, float &pdf) const
+{
+	const unsigned int y = m_Marginal.Sample(alias.x, alias.y);
+	const unsigned int x = m_Rows[y].Sample(alias.z, alias.w);
+
+	// uniform within the texel
+	const float u = (float(x) + texel.x) / float(m_Width);
+	const float v = (float(y) + texel.y) / float(m_Height);
+	const float theta = (1.0f - v) * pi<float>();
+	const float phi = (2.0f * u - 1.0f) * pi<float>();
+
+	const float sinTheta = sinf(theta);
+	pdf = sinTheta > 0.0f ? m_TexelPdfs[x + y * m_Width] / sinTheta : 0.0f;
+	return vec3(sinTheta * sinf(phi), cosf(theta), -sinTheta * cosf(phi));
+}
+
+float EnvironmentSampler::Pdf(const vec3 &dir) const
+{
+	const float sinTheta = sqrtf(glm::max(1.0f - dir.y * dir.y, 0.0f));
+	if (sinTheta <= 0.0f)
+		return 0.0f;
+
+	const ivec2 texel = DirectionToTexel(dir, m_Width, m_Height);
+	return m_TexelPdfs[texel.x + texel.y * m_Width] / sinTheta;
+}
+
+ivec2 EnvironmentSampler::DirectionToTexel(const vec3 &dir, int width, int height)
+{
+	const float u = (1.0f + atan2f(dir.x, -dir.z) / pi<float>()) * 0.5f;
+	const float v = 1.0f - acosf(glm::clamp(dir.y, -1.0f, 1.0f)) / pi<float>();
+	return ivec2(glm::clamp(int(u * float(width)), 0, width - 1), glm::clamp(int(v * float(height)), 0, height - 1));
+}
+
+std::vector<utils::AliasEntry> EnvironmentSampler::GetTables() const
+{
+	std::vector<utils::AliasEntry> tables = m_Marginal.GetEntries();
+	tables.reserve(m_Height + m_Width * m_Height);
+	for (const auto &row : m_Rows)
+		tables.insert(tables.end(), row.GetEntries().begin(), row.GetEntries().end());
+	return tables;
+}
+} // namespace core
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Core/Surface.h"
+#include "Utils/AliasTable.h"
+#include "Utils/RandomGenerator.h"
+
+namespace core
+{
+// Importance sampling for the sky dome: a marginal alias table over the rows and a conditional table per row,
+// weighted by the luminance of every texel and the solid angle it covers. Uses the same lat-long mapping as
+// the sky dome lookups, u = (1 + atan2(x, -z) / pi) / 2 and v = 1 - acos(y) / pi.
+class EnvironmentSampler
+{
+  public:
+	explicit EnvironmentSampler(Surface *skyBox);
+
+	// Picks a direction proportional to the brightness of the sky, pdf is per solid angle. alias holds the entry and
+	// coin numbers for the row and then the column table, texel the position within the picked texel.
+	glm::vec3 SampleUniform(const glm::vec4 &alias, const glm::vec2 &texel, float &pdf) const;
+
+	// Draws the numbers from the concrete generator type of the caller
+	template <typename Rng> inline glm::vec3 Sample(Rng &rng, float &pdf) const
+	{
+		glm::vec4 alias;
+		for (int i = 0; i < 4; i++)
+			alias[i] = rng.Rand(1.0f);
+		const float tx = rng.Rand(1.0f);
+		return SampleUniform(alias, glm::vec2(tx, rng.Rand(1.0f)), pdf);
+	}
+
+	// Solid angle pdf of Sample returning dir
+	float Pdf(const glm::vec3 &dir) const;
+
+	// Texel of a width x height lat-long map that dir falls into. Texel x covers u in [x / width, (x + 1) / width),
+	// the radiance lookups use it too so the texel whose pdf is used is the one whose radiance is returned.
+	static glm::ivec2 DirectionToTexel(const glm::vec3 &dir, int width, int height);
+
+	// False for completely black maps, nothing can be sampled in that case
+	inline bool IsValid() const { return m_Marginal.GetTotalWeight() > 0.0f; }
+
+	// Marginal table followed by the conditional tables of all rows, the layout the kernels expect
+	std::vector<utils::AliasEntry> GetTables() const;
+
+	// Probability of every texel scaled to a density over the (u, v) square divided by 2 pi^2,
+	// dividing by sin(theta) turns it into a solid angle pdf
+	inline const std::vector<float> &GetTexelPdfs() const { return m_TexelPdfs; }
+
+  private:
+	int m_Width, m_Height;
+	utils::AliasTable m_Marginal;
+	std::vector<utils::AliasTable> m_Rows;
+	std::vector<float> m_TexelPdfs;
+};
+} // namespace core
@@ -0,0 +1,134 @@
+#include "FrameBuffer.h"
+
+#include <algorithm>
+#include <future>
+
+#include <immintrin.h>
+
+#include "Core/Surface.h"
+#include "Utils/Timeline.h"
+#include "Utils/ctpl.h"
+
+#define RESOLVE_ROWS 16 // rows per task of the parallel resolve
+
+namespace core
+{
+const char *GetAOVName(AOV aov)
+{
+	switch (aov)
+	{
+	case (AOV::Albedo):
+		return "albedo";
+	case (AOV::Normal):
+		return "normal";
+	case (AOV::Depth):
+		return "depth";
+	case (AOV::Color):
+	default:
+		return "color";
+	}
+}
+
+FrameBuffer::FrameBuffer(int width, int height) { Resize(width, height); }
+
+void FrameBuffer::Resize(int width, int height)
+{
+	m_Width = width;
+	m_Height = height;
+	m_Samples = 0;
+
+	const size_t pixels = size_t(width) * size_t(height);
+	for (int i = 0; i < int(AOV::Count); i++)
+	{
+		m_Layers[i].clear();
+		if (i == int(AOV::Color) || m_AOVs)
+			m_Layers[i].resize(pixels, glm::vec3(0.0f));
+	}
+}
+
+void FrameBuffer::Clear()
+{
+	for (auto &layer : m_Layers)
+		std::fill(layer.begin(), layer.end(), glm::vec3(0.0f));
+	m_Samples = 0;
+}
+
+void FrameBuffer::EnableAOVs(bool enabled)
+{
+	if (m_AOVs == enabled)
+		return;
+
+	m_AOVs = enabled;
+	const size_t pixels = size_t(m_Width) * size_t(m_Height);
+	for (int i = int(AOV::Color) + 1; i < int(AOV::Count); i++)
+	{
+		if (enabled)
+			m_Layers[i].assign(pixels, glm::vec3(0.0f));
+		else
+			std::vector<glm::vec3>().swap(m_Layers[i]);
+	}
+}
+
+void FrameBuffer::Resolve(unsigned int *output, int pitch, int firstRow, int rowCount) const
+{
+	const float *color = reinterpret_cast<const float *>(m_Layers[int(AOV::Color)].data());
+	const float factor = GetScale();
+	const __m256 scale = _mm256_set1_ps(factor);
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), range = _mm256_set1_ps(255.99f);
+	// 12 bytes of RGB become 4 pixels with an empty top byte
+	const __m128i expand = _mm_setr_epi8(0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128);
+
+	const int lastRow = std::min(firstRow + rowCount, m_Height);
+	for (int y = firstRow; y < lastRow; y++)
+	{
+		const float *src = color + size_t(y) * size_t(m_Width) * 3;
+		unsigned int *dst = output + size_t(y) * size_t(pitch);
+
+		int x = 0;
+		for (; x + 8 <= m_Width; x += 8, src += 24)
+		{
+			// 8 pixels are 24 floats, all channels get the same treatment so they can stay interleaved
+			__m128i words[3];
+			for (int i = 0; i < 3; i++)
+			{
+				__m256 v = _mm256_mul_ps(_mm256_loadu_ps(src + i * 8), scale);
+				v = _mm256_min_ps(_mm256_max_ps(v, zero), one); // NaNs end up as 0
+				const __m256i c = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sqrt_ps(v), range));
+				words[i] = _mm_packus_epi32(_mm256_castsi256_si128(c), _mm256_extracti128_si256(c, 1));
+			}
+
+			const __m128i bytes0 = _mm_packus_epi16(words[0], words[1]); // channels 0 - 15
+			const __m128i bytes1 = _mm_packus_epi16(words[2], words[2]); // channels 16 - 23
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), _mm_shuffle_epi8(bytes0, expand));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x + 4),
+							 _mm_shuffle_epi8(_mm_alignr_epi8(bytes1, bytes0, 12), expand));
+		}
+
+		for (; x < m_Width; x++, src += 3)
+		{
+			const glm::vec3 sum = glm::vec3(src[0], src[1], src[2]);
+			const glm::vec3 col = glm::sqrt(glm::clamp(sum * factor, 0.0f, 1.0f)) * 255.99f;
+			dst[x] = unsigned(col.r) + (unsigned(col.g) << 8u) + (unsigned(col.b) << 16u);
+		}
+	}
+}
+
+void FrameBuffer::Resolve(Surface *output, ctpl::ThreadPool *pool) const
+{
+	unsigned int *buffer = output->GetBuffer();
+	const int pitch = output->GetPitch();
+
+	std::vector<std::future<void>> bands;
+	for (int y = 0; y < m_Height; y += RESOLVE_ROWS)
+	{
+		bands.push_back(pool->push([this, buffer, pitch, y](int) {
+			utils::timeline::ScopedEvent event("resolve", "render");
+			Resolve(buffer, pitch, y, RESOLVE_ROWS);
+		}));
+	}
+
+	utils::timeline::ScopedEvent event("wait for resolve", "render");
+	for (auto &band : bands)
+		band.get();
+}
+} // namespace core
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace ctpl
+{
+class ThreadPool;
+}
+
+namespace core
+{
+class Surface;
+
+// Layers of a frame, everything but Color describes the first hit of a path and is only kept with AOVs enabled
+enum class AOV
+{
+	Color,
+	Albedo,
+	Normal,
+	Depth, // distance to the first hit in all three channels, 0 for misses
+	Count
+};
+
+// Lower case name of a layer, used as file name suffix
+const char *GetAOVName(AOV aov);
+
+// Progressive float RGB accumulation of a frame. Samples are only summed up, the division by the sample count
+// happens when the frame is resolved for display or read back, so adding a sample costs a single addition.
+class FrameBuffer
+{
+  public:
+	FrameBuffer() = default;
+	FrameBuffer(int width, int height);
+
+	// Reallocates every enabled layer, contents and sample count are cleared
+	void Resize(int width, int height);
+
+	// Clears every layer and the sample count
+	void Clear();
+
+	void EnableAOVs(bool enabled);
+
+	inline bool HasAOVs() const { return m_AOVs; }
+
+	inline bool HasLayer(AOV aov) const { return !m_Layers[int(aov)].empty(); }
+
+	inline void Add(AOV aov, int x, int y, const glm::vec3 &value) { m_Layers[int(aov)][x + y * m_Width] += value; }
+
+	inline void Set(AOV aov, int index, const glm::vec3 &value) { m_Layers[int(aov)][index] = value; }
+
+	// Every pixel received one more sample
+	inline void FinishSample() { m_Samples++; }
+
+	// Number of samples summed up in every pixel
+	inline void SetSampleCount(int samples) { m_Samples = samples; }
+
+	inline int GetSampleCount() const { return m_Samples; }
+
+	// Factor that turns the sums into averages
+	inline float GetScale() const { return m_Samples > 0 ? 1.0f / float(m_Samples) : 0.0f; }
+
+	inline glm::vec3 GetAverage(AOV aov, int x, int y) const
+	{
+		return m_Layers[int(aov)][x + y * m_Width] * GetScale();
+	}
+
+	// Top-down rows of summed up RGB floats, multiply by GetScale for the averages. nullptr for disabled layers.
+	inline const glm::vec3 *GetLayer(AOV aov) const { return HasLayer(aov) ? m_Layers[int(aov)].data() : nullptr; }
+
+	inline int GetWidth() const { return m_Width; }
+
+	inline int GetHeight() const { return m_Height; }
+
+	// Averages, clamps and gamma corrects rows of the color layer into 8 bit pixels like Surface::Plot, 8 pixels at
+	// a time with AVX2
+	void Resolve(unsigned int *output, int pitch, int firstRow, int rowCount) const;
+
+	// Resolves the whole color layer into output, bands of rows are spread over the pool
+	void Resolve(Surface *output, ctpl::ThreadPool *pool) const;
+
+  private:
+	int m_Width = 0, m_Height = 0;
+	int m_Samples = 0;
+	bool m_AOVs = false;
+	std::vector<glm::vec3> m_Layers[int(AOV::Count)];
+};
+} // namespace core
@@ -1,8 +1,10 @@
 #include "Core/GpuTracer.h"
 #include "Core/Surface.h"
 #include "Shared.h"
+#include "Utils/Messages.h"
 
 #define WF 0
+#define GPU_BVH 1 // build the MBVH on the device, only used when MBVH is enabled
 
 using namespace cl;
 using namespace gl;
@@ -46,22 +48,55 @@ inline unsigned int RoundToPowerOf2(unsigned int v)
 }
 
 GpuTracer::GpuTracer(prims::GpuTriangleList *objectList, gl::Texture *targetTexture1, gl::Texture *targetTexture2,
-					 core::Camera *camera, core::Surface *skyBox, ctpl::ThreadPool *pool)
+					 core::Camera *camera, core::Surface *skyBox, [[maybe_unused]] ctpl::ThreadPool *pool)
+	: m_Camera(camera)
+{
+	Kernel::InitCL();
+#if !(MBVH && GPU_BVH)
+	m_BVHTree = new bvh::StaticBVHTree(objectList, bvh::SceneBuildConfig(), pool);
+	m_BVHTree->ConstructBVH();
+	m_MBVHTree = new bvh::MBVHTree(m_BVHTree);
+#endif
+
+	m_ObjectList = objectList;
+	Init(targetTexture1->GetWidth(), targetTexture1->GetHeight(), targetTexture1, targetTexture2, skyBox);
+}
+
+GpuTracer::GpuTracer(bvh::GpuTopLevelBVH *scene, gl::Texture *targetTexture1, gl::Texture *targetTexture2,
+					 core::Camera *camera, core::Surface *skyBox)
+	: m_Camera(camera), m_TopLevelBVH(scene)
+{
+#if !MBVH
+	utils::FatalError(__FILE__, __LINE__, "Instanced scenes are only supported with MBVH enabled.", "GpuTracer");
+#endif
+	Kernel::InitCL();
+
+	m_ObjectList = scene->GetTriangleList();
+	Init(targetTexture1->GetWidth(), targetTexture1->GetHeight(), targetTexture1, targetTexture2, skyBox);
+}
+
+GpuTracer::GpuTracer(prims::GpuTriangleList *objectList, int width, int height, core::Camera *camera,
+					 core::Surface *skyBox, [[maybe_unused]] ctpl::ThreadPool *pool)
 	: m_Camera(camera)
 {
-	modes = {"NEE MIS", "Reference", "Reference MF"};
 	Kernel::InitCL();
-	m_BVHTree = new bvh::StaticBVHTree(objectList, bvh::BVHType::SAH_BINNING, pool);
+#if !(MBVH && GPU_BVH)
+	m_BVHTree = new bvh::StaticBVHTree(objectList, bvh::SceneBuildConfig(), pool);
 	m_BVHTree->ConstructBVH();
 	m_MBVHTree = new bvh::MBVHTree(m_BVHTree);
+#endif
 
 	m_ObjectList = objectList;
+	Init(width, height, nullptr, nullptr, skyBox);
+}
+
+void GpuTracer::Init(int width, int height, gl::Texture *targetTexture1, gl::Texture *targetTexture2,
+					 core::Surface *skyBox)
+{
+	modes = {"NEE MIS", "Reference", "Reference MF"};
 	outputTexture[0] = targetTexture1;
 	outputTexture[1] = targetTexture2;
 
-	const int width = targetTexture1->GetWidth();
-	const int height = targetTexture1->GetHeight();
-
 	m_Width = width;
 	m_Height = height;
 
@@ -82,7 +117,7 @@ GpuTracer::GpuTracer(prims::GpuTriangleList *objectList, gl::Texture *targetText
 	wShadeKernel = new Kernel("programs/program.cl", "shade", workSize, localSize);
 	wDrawKernel = new Kernel("programs/program.cl", "draw", workSize, localSize);
 
-	this->Resize(targetTexture1);
+	this->Resize(width, height, targetTexture1);
 
 	this->SetupObjects();
 	this->SetupMaterials();
@@ -103,11 +138,17 @@ GpuTracer::~GpuTracer()
 	delete intersectRaysKernelMF;
 	delete intersectRaysKernelBVH;
 	delete intersectRaysKernelOpt;
+	delete drawKernel;
 	delete outputBuffer;
 	delete raysBuffer;
 	delete BVHNodeBuffer;
-	delete MBVHNodeBuffer;
-	delete primitiveIndicesBuffer;
+	delete instanceBuffer;
+	if (m_LBVHBuilder == nullptr) // otherwise owned by the builder
+	{
+		delete MBVHNodeBuffer;
+		delete triangleIsectBuffer;
+	}
+	delete m_LBVHBuilder;
 	delete seedBuffer;
 	delete colorBuffer;
 	delete textureBuffer;
@@ -116,26 +157,26 @@ GpuTracer::~GpuTracer()
 
 	delete cameraBuffer;
 	delete materialBuffer;
+	delete microfacetBuffer;
 	delete triangleBuffer;
+	delete vertexBuffer;
 
 	delete lightIndices;
-	delete lightLotteryTickets;
+	delete lightAliasTable;
+	delete lightNodes;
+	delete lightTrails;
+	delete skyDome;
+	delete skyDomeInfo;
+	delete skyTables;
+	delete skyPdfs;
 
 	delete wIntersectKernel;
+	delete wShadeKernel;
 	delete wDrawKernel;
 }
 
 void GpuTracer::Render(Surface *)
 {
-	intersectRaysKernelRef->SetArgument(18, m_Width);
-	intersectRaysKernelRef->SetArgument(19, m_Height);
-	intersectRaysKernelMF->SetArgument(18, m_Width);
-	intersectRaysKernelMF->SetArgument(19, m_Height);
-	intersectRaysKernelBVH->SetArgument(18, m_Width);
-	intersectRaysKernelBVH->SetArgument(19, m_Height);
-	intersectRaysKernelOpt->SetArgument(18, m_Width);
-	intersectRaysKernelOpt->SetArgument(19, m_Height);
-
 	drawKernel->SetArgument(3, m_Samples);
 	wDrawKernel->SetArgument(4, m_Samples);
 
@@ -148,6 +189,73 @@ void GpuTracer::Render(Surface *)
 	}
 	wDrawKernel->Run();
 #else
+	RunIntersectKernel();
+	drawKernel->Run(outputBuffer);
+#endif
+
+	if (!Kernel::canDoInterop && outputTexture[0] != nullptr)
+	{
+		// the output image is not shared with OpenGL, copy it over through host memory
+		outputBuffer->CopyFromDevice();
+		outputBuffer->CopyToTexture();
+	}
+
+	m_Samples++;
+	UpdateCamera();
+}
+
+void GpuTracer::SetRegion(int firstRow, int rowCount)
+{
+	m_FirstRow = firstRow;
+	m_RowCount = rowCount;
+
+	// the work size needs to be a multiple of the local size, rows past the image are skipped by the kernels
+	const auto roundedWidth = RoundToPowerOf2(m_Width);
+	const auto roundedRows = static_cast<size_t>((rowCount + 7) / 8 * 8);
+	const auto offset = static_cast<size_t>(firstRow);
+
+	generateRayKernel->SetWorkOffset(0, offset, 0);
+	generateRayKernel->SetWorkSize(roundedWidth, roundedRows, 1);
+	intersectRaysKernelRef->SetWorkOffset(0, offset, 0);
+	intersectRaysKernelRef->SetWorkSize(roundedWidth, roundedRows, 1);
+	intersectRaysKernelMF->SetWorkOffset(0, offset, 0);
+	intersectRaysKernelMF->SetWorkSize(roundedWidth, roundedRows, 1);
+	intersectRaysKernelBVH->SetWorkOffset(0, offset, 0);
+	intersectRaysKernelBVH->SetWorkSize(roundedWidth, roundedRows, 1);
+	intersectRaysKernelOpt->SetWorkOffset(0, offset, 0);
+	intersectRaysKernelOpt->SetWorkSize(roundedWidth, roundedRows, 1);
+}
+
+void GpuTracer::TraceRegion(glm::vec4 *output)
+{
+	generateRayKernel->Run();
+	RunIntersectKernel();
+
+	// a region spans whole rows so its colors are stored contiguously
+	const int rowCount = glm::min(m_RowCount, m_Height - m_FirstRow);
+	if (rowCount > 0)
+	{
+		const auto offset = static_cast<unsigned int>(m_FirstRow * m_Width);
+		const auto count = static_cast<unsigned int>(rowCount * m_Width);
+		colorBuffer->CopyFromDevice(offset * sizeof(glm::vec4), count * sizeof(glm::vec4), output + offset);
+	}
+
+	m_Samples++;
+	UpdateCamera();
+}
+
+void GpuTracer::RunIntersectKernel()
+{
+	// SetMode overwrites these
+	intersectRaysKernelRef->SetArgument(18, m_Width);
+	intersectRaysKernelRef->SetArgument(19, m_Height);
+	intersectRaysKernelMF->SetArgument(18, m_Width);
+	intersectRaysKernelMF->SetArgument(19, m_Height);
+	intersectRaysKernelBVH->SetArgument(18, m_Width);
+	intersectRaysKernelBVH->SetArgument(19, m_Height);
+	intersectRaysKernelOpt->SetArgument(18, m_Width);
+	intersectRaysKernelOpt->SetArgument(19, m_Height);
+
 	switch (m_Mode)
 	{
 	case (Mode::Reference):
@@ -161,12 +269,10 @@ void GpuTracer::Render(Surface *)
 		intersectRaysKernelMF->Run();
 		break;
 	}
-	drawKernel->Run(outputBuffer);
-#endif
-
-	m_Samples++;
+}
 
-	// update camera
+void GpuTracer::UpdateCamera()
+{
 	this->SetupCamera();
 
 	// calculate on CPU to make sure we only calculate it once
@@ -177,20 +283,51 @@ void GpuTracer::Render(Surface *)
 
 	generateRayKernel->SetArgument(3, vec4(horizontal, 1.0f));
 	generateRayKernel->SetArgument(4, vec4(vertical, 1.0f));
+	// the field of view determines the spread of the ray cones used for texture filtering
+	generateRayKernel->SetArgument(7, m_Camera->GetPixelSpread());
 }
 
 void GpuTracer::Reset()
 {
 	Kernel::SyncQueue();
+
+	// the list is shared by every device, so each tracer keeps track of the revision it uploaded
+	if (m_ObjectList->GetRevision() != m_Revision)
+		RebuildBVH();
+	else
+		UpdateLights(false);
+
 	m_Samples = 0;
 }
 
-void GpuTracer::Resize(Texture *newOutput)
+void GpuTracer::Resize(Texture *newOutput) { Resize(newOutput->GetWidth(), newOutput->GetHeight(), newOutput); }
+
+const glm::vec4 *GpuTracer::ReadOutput()
 {
-	outputTexture[0] = newOutput;
+	if (Kernel::canDoInterop && outputTexture[0] != nullptr)
+		utils::FatalError(__FILE__, __LINE__, "Output is shared with OpenGL and cannot be read back.", "GpuTracer");
 
-	const int width = newOutput->GetWidth();
-	const int height = newOutput->GetHeight();
+	outputBuffer->CopyFromDevice();
+	return outputBuffer->GetHostPtr<glm::vec4>();
+}
+
+const FrameBuffer *GpuTracer::GetFrameBuffer()
+{
+	std::vector<glm::vec4> colors(size_t(m_Width) * size_t(m_Height));
+	previousColorBuffer->CopyFromDevice(0, static_cast<unsigned int>(colors.size() * sizeof(glm::vec4)),
+										colors.data());
+
+	if (m_FrameBuffer.GetWidth() != m_Width || m_FrameBuffer.GetHeight() != m_Height)
+		m_FrameBuffer.Resize(m_Width, m_Height);
+	for (size_t i = 0; i < colors.size(); i++)
+		m_FrameBuffer.Set(AOV::Color, int(i), glm::vec3(colors[i]));
+	m_FrameBuffer.SetSampleCount(1); // the device already averaged
+	return &m_FrameBuffer;
+}
+
+void GpuTracer::Resize(int width, int height, Texture *newOutput)
+{
+	outputTexture[0] = newOutput;
 
 	m_Width = width;
 	m_Height = height;
@@ -212,11 +349,14 @@ void GpuTracer::Resize(Texture *newOutput)
 	const auto roundedWidth = RoundToPowerOf2(width);
 	const auto roundedHeight = RoundToPowerOf2(height);
 
-	// set up textures
-	outputBuffer = new Buffer(newOutput, BufferType::TARGET);
+	// set up textures, without a texture the output only lives on the device
+	if (newOutput != nullptr)
+		outputBuffer = new Buffer(newOutput, BufferType::TARGET);
+	else
+		outputBuffer = new Buffer(width, height, BufferType::TARGET);
 
 	// create buffer to store primary ray
-	raysBuffer = new Buffer(width * height * 48);
+	raysBuffer = new Buffer(width * height * 64);
 
 	// create buffers to store colors for accumulation
 	previousColorBuffer = new Buffer(width * height * sizeof(glm::vec4));
@@ -271,26 +411,129 @@ void GpuTracer::SetupSeeds(int width, int height)
 
 void GpuTracer::SetupObjects()
 {
-	// copy initial BVH tree to GPU
-	primitiveIndicesBuffer = new Buffer(static_cast<unsigned int>(m_BVHTree->m_PrimitiveCount) * sizeof(unsigned int),
-										m_BVHTree->m_PrimitiveIndices.data());
-	primitiveIndicesBuffer->CopyToDevice();
+	m_Revision = m_ObjectList->GetRevision();
+	triangleBuffer =
+		new Buffer(static_cast<unsigned int>(m_ObjectList->GetTriangles().size()) * sizeof(prims::GpuTriangle),
+				   (void *)m_ObjectList->GetTriangles().data());
+	triangleBuffer->CopyToDevice();
 
-	// create kernels
-#if MBVH
-	BVHNodeBuffer = new Buffer(sizeof(bvh::BVHNode), m_BVHTree->m_BVHPool.data());
+	const auto &vertices = m_ObjectList->GetAttributes().GetVertices();
+	vertexBuffer = new Buffer(static_cast<unsigned int>(vertices.size()) * sizeof(prims::PackedVertex),
+							  (void *)vertices.data());
+	vertexBuffer->CopyToDevice();
+
+	if (m_TopLevelBVH != nullptr)
+	{
+		// meshes are stored back to back, every instance knows the offsets of its mesh
+		const auto &mNodes = m_TopLevelBVH->GetMBVHNodes();
+		MBVHNodeBuffer = new Buffer(static_cast<unsigned int>(mNodes.size()) * sizeof(bvh::MBVHNode),
+									(void *)mNodes.data());
+		MBVHNodeBuffer->CopyToDevice();
+
+		const auto &isects = m_TopLevelBVH->GetIsects();
+		triangleIsectBuffer = new Buffer(static_cast<unsigned int>(isects.size()) * sizeof(prims::GpuTriangleIsect),
+										 (void *)isects.data());
+		triangleIsectBuffer->CopyToDevice();
+
+		SetupInstances();
+		return;
+	}
+
+#if MBVH && GPU_BVH
+	// the device builder owns the MBVH and the triangles used during traversal
+	m_LBVHBuilder = new bvh::LBVHBuilder(triangleBuffer, m_ObjectList->GetPrimitiveCount(), bvh::SceneBuildConfig());
+	m_LBVHBuilder->Build();
+	MBVHNodeBuffer = m_LBVHBuilder->GetMBVHNodes();
+	triangleIsectBuffer = m_LBVHBuilder->GetTriangleIsects();
 #else
+	// copy initial BVH tree to GPU, triangles used during traversal are stored in leaf order
+	const std::vector<prims::GpuTriangleIsect> isects = m_ObjectList->GetIsectTriangles(m_BVHTree->m_PrimitiveIndices);
+	triangleIsectBuffer = new Buffer(static_cast<unsigned int>(isects.size()) * sizeof(prims::GpuTriangleIsect));
+	memcpy(triangleIsectBuffer->GetHostPtr<prims::GpuTriangleIsect>(), isects.data(),
+		   isects.size() * sizeof(prims::GpuTriangleIsect));
+	triangleIsectBuffer->CopyToDevice();
+
+#if !MBVH
 	BVHNodeBuffer = new Buffer(m_BVHTree->m_BVHPool.size() * sizeof(BVHNode), m_BVHTree->m_BVHPool.data());
-#endif
 	BVHNodeBuffer->CopyToDevice();
+#endif
 
-	MBVHNodeBuffer = new Buffer((m_MBVHTree->m_FinalPtr + 1) * sizeof(bvh::MBVHNode), m_MBVHTree->m_Tree.data());
+	MBVHNodeBuffer = new Buffer(m_MBVHTree->m_FinalPtr * sizeof(bvh::MBVHNode), m_MBVHTree->m_Tree.data());
 	MBVHNodeBuffer->CopyToDevice();
+#endif
 
-	triangleBuffer =
-		new Buffer(static_cast<unsigned int>(m_ObjectList->GetTriangles().size()) * sizeof(prims::GpuTriangle),
-				   (void *)m_ObjectList->GetTriangles().data());
+	// a flat triangle list is traced as a single instance without a transform
+	instanceBuffer = new Buffer(sizeof(bvh::GpuInstance));
+	*instanceBuffer->GetHostPtr<bvh::GpuInstance>() = bvh::GpuInstance(glm::mat4(1.f), glm::mat4(1.f), 0, 0);
+	instanceBuffer->CopyToDevice();
+
+#if MBVH
+	// top-level tree with a single leaf that contains the instance
+	bvh::BVHNode root{};
+	root.bounds = bvh::AABB(glm::vec3(-1e34f), glm::vec3(1e34f));
+	root.SetLeftFirst(0);
+	root.SetCount(1);
+	BVHNodeBuffer = new Buffer(sizeof(bvh::BVHNode));
+	*BVHNodeBuffer->GetHostPtr<bvh::BVHNode>() = root;
+	BVHNodeBuffer->CopyToDevice();
+#endif
+}
+
+bool GpuTracer::SetupInstances()
+{
+	const auto &instances = m_TopLevelBVH->GetInstances();
+	const auto &nodes = m_TopLevelBVH->GetTLASNodes();
+	const auto instanceSize = static_cast<unsigned int>(instances.size() * sizeof(bvh::GpuInstance));
+	const auto nodeSize = static_cast<unsigned int>(nodes.size() * sizeof(bvh::BVHNode));
+
+	// only reallocate when instances were added, kernel arguments need to be set again in that case
+	bool reallocated = false;
+	if (instanceBuffer == nullptr || instanceBuffer->m_Size < instanceSize)
+	{
+		delete instanceBuffer;
+		instanceBuffer = new Buffer(instanceSize);
+		reallocated = true;
+	}
+	if (BVHNodeBuffer == nullptr || BVHNodeBuffer->m_Size < nodeSize)
+	{
+		delete BVHNodeBuffer;
+		BVHNodeBuffer = new Buffer(nodeSize);
+		reallocated = true;
+	}
+
+	memcpy(instanceBuffer->GetHostPtr<bvh::GpuInstance>(), instances.data(), instanceSize);
+	memcpy(BVHNodeBuffer->GetHostPtr<bvh::BVHNode>(), nodes.data(), nodeSize);
+	instanceBuffer->CopyToDevice(false);
+	BVHNodeBuffer->CopyToDevice(false);
+
+	return reallocated;
+}
+
+void GpuTracer::UpdateInstances()
+{
+	if (m_TopLevelBVH == nullptr)
+		return;
+
+	Kernel::SyncQueue();
+	m_TopLevelBVH->UpdateInstances();
+	if (SetupInstances())
+		SetArguments();
+	Reset();
+}
+
+void GpuTracer::RebuildBVH()
+{
+	m_Revision = m_ObjectList->GetRevision();
 	triangleBuffer->CopyToDevice();
+
+	// only set when the MBVH is built on the device, instanced scenes keep their host-built trees
+	if (m_LBVHBuilder != nullptr)
+		m_LBVHBuilder->Build();
+	else
+		utils::WarningMessage(__FILE__, __LINE__, "Triangles changed, but BVHs built on the host are not rebuilt.",
+							  "GpuTracer");
+
+	UpdateLights(true);
 }
 
 void GpuTracer::SetupMaterials()
@@ -308,39 +551,103 @@ void GpuTracer::SetupMaterials()
 
 void GpuTracer::SetupNEEData()
 {
-	// NEE
+	delete lightIndices;
+	delete lightAliasTable;
+	delete lightNodes;
+	delete lightTrails;
+
+	// NEE, lights are picked proportional to their area using an alias table
 	lightCount = static_cast<int>(m_ObjectList->GetLightIndices().size());
-	lightArea = 0.f;
 	if (lightCount > 0)
 	{
 		lightIndices = new Buffer(lightCount * sizeof(unsigned int), &m_ObjectList->GetLightIndices()[0]);
 		lightIndices->CopyToDevice();
-		for (auto &i : m_ObjectList->GetLightIndices())
-		{
-			auto &t = m_ObjectList->GetTriangle(i);
-			lightArea += t.m_Area;
-		}
-
-		std::vector<float> lLotteryTickets{};
-		lLotteryTickets.resize(lightCount);
-		lLotteryTickets[0] = m_ObjectList->GetTriangle(0).m_Area / lightArea;
-		for (int i = 1; i < lightCount; i++)
-		{
-			lLotteryTickets[i] = lLotteryTickets[i - 1] + m_ObjectList->GetTriangle(i).m_Area / lightArea;
-		}
-
-		if (lightCount != 0)
-		{
-			lLotteryTickets[lightCount - 1] = 1.f;
-		}
 
-		lightLotteryTickets = new Buffer(lightCount * sizeof(float), lLotteryTickets.data());
-		lightLotteryTickets->CopyToDevice();
+		std::vector<float> lightAreas(lightCount);
+		for (int i = 0; i < lightCount; i++)
+			lightAreas[i] = m_ObjectList->GetTriangles()[m_ObjectList->GetLightIndices()[i]].m_Area;
+		m_LightTable.Build(lightAreas);
+		lightArea = m_LightTable.GetTotalWeight();
+
+		lightAliasTable = new Buffer(lightCount * sizeof(utils::AliasEntry), (void *)m_LightTable.GetEntries().data());
+		lightAliasTable->CopyToDevice();
+
+		// a tree over n lights always has 2n - 1 nodes, so rebuilds can reuse the buffers
+		BuildLightTree();
+		lightNodes = new Buffer((2 * lightCount - 1) * sizeof(bvh::LightNode), (void *)m_LightTree.GetNodes().data());
+		lightNodes->CopyToDevice();
+		lightTrails = new Buffer(lightCount * sizeof(uint64_t), (void *)m_LightTree.GetTrails().data());
+		lightTrails->CopyToDevice();
 	}
 	else
 	{
-		lightLotteryTickets = new Buffer(4);
+		lightArea = 0.f;
+		lightAliasTable = new Buffer(sizeof(utils::AliasEntry));
 		lightIndices = new Buffer(4);
+		lightNodes = new Buffer(sizeof(bvh::LightNode));
+		lightTrails = new Buffer(sizeof(uint64_t));
+	}
+}
+
+void GpuTracer::BuildLightTree()
+{
+	const auto &indices = m_ObjectList->GetLightIndices();
+	const prims::MeshAttributes &attributes = m_ObjectList->GetAttributes();
+	std::vector<bvh::LightBounds> bounds(indices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		const prims::GpuTriangle &triangle = m_ObjectList->GetTriangles()[indices[i]];
+		const vec3 emission = MaterialManager::GetInstance()->GetMaterial(triangle.matIdx).GetEmission();
+
+		bvh::LightBounds &b = bounds[i];
+		b.bmin = glm::min(triangle.p0, glm::min(triangle.p1, triangle.p2));
+		b.bmax = glm::max(triangle.p0, glm::max(triangle.p1, triangle.p2));
+		b.phi = triangle.m_Area * (emission.r + emission.g + emission.b) / 3.0f;
+		b.cosThetaE = 0.0f;
+
+		// NEE uses the interpolated normal, so the cone has to contain all three vertex normals
+		const vec3 n0 = attributes.GetNormal(triangle.v0);
+		const vec3 n1 = attributes.GetNormal(triangle.v1);
+		const vec3 n2 = attributes.GetNormal(triangle.v2);
+		b.axis = normalize(n0 + n1 + n2);
+		if (dot(b.axis, b.axis) > 0.0f)
+			b.cosThetaO = glm::min(dot(b.axis, n0), glm::min(dot(b.axis, n1), dot(b.axis, n2)));
+		else
+			b.axis = vec3(0.0f, 0.0f, 1.0f), b.cosThetaO = -1.0f;
+	}
+
+	m_LightTree.Build(bounds);
+}
+
+void GpuTracer::UpdateLights(bool moved)
+{
+	if (lightCount == 0)
+		return;
+
+	const auto &triangles = m_ObjectList->GetTriangles();
+	for (int i = 0; i < lightCount; i++)
+		m_LightTable.SetWeight(i, triangles[m_ObjectList->GetLightIndices()[i]].m_Area);
+
+	// the light count stays the same, so the buffers keep their size. Rebuilds may reallocate the host vectors, the
+	// data is written from wherever they live now instead of the pointers the buffers were created with.
+	const bool weightsChanged = m_LightTable.Update();
+	if (weightsChanged)
+	{
+		lightArea = m_LightTable.GetTotalWeight();
+		const auto &entries = m_LightTable.GetEntries();
+		lightAliasTable->CopyToDevice(0, static_cast<unsigned int>(entries.size() * sizeof(utils::AliasEntry)),
+									  entries.data());
+		SetArguments();
+	}
+
+	// lights may have moved without changing size
+	if (weightsChanged || moved)
+	{
+		BuildLightTree();
+		const auto &nodes = m_LightTree.GetNodes();
+		lightNodes->CopyToDevice(0, static_cast<unsigned int>(nodes.size() * sizeof(bvh::LightNode)), nodes.data());
+		const auto &trails = m_LightTree.GetTrails();
+		lightTrails->CopyToDevice(0, static_cast<unsigned int>(trails.size() * sizeof(uint64_t)), trails.data());
 	}
 }
 
@@ -351,31 +658,23 @@ void GpuTracer::SetupTextures()
 
 	if (!MaterialManager::GetInstance()->GetTextures().empty())
 	{
+		// mip pyramids of all textures one after another, offsets are in texels. The device keeps every texture
+		// resident, paged textures are read from their tiled files once.
 		std::vector<TextureInfo> textureInfos{};
-		unsigned int vec4Offset = 0;
-		for (auto &tex : MaterialManager::GetInstance()->GetTextures())
+		std::vector<unsigned int> texels{};
+		for (const auto &tex : MaterialManager::GetInstance()->GetTextures())
 		{
-			const auto texSize = tex->GetWidth() * tex->GetHeight();
-			textureInfos.emplace_back(tex->GetWidth(), tex->GetHeight(), vec4Offset);
-			vec4Offset += texSize;
+			textureInfos.emplace_back(tex->GetWidth(), tex->GetHeight(), static_cast<int>(texels.size()),
+									  tex->GetLevelCount());
+			const std::vector<unsigned int> texture = tex->ReadTexels();
+			texels.insert(texels.end(), texture.begin(), texture.end());
 		}
 
-		auto *textureColors = new glm::vec4[vec4Offset];
-		for (unsigned int i = 0; i < textureInfos.size(); i++)
-		{
-			const int offset = textureInfos[i].offset;
-
-			auto tex = MaterialManager::GetInstance()->GetTextures()[i];
-			memcpy(&textureColors[offset], tex->GetTextureBuffer(), tex->GetWidth() * tex->GetHeight() * sizeof(vec4));
-		}
-
-		textureBuffer = new Buffer(vec4Offset * sizeof(vec4), textureColors);
+		textureBuffer = new Buffer(static_cast<unsigned int>(texels.size()) * sizeof(unsigned int), texels.data());
 		textureBuffer->CopyToDevice();
 		textureInfoBuffer =
 			new Buffer(static_cast<unsigned int>(textureInfos.size()) * sizeof(TextureInfo), textureInfos.data());
 		textureInfoBuffer->CopyToDevice();
-
-		delete[] textureColors;
 	}
 }
 
@@ -383,6 +682,8 @@ void GpuTracer::SetupSkybox(Surface *skyBox)
 {
 	delete skyDome;
 	delete skyDomeInfo;
+	delete skyTables;
+	delete skyPdfs;
 
 	m_HasSkybox = (skyBox != nullptr);
 	if (m_HasSkybox)
@@ -392,11 +693,23 @@ void GpuTracer::SetupSkybox(Surface *skyBox)
 		skyDomeInfo = new Buffer(sizeof(TextureInfo), &skyInfo);
 		skyDome->CopyToDevice();
 		skyDomeInfo->CopyToDevice();
+
+		// importance sampling tables, built once per map
+		const EnvironmentSampler sampler(skyBox);
+		const std::vector<utils::AliasEntry> tables = sampler.GetTables();
+		skyTables = new Buffer(static_cast<unsigned int>(tables.size() * sizeof(utils::AliasEntry)),
+							   (void *)tables.data());
+		skyPdfs = new Buffer(static_cast<unsigned int>(sampler.GetTexelPdfs().size() * sizeof(float)),
+							 (void *)sampler.GetTexelPdfs().data());
+		skyTables->CopyToDevice();
+		skyPdfs->CopyToDevice();
 	}
 	else
 	{
 		skyDome = new Buffer(4);
 		skyDomeInfo = new Buffer(4);
+		skyTables = new Buffer(sizeof(utils::AliasEntry));
+		skyPdfs = new Buffer(4);
 	}
 }
 
@@ -416,17 +729,18 @@ void GpuTracer::SetArguments()
 	generateRayKernel->SetArgument(4, vec4(vertical, 1.0f));
 	generateRayKernel->SetArgument(5, m_Width);
 	generateRayKernel->SetArgument(6, m_Height);
+	generateRayKernel->SetArgument(7, m_Camera->GetPixelSpread());
 
 	intersectRaysKernelRef->SetArgument(0, raysBuffer);
 	intersectRaysKernelRef->SetArgument(1, materialBuffer);
 	intersectRaysKernelRef->SetArgument(2, triangleBuffer);
 	intersectRaysKernelRef->SetArgument(3, BVHNodeBuffer);
 	intersectRaysKernelRef->SetArgument(4, MBVHNodeBuffer);
-	intersectRaysKernelRef->SetArgument(5, primitiveIndicesBuffer);
+	intersectRaysKernelRef->SetArgument(5, triangleIsectBuffer);
 	intersectRaysKernelRef->SetArgument(6, seedBuffer);
 	intersectRaysKernelRef->SetArgument(7, colorBuffer);
 	intersectRaysKernelRef->SetArgument(8, lightIndices);
-	intersectRaysKernelRef->SetArgument(9, lightLotteryTickets);
+	intersectRaysKernelRef->SetArgument(9, lightAliasTable);
 	intersectRaysKernelRef->SetArgument(10, textureBuffer);
 	intersectRaysKernelRef->SetArgument(11, textureInfoBuffer);
 	intersectRaysKernelRef->SetArgument(12, skyDome);
@@ -437,17 +751,23 @@ void GpuTracer::SetArguments()
 	intersectRaysKernelRef->SetArgument(17, lightCount);
 	intersectRaysKernelRef->SetArgument(18, m_Width);
 	intersectRaysKernelRef->SetArgument(19, m_Height);
+	intersectRaysKernelRef->SetArgument(20, instanceBuffer);
+	intersectRaysKernelRef->SetArgument(21, lightNodes);
+	intersectRaysKernelRef->SetArgument(22, lightTrails);
+	intersectRaysKernelRef->SetArgument(23, skyTables);
+	intersectRaysKernelRef->SetArgument(24, skyPdfs);
+	intersectRaysKernelRef->SetArgument(25, vertexBuffer);
 
 	intersectRaysKernelOpt->SetArgument(0, raysBuffer);
 	intersectRaysKernelOpt->SetArgument(1, materialBuffer);
 	intersectRaysKernelOpt->SetArgument(2, triangleBuffer);
 	intersectRaysKernelOpt->SetArgument(3, BVHNodeBuffer);
 	intersectRaysKernelOpt->SetArgument(4, MBVHNodeBuffer);
-	intersectRaysKernelOpt->SetArgument(5, primitiveIndicesBuffer);
+	intersectRaysKernelOpt->SetArgument(5, triangleIsectBuffer);
 	intersectRaysKernelOpt->SetArgument(6, seedBuffer);
 	intersectRaysKernelOpt->SetArgument(7, colorBuffer);
 	intersectRaysKernelOpt->SetArgument(8, lightIndices);
-	intersectRaysKernelOpt->SetArgument(9, lightLotteryTickets);
+	intersectRaysKernelOpt->SetArgument(9, lightAliasTable);
 	intersectRaysKernelOpt->SetArgument(10, textureBuffer);
 	intersectRaysKernelOpt->SetArgument(11, textureInfoBuffer);
 	intersectRaysKernelOpt->SetArgument(12, skyDome);
@@ -458,17 +778,23 @@ void GpuTracer::SetArguments()
 	intersectRaysKernelOpt->SetArgument(17, lightCount);
 	intersectRaysKernelOpt->SetArgument(18, m_Width);
 	intersectRaysKernelOpt->SetArgument(19, m_Height);
+	intersectRaysKernelOpt->SetArgument(20, instanceBuffer);
+	intersectRaysKernelOpt->SetArgument(21, lightNodes);
+	intersectRaysKernelOpt->SetArgument(22, lightTrails);
+	intersectRaysKernelOpt->SetArgument(23, skyTables);
+	intersectRaysKernelOpt->SetArgument(24, skyPdfs);
+	intersectRaysKernelOpt->SetArgument(25, vertexBuffer);
 
 	intersectRaysKernelBVH->SetArgument(0, raysBuffer);
 	intersectRaysKernelBVH->SetArgument(1, materialBuffer);
 	intersectRaysKernelBVH->SetArgument(2, triangleBuffer);
 	intersectRaysKernelBVH->SetArgument(3, BVHNodeBuffer);
 	intersectRaysKernelBVH->SetArgument(4, MBVHNodeBuffer);
-	intersectRaysKernelBVH->SetArgument(5, primitiveIndicesBuffer);
+	intersectRaysKernelBVH->SetArgument(5, triangleIsectBuffer);
 	intersectRaysKernelBVH->SetArgument(6, seedBuffer);
 	intersectRaysKernelBVH->SetArgument(7, colorBuffer);
 	intersectRaysKernelBVH->SetArgument(8, lightIndices);
-	intersectRaysKernelBVH->SetArgument(9, lightLotteryTickets);
+	intersectRaysKernelBVH->SetArgument(9, lightAliasTable);
 	intersectRaysKernelBVH->SetArgument(10, textureBuffer);
 	intersectRaysKernelBVH->SetArgument(11, textureInfoBuffer);
 	intersectRaysKernelBVH->SetArgument(12, skyDome);
@@ -479,17 +805,23 @@ void GpuTracer::SetArguments()
 	intersectRaysKernelBVH->SetArgument(17, lightCount);
 	intersectRaysKernelBVH->SetArgument(18, m_Width);
 	intersectRaysKernelBVH->SetArgument(19, m_Height);
+	intersectRaysKernelBVH->SetArgument(20, instanceBuffer);
+	intersectRaysKernelBVH->SetArgument(21, lightNodes);
+	intersectRaysKernelBVH->SetArgument(22, lightTrails);
+	intersectRaysKernelBVH->SetArgument(23, skyTables);
+	intersectRaysKernelBVH->SetArgument(24, skyPdfs);
+	intersectRaysKernelBVH->SetArgument(25, vertexBuffer);
 
 	intersectRaysKernelMF->SetArgument(0, raysBuffer);
 	intersectRaysKernelMF->SetArgument(1, materialBuffer);
 	intersectRaysKernelMF->SetArgument(2, triangleBuffer);
 	intersectRaysKernelMF->SetArgument(3, BVHNodeBuffer);
 	intersectRaysKernelMF->SetArgument(4, MBVHNodeBuffer);
-	intersectRaysKernelMF->SetArgument(5, primitiveIndicesBuffer);
+	intersectRaysKernelMF->SetArgument(5, triangleIsectBuffer);
 	intersectRaysKernelMF->SetArgument(6, seedBuffer);
 	intersectRaysKernelMF->SetArgument(7, colorBuffer);
 	intersectRaysKernelMF->SetArgument(8, lightIndices);
-	intersectRaysKernelMF->SetArgument(9, lightLotteryTickets);
+	intersectRaysKernelMF->SetArgument(9, lightAliasTable);
 	intersectRaysKernelMF->SetArgument(10, textureBuffer);
 	intersectRaysKernelMF->SetArgument(11, textureInfoBuffer);
 	intersectRaysKernelMF->SetArgument(12, skyDome);
@@ -500,6 +832,12 @@ void GpuTracer::SetArguments()
 	intersectRaysKernelMF->SetArgument(17, lightCount);
 	intersectRaysKernelMF->SetArgument(18, m_Width);
 	intersectRaysKernelMF->SetArgument(19, m_Height);
+	intersectRaysKernelMF->SetArgument(20, instanceBuffer);
+	intersectRaysKernelMF->SetArgument(21, lightNodes);
+	intersectRaysKernelMF->SetArgument(22, lightTrails);
+	intersectRaysKernelMF->SetArgument(23, skyTables);
+	intersectRaysKernelMF->SetArgument(24, skyPdfs);
+	intersectRaysKernelMF->SetArgument(25, vertexBuffer);
 
 	drawKernel->SetArgument(0, outputBuffer);
 	drawKernel->SetArgument(1, previousColorBuffer);
@@ -513,11 +851,11 @@ void GpuTracer::SetArguments()
 	wIntersectKernel->SetArgument(2, triangleBuffer);
 	wIntersectKernel->SetArgument(3, BVHNodeBuffer);
 	wIntersectKernel->SetArgument(4, MBVHNodeBuffer);
-	wIntersectKernel->SetArgument(5, primitiveIndicesBuffer);
+	wIntersectKernel->SetArgument(5, triangleIsectBuffer);
 	wIntersectKernel->SetArgument(6, seedBuffer);
 	wIntersectKernel->SetArgument(7, colorBuffer);
 	wIntersectKernel->SetArgument(8, lightIndices);
-	wIntersectKernel->SetArgument(9, lightLotteryTickets);
+	wIntersectKernel->SetArgument(9, lightAliasTable);
 	wIntersectKernel->SetArgument(10, textureBuffer);
 	wIntersectKernel->SetArgument(11, textureInfoBuffer);
 	wIntersectKernel->SetArgument(12, skyDome);
@@ -528,17 +866,23 @@ void GpuTracer::SetArguments()
 	wIntersectKernel->SetArgument(17, lightCount);
 	wIntersectKernel->SetArgument(18, m_Width);
 	wIntersectKernel->SetArgument(19, m_Height);
+	wIntersectKernel->SetArgument(20, instanceBuffer);
+	wIntersectKernel->SetArgument(21, lightNodes);
+	wIntersectKernel->SetArgument(22, lightTrails);
+	wIntersectKernel->SetArgument(23, skyTables);
+	wIntersectKernel->SetArgument(24, skyPdfs);
+	wIntersectKernel->SetArgument(25, vertexBuffer);
 
 	wShadeKernel->SetArgument(0, raysBuffer);
 	wShadeKernel->SetArgument(1, materialBuffer);
 	wShadeKernel->SetArgument(2, triangleBuffer);
 	wShadeKernel->SetArgument(3, BVHNodeBuffer);
 	wShadeKernel->SetArgument(4, MBVHNodeBuffer);
-	wShadeKernel->SetArgument(5, primitiveIndicesBuffer);
+	wShadeKernel->SetArgument(5, triangleIsectBuffer);
 	wShadeKernel->SetArgument(6, seedBuffer);
 	wShadeKernel->SetArgument(7, colorBuffer);
 	wShadeKernel->SetArgument(8, lightIndices);
-	wShadeKernel->SetArgument(9, lightLotteryTickets);
+	wShadeKernel->SetArgument(9, lightAliasTable);
 	wShadeKernel->SetArgument(10, textureBuffer);
 	wShadeKernel->SetArgument(11, textureInfoBuffer);
 	wShadeKernel->SetArgument(12, skyDome);
@@ -549,6 +893,12 @@ void GpuTracer::SetArguments()
 	wShadeKernel->SetArgument(17, lightCount);
 	wShadeKernel->SetArgument(18, m_Width);
 	wShadeKernel->SetArgument(19, m_Height);
+	wShadeKernel->SetArgument(20, instanceBuffer);
+	wShadeKernel->SetArgument(21, lightNodes);
+	wShadeKernel->SetArgument(22, lightTrails);
+	wShadeKernel->SetArgument(23, skyTables);
+	wShadeKernel->SetArgument(24, skyPdfs);
+	wShadeKernel->SetArgument(25, vertexBuffer);
 
 	wDrawKernel->SetArgument(0, outputBuffer);
 	wDrawKernel->SetArgument(1, raysBuffer);
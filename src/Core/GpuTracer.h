@@ -4,14 +4,19 @@
 
 #include <glm/glm.hpp>
 
+#include "BVH/GpuTopLevelBVH.h"
+#include "BVH/LBVHBuilder.h"
 #include "BVH/MBVHTree.h"
 #include "BVH/StaticBVHTree.h"
 #include "CL/Buffer.h"
 #include "CL/OpenCL.h"
 #include "Core/Camera.h"
+#include "Core/EnvironmentSampler.h"
 #include "Core/PathTracer.h"
 #include "GL/Texture.h"
+#include "BVH/LightBVH.h"
 #include "Primitives/GpuTriangleList.h"
+#include "Utils/AliasTable.h"
 #include "Utils/Memory.h"
 
 using namespace cl;
@@ -29,14 +34,15 @@ struct TextureInfo
 		glm::vec<4, int> data;
 		struct
 		{
-			int width, height, offset, dummy;
+			int width, height, offset, levels;
 		};
 	};
-	TextureInfo(int width, int height, int offset)
+	TextureInfo(int width, int height, int offset, int levels = 1)
 	{
 		this->width = width;
 		this->height = height;
 		this->offset = offset;
+		this->levels = levels;
 	}
 };
 
@@ -46,6 +52,12 @@ class GpuTracer : public Renderer
 	GpuTracer() = default;
 	GpuTracer(prims::GpuTriangleList *objectList, gl::Texture *targetTexture1, gl::Texture *targetTexture2,
 			  Camera *camera, Surface *skyBox = nullptr, ctpl::ThreadPool *pool = nullptr);
+	// Traces the meshes of a two-level scene, instances can be moved every frame using UpdateInstances
+	GpuTracer(bvh::GpuTopLevelBVH *scene, gl::Texture *targetTexture1, gl::Texture *targetTexture2, Camera *camera,
+			  Surface *skyBox = nullptr);
+	// Renders into an image in device memory without any OpenGL texture, used when running headless
+	GpuTracer(prims::GpuTriangleList *objectList, int width, int height, Camera *camera, Surface *skyBox = nullptr,
+			  ctpl::ThreadPool *pool = nullptr);
 	~GpuTracer() override;
 
 	void Render(Surface *output) override;
@@ -74,13 +86,37 @@ class GpuTracer : public Renderer
 
 	void Resize(gl::Texture *newOutput) override;
 
+	// Without a texture the output image only lives in device memory
+	void Resize(int width, int height, gl::Texture *newOutput);
+
+	// Reads the last drawn frame back into host memory, returns RGBA floats
+	const glm::vec4 *ReadOutput();
+
+	// Restricts tracing to whole rows so several devices can share an image, needs to be set again after resizing
+	void SetRegion(int firstRow, int rowCount);
+
+	// Traces one sample per pixel of the region without accumulating it and reads the colors back into output,
+	// which holds the full image
+	void TraceRegion(glm::vec4 *output);
+
 	void SetupCamera();
 	void SetupSeeds(int width, int height);
 
 	void SetupObjects();
+
+	// Uploads the triangles and rebuilds the device BVH after they were edited, called from Reset
+	void RebuildBVH();
+
+	// Rebuilds the top-level BVH after GameObjects have moved and uploads the instances
+	void UpdateInstances();
 	void SetupMaterials();
 
 	void SetupNEEData();
+
+	// Rebuilds the light alias table when light areas changed, the light tree also when lights moved
+	void UpdateLights(bool moved);
+
+	void BuildLightTree();
 	void SetupTextures();
 	void SetupSkybox(Surface *skyBox);
 
@@ -111,6 +147,9 @@ class GpuTracer : public Renderer
 
 	inline int GetSamples() const override { return m_Samples; }
 
+	// Waits for the queued kernels and reads the accumulated colors back
+	const FrameBuffer *GetFrameBuffer() override;
+
 	inline void SetOutput(gl::Texture *outputTexture1, gl::Texture *outputTexture2)
 	{
 		this->outputTexture[0] = outputTexture1;
@@ -128,16 +167,29 @@ class GpuTracer : public Renderer
 	};
 
   private:
+	void Init(int width, int height, gl::Texture *targetTexture1, gl::Texture *targetTexture2, Surface *skyBox);
+
+	void RunIntersectKernel();
+
+	// Uploads the camera for the next frame
+	void UpdateCamera();
+
+	// Returns true when the instance buffers had to be reallocated
+	bool SetupInstances();
+
 	Camera *m_Camera = nullptr;
 	prims::GpuTriangleList *m_ObjectList = nullptr;
 	bvh::StaticBVHTree *m_BVHTree = nullptr;
 	bvh::MBVHTree *m_MBVHTree = nullptr;
+	bvh::LBVHBuilder *m_LBVHBuilder = nullptr;
+	bvh::GpuTopLevelBVH *m_TopLevelBVH = nullptr;
 	gl::Texture *outputTexture[2] = {nullptr, nullptr};
 	cl::Buffer *outputBuffer = nullptr;
 
-	cl::Buffer *primitiveIndicesBuffer = nullptr;
+	cl::Buffer *triangleIsectBuffer = nullptr;
 	cl::Buffer *BVHNodeBuffer = nullptr;
 	cl::Buffer *MBVHNodeBuffer = nullptr;
+	cl::Buffer *instanceBuffer = nullptr;
 	cl::Buffer *seedBuffer = nullptr;
 	cl::Buffer *previousColorBuffer = nullptr;
 	cl::Buffer *colorBuffer = nullptr;
@@ -145,15 +197,23 @@ class GpuTracer : public Renderer
 	cl::Buffer *textureInfoBuffer = nullptr;
 	cl::Buffer *skyDome = nullptr;
 	cl::Buffer *skyDomeInfo = nullptr;
+	cl::Buffer *skyTables = nullptr; // marginal and conditional alias tables for sampling the sky
+	cl::Buffer *skyPdfs = nullptr;
 
 	cl::Buffer *raysBuffer = nullptr;
 	cl::Buffer *cameraBuffer = nullptr;
 	cl::Buffer *materialBuffer = nullptr;
 	cl::Buffer *microfacetBuffer = nullptr;
 	cl::Buffer *triangleBuffer = nullptr;
+	cl::Buffer *vertexBuffer = nullptr; // normals and texture coordinates the triangles index
+	unsigned int m_Revision = 0;		// revision of the triangle list on the device
 
 	cl::Buffer *lightIndices = nullptr;
-	cl::Buffer *lightLotteryTickets = nullptr;
+	cl::Buffer *lightAliasTable = nullptr;
+	cl::Buffer *lightNodes = nullptr;
+	cl::Buffer *lightTrails = nullptr;
+	utils::AliasTable m_LightTable;
+	bvh::LightBVH m_LightTree;
 	int lightCount{};
 	float lightArea{};
 
@@ -168,9 +228,12 @@ class GpuTracer : public Renderer
 	cl::Kernel *wShadeKernel = nullptr;
 	cl::Kernel *wDrawKernel = nullptr;
 
+	FrameBuffer m_FrameBuffer; // host copy of the previous color buffer, only filled by GetFrameBuffer
+
 	int tIndex = 0;
 	int m_Samples = 0;
 	int m_Width{}, m_Height{};
+	int m_FirstRow = 0, m_RowCount = 0;
 
 	bool m_SkyboxEnabled{};
 	bool m_HasSkybox = false;
@@ -0,0 +1,210 @@
+#include "Core/MultiGpuTracer.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "Utils/Messages.h"
+#include "Utils/Timer.h"
+
+#define BAND_BLOCK 8 // rows per block, matches the local work size of the kernels
+
+namespace core
+{
+MultiGpuTracer::MultiGpuTracer(prims::GpuTriangleList *objectList, int width, int height, Camera *camera,
+							   Surface *skyBox, gl::Texture *target, ctpl::ThreadPool *pool)
+	: m_Target(target)
+{
+	const int deviceCount = cl::Kernel::InitDevices();
+	if (deviceCount == 0)
+		utils::FatalError(__FILE__, __LINE__, "No OpenCL devices available.", "MultiGpuTracer");
+
+	// every tracer creates its kernels and scene buffers on the device that is current during construction
+	for (int i = 0; i < deviceCount; i++)
+	{
+		cl::Kernel::SetCurrentDevice(i);
+		m_Devices.push_back({new GpuTracer(objectList, width, height, camera, skyBox, pool), 0, 0, 0.f});
+	}
+	cl::Kernel::SetCurrentDevice(0);
+
+	modes = m_Devices[0].tracer->GetModes();
+	m_Mode = m_Devices[0].tracer->GetMode();
+	m_DevicePool = new ctpl::ThreadPool(deviceCount);
+
+	Resize(width, height);
+}
+
+MultiGpuTracer::~MultiGpuTracer()
+{
+	cl::Kernel::SyncDevices();
+	delete m_DevicePool;
+	for (auto &device : m_Devices)
+		delete device.tracer;
+}
+
+void MultiGpuTracer::Render(Surface *)
+{
+	Balance();
+
+	std::vector<std::future<void>> results;
+	for (auto &device : m_Devices)
+	{
+		if (device.rowCount == 0)
+			continue;
+
+		results.push_back(m_DevicePool->push([this, &device](int) -> void {
+			const utils::Timer timer;
+			device.tracer->SetRegion(device.firstRow, device.rowCount);
+			device.tracer->TraceRegion(m_Colors.data());
+			const float rowsPerMs = float(device.rowCount) / glm::max(timer.elapsed(), 0.01f);
+
+			// bands don't overlap, so every device can merge its own rows
+			Accumulate(device.firstRow, device.rowCount);
+
+			// smoothed so a single slow frame doesn't move the split around
+			device.rowsPerMs = device.rowsPerMs > 0.f ? glm::mix(device.rowsPerMs, rowsPerMs, 0.25f) : rowsPerMs;
+		}));
+	}
+
+	for (auto &r : results)
+		r.get();
+
+	m_Samples++;
+
+	if (m_Target != nullptr)
+	{
+		glBindTexture(GL_TEXTURE_2D, m_Target->GetID());
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_Width, m_Height, GL_RGBA, GL_FLOAT, m_Output.data());
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+}
+
+void MultiGpuTracer::Reset()
+{
+	cl::Kernel::SyncDevices();
+	ForEachDevice([](GpuTracer *tracer) { tracer->Reset(); });
+	m_Samples = 0;
+}
+
+void MultiGpuTracer::SetMode(Mode mode)
+{
+	cl::Kernel::SyncDevices();
+	ForEachDevice([mode](GpuTracer *tracer) { tracer->SetMode(mode); });
+	m_Mode = mode;
+}
+
+void MultiGpuTracer::SetMode(std::string mode)
+{
+	cl::Kernel::SyncDevices();
+	ForEachDevice([&mode](GpuTracer *tracer) { tracer->SetMode(mode); });
+	m_Mode = m_Devices[0].tracer->GetMode();
+}
+
+void MultiGpuTracer::SwitchSkybox()
+{
+	cl::Kernel::SyncDevices();
+	ForEachDevice([](GpuTracer *tracer) { tracer->SwitchSkybox(); });
+}
+
+void MultiGpuTracer::Resize(gl::Texture *newOutput)
+{
+	m_Target = newOutput;
+	Resize(newOutput->GetWidth(), newOutput->GetHeight());
+}
+
+void MultiGpuTracer::Resize(int width, int height)
+{
+	cl::Kernel::SyncDevices();
+
+	m_Width = width;
+	m_Height = height;
+	ForEachDevice([width, height](GpuTracer *tracer) { tracer->Resize(width, height, nullptr); });
+
+	m_Colors.assign(width * height, glm::vec4(0.f));
+	m_Accumulator.assign(width * height, glm::vec4(0.f));
+	m_Output.assign(width * height, glm::vec4(0.f));
+	m_Samples = 0;
+}
+
+template <typename Function> void MultiGpuTracer::ForEachDevice(const Function &function)
+{
+	for (int i = 0; i < static_cast<int>(m_Devices.size()); i++)
+	{
+		cl::Kernel::SetCurrentDevice(i);
+		function(m_Devices[i].tracer);
+	}
+	cl::Kernel::SetCurrentDevice(0);
+}
+
+void MultiGpuTracer::Balance()
+{
+	const int blockCount = (m_Height + BAND_BLOCK - 1) / BAND_BLOCK;
+	const int deviceCount = static_cast<int>(m_Devices.size());
+
+	// fastest first, with fewer blocks than devices the slowest ones stay idle
+	std::vector<int> order(deviceCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(),
+					 [this](int a, int b) { return m_Devices[a].rowsPerMs > m_Devices[b].rowsPerMs; });
+	const int activeCount = glm::min(deviceCount, blockCount);
+
+	float total = 0.f;
+	for (int i = 0; i < activeCount; i++)
+		total += m_Devices[order[i]].rowsPerMs;
+
+	// bands are proportional to the measured throughput, nothing is measured yet in the first frame.
+	// Every active device keeps at least one block so its throughput can still be measured.
+	std::vector<int> blocks(deviceCount, 0);
+	int assigned = 0;
+	for (int i = 0; i < activeCount; i++)
+	{
+		const float rate = m_Devices[order[i]].rowsPerMs;
+		const float share = total > 0.f ? rate / total : 1.f / float(activeCount);
+		blocks[order[i]] = glm::max(1, static_cast<int>(share * float(blockCount)));
+		assigned += blocks[order[i]];
+	}
+
+	// raising small shares to one block can overshoot, take those blocks from the largest bands
+	while (assigned > blockCount)
+	{
+		*std::max_element(blocks.begin(), blocks.end()) -= 1;
+		assigned--;
+	}
+
+	// rounding down leaves a remainder, which goes to the fastest device
+	if (activeCount > 0)
+		blocks[order[0]] += blockCount - assigned;
+
+	int firstBlock = 0;
+	for (int i = 0; i < deviceCount; i++)
+	{
+		m_Devices[i].firstRow = firstBlock * BAND_BLOCK;
+		m_Devices[i].rowCount = blocks[i] * BAND_BLOCK;
+		firstBlock += blocks[i];
+	}
+}
+
+void MultiGpuTracer::Accumulate(int firstRow, int rowCount)
+{
+	const int first = firstRow * m_Width;
+	const int last = glm::min(firstRow + rowCount, m_Height) * m_Width;
+	const float factor = 1.f / float(m_Samples + 1);
+	const float previous = float(m_Samples) * factor;
+
+	for (int i = first; i < last; i++)
+	{
+		const glm::vec4 color = m_Accumulator[i] * previous + m_Colors[i] * factor;
+		m_Accumulator[i] = color;
+		m_Output[i] = glm::vec4(glm::sqrt(glm::vec3(color)), 1.f);
+	}
+}
+
+const FrameBuffer *MultiGpuTracer::GetFrameBuffer()
+{
+	if (m_FrameBuffer.GetWidth() != m_Width || m_FrameBuffer.GetHeight() != m_Height)
+		m_FrameBuffer.Resize(m_Width, m_Height);
+	for (int i = 0, s = m_Width * m_Height; i < s; i++)
+		m_FrameBuffer.Set(AOV::Color, i, glm::vec3(m_Accumulator[i]));
+	m_FrameBuffer.SetSampleCount(1); // the device already averaged
+	return &m_FrameBuffer;
+}
+} // namespace core
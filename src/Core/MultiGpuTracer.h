@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Core/GpuTracer.h"
+#include "Utils/ctpl.h"
+
+namespace core
+{
+// Splits the image into bands of rows over all devices created by cl::Kernel::InitDevices.
+// Every device has its own GpuTracer with a context, queue and copy of the scene. Band sizes follow the
+// throughput measured in the previous frame and the samples are accumulated on the host.
+class MultiGpuTracer : public Renderer
+{
+  public:
+	MultiGpuTracer(prims::GpuTriangleList *objectList, int width, int height, Camera *camera,
+				   Surface *skyBox = nullptr, gl::Texture *target = nullptr, ctpl::ThreadPool *pool = nullptr);
+	~MultiGpuTracer() override;
+
+	void Render(Surface *output) override;
+
+	void Reset() override;
+
+	void SetMode(Mode mode) override;
+
+	void SetMode(std::string mode) override;
+
+	void SwitchSkybox() override;
+
+	void Resize(gl::Texture *newOutput) override;
+
+	inline const char *GetModeString() const noexcept override { return m_Devices[0].tracer->GetModeString(); }
+
+	inline int GetSamples() const override { return m_Samples; }
+
+	// Accumulated colors of the full image
+	inline const glm::vec4 *GetOutput() const { return m_Accumulator.data(); }
+
+	const FrameBuffer *GetFrameBuffer() override;
+
+  private:
+	struct DeviceState
+	{
+		GpuTracer *tracer;
+		int firstRow, rowCount;
+		float rowsPerMs; // measured throughput, decides the band size of the next frame
+	};
+
+	// Calls function with the tracer of every device while that device is current, so the queue it syncs and the
+	// buffers it creates belong to its own device
+	template <typename Function> void ForEachDevice(const Function &function);
+
+	void Balance();
+
+	void Accumulate(int firstRow, int rowCount);
+
+	void Resize(int width, int height);
+
+	gl::Texture *m_Target = nullptr;
+	ctpl::ThreadPool *m_DevicePool = nullptr;
+	std::vector<DeviceState> m_Devices;
+
+	std::vector<glm::vec4> m_Colors;	  // sample of the current frame
+	std::vector<glm::vec4> m_Accumulator; // host side equivalent of the previous color buffer
+	std::vector<glm::vec4> m_Output;	  // gamma corrected accumulator, uploaded to the target texture
+	FrameBuffer m_FrameBuffer;			  // RGB copy of the accumulator, only filled by GetFrameBuffer
+
+	int m_Width{}, m_Height{};
+	int m_Samples = 0;
+};
+} // namespace core
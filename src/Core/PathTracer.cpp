@@ -1,6 +1,10 @@
 #include "PathTracer.h"
-#include "Utils/MersenneTwister.h"
-#include "Utils/Xor128.h"
+#include "Materials/Microfacet8.h"
+#include "Primitives/Triangle.h"
+#include "Shared.h"
+#include "Utils/FloatError.h"
+#include "Utils/Pcg32.h"
+#include "Utils/Timeline.h"
 
 #include <glm/gtc/constants.hpp>
 
@@ -11,66 +15,91 @@ namespace core
 #define RUSSIAN_ROULETTE 1
 #define LOOP_DEPTH 16
 #define FIREFLYFILTER 1
+#define WAVEFRONT 1 // Reference & Reference MF shade whole tiles in batches of hits with the same material type
+#define MICROFACET_VALIDATE 0 // checks the AVX2 microfacet code against the scalar version on startup
+#define ROUGHNESS_REGULARIZATION 0 // widens glossy lobes that are sharper than the footprint of the incoming ray
 
 #define TILE_HEIGHT 32
 #define TILE_WIDTH 32
 
 using namespace prims;
 
+SamplerType PathTracer::m_SamplerType = SamplerType::Sobol;
+
+static inline glm::vec3 FireflyFilter(const glm::vec3 &E)
+{
+#if FIREFLYFILTER
+	const float lengthSqr = dot(E, E);
+	if (lengthSqr > 100.0f) // length > 10
+		return E / sqrtf(lengthSqr) * 10.0f;
+#endif
+	return E;
+}
+
+// Roughness regularization: a lobe is never narrower than the spread of the ray cone that hits it, which removes
+// most fireflies of glossy surfaces seen after a diffuse bounce at the cost of some bias
+static inline float RegularizedAlpha(float alpha, const Ray &r)
+{
+	return ROUGHNESS_REGULARIZATION ? std::max(alpha, std::min(r.coneSpread, 1.0f)) : alpha;
+}
+
 PathTracer::PathTracer(WorldScene *scene, int width, int height, Camera *camera, Surface *skyBox)
 	: m_Scene(scene), m_Width(width), m_Height(height), m_SkyBox(skyBox), m_Camera(camera),
-	  m_SkyboxEnabled(skyBox != nullptr)
+	  m_SkyboxEnabled(skyBox != nullptr), m_Materials(MaterialManager::GetInstance())
 {
 	modes = {"NEE", "IS", "NEE_IS", "NEE_MIS", "Reference MF", "Reference"};
-	m_Pixels = new glm::vec3[m_Width * m_Height];
+	m_FrameBuffer.Resize(m_Width, m_Height);
 	m_Energy = new float[m_Width * m_Height];
 
+	// builds the light table and tree
 	Reset();
 	m_Tiles = (m_Width / TILE_WIDTH) * (m_Height / TILE_HEIGHT);
 
-	auto &lights = m_Scene->GetLights();
-	m_LightArea = 0.0f;
-	m_LightCount = static_cast<unsigned int>(lights.size());
-	if (!lights.empty())
+	if (m_SkyBox != nullptr)
 	{
-		for (SceneObject *light : lights)
-		{
-			m_LightArea += light->GetArea();
-		}
-
-		m_LightLotteryTickets.resize(lights.size());
-		m_LightLotteryTickets[0] = lights[0]->GetArea() / m_LightArea;
-		for (unsigned int i = 1; i < lights.size(); i++)
+		m_SkySampler = new EnvironmentSampler(m_SkyBox);
+		if (!m_SkySampler->IsValid())
 		{
-			m_LightLotteryTickets[i] = m_LightLotteryTickets[i - 1] + lights[i]->GetArea() / m_LightArea;
+			delete m_SkySampler;
+			m_SkySampler = nullptr;
 		}
-		m_LightLotteryTickets[lights.size() - 1] = 1.f;
 	}
 
+#if MICROFACET_VALIDATE
+	Pcg32 validationRng;
+	ValidateMicrofacet8(validationRng);
+#endif
+
 	this->tPool = new ctpl::ThreadPool(ctpl::nr_of_cores);
 
 	for (int i = 0; i < m_Tiles; i++)
 	{
-		m_Rngs.push_back(new Xor128());
+		m_Samplers.push_back(Sampler::Create(m_SamplerType));
 	}
+	m_TileSamplerType = m_SamplerType;
 
 	m_Samples = 0;
-	m_Materials = MaterialManager::GetInstance();
 }
 
 PathTracer::~PathTracer()
 {
 	delete tPool;
 
-	delete[] m_Pixels;
 	delete[] m_Energy;
+	delete m_SkySampler;
+	for (Sampler *sampler : m_Samplers)
+		delete sampler;
 }
 
 void PathTracer::Reset()
 {
-	memset(m_Pixels, 0, m_Width * m_Height * 4);
+	m_FrameBuffer.Clear();
 	memset(m_Energy, 0, m_Width * m_Height * 4);
 	m_Samples = 0;
+
+	// only rebuilds the light table if a light was added or changed size
+	UpdateLights();
+	m_MaterialTable.Compile(*MaterialManager::GetInstance());
 }
 
 int PathTracer::GetSamples() const { return m_Samples; }
@@ -94,7 +123,7 @@ float PathTracer::TotalEnergy() const
 	{
 		for (int x = 0; x < m_Width; x++)
 		{
-			const glm::vec3 tmp = (m_Pixels[x + y * m_Width] * oneThird);
+			const glm::vec3 tmp = (m_FrameBuffer.GetAverage(AOV::Color, x, y) * oneThird);
 			const float E = tmp.r + tmp.g + tmp.b;
 
 			totalEnergy += E;
@@ -105,8 +134,6 @@ float PathTracer::TotalEnergy() const
 
 void PathTracer::Render(Surface *output)
 {
-	const float EFactor = 1.0f / float(SAMPLE_COUNT);
-
 	m_Height = output->GetHeight();
 	m_Width = output->GetWidth();
 
@@ -119,48 +146,405 @@ void PathTracer::Render(Surface *output)
 	{
 		for (int tile_x = 0; tile_x < hTiles; tile_x++)
 		{
-			RandomGenerator *rngPointer = m_Rngs.at(idx);
+			Sampler *sampler = m_Samplers.at(idx);
 			idx++;
-			tResults.push_back(tPool->push([tile_x, tile_y, this, output, rngPointer, EFactor](int) -> void {
-				for (int y = 0; y < TILE_HEIGHT; y++)
+			tResults.push_back(tPool->push([tile_x, tile_y, this, sampler](int) -> void {
+				utils::timeline::ScopedEvent event("tile", "render");
+				// resolve the sampler once per tile, everything below calls it directly
+				switch (m_TileSamplerType)
 				{
-					const int pixel_y = y + tile_y * TILE_HEIGHT;
-					for (int x = 0; x < TILE_WIDTH; x++)
-					{
-						const int pixel_x = x + tile_x * TILE_WIDTH;
+				case (SamplerType::Random):
+					RenderTile(tile_x, tile_y, static_cast<RandomSampler &>(*sampler));
+					break;
+				case (SamplerType::BlueNoise):
+					RenderTile(tile_x, tile_y, static_cast<BlueNoiseSampler &>(*sampler));
+					break;
+				case (SamplerType::Sobol):
+				default:
+					RenderTile(tile_x, tile_y, static_cast<SobolSampler &>(*sampler));
+					break;
+				}
+			}));
+		}
+	}
 
-						uint depth = 0;
-						Ray r = m_Camera->GenerateRandomRay(float(pixel_x), float(pixel_y), *rngPointer);
-						auto color = Trace(r, depth, 1.f, *rngPointer) * EFactor;
+	{
+		utils::timeline::ScopedEvent event("wait for tiles", "render");
+		for (auto &r : tResults)
+			r.get();
+	}
 
-						const int idx = pixel_x + pixel_y * m_Width;
+	tResults.clear();
+	m_Samples++;
 
-						if (m_Samples > 0)
-						{
-							const float factor = 1.0f / float(m_Samples + 1);
-							m_Pixels[idx] = m_Pixels[idx] * float(m_Samples) * factor + color * factor;
-						}
-						else
+	// tiles only add up samples, the display gets averaged and gamma corrected once per frame
+	utils::stats::ScopedTimer timer(utils::stats::Stage::Accumulate);
+	m_FrameBuffer.FinishSample();
+	m_FrameBuffer.Resolve(output, tPool);
+}
+
+template <typename Rng> void PathTracer::RenderTile(int tileX, int tileY, Rng &rng)
+{
+#if WAVEFRONT && SAMPLE_COUNT == 1
+	if (m_Mode == Mode::Reference || m_Mode == Mode::ReferenceMicrofacet)
+	{
+		RenderTileWavefront(tileX, tileY, rng);
+		return;
+	}
+#endif
+
+	// camera rays, tracing and shading are interleaved here, the whole tile counts as tracing
+	utils::stats::ScopedTimer timer(utils::stats::Stage::Trace);
+	utils::stats::Add(utils::stats::Counter::Paths, TILE_WIDTH * TILE_HEIGHT * SAMPLE_COUNT);
+
+	const float EFactor = 1.0f / float(SAMPLE_COUNT);
+	for (int y = 0; y < TILE_HEIGHT; y++)
+	{
+		const int pixel_y = y + tileY * TILE_HEIGHT;
+		for (int x = 0; x < TILE_WIDTH; x++)
+		{
+			const int pixel_x = x + tileX * TILE_WIDTH;
+
+			uint depth = 0;
+			rng.StartPixel(pixel_x, pixel_y, m_Samples);
+			Ray r = m_Camera->GenerateRandomRay(float(pixel_x), float(pixel_y), rng);
+			if (m_FrameBuffer.HasAOVs())
+			{
+				// the integrators trace the camera ray themselves, the first hit costs an extra ray here
+				Ray primary = r;
+				m_Scene->TraceRay(primary);
+				StoreAOVs(pixel_x, pixel_y, primary);
+			}
+			StoreSample(pixel_x, pixel_y, Trace(r, depth, 1.f, rng) * EFactor);
+		}
+	}
+}
+
+void PathTracer::StoreSample(int x, int y, const glm::vec3 &color)
+{
+	m_FrameBuffer.Add(AOV::Color, x, y, color);
+	m_Energy[x + y * m_Width] = color.x + color.y + color.z;
+}
+
+void PathTracer::StoreAOVs(int x, int y, const Ray &r)
+{
+	vec3 albedo = vec3(0.0f), normal = vec3(0.0f), depth = vec3(0.0f);
+	if (r.IsValid())
+	{
+		albedo = m_MaterialTable.GetAlbedo(r.obj->materialIdx, r, r.GetHitpoint());
+		normal = r.normal;
+		depth = vec3(r.t);
+	}
+
+	m_FrameBuffer.Add(AOV::Albedo, x, y, albedo);
+	m_FrameBuffer.Add(AOV::Normal, x, y, normal);
+	m_FrameBuffer.Add(AOV::Depth, x, y, depth);
+}
+
+template <typename Rng> void PathTracer::RenderTileWavefront(int tileX, int tileY, Rng &rng)
+{
+	// reused by every tile a thread renders
+	thread_local std::vector<PathState> paths;
+	thread_local std::vector<unsigned int> active, next, hits, hitMaterials;
+	thread_local ShadingBatches batches;
+
+	const unsigned int pathCount = TILE_WIDTH * TILE_HEIGHT;
+	paths.resize(pathCount);
+	active.resize(pathCount);
+	utils::stats::Add(utils::stats::Counter::Paths, pathCount);
+
+	{
+		utils::stats::ScopedTimer timer(utils::stats::Stage::Camera);
+		for (int y = 0; y < TILE_HEIGHT; y++)
+		{
+			for (int x = 0; x < TILE_WIDTH; x++)
+			{
+				const unsigned int id = x + y * TILE_WIDTH;
+				PathState &path = paths[id];
+				const int pixelX = x + tileX * TILE_WIDTH, pixelY = y + tileY * TILE_HEIGHT;
+				rng.StartPixel(pixelX, pixelY, m_Samples);
+				path.ray = m_Camera->GenerateRandomRay(float(pixelX), float(pixelY), rng);
+				path.sampler = rng.GetState();
+				path.throughput = vec3(1.0f);
+				path.E = vec3(0.0f);
+				active[id] = id;
+			}
+		}
+	}
+
+	for (uint depth = 0; depth < LOOP_DEPTH && !active.empty(); depth++)
+	{
+		hits.clear();
+		hitMaterials.clear();
+		{
+			utils::stats::ScopedTimer timer(utils::stats::Stage::Trace);
+			for (const unsigned int id : active)
+			{
+				PathState &path = paths[id];
+				TraceRay(path.ray, depth);
+				if (depth == 0 && m_FrameBuffer.HasAOVs())
+					StoreAOVs(id % TILE_WIDTH + tileX * TILE_WIDTH, id / TILE_WIDTH + tileY * TILE_HEIGHT, path.ray);
+				if (path.ray.IsValid())
+				{
+					hits.push_back(id);
+					hitMaterials.push_back(path.ray.obj->materialIdx);
+				}
+				else if (m_SkyBox != nullptr)
+				{
+					path.E += path.throughput * SampleSkyBox(path.ray.direction);
+				}
+			}
+		}
+
+		utils::stats::ScopedTimer timer(utils::stats::Stage::Shade);
+		batches.Build(m_MaterialTable, hits.data(), hitMaterials.data(), static_cast<unsigned int>(hits.size()));
+
+		const unsigned int *lights = batches.GetBatch(MaterialType::Light);
+		for (unsigned int i = 0, s = batches.GetBatchSize(MaterialType::Light); i < s; i++)
+		{
+			PathState &path = paths[lights[i]];
+			path.E += path.throughput * m_MaterialTable.GetEmission(path.ray.obj->materialIdx);
+		}
+
+		next.clear();
+		if (m_Mode == Mode::ReferenceMicrofacet)
+		{
+			// every type takes the same microfacet path, dielectrics are picked out per hit
+			for (int type = int(MaterialType::Diffuse); type < int(MaterialType::Count); type++)
+			{
+				const auto t = MaterialType(type);
+				ShadeMicrofacet(paths.data(), batches.GetBatch(t), batches.GetBatchSize(t), next, rng);
+			}
+		}
+		else
+		{
+			ShadeDiffuse(paths.data(), batches.GetBatch(MaterialType::Diffuse),
+						 batches.GetBatchSize(MaterialType::Diffuse), next, rng);
+			ShadeSpecular(paths.data(), batches.GetBatch(MaterialType::Specular),
+						  batches.GetBatchSize(MaterialType::Specular), next);
+			ShadeDiffuseSpecular(paths.data(), batches.GetBatch(MaterialType::DiffuseSpecular),
+								 batches.GetBatchSize(MaterialType::DiffuseSpecular), next, rng);
+			ShadeDielectric(paths.data(), batches.GetBatch(MaterialType::Dielectric),
+							batches.GetBatchSize(MaterialType::Dielectric), next, rng);
+		}
+
+		active.swap(next);
+	}
+
+	utils::stats::ScopedTimer timer(utils::stats::Stage::Accumulate);
+	for (int y = 0; y < TILE_HEIGHT; y++)
+	{
+		for (int x = 0; x < TILE_WIDTH; x++)
+		{
+			const vec3 E = FireflyFilter(paths[x + y * TILE_WIDTH].E);
+			StoreSample(x + tileX * TILE_WIDTH, y + tileY * TILE_HEIGHT, E);
+		}
+	}
+}
+
+// Normal facing the incoming ray
+static inline glm::vec3 FaceForward(const Ray &r, bool &flipNormal)
+{
+	flipNormal = dot(r.normal, r.direction) > 0.0f;
+	return flipNormal ? -r.normal : r.normal;
+}
+
+template <typename Rng>
+void PathTracer::ShadeDiffuse(PathState *paths, const unsigned int *batch, unsigned int count,
+							  std::vector<unsigned int> &next, Rng &rng) const
+{
+	const float PDF = 1.0f / (2.0f * PI); // constant PDF
+	for (unsigned int i = 0; i < count; i++)
+	{
+		PathState &path = paths[batch[i]];
+		ScopedSamplerState pathSampler(rng, path.sampler);
+		Ray &r = path.ray;
+		const vec3 p = r.GetHitpoint();
+		const vec3 albedoColor = m_MaterialTable.GetAlbedo(r.obj->materialIdx, r, p);
+		bool flipNormal;
+		const vec3 normal = FaceForward(r, flipNormal);
+
+		r = r.DiffuseReflection(p, normal, rng);
+		const glm::vec3 BRDF = albedoColor * glm::one_over_pi<float>();
+		path.throughput *= BRDF * dot(normal, r.direction) / PDF;
+		next.push_back(batch[i]);
+	}
+}
+
+void PathTracer::ShadeSpecular(PathState *paths, const unsigned int *batch, unsigned int count,
+							   std::vector<unsigned int> &next) const
+{
+	for (unsigned int i = 0; i < count; i++)
+	{
+		PathState &path = paths[batch[i]];
+		Ray &r = path.ray;
+		const vec3 p = r.GetHitpoint();
+		path.throughput *= m_MaterialTable.GetAlbedo(r.obj->materialIdx, r, p);
+		bool flipNormal;
+		r = r.Reflect(p, FaceForward(r, flipNormal));
+		next.push_back(batch[i]);
+	}
+}
+
+template <typename Rng>
+void PathTracer::ShadeDiffuseSpecular(PathState *paths, const unsigned int *batch, unsigned int count,
+									  std::vector<unsigned int> &next, Rng &rng) const
+{
+	const float PDF = 1.0f / (2.0f * PI); // constant PDF
+	for (unsigned int i = 0; i < count; i++)
+	{
+		PathState &path = paths[batch[i]];
+		ScopedSamplerState pathSampler(rng, path.sampler);
+		Ray &r = path.ray;
+		const unsigned int matIdx = r.obj->materialIdx;
+		const vec3 p = r.GetHitpoint();
+		const vec3 albedoColor = m_MaterialTable.GetAlbedo(matIdx, r, p);
+		bool flipNormal;
+		const vec3 normal = FaceForward(r, flipNormal);
+
+		if (rng.Rand(1.0f) < m_MaterialTable.GetSpecular(matIdx))
+		{
+			path.throughput *= albedoColor;
+			r = r.Reflect(p, normal);
+		}
+		else
+		{
+			r = r.DiffuseReflection(p, normal, rng);
+			const glm::vec3 BRDF = albedoColor * glm::one_over_pi<float>();
+			path.throughput *= BRDF * dot(normal, r.direction) / PDF;
+		}
+		next.push_back(batch[i]);
+	}
+}
+
+template <typename Rng>
+void PathTracer::ShadeDielectric(PathState *paths, const unsigned int *batch, unsigned int count,
+								 std::vector<unsigned int> &next, Rng &rng) const
+{
+	for (unsigned int i = 0; i < count; i++)
+	{
+		PathState &path = paths[batch[i]];
+		ScopedSamplerState pathSampler(rng, path.sampler);
+		Ray &r = path.ray;
+		const unsigned int matIdx = r.obj->materialIdx;
+		const vec3 p = r.GetHitpoint();
+		const vec3 albedoColor = m_MaterialTable.GetAlbedo(matIdx, r, p);
+		bool flipNormal;
+		const vec3 normal = FaceForward(r, flipNormal);
+
+		path.throughput *= albedoColor * Refract(flipNormal, m_MaterialTable.GetRefractionIndex(matIdx),
+												 m_MaterialTable.GetAbsorption(matIdx), normal, p, r.t, r, rng);
+		next.push_back(batch[i]);
+	}
+}
+
+template <typename Rng>
+void PathTracer::ShadeMicrofacet(PathState *paths, const unsigned int *batch, unsigned int count,
+								 std::vector<unsigned int> &next, Rng &rng) const
+{
+	// 8 hits at a time: sampling the microfacet normal and the weight run on all lanes at once with AVX2,
+	// building the shading frames and picking refraction or reflection stays scalar
+	for (unsigned int first = 0; first < count; first += 8)
+	{
+		const unsigned int lanes = std::min(count - first, 8u);
+
+		alignas(32) float alphaX[8], alphaY[8], U[16];
+		alignas(32) float wiX[8], wiY[8], wiZ[8], wmX[8], wmY[8], wmZ[8], woX[8], woY[8], woZ[8];
+		glm::vec3 u[8], v[8], w[8]; // For the transformation from world to local and back
+		bool flipNormal[8];
+		SamplerState *states[8];
+
+		for (unsigned int i = 0; i < 8; i++)
+		{
+			if (i >= lanes)
+			{
+				// unused lanes get a valid configuration so they do not produce NaNs
+				alphaX[i] = alphaY[i] = 1.0f;
+				wiX[i] = wiY[i] = 0.0f, wiZ[i] = 1.0f;
+				continue;
+			}
+
+			PathState &path = paths[batch[first + i]];
+			const Ray &r = path.ray;
+			const unsigned int matIdx = r.obj->materialIdx;
+			const vec3 normal = FaceForward(r, flipNormal[i]);
+			const vec3 wiLocal = rng.worldToLocalMicro(normal, r.direction, u[i], v[i], w[i]);
+			wiX[i] = wiLocal.x, wiY[i] = wiLocal.y, wiZ[i] = wiLocal.z;
+			alphaX[i] = RegularizedAlpha(m_MaterialTable.GetAlphaX()[matIdx], r);
+			alphaY[i] = RegularizedAlpha(m_MaterialTable.GetAlphaY()[matIdx], r);
+			states[i] = &path.sampler;
+		}
+
+		// the two numbers for the microfacet normal of all lanes at once
+		SampleBatch(rng, states, lanes, 2, U);
+
+		const Microfacet8 mf(alphaX, alphaY);
+		const Direction8 wi8 = {_mm256_load_ps(wiX), _mm256_load_ps(wiY), _mm256_load_ps(wiZ)};
+		const Direction8 wm8 = mf.SampleWm(_mm256_load_ps(U), _mm256_load_ps(U + 8));
+		_mm256_store_ps(wmX, wm8.x);
+		_mm256_store_ps(wmY, wm8.y);
+		_mm256_store_ps(wmZ, wm8.z);
+
+		for (unsigned int i = 0; i < 8; i++)
+		{
+			const vec3 wiLocal = vec3(wiX[i], wiY[i], wiZ[i]);
+			const vec3 wmLocal = vec3(wmX[i], wmY[i], wmZ[i]);
+			vec3 woLocal = wmLocal * 2.0f * glm::dot(wmLocal, wiLocal) - wiLocal; // mirror wi in wm to get wo
+
+			PathState *path = i < lanes ? &paths[batch[first + i]] : nullptr;
+			const unsigned int matIdx = path != nullptr ? path->ray.obj->materialIdx : 0;
+			if (path != nullptr && m_MaterialTable.GetType(matIdx) == MaterialType::Dielectric)
+			{
+				ScopedSamplerState pathSampler(rng, path->sampler);
+				const Ray &r = path->ray;
+				const vec3 wm = rng.localToWorldMicro(wmLocal, u[i], v[i], w[i]);
+				const float ior = m_MaterialTable.GetRefractionIndex(matIdx);
+				const float n = flipNormal[i] ? ior : 1.0f / ior;
+				const float cosTheta = dot(wm, -r.direction);
+				const float k = 1.0f - (n * n) * (1.0f - cosTheta * cosTheta);
+
+				if (k > 0.0f)
+				{
+					const float a = flipNormal[i] ? ior - 1.0f : 1.0f - ior;
+					const float b = ior + 1.0f;
+					const float R0 = (a * a) / (b * b);
+					const float c = 1.0f - cosTheta;
+					const float Fr = R0 + (1.0f - R0) * (c * c * c * c * c);
+
+					if (rng.Rand(1.0f) > Fr)
+					{
+						if (!flipNormal[i])
 						{
-							m_Pixels[idx] = color;
+							const vec3 &absorption = m_MaterialTable.GetAbsorption(matIdx);
+							path->throughput *= glm::vec3(exp(-absorption.r * r.t), exp(-absorption.g * r.t),
+														  exp(-absorption.b * r.t));
 						}
-
-						m_Energy[idx] = color.x + color.y + color.z;
-						output->Plot(pixel_x, pixel_y, m_Pixels[idx]);
+						woLocal = glm::normalize(n * -wiLocal + wmLocal * (n * cosTheta - sqrtf(k)));
 					}
 				}
-			}));
+			}
+
+			woX[i] = woLocal.x, woY[i] = woLocal.y, woZ[i] = woLocal.z;
 		}
-	}
 
-	for (auto &r : tResults)
-		r.get();
+		alignas(32) float weights[8];
+		const Direction8 wo8 = {_mm256_load_ps(woX), _mm256_load_ps(woY), _mm256_load_ps(woZ)};
+		_mm256_store_ps(weights, mf.Weight(wo8, wi8, wm8));
 
-	tResults.clear();
-	m_Samples++;
+		for (unsigned int i = 0; i < lanes; i++)
+		{
+			PathState &path = paths[batch[first + i]];
+			Ray &r = path.ray;
+			const vec3 p = r.GetHitpoint();
+			const vec3 wo = rng.localToWorldMicro(vec3(woX[i], woY[i], woZ[i]), u[i], v[i], w[i]);
+			path.throughput *= m_MaterialTable.GetAlbedo(r.obj->materialIdx, r, p) * weights[i];
+			r = r.Bounce(p, wo, r.GetGlossySpread(sqrtf(alphaX[i] * alphaY[i])));
+			next.push_back(batch[first + i]);
+		}
+	}
 }
 
-glm::vec3 PathTracer::Trace(Ray &r, uint &depth, float refractionIndex, RandomGenerator &rng)
+template <typename Rng> glm::vec3 PathTracer::Trace(Ray &r, uint &depth, float refractionIndex, Rng &rng)
 {
 	glm::vec3 E = glm::vec3(0.0f);
 	for (int i = 0; i < SAMPLE_COUNT; i++)
@@ -195,16 +579,10 @@ glm::vec3 PathTracer::Trace(Ray &r, uint &depth, float refractionIndex, RandomGe
 		E += newSample;
 	}
 
-#if FIREFLYFILTER
-	const float lengthSqr = dot(E, E);
-	if (lengthSqr > 100.0f) // length > 10
-		return E / sqrtf(lengthSqr) * 10.0f;
-#endif
-
-	return E;
+	return FireflyFilter(E);
 }
 
-glm::vec3 PathTracer::SampleNEE(Ray &r, RandomGenerator &rng) const
+template <typename Rng> glm::vec3 PathTracer::SampleNEE(Ray &r, Rng &rng) const
 {
 	vec3 E = vec3(0.0f);
 	vec3 throughput = vec3(1.0f);
@@ -213,7 +591,7 @@ glm::vec3 PathTracer::SampleNEE(Ray &r, RandomGenerator &rng) const
 	const float PDF = 1.0f / (2.0f * PI);
 	for (uint depth = 0; depth < LOOP_DEPTH; depth++)
 	{
-		m_Scene->TraceRay(r);
+		TraceRay(r, depth);
 		if (!r.IsValid())
 		{
 			// Sample skybox
@@ -237,8 +615,9 @@ glm::vec3 PathTracer::SampleNEE(Ray &r, RandomGenerator &rng) const
 			break;
 		}
 
-		const glm::vec3 albedoColor = mat.GetAlbedoColor(r.obj, p);
+		const glm::vec3 albedoColor = mat.GetAlbedoColor(r, p);
 		vec3 normal = r.normal;
+		const vec3 geometricNormal = r.geometricNormal;
 		const bool flipNormal = dot(normal, r.direction) > 0.0f;
 		if (flipNormal)
 			normal *= -1.0f;
@@ -275,13 +654,15 @@ glm::vec3 PathTracer::SampleNEE(Ray &r, RandomGenerator &rng) const
 
 		// NEE
 		float NEEpdf;
-		SceneObject *light = RandomPointOnLight(NEEpdf, rng);
+		SceneObject *light = RandomPointOnLight(p, normal, NEEpdf, rng);
+		specular = m_LightCount == 0;
 		if (light != nullptr)
-		{ // if there are no lights
-			specular = false;
+		{ // if there are no lights or none of them reach p
 			const vec3 Direction = normalize(p - light->GetPosition());
 			vec3 lightNormal;
-			const vec3 pointOnLight = light->GetRandomPointOnSurface(Direction, lightNormal, rng);
+			const float r1 = rng.Rand(1.f);
+			const float r2 = rng.Rand(1.f);
+			const vec3 pointOnLight = light->GetRandomPointOnSurface(Direction, lightNormal, r1, r2);
 
 			vec3 L = pointOnLight - p;
 			const float squaredDistance = dot(L, L);
@@ -293,8 +674,8 @@ glm::vec3 PathTracer::SampleNEE(Ray &r, RandomGenerator &rng) const
 
 			if (NdotL > 0.f && LNdotL > 0.f)
 			{
-				Ray lightRay = Ray(p + EPSILON * L, L);
-				if (!m_Scene->TraceShadowRay(lightRay, distance - EPSILON))
+				Ray lightRay = Ray(utils::OffsetRayOrigin(p, geometricNormal, L), L);
+				if (!TraceShadowRay(lightRay, distance - EPSILON))
 				{
 					const float SolidAngle = LNdotL * (light->m_Area / squaredDistance);
 					const auto m = m_Materials->GetMaterial(light->materialIdx);
@@ -318,14 +699,14 @@ glm::vec3 PathTracer::SampleNEE(Ray &r, RandomGenerator &rng) const
 	return E;
 }
 
-glm::vec3 PathTracer::SampleIS(Ray &r, RandomGenerator &rng) const
+template <typename Rng> glm::vec3 PathTracer::SampleIS(Ray &r, Rng &rng) const
 {
 	vec3 E = vec3(0.0f);
 	vec3 throughput = vec3(1.0f);
 
 	for (uint depth = 0; depth < LOOP_DEPTH; depth++)
 	{
-		m_Scene->TraceRay(r);
+		TraceRay(r, depth);
 		if (!r.IsValid())
 		{
 			// sample skybox
@@ -346,7 +727,7 @@ glm::vec3 PathTracer::SampleIS(Ray &r, RandomGenerator &rng) const
 			break;
 		}
 
-		const glm::vec3 albedoColor = mat.GetAlbedoColor(r.obj, p);
+		const glm::vec3 albedoColor = mat.GetAlbedoColor(r, p);
 		vec3 normal = r.normal;
 		const bool flipNormal = dot(normal, r.direction) > 0.0f;
 		if (flipNormal)
@@ -394,7 +775,7 @@ glm::vec3 PathTracer::SampleIS(Ray &r, RandomGenerator &rng) const
 	return E;
 }
 
-glm::vec3 PathTracer::SampleNEE_IS(Ray &r, RandomGenerator &rng) const
+template <typename Rng> glm::vec3 PathTracer::SampleNEE_IS(Ray &r, Rng &rng) const
 {
 	vec3 E = vec3(0.0f);
 	vec3 throughput = vec3(1.0f);
@@ -402,7 +783,7 @@ glm::vec3 PathTracer::SampleNEE_IS(Ray &r, RandomGenerator &rng) const
 
 	for (uint depth = 0; depth < LOOP_DEPTH; depth++)
 	{
-		m_Scene->TraceRay(r);
+		TraceRay(r, depth);
 		if (!r.IsValid())
 		{
 			// sample skybox
@@ -426,8 +807,9 @@ glm::vec3 PathTracer::SampleNEE_IS(Ray &r, RandomGenerator &rng) const
 			break;
 		}
 
-		const glm::vec3 albedoColor = mat.GetAlbedoColor(r.obj, p);
+		const glm::vec3 albedoColor = mat.GetAlbedoColor(r, p);
 		vec3 normal = r.normal;
+		const vec3 geometricNormal = r.geometricNormal;
 		const bool flipNormal = dot(normal, r.direction) > 0.0f;
 		if (flipNormal)
 			normal *= -1.0f;
@@ -465,13 +847,15 @@ glm::vec3 PathTracer::SampleNEE_IS(Ray &r, RandomGenerator &rng) const
 
 		// NEE
 		float NEEpdf;
-		SceneObject *light = RandomPointOnLight(NEEpdf, rng);
+		SceneObject *light = RandomPointOnLight(p, normal, NEEpdf, rng);
+		specular = m_LightCount == 0;
 		if (light != nullptr)
-		{ // if there are no lights
-			specular = false;
+		{ // if there are no lights or none of them reach p
 			const vec3 Direction = normalize(p - light->GetPosition());
 			vec3 lightNormal;
-			const vec3 pointOnLight = light->GetRandomPointOnSurface(Direction, lightNormal, rng);
+			const float r1 = rng.Rand(1.f);
+			const float r2 = rng.Rand(1.f);
+			const vec3 pointOnLight = light->GetRandomPointOnSurface(Direction, lightNormal, r1, r2);
 
 			vec3 L = pointOnLight - p;
 			const float squaredDistance = dot(L, L);
@@ -483,8 +867,8 @@ glm::vec3 PathTracer::SampleNEE_IS(Ray &r, RandomGenerator &rng) const
 
 			if (NdotL > 0.f && LNdotL > 0.f)
 			{
-				Ray lightRay = Ray(p + EPSILON * L, L);
-				if (!m_Scene->TraceShadowRay(lightRay, lDistance - EPSILON))
+				Ray lightRay = Ray(utils::OffsetRayOrigin(p, geometricNormal, L), L);
+				if (!TraceShadowRay(lightRay, lDistance - EPSILON))
 				{
 					const float SolidAngle = LNdotL * light->m_Area / squaredDistance;
 					const auto m = m_Materials->GetMaterial(light->materialIdx);
@@ -508,22 +892,26 @@ glm::vec3 PathTracer::SampleNEE_IS(Ray &r, RandomGenerator &rng) const
 	return E;
 }
 
-glm::vec3 PathTracer::SampleNEE_MIS(Ray &r, RandomGenerator &rng) const
+template <typename Rng> glm::vec3 PathTracer::SampleNEE_MIS(Ray &r, Rng &rng) const
 {
 	vec3 E = vec3(0.0f);
 	vec3 throughput = vec3(1.0f);
 	bool specular = true;
 	vec3 BRDF{}, normal{}, tUpdate = vec3(1.0f);
+	float brdfPDF = 0.0f;
 	for (uint depth = 0; depth < LOOP_DEPTH; depth++)
 	{
-		m_Scene->TraceRay(r);
+		TraceRay(r, depth);
 		if (!r.IsValid())
 		{
 			// Sample skybox
 			if (m_SkyBox != nullptr)
 			{
 				const vec3 c = this->SampleSkyBox(r.direction);
-				E += throughput * c * tUpdate;
+				float weight = 1.0f;
+				if (!specular && m_SkySampler != nullptr)
+					weight = brdfPDF / (brdfPDF + m_SkySampler->Pdf(r.direction));
+				E += throughput * c * tUpdate * weight;
 			}
 			break;
 		}
@@ -553,17 +941,15 @@ glm::vec3 PathTracer::SampleNEE_MIS(Ray &r, RandomGenerator &rng) const
 
 				const float NdotL = dot(normal, L);
 				const float LNdotL = dot(lightNormal, -L);
-				const float InversePDFnee = m_LightArea / light->m_Area;
 				const float SolidAngle = LNdotL * light->m_Area / squaredDistance;
-				const float lightPDF = 1.0f / SolidAngle;
 				const float brdfPDF = NdotL / PI;
-				const vec3 Ld = BRDF * mat.GetEmission() * NdotL * InversePDFnee;
 
-				if (lightPDF > 0.0f && brdfPDF > 0.0f)
+				if (SolidAngle > 0.0f && brdfPDF > 0.0f)
 				{
-					const float w1 = brdfPDF / (brdfPDF + lightPDF);
-					const float w2 = lightPDF / (brdfPDF + lightPDF);
-					E += throughput * Ld / (w1 * brdfPDF + w2 * lightPDF);
+					// pdf of NEE picking this light and point as seen from the previous vertex
+					const float lightPDF = LightPdf(r.origin, normal, light) / SolidAngle;
+					const vec3 Ld = BRDF * mat.GetEmission() * NdotL;
+					E += throughput * Ld / (brdfPDF + lightPDF);
 				}
 			}
 			break;
@@ -572,8 +958,9 @@ glm::vec3 PathTracer::SampleNEE_MIS(Ray &r, RandomGenerator &rng) const
 		throughput *= tUpdate;
 		tUpdate = vec3(1.0f);
 
-		const glm::vec3 albedoColor = mat.GetAlbedoColor(r.obj, p);
+		const glm::vec3 albedoColor = mat.GetAlbedoColor(r, p);
 		normal = r.normal;
+		const vec3 geometricNormal = r.geometricNormal;
 		const bool flipNormal = dot(normal, r.direction) > 0.0f;
 		if (flipNormal)
 			normal *= -1.0f;
@@ -612,12 +999,14 @@ glm::vec3 PathTracer::SampleNEE_MIS(Ray &r, RandomGenerator &rng) const
 		// NEE
 		specular = false;
 		float NEEpdf;
-		SceneObject *light = RandomPointOnLight(NEEpdf, rng);
+		SceneObject *light = RandomPointOnLight(p, normal, NEEpdf, rng);
 		if (light != nullptr)
-		{ // if there are no lights
+		{ // if there are no lights or none of them reach p
 			const vec3 Direction = normalize(p - light->GetPosition());
 			vec3 lightNormal;
-			const vec3 pointOnLight = light->GetRandomPointOnSurface(Direction, lightNormal, rng);
+			const float r1 = rng.Rand(1.f);
+			const float r2 = rng.Rand(1.f);
+			const vec3 pointOnLight = light->GetRandomPointOnSurface(Direction, lightNormal, r1, r2);
 
 			vec3 L = pointOnLight - p;
 			const float squaredDistance = dot(L, L);
@@ -629,21 +1018,38 @@ glm::vec3 PathTracer::SampleNEE_MIS(Ray &r, RandomGenerator &rng) const
 
 			if (NdotL > 0.f && LNdotL > 0.f)
 			{
-				Ray lightRay = Ray(p + EPSILON * L, L);
-				if (!m_Scene->TraceShadowRay(lightRay, distance - EPSILON))
+				Ray lightRay = Ray(utils::OffsetRayOrigin(p, geometricNormal, L), L);
+				if (!TraceShadowRay(lightRay, distance - EPSILON))
 				{
 					const float SolidAngle = LNdotL * light->m_Area / squaredDistance;
 					const auto m = m_Materials->GetMaterial(light->materialIdx);
-					const vec3 Ld = BRDF * m.GetEmission() * NdotL / NEEpdf;
+					const vec3 Ld = BRDF * m.GetEmission() * NdotL;
 
+					// balance heuristic, the light pdf includes the probability of picking this light
 					const float bPDF = NdotL / PI;
-					const float lightPDF = 1.0f / SolidAngle;
-					if (lightPDF > 0.0f && bPDF > 0.0f)
-					{
-						const float w1 = bPDF / (bPDF + lightPDF);
-						const float w2 = lightPDF / (bPDF + lightPDF);
-						E += throughput * Ld / (w1 * bPDF + w2 * lightPDF);
-					}
+					const float lightPDF = NEEpdf / SolidAngle;
+					if (lightPDF > 0.0f)
+						E += throughput * Ld / (bPDF + lightPDF);
+				}
+			}
+		}
+
+		// the sky is sampled as a separate light
+		if (m_SkySampler != nullptr && m_SkyboxEnabled)
+		{
+			float skyPDF;
+			const vec3 L = m_SkySampler->Sample(rng, skyPDF);
+			const float NdotL = dot(normal, L);
+			if (NdotL > 0.0f && skyPDF > 0.0f)
+			{
+				Ray skyRay = Ray(utils::OffsetRayOrigin(p, geometricNormal, L), L);
+				m_Scene->TraceRay(skyRay);
+				utils::stats::Add(utils::stats::Counter::ShadowRays);
+				utils::stats::Add(utils::stats::Counter::OccludedShadowRays, skyRay.IsValid() ? 1 : 0);
+				if (!skyRay.IsValid())
+				{
+					const vec3 Ld = BRDF * SampleSkyBox(L) * NdotL;
+					E += throughput * Ld / (NdotL / PI + skyPDF);
 				}
 			}
 		}
@@ -651,10 +1057,10 @@ glm::vec3 PathTracer::SampleNEE_MIS(Ray &r, RandomGenerator &rng) const
 
 		r = r.CosineWeightedDiffuseReflection(p, normal, rng);
 		const float NdotR = dot(normal, r.direction);
-		const float PDF = NdotR / PI;
-		if (PDF <= 0.0f)
+		brdfPDF = NdotR / PI;
+		if (brdfPDF <= 0.0f)
 			break;
-		tUpdate *= BRDF * NdotR / PDF;
+		tUpdate *= BRDF * NdotR / brdfPDF;
 #if RUSSIAN_ROULETTE
 		if (RussianRoulette(tUpdate, depth, rng))
 		{
@@ -671,12 +1077,12 @@ glm::vec3 PathTracer::SampleSkyBox(const glm::vec3 &dir) const
 	{
 		return vec3(0.0f);
 	}
-	const float u = glm::min(1.0f, glm::max(0.0f, (1.0f + atan2f(dir.x, -dir.z) / PI) / 2.0f));
-	const float v = glm::min(1.0f, glm::max(0.0f, acosf(dir.y) / PI));
-	return this->m_SkyBox->GetColorAt(u, 1.0f - v);
+	const int width = m_SkyBox->GetWidth();
+	const ivec2 texel = EnvironmentSampler::DirectionToTexel(dir, width, m_SkyBox->GetHeight());
+	return vec3(m_SkyBox->GetTextureBuffer()[texel.x + texel.y * width]);
 }
 
-glm::vec3 PathTracer::SampleReference(Ray &r, RandomGenerator &rng) const
+template <typename Rng> glm::vec3 PathTracer::SampleReference(Ray &r, Rng &rng) const
 {
 	vec3 E = vec3(0.0f);
 	vec3 throughput = vec3(1.0f);
@@ -684,7 +1090,7 @@ glm::vec3 PathTracer::SampleReference(Ray &r, RandomGenerator &rng) const
 
 	for (uint depth = 0; depth < LOOP_DEPTH; depth++)
 	{
-		m_Scene->TraceRay(r);
+		TraceRay(r, depth);
 		if (!r.IsValid())
 		{
 			// sample skybox
@@ -705,7 +1111,7 @@ glm::vec3 PathTracer::SampleReference(Ray &r, RandomGenerator &rng) const
 			break;
 		}
 
-		const glm::vec3 albedoColor = mat.GetAlbedoColor(r.obj, p);
+		const glm::vec3 albedoColor = mat.GetAlbedoColor(r, p);
 		vec3 normal = r.normal;
 		const bool flipNormal = dot(normal, r.direction) > 0.0f;
 		if (flipNormal)
@@ -746,15 +1152,23 @@ glm::vec3 PathTracer::SampleReference(Ray &r, RandomGenerator &rng) const
 	return E;
 }
 
+template <typename Rng>
 inline glm::vec3 PathTracer::Refract(const bool &flipNormal, const Material &mat, const glm::vec3 &normal,
-									 const glm::vec3 &p, const float &t, Ray &r, RandomGenerator &rng) const
+									 const glm::vec3 &p, const float &t, Ray &r, Rng &rng) const
+{
+	return Refract(flipNormal, mat.refractionIndex, mat.absorption, normal, p, t, r, rng);
+}
+
+template <typename Rng>
+inline glm::vec3 PathTracer::Refract(bool flipNormal, float refractionIndex, const glm::vec3 &absorption,
+									 const glm::vec3 &normal, const glm::vec3 &p, float t, Ray &r, Rng &rng) const
 {
 	float n1, n2;
 	glm::vec3 throughputUpdate = vec3(1.0f);
 	if (flipNormal)
-		n1 = mat.refractionIndex, n2 = 1.0f;
+		n1 = refractionIndex, n2 = 1.0f;
 	else
-		n1 = 1.0f, n2 = mat.refractionIndex;
+		n1 = 1.0f, n2 = refractionIndex;
 
 	const float n = n1 / n2;
 	const float cosTheta = dot(normal, -r.direction);
@@ -770,13 +1184,10 @@ inline glm::vec3 PathTracer::Refract(const bool &flipNormal, const Material &mat
 		if (rng.Rand(1.0f) > Fr)
 		{
 			if (!flipNormal)
-			{
-				throughputUpdate =
-					glm::vec3(exp(-mat.absorption.r * t), exp(-mat.absorption.g * t), exp(-mat.absorption.b * t));
-			}
+				throughputUpdate = glm::vec3(exp(-absorption.r * t), exp(-absorption.g * t), exp(-absorption.b * t));
 
 			const vec3 dir = normalize(n * r.direction + normal * (n * cosTheta - sqrtf(k)));
-			r = Ray(p + EPSILON * dir, dir);
+			r = r.Bounce(p, dir, r.GetRefractedSpread(n));
 			return throughputUpdate;
 		}
 	}
@@ -788,10 +1199,14 @@ inline glm::vec3 PathTracer::Refract(const bool &flipNormal, const Material &mat
 bool PathTracer::TraceLightRay(Ray &r, SceneObject *light) const
 {
 	m_Scene->TraceRay(r);
-	return !r.IsValid() || r.obj == light;
+	const bool visible = !r.IsValid() || r.obj == light;
+	utils::stats::Add(utils::stats::Counter::ShadowRays);
+	utils::stats::Add(utils::stats::Counter::OccludedShadowRays, visible ? 0 : 1);
+	return visible;
 }
 
-SceneObject *PathTracer::RandomPointOnLight(float &NEEpdf, RandomGenerator &rng) const
+template <typename Rng>
+SceneObject *PathTracer::RandomPointOnLight(const vec3 &p, const vec3 &normal, float &NEEpdf, Rng &rng) const
 {
 	const std::vector<SceneObject *> &lights = m_Scene->GetLights();
 	if (!m_LightCount)
@@ -799,22 +1214,77 @@ SceneObject *PathTracer::RandomPointOnLight(float &NEEpdf, RandomGenerator &rng)
 		return nullptr;
 	}
 
-	const float randomf = rng.Rand(1.f);
-	int winningIdx = 0;
-	float previous = 0;
+#if LIGHT_TREE
+	const int winningIdx = m_LightTree.Sample(p, normal, rng.Rand(1.f), NEEpdf);
+	if (winningIdx < 0)
+		return nullptr;
+#else
+	const float r = rng.Rand(1.f);
+	const unsigned int winningIdx = m_LightTable.Sample(r, rng.Rand(1.f));
+	NEEpdf = lights[winningIdx]->m_Area / m_LightArea;
+#endif
+	return lights.at(winningIdx);
+}
+
+float PathTracer::LightPdf(const vec3 &p, const vec3 &normal, const SceneObject *light) const
+{
+	const auto lightIdx = m_LightIndices.find(light);
+	if (lightIdx == m_LightIndices.end())
+		return 0.0f;
+
+#if LIGHT_TREE
+	return m_LightTree.Pmf(p, normal, lightIdx->second);
+#else
+	return light->m_Area / m_LightArea;
+#endif
+}
+
+void PathTracer::UpdateLights()
+{
+	const std::vector<SceneObject *> &lights = m_Scene->GetLights();
+	for (unsigned int i = 0; i < lights.size(); i++)
+	{
+		if (i < m_LightTable.GetSize())
+			m_LightTable.SetWeight(i, lights[i]->GetArea());
+		else
+			m_LightTable.AddWeight(lights[i]->GetArea());
+	}
+
+	if (m_LightTable.Update())
+	{
+		m_LightArea = m_LightTable.GetTotalWeight();
+		m_LightCount = m_LightTable.GetSize();
+		BuildLightTree();
+	}
+}
 
-	for (uint i = 0; i < m_LightCount; i++) // get light corresponding with winning ticket
+void PathTracer::BuildLightTree()
+{
+	const std::vector<SceneObject *> &lights = m_Scene->GetLights();
+	std::vector<bvh::LightBounds> bounds(lights.size());
+	m_LightIndices.clear();
+	for (unsigned int i = 0; i < lights.size(); i++)
 	{
-		if (m_LightLotteryTickets[i] > previous && randomf <= m_LightLotteryTickets[i])
-		{
-			winningIdx = i;
-			break;
-		}
-		previous = m_LightLotteryTickets[i];
+		const SceneObject *light = lights[i];
+		const bvh::AABB aabb = light->GetBounds();
+		const vec3 emission = m_Materials->GetMaterial(light->materialIdx).GetEmission();
+
+		bvh::LightBounds &b = bounds[i];
+		b.bmin = vec3(aabb.bmin[0], aabb.bmin[1], aabb.bmin[2]);
+		b.bmax = vec3(aabb.bmax[0], aabb.bmax[1], aabb.bmax[2]);
+		b.phi = light->GetArea() * (emission.r + emission.g + emission.b) / 3.0f;
+		b.cosThetaE = 0.0f;
+
+		// triangles only emit along their normal, anything else is bounded by the full sphere
+		if (const auto *triangle = dynamic_cast<const Triangle *>(light))
+			b.axis = triangle->normal, b.cosThetaO = 1.0f;
+		else
+			b.axis = vec3(0.0f, 0.0f, 1.0f), b.cosThetaO = -1.0f;
+
+		m_LightIndices[light] = i;
 	}
 
-	NEEpdf = lights[winningIdx]->m_Area / m_LightArea;
-	return lights.at(winningIdx);
+	m_LightTree.Build(bounds);
 }
 
 void PathTracer::Resize(gl::Texture *newOutput)
@@ -822,23 +1292,25 @@ void PathTracer::Resize(gl::Texture *newOutput)
 	m_Width = newOutput->GetWidth();
 	m_Height = newOutput->GetHeight();
 
-	delete[] m_Pixels;
 	delete[] m_Energy;
 
-	m_Pixels = new glm::vec3[m_Width * m_Height];
+	m_FrameBuffer.Resize(m_Width, m_Height);
 	m_Energy = new float[m_Width * m_Height];
 	Reset();
 
 	m_Tiles = (m_Width / TILE_WIDTH) * (m_Height / TILE_HEIGHT);
 
-	m_Rngs.clear();
+	for (Sampler *sampler : m_Samplers)
+		delete sampler;
+	m_Samplers.clear();
 	for (int i = 0; i < m_Tiles; i++)
 	{
-		m_Rngs.push_back(new MersenneTwister());
+		m_Samplers.push_back(Sampler::Create(m_SamplerType));
 	}
+	m_TileSamplerType = m_SamplerType;
 }
 
-glm::vec3 PathTracer::SampleReferenceMicrofacet(Ray &r, RandomGenerator &rng) const
+template <typename Rng> glm::vec3 PathTracer::SampleReferenceMicrofacet(Ray &r, Rng &rng) const
 {
 	glm::vec3 E = vec3(0.0f);
 	glm::vec3 throughput = vec3(1.0f);
@@ -847,7 +1319,7 @@ glm::vec3 PathTracer::SampleReferenceMicrofacet(Ray &r, RandomGenerator &rng) co
 
 	for (uint depth = 0; depth < LOOP_DEPTH; depth++)
 	{
-		m_Scene->TraceRay(r);
+		TraceRay(r, depth);
 		if (!r.IsValid())
 		{
 			if (m_SkyBox != nullptr)
@@ -861,7 +1333,8 @@ glm::vec3 PathTracer::SampleReferenceMicrofacet(Ray &r, RandomGenerator &rng) co
 		const vec3 p = r.GetHitpoint();
 		const uint matIdx = r.obj->materialIdx;
 		const auto mat = m_Materials->GetMaterial(matIdx);
-		const auto mf = m_Materials->GetMicrofacet(matIdx);
+		const Microfacet &lobe = m_Materials->GetMicrofacet(matIdx);
+		const Microfacet mf(RegularizedAlpha(lobe.m_AlphaX, r), RegularizedAlpha(lobe.m_AlphaY, r));
 
 		if (mat.IsLight())
 		{
@@ -869,7 +1342,7 @@ glm::vec3 PathTracer::SampleReferenceMicrofacet(Ray &r, RandomGenerator &rng) co
 			break;
 		}
 
-		const glm::vec3 albedoColor = mat.GetAlbedoColor(r.obj, p);
+		const glm::vec3 albedoColor = mat.GetAlbedoColor(r, p);
 		vec3 normal = r.normal;
 		const bool flipNormal = dot(normal, r.direction) > 0.0f;
 		if (flipNormal)
@@ -932,7 +1405,7 @@ glm::vec3 PathTracer::SampleReferenceMicrofacet(Ray &r, RandomGenerator &rng) co
 			const float weight = mf.weight(woLocal, wiLocal, wmLocal);
 			wo = rng.localToWorldMicro(woLocal, u, v, w);
 			throughput *= albedoColor * weight;
-			r = Ray(p + EPSILON * wo, wo);
+			r = r.Bounce(p, wo, r.GetGlossySpread(sqrtf(mf.m_AlphaX * mf.m_AlphaY)));
 		}
 		else
 		{
@@ -940,14 +1413,14 @@ glm::vec3 PathTracer::SampleReferenceMicrofacet(Ray &r, RandomGenerator &rng) co
 			const float weight = mf.weight(woLocal, wiLocal, wmLocal);
 			wo = rng.localToWorldMicro(woLocal, u, v, w);
 			throughput *= albedoColor * weight;
-			r = Ray(p + EPSILON * wo, wo);
+			r = r.Bounce(p, wo, r.GetGlossySpread(sqrtf(mf.m_AlphaX * mf.m_AlphaY)));
 		}
 	}
 
 	return E;
 }
 
-glm::vec3 PathTracer::SampleNEEMicrofacet(Ray &r, RandomGenerator &rng) const
+template <typename Rng> glm::vec3 PathTracer::SampleNEEMicrofacet(Ray &r, Rng &rng) const
 {
 	glm::vec3 E = vec3(0.0f);
 	glm::vec3 throughput = vec3(1.0f);
@@ -956,7 +1429,7 @@ glm::vec3 PathTracer::SampleNEEMicrofacet(Ray &r, RandomGenerator &rng) const
 
 	for (uint depth = 0; depth < LOOP_DEPTH; depth++)
 	{
-		m_Scene->TraceRay(r);
+		TraceRay(r, depth);
 		if (!r.IsValid())
 		{
 			if (m_SkyBox != nullptr)
@@ -970,7 +1443,8 @@ glm::vec3 PathTracer::SampleNEEMicrofacet(Ray &r, RandomGenerator &rng) const
 		const vec3 p = r.GetHitpoint();
 		const uint matIdx = r.obj->materialIdx;
 		const auto mat = m_Materials->GetMaterial(matIdx);
-		const auto mf = m_Materials->GetMicrofacet(matIdx);
+		const Microfacet &lobe = m_Materials->GetMicrofacet(matIdx);
+		const Microfacet mf(RegularizedAlpha(lobe.m_AlphaX, r), RegularizedAlpha(lobe.m_AlphaY, r));
 
 		if (mat.IsLight())
 		{
@@ -979,6 +1453,7 @@ glm::vec3 PathTracer::SampleNEEMicrofacet(Ray &r, RandomGenerator &rng) const
 		}
 
 		vec3 normal = r.normal;
+		const vec3 geometricNormal = r.geometricNormal;
 		const bool flipNormal = dot(normal, r.direction) > 0.0f;
 		if (flipNormal)
 			normal *= -1.0f;
@@ -1042,7 +1517,7 @@ glm::vec3 PathTracer::SampleNEEMicrofacet(Ray &r, RandomGenerator &rng) const
 			const float weight = mf.weight(woLocal, wiLocal, wmLocal);
 
 			throughput *= mat.GetAlbedoColor(r.obj, p) * weight;
-			r = Ray(p + EPSILON * wo, wo);
+			r = r.Bounce(p, wo, r.GetGlossySpread(sqrtf(mf.m_AlphaX * mf.m_AlphaY)));
 		}
 		else
 		{
@@ -1052,12 +1527,15 @@ glm::vec3 PathTracer::SampleNEEMicrofacet(Ray &r, RandomGenerator &rng) const
 
 			// NEE
 			float NEEpdf;
-			SceneObject *light = RandomPointOnLight(NEEpdf, rng);
+			// the microfacet lobe can point anywhere, so the receiver cosine is left out of the light importance
+			SceneObject *light = RandomPointOnLight(p, vec3(0.0f), NEEpdf, rng);
 			if (light != nullptr)
-			{ // if there are no lights
+			{ // if there are no lights or none of them reach p
 				const vec3 Direction = glm::normalize(p - light->GetPosition());
 				vec3 lightNormal;
-				const vec3 pointOnLight = light->GetRandomPointOnSurface(Direction, lightNormal, rng);
+				const float r1 = rng.Rand(1.f);
+				const float r2 = rng.Rand(1.f);
+				const vec3 pointOnLight = light->GetRandomPointOnSurface(Direction, lightNormal, r1, r2);
 
 				vec3 L = pointOnLight - p;
 				const float squaredDistance = dot(L, L);
@@ -1069,8 +1547,8 @@ glm::vec3 PathTracer::SampleNEEMicrofacet(Ray &r, RandomGenerator &rng) const
 
 				if (NdotL > 0.f && LNdotL > 0.f)
 				{
-					Ray lightRay = Ray(p + EPSILON * L, L);
-					if (!m_Scene->TraceShadowRay(r, lDistance))
+					Ray lightRay = Ray(utils::OffsetRayOrigin(p, geometricNormal, L), L);
+					if (!TraceShadowRay(lightRay, lDistance - EPSILON))
 					{
 						const float SolidAngle = LNdotL * light->m_Area / squaredDistance;
 						const auto lightMat = m_Materials->GetMaterial(light->materialIdx);
@@ -1087,7 +1565,7 @@ glm::vec3 PathTracer::SampleNEEMicrofacet(Ray &r, RandomGenerator &rng) const
 			// NEE
 
 			throughput *= mat.GetAlbedoColor(r.obj, p) * weight;
-			r = Ray(p + EPSILON * wo, wo);
+			r = r.Bounce(p, wo, r.GetGlossySpread(sqrtf(mf.m_AlphaX * mf.m_AlphaY)));
 		}
 	}
 
@@ -1,9 +1,17 @@
 #pragma once
 
+#include <unordered_map>
+
+#include "BVH/LightBVH.h"
 #include "Core/Camera.h"
+#include "Core/EnvironmentSampler.h"
 #include "Core/Renderer.h"
 #include "Materials/MaterialManager.h"
+#include "Materials/MaterialTable.h"
 #include "Primitives/SceneObjectList.h"
+#include "Utils/AliasTable.h"
+#include "Utils/Sampler.h"
+#include "Utils/Stats.h"
 #include "Utils/ctpl.h"
 
 namespace core
@@ -26,32 +34,49 @@ class PathTracer : public Renderer
 
 	void Reset() override;
 
+	// Sample sequence of path tracers created after this call
+	static void SetSamplerType(SamplerType type) { m_SamplerType = type; }
+
 	int GetSamples() const override;
 
+	inline const FrameBuffer *GetFrameBuffer() override { return &m_FrameBuffer; }
+
+	inline void SetAOVsEnabled(bool enabled) override
+	{
+		m_FrameBuffer.EnableAOVs(enabled);
+		Reset();
+	}
+
 	void Render(Surface *output) override;
 
-	glm::vec3 Trace(Ray &r, uint &depth, float refractionIndex, RandomGenerator &rng);
+	// Rng is the concrete sampler type of the tile
+	template <typename Rng> glm::vec3 Trace(Ray &r, uint &depth, float refractionIndex, Rng &rng);
 
 	bool TraceLightRay(Ray &r, prims::SceneObject *light) const; // returns whether light is obstructed
 
-	glm::vec3 SampleNEE(Ray &r, RandomGenerator &rng) const;
+	template <typename Rng> glm::vec3 SampleNEE(Ray &r, Rng &rng) const;
 
-	glm::vec3 SampleIS(Ray &r, RandomGenerator &rng) const;
+	template <typename Rng> glm::vec3 SampleIS(Ray &r, Rng &rng) const;
 
-	glm::vec3 SampleReference(Ray &r, RandomGenerator &rng) const;
+	template <typename Rng> glm::vec3 SampleReference(Ray &r, Rng &rng) const;
 
-	glm::vec3 SampleNEE_IS(Ray &r, RandomGenerator &rng) const;
+	template <typename Rng> glm::vec3 SampleNEE_IS(Ray &r, Rng &rng) const;
 
-	glm::vec3 SampleNEE_MIS(Ray &r, RandomGenerator &rng) const;
+	template <typename Rng> glm::vec3 SampleNEE_MIS(Ray &r, Rng &rng) const;
 
 	glm::vec3 SampleSkyBox(const glm::vec3 &dir) const;
 
-	glm::vec3 SampleReferenceMicrofacet(Ray &r, RandomGenerator &rng) const;
+	template <typename Rng> glm::vec3 SampleReferenceMicrofacet(Ray &r, Rng &rng) const;
 
-	glm::vec3 SampleNEEMicrofacet(Ray &r, RandomGenerator &rng) const;
+	template <typename Rng> glm::vec3 SampleNEEMicrofacet(Ray &r, Rng &rng) const;
 
+	template <typename Rng>
 	glm::vec3 Refract(const bool &flipNormal, const Material &mat, const glm::vec3 &normal, const glm::vec3 &p,
-					  const float &t, Ray &r, RandomGenerator &rng) const;
+					  const float &t, Ray &r, Rng &rng) const;
+
+	template <typename Rng>
+	glm::vec3 Refract(bool flipNormal, float refractionIndex, const glm::vec3 &absorption, const glm::vec3 &normal,
+					  const glm::vec3 &p, float t, Ray &r, Rng &rng) const;
 
 	float GetEnergy() const;
 
@@ -62,15 +87,30 @@ class PathTracer : public Renderer
 		this->m_SkyboxEnabled = (this->m_SkyBox != nullptr && !this->m_SkyboxEnabled);
 	}
 
-	prims::SceneObject *RandomPointOnLight(float &NEEpdf, RandomGenerator &rng) const;
+	// Picks a light for shading point p, NEEpdf is the probability of picking it
+	template <typename Rng>
+	prims::SceneObject *RandomPointOnLight(const glm::vec3 &p, const glm::vec3 &normal, float &NEEpdf,
+										   Rng &rng) const;
+
+	// Probability of RandomPointOnLight picking light at shading point p
+	float LightPdf(const glm::vec3 &p, const glm::vec3 &normal, const prims::SceneObject *light) const;
+
+	// Picks up lights that were added or changed in size since the last call
+	void UpdateLights();
 
-	inline bool RussianRoulette(glm::vec3 &throughput, const uint depth, RandomGenerator &rng) const
+	void BuildLightTree();
+
+	template <typename Rng> inline bool RussianRoulette(glm::vec3 &throughput, const uint depth, Rng &rng) const
 	{
 		if (depth > 3)
 		{
+			utils::stats::Add(utils::stats::Counter::RouletteTests);
 			const float probability = std::max(EPSILON, std::max(throughput.x, std::max(throughput.y, throughput.z)));
 			if (rng.Rand(1.0f) > probability || probability <= 0.f)
+			{
+				utils::stats::Add(utils::stats::Counter::RouletteKills);
 				return true;
+			}
 			throughput /= probability;
 		}
 		return false;
@@ -95,22 +135,80 @@ class PathTracer : public Renderer
 	}
 
   private:
+	// A path in flight in the wavefront renderer
+	struct PathState
+	{
+		Ray ray;
+		glm::vec3 throughput;
+		glm::vec3 E;
+		SamplerState sampler;
+	};
+
+	// Scene queries of the integrators, counted by ray type
+	inline void TraceRay(Ray &r, uint depth) const
+	{
+		utils::stats::Add(depth == 0 ? utils::stats::Counter::PrimaryRays : utils::stats::Counter::BounceRays);
+		m_Scene->TraceRay(r);
+	}
+
+	inline bool TraceShadowRay(Ray &r, float tMax) const
+	{
+		const bool occluded = m_Scene->TraceShadowRay(r, tMax);
+		utils::stats::Add(utils::stats::Counter::ShadowRays);
+		utils::stats::Add(utils::stats::Counter::OccludedShadowRays, occluded ? 1 : 0);
+		return occluded;
+	}
+
+	void StoreSample(int x, int y, const glm::vec3 &color);
+
+	// First hit of a pixel for the auxiliary layers, r is the traced camera ray
+	void StoreAOVs(int x, int y, const Ray &r);
+
+	template <typename Rng> void RenderTile(int tileX, int tileY, Rng &rng);
+
+	// Reference and Reference MF a tile at a time: all paths of the tile are extended, the hits are grouped by
+	// material type and every group is shaded by its own routine
+	template <typename Rng> void RenderTileWavefront(int tileX, int tileY, Rng &rng);
+
+	// Shade a batch of hits, paths that continue are appended to next
+	template <typename Rng>
+	void ShadeDiffuse(PathState *paths, const unsigned int *batch, unsigned int count, std::vector<unsigned int> &next,
+					  Rng &rng) const;
+	void ShadeSpecular(PathState *paths, const unsigned int *batch, unsigned int count,
+					   std::vector<unsigned int> &next) const;
+	template <typename Rng>
+	void ShadeDiffuseSpecular(PathState *paths, const unsigned int *batch, unsigned int count,
+							  std::vector<unsigned int> &next, Rng &rng) const;
+	template <typename Rng>
+	void ShadeDielectric(PathState *paths, const unsigned int *batch, unsigned int count,
+						 std::vector<unsigned int> &next, Rng &rng) const;
+	template <typename Rng>
+	void ShadeMicrofacet(PathState *paths, const unsigned int *batch, unsigned int count,
+						 std::vector<unsigned int> &next, Rng &rng) const;
+
 	prims::WorldScene *m_Scene;
-	glm::vec3 *m_Pixels;
+	FrameBuffer m_FrameBuffer;
 	float *m_Energy;
 	int m_Width, m_Height, m_Samples;
-	std::vector<float> m_LightLotteryTickets;
-	float m_LightArea;
-	unsigned int m_LightCount;
+	utils::AliasTable m_LightTable; // lights are picked proportional to their area
+	bvh::LightBVH m_LightTree;		// or proportional to their estimated contribution with LIGHT_TREE
+	std::unordered_map<const prims::SceneObject *, unsigned int> m_LightIndices;
+	float m_LightArea = 0.0f;
+	unsigned int m_LightCount = 0;
 	Surface *m_SkyBox = nullptr;
+	EnvironmentSampler *m_SkySampler = nullptr; // only set for maps with anything to sample
 	bool m_SkyboxEnabled = false;
 	Camera *m_Camera;
 	const MaterialManager *m_Materials;
+	MaterialTable m_MaterialTable; // snapshot of the materials, compiled on every reset
 
 	int m_Tiles;
 
 	ctpl::ThreadPool *tPool = nullptr;
 	std::vector<std::future<void>> tResults{};
-	std::vector<RandomGenerator *> m_Rngs{};
+	std::vector<Sampler *> m_Samplers{}; // one per tile
+	SamplerType m_TileSamplerType = SamplerType::Sobol;
+
+	static SamplerType m_SamplerType;
 };
 } // namespace core
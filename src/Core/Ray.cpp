@@ -1,5 +1,12 @@
 #include "Ray.h"
 #include "Shared.h"
+#include "Utils/FloatError.h"
+
+#include <algorithm>
+
+// spread angle added by a diffuse bounce, a cosine lobe is far wider than this but the texture lookups of a path
+// should not drop to the coarsest mips after the first diffuse hit
+#define DIFFUSE_CONE_SPREAD 0.25f
 
 using namespace glm;
 
@@ -11,20 +18,45 @@ Ray::Ray(const vec3 &a, const vec3 &b)
 	this->direction = b;
 	this->t = 1e34f;
 	this->obj = nullptr;
+	PrecomputeShear();
+}
+
+// Woop et al., Watertight Ray/Triangle Intersection, JCGT 2013
+void Ray::PrecomputeShear()
+{
+	const vec3 absDir = abs(direction);
+	kz = absDir.x > absDir.y ? (absDir.x > absDir.z ? 0 : 2) : (absDir.y > absDir.z ? 1 : 2);
+	kx = (kz + 1) % 3;
+	ky = (kx + 1) % 3;
+	if (direction[kz] < 0.0f)
+		std::swap(kx, ky);
+
+	shear = vec3(direction[kx], direction[ky], 1.0f) / direction[kz];
 }
 
 vec3 Ray::GetHitpoint() const { return origin + t * direction; }
 
+Ray Ray::Bounce(const vec3 &point, const vec3 &dir, float spread) const
+{
+	Ray r = {utils::OffsetRayOrigin(point, geometricNormal, dir), dir};
+	r.coneWidth = GetConeWidth();
+	r.coneSpread = spread;
+	return r;
+}
+
+float Ray::GetGlossySpread(float alpha) const { return coneSpread + std::min(alpha, 1.0f) * DIFFUSE_CONE_SPREAD; }
+
+// a mirror keeps the spread, the curvature of the surface is not known here
 Ray Ray::Reflect(const vec3 &point, const vec3 &normal) const
 {
 	const vec3 reflectDir = (direction - (2.f * dot(normal, direction) * normal));
-	return {point + EPSILON * reflectDir, reflectDir};
+	return Bounce(point, reflectDir, coneSpread);
 }
 
-Ray Ray::DiffuseReflection(const vec3 &point, const vec3 &normal, RandomGenerator &rng) const
+Ray Ray::DiffuseReflection(const vec3 &point, const vec3 &normal, float r1, float r2) const
 {
-	const vec3 dir = rng.RandomPointOnHemisphere(normal);
-	return {point + EPSILON * dir, dir};
+	const vec3 dir = RandomGenerator::PointOnHemisphere(normal, r1, r2);
+	return Bounce(point, dir, coneSpread + DIFFUSE_CONE_SPREAD);
 }
 
 Ray Ray::Reflect(const vec3 &normal) const
@@ -33,12 +65,6 @@ Ray Ray::Reflect(const vec3 &normal) const
 	return Reflect(point, normal);
 }
 
-Ray Ray::DiffuseReflection(const vec3 &normal, RandomGenerator &rng) const
-{
-	const vec3 point = GetHitpoint();
-	return DiffuseReflection(point, normal, rng);
-}
-
 // http://www.rorydriscoll.com/2009/01/07/better-sampling/
 vec3 cosineWeightedSample(const float &r1, const float &r2)
 {
@@ -49,15 +75,13 @@ vec3 cosineWeightedSample(const float &r1, const float &r2)
 	return vec3(x, fmax(0.0f, sqrtf(1.0f - r1)), z);
 }
 
-Ray Ray::CosineWeightedDiffuseReflection(const vec3 &origin, const vec3 &normal, RandomGenerator &rng) const
+Ray Ray::CosineWeightedDiffuseReflection(const vec3 &origin, const vec3 &normal, float r1, float r2) const
 {
 	vec3 Nt, Nb;
-	rng.createCoordinateSystem(normal, Nt, Nb);
-	const float r1 = rng.Rand(1.0f);
-	const float r2 = rng.Rand(1.0f);
+	RandomGenerator::createCoordinateSystem(normal, Nt, Nb);
 	const vec3 sample = cosineWeightedSample(r1, r2);
-	const vec3 dir = rng.localToWorld(sample, Nt, Nb, normal);
-	return {origin + EPSILON * dir, dir};
+	const vec3 dir = RandomGenerator::localToWorld(sample, Nt, Nb, normal);
+	return Bounce(origin, dir, coneSpread + DIFFUSE_CONE_SPREAD);
 }
 
 glm::vec3 Ray::TransformToTangent(const vec3 &normal, vec3 vector) const
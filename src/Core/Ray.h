@@ -28,18 +28,56 @@ struct Ray
 
 	glm::vec3 GetHitpoint() const;
 
+	// Width of the ray cone at the hit point
+	inline float GetConeWidth() const { return coneWidth + coneSpread * t; }
+
+	// Ray leaving point, the hit point of this ray, along dir. It starts just off the surface on the side of dir, so
+	// interpolated normals can't put it below the surface, and its cone starts with the width at the hit point and
+	// the given spread.
+	Ray Bounce(const glm::vec3 &point, const glm::vec3 &dir, float spread) const;
+
+	// Spread after a glossy bounce off a GGX lobe with the given alpha, an alpha of 1 spreads like a diffuse bounce
+	float GetGlossySpread(float alpha) const;
+
+	// Spread after refracting with relative index of refraction eta (n1 / n2)
+	inline float GetRefractedSpread(float eta) const { return coneSpread * eta; }
+
 	Ray Reflect(const glm::vec3 &point, const glm::vec3 &normal) const;
 
 	Ray Reflect(const glm::vec3 &normal) const;
 
-	Ray DiffuseReflection(const glm::vec3 &point, const glm::vec3 &normal, RandomGenerator &rng) const;
+	// Diffuse bounces for two given uniform numbers. The Rng overloads draw them from the concrete generator type of
+	// the caller, so the inner loops of the integrators make no virtual calls.
+	Ray DiffuseReflection(const glm::vec3 &point, const glm::vec3 &normal, float r1, float r2) const;
 
-	Ray DiffuseReflection(const glm::vec3 &normal, RandomGenerator &rng) const;
+	template <typename Rng>
+	inline Ray DiffuseReflection(const glm::vec3 &point, const glm::vec3 &normal, Rng &rng) const
+	{
+		const float r1 = rng.Rand(1.0f);
+		const float r2 = rng.Rand(1.0f);
+		return DiffuseReflection(point, normal, r1, r2);
+	}
 
-	Ray CosineWeightedDiffuseReflection(const glm::vec3 &origin, const glm::vec3 &normal, RandomGenerator &rng) const;
+	template <typename Rng> inline Ray DiffuseReflection(const glm::vec3 &normal, Rng &rng) const
+	{
+		return DiffuseReflection(GetHitpoint(), normal, rng);
+	}
+
+	Ray CosineWeightedDiffuseReflection(const glm::vec3 &origin, const glm::vec3 &normal, float r1, float r2) const;
+
+	template <typename Rng>
+	inline Ray CosineWeightedDiffuseReflection(const glm::vec3 &origin, const glm::vec3 &normal, Rng &rng) const
+	{
+		const float r1 = rng.Rand(1.0f);
+		const float r2 = rng.Rand(1.0f);
+		return CosineWeightedDiffuseReflection(origin, normal, r1, r2);
+	}
 
 	glm::vec3 TransformToTangent(const glm::vec3 &normal, glm::vec3 vector) const;
 
+	// Permutation and shear of the watertight triangle test, done once per ray instead of once per triangle
+	void PrecomputeShear();
+
 	union {
 		struct
 		{
@@ -59,6 +97,15 @@ struct Ray
 	};
 
 	const prims::SceneObject *obj;
-	glm::vec3 normal;
+	glm::vec3 normal;		   // shading normal at the hit point
+	glm::vec3 geometricNormal; // normal of the surface itself, rays leaving the hit point are offset along it
+
+	// ray cone used for texture filtering, a spread of 0 samples the full resolution textures
+	float coneWidth = 0.0f;
+	float coneSpread = 0.0f;
+
+	// z is the largest component of the direction, x and y are swapped when it is negative to keep the winding
+	int kx, ky, kz;
+	glm::vec3 shear; // shears the direction onto (0, 0, 1) after the permutation
 };
 } // namespace core
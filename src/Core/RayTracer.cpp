@@ -1,7 +1,10 @@
 #include "RayTracer.h"
 #include "Materials/MaterialManager.h"
+#include "Utils/FloatError.h"
 #include "Utils/MersenneTwister.h"
-#include "Utils/Xor128.h"
+#include "Utils/Pcg32.h"
+#include "Utils/Stats.h"
+#include "Utils/Timeline.h"
 
 using namespace gl;
 
@@ -21,15 +24,14 @@ RayTracer::RayTracer(prims::WorldScene *Scene, glm::vec3 backGroundColor, glm::v
 	this->maxRecursionDepth = maxRecursionDepth;
 	this->m_Camera = camera;
 	this->tPool = new ctpl::ThreadPool(ctpl::nr_of_cores);
-	this->m_Rngs = new std::vector<RandomGenerator *>();
 	this->m_Tiles = (m_Width / TILE_WIDTH) * (m_Height / TILE_HEIGHT);
 	this->tResults = new std::vector<std::future<void>>(m_Tiles);
 	this->m_LightCount = static_cast<int>(m_Scene->GetLights().size());
-	this->m_Pixels = new vec3[m_Width * m_Height];
+	this->m_FrameBuffer.Resize(m_Width, m_Height);
 
 	for (int i = 0; i < m_Tiles; i++)
 	{
-		this->m_Rngs->push_back(new Xor128());
+		this->m_Rngs.emplace_back(0x853c49e6748fea9bULL, uint64_t(i));
 	}
 }
 
@@ -47,11 +49,14 @@ void RayTracer::Render(Surface *output)
 	{
 		for (int tile_x = 0; tile_x < hTiles; tile_x++)
 		{
-			RandomGenerator *rngPointer = m_Rngs->at(idx);
+			Pcg32 *rngPointer = &m_Rngs.at(idx);
 			idx++;
 
 			tResults->at(tile_y * hTiles + tile_x) =
-				tPool->push([tile_x, tile_y, this, output, rngPointer](int threadId) -> void {
+				tPool->push([tile_x, tile_y, this, rngPointer](int threadId) -> void {
+					utils::timeline::ScopedEvent event("tile", "render");
+					utils::stats::ScopedTimer timer(utils::stats::Stage::Trace);
+					utils::stats::Add(utils::stats::Counter::Paths, TILE_WIDTH * TILE_HEIGHT);
 					for (int y = 0; y < TILE_HEIGHT; y++)
 					{
 						const int pixel_y = y + tile_y * TILE_HEIGHT;
@@ -62,34 +67,28 @@ void RayTracer::Render(Surface *output)
 							Ray r = m_Camera->GenerateRay(float(pixel_x), float(pixel_y));
 							const glm::vec3 color = Trace(r, depth, 1.f, *rngPointer);
 
-							const int pidx = pixel_x + pixel_y * m_Width;
-
-							if (m_Samples > 0)
-							{
-								const float factor = 1.0f / float(m_Samples + 1);
-								m_Pixels[pidx] = m_Pixels[pidx] * float(m_Samples) * factor + color * factor;
-							}
-							else
-							{
-								m_Pixels[pidx] = color;
-							}
-							output->Plot(pixel_x, pixel_y, m_Pixels[pidx]);
+							m_FrameBuffer.Add(AOV::Color, pixel_x, pixel_y, color);
 						}
 					}
 				});
 		}
 	}
 
-	for (auto &r : *tResults)
 	{
-		r.get();
+		utils::timeline::ScopedEvent event("wait for tiles", "render");
+		for (auto &r : *tResults)
+			r.get();
 	}
 
 	m_Samples++;
+	utils::stats::ScopedTimer timer(utils::stats::Stage::Accumulate);
+	m_FrameBuffer.FinishSample();
+	m_FrameBuffer.Resolve(output, tPool);
 }
 
-glm::vec3 RayTracer::Trace(Ray &r, uint &depth, float refractionIndex, RandomGenerator &rng)
+template <typename Rng> glm::vec3 RayTracer::Trace(Ray &r, uint &depth, float refractionIndex, Rng &rng)
 {
+	utils::stats::Add(depth == 0 ? utils::stats::Counter::PrimaryRays : utils::stats::Counter::BounceRays);
 	m_Scene->TraceRay(r);
 
 	if (!r.IsValid())
@@ -100,7 +99,7 @@ glm::vec3 RayTracer::Trace(Ray &r, uint &depth, float refractionIndex, RandomGen
 	return Shade(r, depth, refractionIndex, rng);
 }
 
-glm::vec3 RayTracer::Shade(const Ray &r, uint &depth, float refractionIndex, RandomGenerator &rng)
+template <typename Rng> glm::vec3 RayTracer::Shade(const Ray &r, uint &depth, float refractionIndex, Rng &rng)
 {
 	if (depth >= maxRecursionDepth)
 	{
@@ -124,8 +123,9 @@ glm::vec3 RayTracer::Shade(const Ray &r, uint &depth, float refractionIndex, Ran
 	return diffuseColor + reflectionRefractionColor;
 }
 
+template <typename Rng>
 glm::vec3 RayTracer::GetDiffuseSpecularColor(const Ray &r, const Material &mat, const glm::vec3 &hitPoint,
-											 RandomGenerator &rng) const
+											 Rng &rng) const
 {
 	if (m_LightCount < 0)
 		return {};
@@ -157,11 +157,16 @@ glm::vec3 RayTracer::GetDiffuseSpecularColor(const Ray &r, const Material &mat,
 		if (NdotL <= 0.0f)
 			continue;
 
-		Ray shadowRay = {p + EPSILON * towardsLightNorm, towardsLightNorm};
-		if (!m_Scene->TraceShadowRay(shadowRay, distToLight - 2.0f * EPSILON))
+		Ray shadowRay = {utils::OffsetRayOrigin(p, r.geometricNormal, towardsLightNorm), towardsLightNorm};
+		const bool occluded = m_Scene->TraceShadowRay(shadowRay, distToLight - 2.0f * EPSILON);
+		utils::stats::Add(utils::stats::Counter::ShadowRays);
+		utils::stats::Add(utils::stats::Counter::OccludedShadowRays, occluded ? 1 : 0);
+		if (!occluded)
 		{
 			glm::vec3 lNormal;
-			const glm::vec3 pointOnLight = light->GetRandomPointOnSurface(towardsLightNorm, lNormal, rng);
+			const float r1 = rng.Rand(1.f);
+			const float r2 = rng.Rand(1.f);
+			const glm::vec3 pointOnLight = light->GetRandomPointOnSurface(towardsLightNorm, lNormal, r1, r2);
 			const float LNdotL = glm::dot(lNormal, -towardsLightNorm);
 			if (LNdotL > 0.0f)
 			{
@@ -177,8 +182,9 @@ glm::vec3 RayTracer::GetDiffuseSpecularColor(const Ray &r, const Material &mat,
 	return ret;
 }
 
+template <typename Rng>
 glm::vec3 RayTracer::GetreflectionRefractionColor(const core::Ray &r, uint &depth, float refractionIndex,
-												  const Material &mat, const glm::vec3 &hitPoint, RandomGenerator &rng)
+												  const Material &mat, const glm::vec3 &hitPoint, Rng &rng)
 {
 	depth++;
 	const vec3 normal = r.obj->GetNormal(hitPoint);
@@ -217,7 +223,7 @@ glm::vec3 RayTracer::GetreflectionRefractionColor(const core::Ray &r, uint &dept
 				R0 + (1.f - R0) * (minCosTheta * minCosTheta * minCosTheta * minCosTheta * minCosTheta);
 			FractionTransmission = 1.f - FractionReflection;
 			vec3 newDir = n * r.direction + normal * (n * cosTheta - sqrtf(k));
-			auto refractionRay = Ray(hitPoint + EPSILON * newDir, newDir);
+			auto refractionRay = r.Bounce(hitPoint, newDir, r.GetRefractedSpread(n));
 			refractionCol = Trace(refractionRay, depth, n2, rng);
 			if (DoAbsorption)
 			{
@@ -236,7 +242,5 @@ RayTracer::~RayTracer()
 {
 	delete tPool;
 	delete tResults;
-	delete m_Rngs;
-	delete[] m_Pixels;
 }
 } // namespace core
\ No newline at end of file
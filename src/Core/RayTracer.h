@@ -5,6 +5,7 @@
 #include "Camera.h"
 #include "Primitives/SceneObjectList.h"
 #include "Renderer.h"
+#include "Utils/Pcg32.h"
 #include "Utils/ctpl.h"
 
 namespace core
@@ -19,18 +20,27 @@ class RayTracer : public Renderer
 
 	RayTracer(prims::WorldScene *Scene, glm::vec3 backgroundColor, glm::vec3 ambientColor, uint maxRecursionDepth,
 			  Camera *camera, int width, int height);
-	glm::vec3 Trace(Ray &r, uint &depth, float refractionIndex, RandomGenerator &rng);
-	glm::vec3 Shade(const Ray &r, uint &depth, float refractionIndex, RandomGenerator &rng);
-	glm::vec3 GetDiffuseSpecularColor(const Ray &r, const Material &mat, const glm::vec3 &hitPoint,
-									  RandomGenerator &rng) const;
+
+	// Rng is the concrete generator type of the tile
+	template <typename Rng> glm::vec3 Trace(Ray &r, uint &depth, float refractionIndex, Rng &rng);
+	template <typename Rng> glm::vec3 Shade(const Ray &r, uint &depth, float refractionIndex, Rng &rng);
+	template <typename Rng>
+	glm::vec3 GetDiffuseSpecularColor(const Ray &r, const Material &mat, const glm::vec3 &hitPoint, Rng &rng) const;
+	template <typename Rng>
 	glm::vec3 GetreflectionRefractionColor(const Ray &r, uint &depth, float refractionIndex, const Material &mat,
-										   const glm::vec3 &hitPoint, RandomGenerator &rng);
+										   const glm::vec3 &hitPoint, Rng &rng);
 
 	inline void SwitchSkybox() override {}
 
 	void Resize(gl::Texture *newOutput) override;
 
-	inline void Reset() override { m_Samples = 0; }
+	inline void Reset() override
+	{
+		m_Samples = 0;
+		m_FrameBuffer.Clear();
+	}
+
+	inline const FrameBuffer *GetFrameBuffer() override { return &m_FrameBuffer; }
 
 	inline void SetMode(std::string) override{};
 
@@ -44,9 +54,9 @@ class RayTracer : public Renderer
 	int m_Tiles, m_Width, m_Height, m_LightCount;
 
 	std::vector<std::future<void>> *tResults = nullptr;
-	std::vector<RandomGenerator *> *m_Rngs = nullptr;
+	std::vector<Pcg32> m_Rngs; // a stream per tile
 
-	glm::vec3 *m_Pixels;
+	FrameBuffer m_FrameBuffer;
 
 	int m_Samples = 0;
 };
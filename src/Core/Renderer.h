@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Core/FrameBuffer.h"
 #include "Core/Ray.h"
 #include "Core/Surface.h"
 #include "Utils/RandomGenerator.h"
@@ -28,6 +29,13 @@ class Renderer
 
 	inline virtual int GetSamples() const { return 0; }
 
+	// Accumulated image in host memory, renderers that accumulate on a device read it back first.
+	// nullptr if the renderer does not keep one.
+	inline virtual const FrameBuffer *GetFrameBuffer() { return nullptr; }
+
+	// Keeps albedo, normal & depth of the first hits next to the color, only the CPU path tracer does this
+	inline virtual void SetAOVsEnabled(bool) {}
+
 	virtual void Resize(gl::Texture *newOutput) = 0;
 
 	virtual ~Renderer() = default;
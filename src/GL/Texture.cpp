@@ -113,8 +113,8 @@ core::Pixel *Texture::mapToPixelBuffer()
 	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB);
 	Bind();
 	glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, m_PboId);
+	// not cleared, the CPU renderers resolve every pixel of their frame into it
 	auto *buffer = glMapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
-	memset(buffer, 0, m_Width * m_Height * 4);
 	return (core::Pixel *)buffer;
 }
 
@@ -0,0 +1,229 @@
+#include "Headless.h"
+
+#include "BVH/BVHAnalysis.h"
+#include "CL/OpenCL.h"
+#include "Utils/Stats.h"
+
+#define SAH_REPORT_LIMIT 100000 // full SAH sweeps are quadratic, larger scenes only compare the other build types
+
+Headless::Headless(RendererType type, int width, int height, const char *scene, const char *skybox)
+	: m_Type(type), m_Width(width), m_Height(height)
+{
+	using namespace core;
+
+	m_TPool = new ctpl::ThreadPool(ctpl::nr_of_cores);
+	m_ObjectList = new prims::SceneObjectList();
+	m_GpuList = new prims::GpuTriangleList();
+	m_Screen = new core::Surface(m_Width, m_Height);
+	m_Camera = Camera(m_Width, m_Height, 80.f);
+
+	const auto defaultMaterial =
+		static_cast<unsigned int>(MaterialManager::GetInstance()->AddMaterial(Material(1.0f, vec3(1.0f), 8.0f)));
+
+	// same scene setup as Application so the numbers are comparable
+	if (m_Type == GPU)
+	{
+		if (scene != nullptr)
+			prims::Load(scene, defaultMaterial, glm::vec3(0.0f), 1.0f, m_GpuList);
+		else
+			Dragon(m_GpuList);
+
+		if (m_GpuList->GetTriangles().empty())
+			utils::FatalError(__FILE__, __LINE__, "No triangles for GPU, exiting.", "GPU Init");
+	}
+	else
+	{
+		if (scene != nullptr)
+			prims::Load(scene, defaultMaterial, glm::vec3(0.0f), 1.0f, m_ObjectList, glm::mat4(1.0f),
+							prims::SceneTriangleTest());
+		else
+			Dragon(m_ObjectList);
+	}
+
+	m_Skybox = new core::Surface(skybox != nullptr ? skybox : "models/envmaps/pisa.png");
+
+	if (m_Type == GPU)
+	{
+		std::cout << "Primitive count: " << m_GpuList->GetTriangles().size() << std::endl;
+		if (cl::Kernel::GetDeviceCount() > 1)
+			m_Renderer = new MultiGpuTracer(m_GpuList, m_Width, m_Height, &m_Camera, m_Skybox, nullptr, m_TPool);
+		else
+			m_Renderer = new GpuTracer(m_GpuList, m_Width, m_Height, &m_Camera, m_Skybox, m_TPool);
+	}
+	else
+	{
+		m_Scene = new bvh::TopLevelBVH(m_ObjectList, &m_GameObjects, bvh::SceneBuildConfig(), m_TPool);
+		std::cout << "Primitive count: " << m_Scene->GetPrimitiveCount() << std::endl;
+		m_Renderer = new PathTracer(m_Scene, m_Width, m_Height, &m_Camera, m_Skybox);
+	}
+	m_Renderer->SetMode(Mode::ReferenceMicrofacet);
+}
+
+Headless::~Headless()
+{
+	delete m_Writer; // finishes writing first
+	if (m_StatsFile != nullptr)
+		fclose(m_StatsFile);
+	delete m_Renderer;
+	delete m_Scene;
+	delete m_Skybox;
+	delete m_Screen;
+	delete m_TPool;
+}
+
+void Headless::SetOutput(const std::string &path, int checkpoint, bool aovs)
+{
+	m_OutputPath = path;
+	m_Checkpoint = checkpoint;
+	m_Renderer->SetAOVsEnabled(aovs);
+	if (m_Writer == nullptr)
+		m_Writer = new utils::AsyncImageWriter();
+}
+
+void Headless::SetStatsOutput(const std::string &path)
+{
+	if (m_StatsFile != nullptr)
+		fclose(m_StatsFile);
+
+	m_StatsFile = fopen(path.c_str(), "a");
+	if (m_StatsFile == nullptr)
+	{
+		const std::string message = "Could not open " + path + " for writing.";
+		utils::WarningMessage(__FILE__, __LINE__, message.c_str(), "Headless");
+	}
+}
+
+void Headless::WriteOutput()
+{
+	using namespace core;
+
+	const FrameBuffer *frame = m_Renderer->GetFrameBuffer();
+	if (frame == nullptr)
+	{
+		utils::WarningMessage(__FILE__, __LINE__, "Renderer has no frame buffer to write.", "Headless");
+		return;
+	}
+
+	// render.exr becomes render.albedo.exr etc.
+	const size_t dot = m_OutputPath.find_last_of('.');
+	const std::string stem = dot == std::string::npos ? m_OutputPath : m_OutputPath.substr(0, dot);
+	const std::string extension = dot == std::string::npos ? "" : m_OutputPath.substr(dot);
+	const utils::ImageFormat format = utils::GetImageFormat(m_OutputPath);
+
+	for (int i = 0; i < int(AOV::Count); i++)
+	{
+		const auto aov = AOV(i);
+		if (!frame->HasLayer(aov))
+			continue;
+
+		const std::string path = aov == AOV::Color ? m_OutputPath : stem + "." + GetAOVName(aov) + extension;
+		m_Writer->Write(path, frame->GetWidth(), frame->GetHeight(), frame->GetLayer(aov), format, frame->GetScale());
+	}
+}
+
+float Headless::Run(int frames)
+{
+	// scene setup and BVH builds are not part of the first frame
+	utils::stats::EndFrame(0.0f);
+
+	utils::Timer timer, frameTimer;
+	for (int i = 0; i < frames; i++)
+	{
+		m_Renderer->Render(m_Screen);
+		if (m_StatsFile != nullptr)
+		{
+			// kernels are only enqueued, per frame numbers need them to be done
+			if (m_Type == GPU)
+				cl::Kernel::SyncDevices();
+			fprintf(m_StatsFile, "%s\n", utils::stats::EndFrame(frameTimer.elapsed()).ToJSON().c_str());
+			frameTimer.reset();
+		}
+		// the writer copies the image, rendering continues while it is written
+		if (m_Writer != nullptr && m_Checkpoint > 0 && (i + 1) % m_Checkpoint == 0 && i + 1 < frames)
+			WriteOutput();
+	}
+
+	// kernels are only enqueued, wait for all of them before stopping the clock
+	if (m_Type == GPU)
+		cl::Kernel::SyncDevices();
+
+	const float elapsed = timer.elapsed();
+	const float frameTime = elapsed / float(glm::max(frames, 1));
+	const double samples = double(m_Width) * double(m_Height) * double(frames);
+
+	printf("Renderer: %s, Mode: %s, Frames: %i, Resolution: %ix%i\n", m_Type == GPU ? "GPU" : "CPU",
+		   m_Renderer->GetModeString(), frames, m_Width, m_Height);
+	printf("Total: %.2f ms, Frame: %.2f ms, Throughput: %.3f MSamples/s\n", elapsed, frameTime,
+		   samples / (double(elapsed) * 1000.0));
+
+	if (m_Writer != nullptr)
+	{
+		WriteOutput();
+		m_Writer->Flush();
+	}
+
+	return frameTime;
+}
+
+void Headless::ReportBVH(int rays)
+{
+	const auto *tree = m_Scene != nullptr ? dynamic_cast<const bvh::MBVHTree *>(m_Scene->m_StaticBVHTree) : nullptr;
+	if (tree == nullptr)
+	{
+		utils::WarningMessage(__FILE__, __LINE__, "BVH reports need the C++ scene.", "Headless");
+		return;
+	}
+
+	// the same rays for every tree
+	const std::vector<core::Ray> cameraRays = bvh::GenerateCameraRays(m_Camera, m_Width, m_Height, rays);
+	const std::vector<core::Ray> randomRays = bvh::GenerateRandomRays(tree->m_Bounds, rays);
+
+	const auto report = [this, &cameraRays, &randomRays](const prims::WorldScene &scene, bvh::BVHReport result) {
+		bvh::MeasureTraversal(scene, cameraRays, "camera", result);
+		bvh::MeasureTraversal(scene, randomRays, "random", result);
+		printf("%s", result.ToString().c_str());
+		if (m_StatsFile != nullptr)
+			fprintf(m_StatsFile, "%s\n", result.ToJSON().c_str());
+	};
+
+	const auto reportConfig = [this, &report](const bvh::BVHBuildConfig &config) {
+		auto *binaryTree = new bvh::StaticBVHTree(m_ObjectList, config, m_TPool);
+		binaryTree->ConstructBVH();
+		auto *mbvhTree = new bvh::MBVHTree(binaryTree);
+		report(*binaryTree, bvh::Analyze(*binaryTree, m_TPool));
+		report(*mbvhTree, bvh::Analyze(*mbvhTree, m_TPool));
+		delete mbvhTree;
+		delete binaryTree;
+	};
+
+	report(*tree->m_OriginalTree, bvh::Analyze(*tree->m_OriginalTree, m_TPool));
+	report(*tree, bvh::Analyze(*tree, m_TPool));
+
+	for (const bvh::BVHType type : {bvh::CENTRAL_SPLIT, bvh::SAH_BINNING, bvh::SAH})
+	{
+		if (type == tree->m_OriginalTree->GetType())
+			continue;
+		if (type == bvh::SAH && m_ObjectList->GetPrimitiveCount() > SAH_REPORT_LIMIT)
+		{
+			printf("Skipping full SAH, more than %i primitives.\n", SAH_REPORT_LIMIT);
+			continue;
+		}
+
+		bvh::BVHBuildConfig config = bvh::SceneBuildConfig();
+		config.type = type;
+		config.autoTune = false;
+		reportConfig(config);
+	}
+
+	// what --bvh-tune would pick for this scene
+	if (!bvh::SceneBuildConfig().autoTune)
+	{
+		bvh::BVHBuildConfig config = bvh::SceneBuildConfig();
+		config.autoTune = true;
+		reportConfig(config);
+	}
+
+	// rays through the top level also traverse the static tree and every instance they reach
+	if (!m_Scene->m_DynamicNodes.empty())
+		report(*m_Scene, bvh::AnalyzeDynamic(*m_Scene, m_TPool));
+}
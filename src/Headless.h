@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Application.h"
+#include "Utils/ImageWriter.h"
+
+// Renders a fixed number of frames without a window or OpenGL context and reports the throughput.
+// Used on render nodes without a display and in CI to compare the OpenCL kernels against the C++ path tracer.
+class Headless
+{
+  public:
+	Headless(RendererType type, int width, int height, const char *scene = nullptr, const char *skybox = nullptr);
+	~Headless();
+
+	// Writes the accumulated image to path (.pfm, .exr or .png) once the run is done and every checkpoint frames
+	// in between. With aovs the first hit layers are written next to it, e.g. render.albedo.exr.
+	void SetOutput(const std::string &path, int checkpoint = 0, bool aovs = false);
+
+	// Appends the counters and stage times of every frame to path as JSON lines
+	void SetStatsOutput(const std::string &path);
+
+	// Returns the average time per frame in milliseconds
+	float Run(int frames);
+
+	// Prints the quality of the scene BVH and of the other build types for the same primitives, traced with about
+	// rays camera rays and rays random rays each. Also appended to the stats output as JSON lines. C++ scene only.
+	void ReportBVH(int rays);
+
+  private:
+	// Hands the current image to the writer thread
+	void WriteOutput();
+
+	RendererType m_Type;
+	int m_Width, m_Height;
+
+	core::Renderer *m_Renderer = nullptr;
+	core::Camera m_Camera;
+	core::Surface *m_Screen = nullptr;
+	core::Surface *m_Skybox = nullptr;
+
+	prims::SceneObjectList *m_ObjectList = nullptr;
+	prims::GpuTriangleList *m_GpuList = nullptr;
+	bvh::TopLevelBVH *m_Scene = nullptr;
+	std::vector<bvh::GameObject *> m_GameObjects;
+
+	ctpl::ThreadPool *m_TPool = nullptr;
+
+	std::string m_OutputPath;
+	int m_Checkpoint = 0;
+	utils::AsyncImageWriter *m_Writer = nullptr;
+
+	FILE *m_StatsFile = nullptr;
+};
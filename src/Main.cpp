@@ -1,8 +1,14 @@
 ﻿#include "Application.h"
+#include "Headless.h"
 
+#include "BVH/BVHBuildConfig.h"
+#include "CL/OpenCL.h"
+#include "Materials/MaterialManager.h"
+#include "Primitives/Model.h"
 #include "Shared.h"
 #include "Utils/GLFWWindow.h"
 #include "Utils/SDLWindow.h"
+#include "Utils/Timeline.h"
 #include "Utils/Timer.h"
 
 constexpr int SCRWIDTH = 1024;
@@ -12,11 +18,32 @@ using namespace utils;
 
 #define USE_SDL 0
 
+static void WriteTimeline(const std::string &path)
+{
+	timeline::Stop();
+	if (timeline::Write(path))
+		printf("Timeline written to %s\n", path.c_str());
+	else
+		WarningMessage(__FILE__, __LINE__, ("Could not write " + path).c_str(), "Timeline");
+}
+
 int main(int argc, char *argv[])
 {
 	printf("Application started.\n");
 
 	bool oFullScreen = false;
+	bool headless = false;
+	bool bvhReport = false;
+	int bvhRays = 1 << 18;
+	bool multiDevice = false;
+	int frames = 100;
+	int checkpoint = 0;
+	bool aovs = false;
+	std::string output;
+	std::string stats;
+	std::string timelinePath;
+	cl_device_type deviceType = CL_DEVICE_TYPE_GPU;
+	std::string platformName;
 	RendererType rendererType = CPU;
 	std::string file;
 
@@ -29,12 +56,98 @@ int main(int argc, char *argv[])
 			rendererType = GPU;
 		else if (str == "--cpu" || str == "-c")
 			rendererType = CPU;
+		else if (str == "--headless")
+			headless = true;
+		else if (str == "--frames" && i + 1 < argc)
+			frames = std::stoi(argv[++i]);
+		else if (str == "--output" && i + 1 < argc)
+			output = argv[++i];
+		else if (str == "--checkpoint" && i + 1 < argc)
+			checkpoint = std::stoi(argv[++i]);
+		else if (str == "--aovs")
+			aovs = true;
+		else if (str == "--stats" && i + 1 < argc)
+			stats = argv[++i];
+		else if (str == "--timeline" && i + 1 < argc)
+			timelinePath = argv[++i];
+		else if (str == "--bvh-report")
+			bvhReport = true;
+		else if (str == "--bvh-rays" && i + 1 < argc)
+			bvhRays = std::stoi(argv[++i]);
+		else if (str == "--bvh-tune")
+			bvh::SceneBuildConfig().autoTune = true;
+		else if (str == "--bvh-leaf-size" && i + 1 < argc)
+			bvh::SceneBuildConfig().maxLeafSize = std::stoi(argv[++i]);
+		else if (str == "--bvh-bins" && i + 1 < argc)
+			bvh::SceneBuildConfig().bins = std::stoi(argv[++i]);
+		else if (str == "--precomputed-triangles")
+			prims::SceneTriangleTest() = prims::TriangleTest::Precomputed;
+		else if (str == "--cl-device" && i + 1 < argc)
+		{
+			const std::string type = argv[++i];
+			if (type == "cpu")
+				deviceType = CL_DEVICE_TYPE_CPU;
+			else if (type == "all")
+				deviceType = CL_DEVICE_TYPE_ALL;
+			else
+				deviceType = CL_DEVICE_TYPE_GPU;
+		}
+		else if (str == "--cl-platform" && i + 1 < argc)
+			platformName = argv[++i];
+		else if (str == "--cl-multi-device")
+			multiDevice = true;
+		else if (str == "--sampler" && i + 1 < argc)
+		{
+			const std::string type = argv[++i];
+			if (type == "random")
+				core::PathTracer::SetSamplerType(SamplerType::Random);
+			else if (type == "bluenoise")
+				core::PathTracer::SetSamplerType(SamplerType::BlueNoise);
+			else
+				core::PathTracer::SetSamplerType(SamplerType::Sobol);
+		}
+		else if (str == "--texture-cache" && i + 1 < argc)
+			MaterialManager::GetInstance()->SetTextureCacheBudget(size_t(std::stoul(argv[++i])) << 20u);
 		else
 			file = str;
 	}
 
-	int exitApp = 0;
+	// started before anything is built so scene BVHs and OpenCL queues are part of it
+	if (!timelinePath.empty())
+	{
+		timeline::SetThreadName("Main");
+		timeline::Start();
+	}
+
+	// the OpenCL renderer can also run on CPU devices (POCL, Intel), optionally restricted to a platform
+	cl::Kernel::SelectDevice(deviceType, platformName);
+	// all devices of the selected type share the image, the GPU renderer picks this up
+	if (multiDevice && rendererType == GPU)
+		cl::Kernel::InitDevices();
+
 	const char *f = file.c_str();
+	if (headless || bvhReport)
+	{
+		cl::Kernel::SetHeadless(true);
+		// the report analyzes the BVHs of the C++ path tracer
+		Headless headlessApp(bvhReport ? CPU : rendererType, SCRWIDTH, SCRHEIGHT, file.empty() ? nullptr : f);
+		if (!output.empty())
+			headlessApp.SetOutput(output, checkpoint, aovs);
+		if (!stats.empty())
+			headlessApp.SetStatsOutput(stats);
+		if (bvhReport)
+			headlessApp.ReportBVH(bvhRays);
+		else
+			headlessApp.Run(frames);
+		if (!timelinePath.empty())
+		{
+			cl::Kernel::SyncDevices(); // kernel events arrive once they are done
+			WriteTimeline(timelinePath);
+		}
+		return EXIT_SUCCESS;
+	}
+
+	int exitApp = 0;
 #if USE_SDL
 	auto window = utils::SDLWindow("Tracer", SCRWIDTH, SCRHEIGHT, oFullScreen);
 #else
@@ -131,5 +244,9 @@ int main(int argc, char *argv[])
 	}
 
 	delete app;
+	if (!timelinePath.empty())
+	{
+		WriteTimeline(timelinePath);
+	}
 	return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -64,7 +64,7 @@ Material::Material(float diffuse, glm::vec3 colorDiffuse, float shininess, unsig
 glm::vec3 Material::GetDiffuseColor(const prims::SceneObject *obj, const glm::vec3 &hitPoint) const
 {
 	if (this->textureIdx > -1)
-		return MaterialManager::GetInstance()->GetTexture(textureIdx).GetColorAt(obj->GetTexCoords(hitPoint));
+		return MaterialManager::GetInstance()->GetTexture(textureIdx).Sample(obj->GetTexCoords(hitPoint), 0.0f);
 	else
 		return this->colorDiffuse;
 }
@@ -72,7 +72,29 @@ glm::vec3 Material::GetDiffuseColor(const prims::SceneObject *obj, const glm::ve
 glm::vec3 Material::GetAlbedoColor(const prims::SceneObject *obj, const glm::vec3 &hitPoint) const
 {
 	if (this->textureIdx > -1)
-		return MaterialManager::GetInstance()->GetTexture(textureIdx).GetColorAt(obj->GetTexCoords(hitPoint));
+		return MaterialManager::GetInstance()->GetTexture(textureIdx).Sample(obj->GetTexCoords(hitPoint), 0.0f);
 	else
 		return this->colorDiffuse;
-}
\ No newline at end of file
+}
+glm::vec3 Material::GetAlbedoColor(const core::Ray &r, const glm::vec3 &hitPoint) const
+{
+	if (this->textureIdx < 0)
+		return this->colorDiffuse;
+	return SampleTexture(textureIdx, r, hitPoint);
+}
+
+glm::vec3 Material::SampleTexture(int textureIdx, const core::Ray &r, const glm::vec3 &hitPoint)
+{
+	const MipTexture &texture = MaterialManager::GetInstance()->GetTexture(textureIdx);
+	const glm::vec2 texCoords = r.obj->GetTexCoords(hitPoint);
+
+	// ray cone footprint, Akenine-Moller et al. "Texture Level of Detail Strategies for Real-Time Ray Tracing"
+	const float uvRatio = r.obj->GetUVAreaRatio();
+	const float width = r.GetConeWidth();
+	const float cosTheta = glm::abs(glm::dot(r.normal, r.direction));
+	if (uvRatio <= 0.0f || width <= 0.0f || cosTheta <= 0.0f)
+		return texture.Sample(texCoords, 0.0f);
+
+	const float uvLod = 0.5f * log2f(uvRatio) + log2f(width / cosTheta);
+	return texture.Sample(texCoords, texture.GetLod(uvLod));
+}
@@ -55,6 +55,11 @@ struct Material
 
 	glm::vec3 GetAlbedoColor(const prims::SceneObject *obj, const glm::vec3 &hitPoint) const;
 
+	// Filtered lookup using the footprint of the ray cone at the hit, r needs to hold the intersection
+	glm::vec3 GetAlbedoColor(const core::Ray &r, const glm::vec3 &hitPoint) const;
+
+	static glm::vec3 SampleTexture(int textureIdx, const core::Ray &r, const glm::vec3 &hitPoint);
+
 	inline const glm::vec3 &GetSpecularColor() const { return this->colorDiffuse; }
 
 	inline const float &GetDiffuse() const { return this->diffuse; }
@@ -1,5 +1,9 @@
 #include "MaterialManager.h"
 
+#include <sys/stat.h>
+
+#include "Utils/Messages.h"
+
 using namespace core;
 
 static MaterialManager *instance = nullptr;
@@ -18,13 +22,13 @@ Material &MaterialManager::GetMaterial(size_t index) { return m_Materials.at(ind
 
 Microfacet &MaterialManager::GetMicrofacet(size_t index) { return m_Microfacets.at(index); }
 
-Surface &MaterialManager::GetTexture(size_t index) { return *m_Textures.at(index); }
+MipTexture &MaterialManager::GetTexture(size_t index) { return *m_Textures.at(index); }
 
 const Material &MaterialManager::GetMaterial(size_t index) const { return m_Materials.at(index); }
 
 const Microfacet &MaterialManager::GetMicrofacet(size_t index) const { return m_Microfacets.at(index); }
 
-const Surface &MaterialManager::GetTexture(size_t index) const { return *m_Textures.at(index); }
+const MipTexture &MaterialManager::GetTexture(size_t index) const { return *m_Textures.at(index); }
 
 size_t MaterialManager::AddMaterial(Material mat)
 {
@@ -44,10 +48,51 @@ size_t MaterialManager::AddMicrofacet(Microfacet mat)
 size_t MaterialManager::AddTexture(const char *path)
 {
 	auto idx = m_Textures.size();
-	m_Textures.push_back(new Surface(path));
+	if (m_TextureCache != nullptr)
+	{
+		const std::string tiledPath = std::string(path) + ".tmip";
+		struct stat image = {}, tiled = {};
+		const bool hasImage = stat(path, &image) == 0;
+		if (stat(tiledPath.c_str(), &tiled) == 0 && (!hasImage || tiled.st_mtime >= image.st_mtime))
+		{
+			m_Textures.push_back(std::make_unique<MipTexture>(m_TextureCache, tiledPath));
+			return idx;
+		}
+
+		// convert once, later runs only read the tiles they need
+		auto *surface = new Surface(path);
+		auto texture = std::make_unique<MipTexture>(surface);
+		delete surface;
+		if (hasImage && texture->Write(tiledPath))
+		{
+			m_Textures.push_back(std::make_unique<MipTexture>(m_TextureCache, tiledPath));
+			return idx;
+		}
+
+		if (hasImage)
+			utils::WarningMessage(__FILE__, __LINE__, ("Could not write " + tiledPath).c_str(), "MaterialManager");
+		m_Textures.push_back(std::move(texture));
+		return idx;
+	}
+
+	// only the mip pyramid is kept, the surface is just used to decode the image
+	auto *surface = new Surface(path);
+	m_Textures.push_back(std::make_unique<MipTexture>(surface));
+	delete surface;
 	return idx;
 }
 
+void MaterialManager::SetTextureCacheBudget(size_t budget)
+{
+	// textures that already page through the old cache keep using it, so it stays alive until Delete
+	m_TextureCache = nullptr;
+	if (budget > 0)
+	{
+		m_TextureCaches.push_back(std::make_unique<TextureCache>(budget));
+		m_TextureCache = m_TextureCaches.back().get();
+	}
+}
+
 void MaterialManager::Delete()
 {
 	auto *pointer = instance;
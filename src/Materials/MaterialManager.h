@@ -1,11 +1,14 @@
 #pragma once
 
+#include <memory>
 #include <vector>
 
 #include "Core/Surface.h"
 
 #include "Materials/Material.h"
 #include "Materials/Microfacet.h"
+#include "Materials/MipTexture.h"
+#include "Materials/TextureCache.h"
 
 class MaterialManager
 {
@@ -14,22 +17,32 @@ class MaterialManager
 
 	Material &GetMaterial(size_t index);
 	Microfacet &GetMicrofacet(size_t index);
-	core::Surface &GetTexture(size_t index);
+	MipTexture &GetTexture(size_t index);
 
 	std::vector<Material> &GetMaterials() { return m_Materials; }
 
 	std::vector<Microfacet> &GetMicrofacets() { return m_Microfacets; }
 
-	std::vector<core::Surface *> &GetTextures() { return m_Textures; }
+	std::vector<std::unique_ptr<MipTexture>> &GetTextures() { return m_Textures; }
 
 	const Material &GetMaterial(size_t index) const;
 	const Microfacet &GetMicrofacet(size_t index) const;
-	const core::Surface &GetTexture(size_t index) const;
+	const MipTexture &GetTexture(size_t index) const;
+
+	const std::vector<Material> &GetMaterials() const { return m_Materials; }
+
+	const std::vector<Microfacet> &GetMicrofacets() const { return m_Microfacets; }
 
 	size_t AddMaterial(Material mat);
 	size_t AddMicrofacet(Microfacet mat);
 	size_t AddTexture(const char *path);
 
+	// Textures added after this are paged in from tiled files next to the image (path + ".tmip") and kept within
+	// budget bytes, the tiled files are (re)created when they are missing or older than the image
+	void SetTextureCacheBudget(size_t budget);
+
+	inline TextureCache *GetTextureCache() const { return m_TextureCache; }
+
 	static void Delete();
 
   private:
@@ -39,5 +52,9 @@ class MaterialManager
 	std::vector<Material> m_Materials;
 	std::vector<Microfacet> m_Microfacets;
 
-	std::vector<core::Surface *> m_Textures;
+	// caches are declared first so they outlive the textures paging through them
+	std::vector<std::unique_ptr<TextureCache>> m_TextureCaches;
+	TextureCache *m_TextureCache = nullptr; // used by textures added next, null without a budget
+
+	std::vector<std::unique_ptr<MipTexture>> m_Textures;
 };
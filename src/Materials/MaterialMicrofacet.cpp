@@ -47,13 +47,10 @@ inline vec3 from_tangent_to_local(const vec3 &normal, const vec3 &tangent)
 	return tangent.x * t + tangent.y * b + tangent.z * normal;
 }
 
-glm::vec3 MaterialMicrofacet::SampleNormal(const vec3 &inDirection, const vec3 &normal, RandomGenerator &rng) const
+glm::vec3 MaterialMicrofacet::SampleNormal(const vec3 &inDirection, const vec3 &normal, float r0, float r1) const
 {
 	glm::vec3 Nt, Nb;
-	rng.createCoordinateSystem(normal, Nt, Nb);
-
-	float r0 = rng.Rand(1.0f);
-	float r1 = rng.Rand(1.0f);
+	RandomGenerator::createCoordinateSystem(normal, Nt, Nb);
 
 	float t = powf(r0, 2.0f / ((m_AlphaX + m_AlphaY / 2.0f) + 1.0f));
 
@@ -64,7 +61,7 @@ glm::vec3 MaterialMicrofacet::SampleNormal(const vec3 &inDirection, const vec3 &
 	float z = sinf(phi) * sqrt_1_min_t;
 	float y = sqrtf(t);
 
-	return rng.localToWorld(vec3(x, y, z), Nt, Nb, normal);
+	return RandomGenerator::localToWorld(vec3(x, y, z), Nt, Nb, normal);
 }
 
 inline float distribution_for_normal(float ndoth, float alpha)
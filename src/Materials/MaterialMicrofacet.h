@@ -13,7 +13,15 @@ class MaterialMicrofacet
 	~MaterialMicrofacet() = default;
 	MaterialMicrofacet(float alphaX, float alphaY);
 
-	vec3 SampleNormal(const vec3 &inDirection, const vec3 &realNormal, RandomGenerator &rng) const;
+	// Normal for two uniform numbers, the Rng overload draws them from the concrete generator type of the caller
+	vec3 SampleNormal(const vec3 &inDirection, const vec3 &realNormal, float r0, float r1) const;
+
+	template <typename Rng> inline vec3 SampleNormal(const vec3 &inDirection, const vec3 &realNormal, Rng &rng) const
+	{
+		const float r0 = rng.Rand(1.0f);
+		const float r1 = rng.Rand(1.0f);
+		return SampleNormal(inDirection, realNormal, r0, r1);
+	}
 	float Weight(const glm::vec3 &inDirection, const glm::vec3 &realNormal, const glm::vec3 outDirection) const;
 
 	inline float G(const vec3 &out, const vec3 &in) const { return G1(out) * G1(in); }
@@ -0,0 +1,78 @@
+#include "Materials/MaterialTable.h"
+
+#include <algorithm>
+
+void MaterialTable::Compile(const MaterialManager &manager)
+{
+	const std::vector<Material> &materials = manager.GetMaterials();
+	const std::vector<Microfacet> &microfacets = manager.GetMicrofacets();
+	const auto count = static_cast<unsigned int>(materials.size());
+
+	m_Types.resize(count);
+	m_Albedo.resize(count);
+	m_Emission.resize(count);
+	m_Absorption.resize(count);
+	m_Specular.resize(count);
+	m_RefractionIdx.resize(count);
+	m_AlphaX.resize(count);
+	m_AlphaY.resize(count);
+	m_TextureIdx.resize(count);
+	m_Ranks.resize(count);
+
+	unsigned int typeCounts[int(MaterialType::Count)] = {};
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const Material &mat = materials[i];
+		if (mat.IsLight())
+			m_Types[i] = MaterialType::Light;
+		else if (mat.IsTransparent())
+			m_Types[i] = MaterialType::Dielectric;
+		else if (mat.IsDiffuse() && mat.IsReflective())
+			m_Types[i] = MaterialType::DiffuseSpecular;
+		else if (mat.IsReflective())
+			m_Types[i] = MaterialType::Specular;
+		else
+			m_Types[i] = MaterialType::Diffuse;
+		typeCounts[int(m_Types[i])]++;
+
+		m_Albedo[i] = mat.colorDiffuse;
+		m_Emission[i] = mat.GetEmission();
+		m_Absorption[i] = mat.absorption;
+		m_Specular[i] = mat.GetSpecular();
+		m_RefractionIdx[i] = mat.refractionIndex;
+		m_TextureIdx[i] = mat.textureIdx;
+
+		const Microfacet mf = i < microfacets.size() ? microfacets[i] : Microfacet(mat.diffuse, mat.diffuse);
+		m_AlphaX[i] = mf.m_AlphaX;
+		m_AlphaY[i] = mf.m_AlphaY;
+	}
+
+	m_TypeOffsets[0] = 0;
+	for (int type = 0; type < int(MaterialType::Count); type++)
+		m_TypeOffsets[type + 1] = m_TypeOffsets[type] + typeCounts[type];
+
+	unsigned int next[int(MaterialType::Count)];
+	std::copy(m_TypeOffsets, m_TypeOffsets + int(MaterialType::Count), next);
+	for (unsigned int i = 0; i < count; i++)
+		m_Ranks[i] = next[int(m_Types[i])]++;
+}
+
+void ShadingBatches::Build(const MaterialTable &table, const unsigned int *ids, const unsigned int *materialIdx,
+						   unsigned int count)
+{
+	const unsigned int materialCount = table.GetSize();
+	m_Counts.assign(materialCount + 1, 0);
+	m_Hits.resize(count);
+
+	for (unsigned int i = 0; i < count; i++)
+		m_Counts[table.GetRank(materialIdx[i]) + 1]++;
+	for (unsigned int i = 0; i < materialCount; i++)
+		m_Counts[i + 1] += m_Counts[i];
+
+	for (int type = 0; type <= int(MaterialType::Count); type++)
+		m_Offsets[type] = m_Counts[table.GetTypeOffset(MaterialType(type))];
+
+	// m_Counts now holds the first slot of every rank
+	for (unsigned int i = 0; i < count; i++)
+		m_Hits[m_Counts[table.GetRank(materialIdx[i])]++] = ids[i];
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Core/Ray.h"
+#include "Materials/MaterialManager.h"
+
+// Shading model of a material, hits are grouped by this before shading
+enum class MaterialType : unsigned char
+{
+	Light = 0,
+	Diffuse = 1,
+	Specular = 2,
+	DiffuseSpecular = 3, // picks between a mirror and a diffuse bounce
+	Dielectric = 4,
+	Count = 5
+};
+
+// Flattened copy of the materials and microfacets in MaterialManager, every property lives in its own array.
+// Compiled when rendering starts and left untouched while threads are shading.
+class MaterialTable
+{
+  public:
+	MaterialTable() = default;
+
+	void Compile(const MaterialManager &manager);
+
+	inline MaterialType GetType(unsigned int idx) const { return m_Types[idx]; }
+
+	inline glm::vec3 GetAlbedo(unsigned int idx, const core::Ray &r, const glm::vec3 &hitPoint) const
+	{
+		if (m_TextureIdx[idx] < 0)
+			return m_Albedo[idx];
+		return Material::SampleTexture(m_TextureIdx[idx], r, hitPoint);
+	}
+
+	inline const glm::vec3 &GetEmission(unsigned int idx) const { return m_Emission[idx]; }
+
+	inline const glm::vec3 &GetAbsorption(unsigned int idx) const { return m_Absorption[idx]; }
+
+	inline float GetSpecular(unsigned int idx) const { return m_Specular[idx]; }
+
+	inline float GetRefractionIndex(unsigned int idx) const { return m_RefractionIdx[idx]; }
+
+	inline Microfacet GetMicrofacet(unsigned int idx) const { return {m_AlphaX[idx], m_AlphaY[idx]}; }
+
+	inline const float *GetAlphaX() const { return m_AlphaX.data(); }
+
+	inline const float *GetAlphaY() const { return m_AlphaY.data(); }
+
+	inline unsigned int GetSize() const { return static_cast<unsigned int>(m_Types.size()); }
+
+	// Position of a material when all materials are ordered by type, see ShadingBatches
+	inline unsigned int GetRank(unsigned int idx) const { return m_Ranks[idx]; }
+
+	// First rank of every type, entry Count is the number of materials
+	inline unsigned int GetTypeOffset(MaterialType type) const { return m_TypeOffsets[int(type)]; }
+
+  private:
+	std::vector<MaterialType> m_Types;
+	std::vector<glm::vec3> m_Albedo;
+	std::vector<glm::vec3> m_Emission;
+	std::vector<glm::vec3> m_Absorption;
+	std::vector<float> m_Specular;
+	std::vector<float> m_RefractionIdx;
+	std::vector<float> m_AlphaX, m_AlphaY;
+	std::vector<int> m_TextureIdx;
+
+	std::vector<unsigned int> m_Ranks;
+	unsigned int m_TypeOffsets[int(MaterialType::Count) + 1] = {};
+};
+
+// Groups hits by material type and, within a type, by material using a counting sort, so every shading routine
+// runs over a contiguous list of hits that take the same code path and mostly touch the same material.
+class ShadingBatches
+{
+  public:
+	// materialIdx[i] is the material of hit ids[i], batches hold the ids
+	void Build(const MaterialTable &table, const unsigned int *ids, const unsigned int *materialIdx,
+			   unsigned int count);
+
+	// Hits of a type, in order of their material
+	inline const unsigned int *GetBatch(MaterialType type) const { return m_Hits.data() + m_Offsets[int(type)]; }
+
+	inline unsigned int GetBatchSize(MaterialType type) const
+	{
+		return m_Offsets[int(type) + 1] - m_Offsets[int(type)];
+	}
+
+  private:
+	std::vector<unsigned int> m_Counts;
+	std::vector<unsigned int> m_Hits;
+	unsigned int m_Offsets[int(MaterialType::Count) + 1] = {};
+};
@@ -112,7 +112,7 @@ class Microfacet
 	~Microfacet() = default;
 
 	// Sample microfacet normal
-	inline glm::vec3 sampleWm(RandomGenerator &rng) const
+	template <typename Rng> inline glm::vec3 sampleWm(Rng &rng) const
 	{
 		const float U1 = rng.Rand(1.0f);
 		const float U2 = rng.Rand(1.0f);
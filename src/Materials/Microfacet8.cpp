@@ -0,0 +1,154 @@
+#include "Materials/Microfacet8.h"
+
+#include <string>
+
+#include "Utils/Messages.h"
+
+namespace
+{
+// Replays given uniform numbers so the scalar sampler sees the same input as a lane
+class ReplayGenerator : public RandomGenerator
+{
+  public:
+	ReplayGenerator(float u1, float u2) : m_U{u1, u2} {}
+
+	float Rand(float range) override { return m_U[m_Next++ & 1] * range; }
+
+	unsigned int RandomUint() override { return 0; }
+
+  private:
+	float m_U[2];
+	unsigned int m_Next = 0;
+};
+
+// Scalar GGX D for unit vectors, written out with angles to check the trig free version
+float ReferenceD(const Microfacet &mf, const glm::vec3 &wm)
+{
+	const float tan2 = tanTheta(wm) * tanTheta(wm);
+	const float cos4 = cos2Theta(wm) * cos2Theta(wm);
+	const float e = 1.0f + tan2 * (cos2Phi(wm) / (mf.m_AlphaX * mf.m_AlphaX) +
+								   sin2Phi(wm) / (mf.m_AlphaY * mf.m_AlphaY));
+	return 1.0f / (PI * mf.m_AlphaX * mf.m_AlphaY * cos4 * e * e);
+}
+
+glm::vec3 RandomDirection(RandomGenerator &rng)
+{
+	const float z = rng.Rand(1.0f) * 0.98f + 0.01f;
+	const float r = sqrtf(1.0f - z * z);
+	const float phi = 2.0f * PI * rng.Rand(1.0f);
+	return glm::vec3(r * cosf(phi), r * sinf(phi), z);
+}
+
+// Direction at the given height above the tangent plane, 0 lies in the plane
+glm::vec3 GrazingDirection(RandomGenerator &rng, float z)
+{
+	const float r = sqrtf(1.0f - z * z);
+	const float phi = 2.0f * PI * rng.Rand(1.0f);
+	return glm::vec3(r * cosf(phi), r * sinf(phi), z);
+}
+
+inline float Error(float value, float reference) { return fabsf(value - reference) / std::max(1.0f, fabsf(reference)); }
+
+// References that are not finite themselves (D of a tangent normal) are only checked for a finite batched value
+inline void Track(float &maxError, unsigned int &nonFinite, float value, float reference)
+{
+	if (!std::isfinite(value))
+		nonFinite++;
+	else if (std::isfinite(reference))
+		maxError = std::max(maxError, Error(value, reference));
+}
+
+Direction8 Load(const glm::vec3 *v)
+{
+	float x[8], y[8], z[8];
+	for (int i = 0; i < 8; i++)
+		x[i] = v[i].x, y[i] = v[i].y, z[i] = v[i].z;
+	return {_mm256_loadu_ps(x), _mm256_loadu_ps(y), _mm256_loadu_ps(z)};
+}
+
+// Uniform numbers at the ends of [0, 1], including 1 itself which samplers used to return
+const float EDGE_U1[] = {0.0f, 0x1.fffffep-1f, 1.0f};
+const float EDGE_ALPHA[] = {0.01f, 1.0f};
+const float EDGE_Z[] = {0.0f, 1e-4f, 1e-2f};
+} // namespace
+
+Microfacet8Error MeasureMicrofacet8(RandomGenerator &rng, int iterations)
+{
+	Microfacet8Error error = {};
+
+	// every combination of edge values once, then random ones
+	constexpr int edgeCases = 3 * 2 * 2 * 3;
+	for (int iteration = 0; iteration < edgeCases + iterations; iteration++)
+	{
+		const bool edge = iteration < edgeCases;
+		alignas(32) float alphaX[8], alphaY[8], U1[8], U2[8];
+		glm::vec3 wo[8], wi[8];
+		for (int i = 0; i < 8; i++)
+		{
+			if (edge)
+			{
+				// odd lanes are isotropic, even lanes pair one extreme alpha with the other
+				const int c = iteration;
+				alphaX[i] = EDGE_ALPHA[(c / 3) % 2];
+				alphaY[i] = (i & 1) ? alphaX[i] : EDGE_ALPHA[(c / 6) % 2];
+				U1[i] = EDGE_U1[c % 3];
+				U2[i] = float(i) / 8.0f + rng.Rand(0.125f);
+				wo[i] = GrazingDirection(rng, EDGE_Z[(c / 12) % 3]);
+				wi[i] = (i & 2) ? GrazingDirection(rng, EDGE_Z[(c / 12) % 3]) : RandomDirection(rng);
+				continue;
+			}
+
+			alphaX[i] = 0.01f + rng.Rand(1.0f);
+			alphaY[i] = (i & 1) ? alphaX[i] : 0.01f + rng.Rand(1.0f);
+			U1[i] = rng.Rand(1.0f);
+			U2[i] = rng.Rand(1.0f);
+			wo[i] = RandomDirection(rng);
+			wi[i] = RandomDirection(rng);
+		}
+
+		const Microfacet8 mf8(alphaX, alphaY);
+		const Direction8 wm8 = mf8.SampleWm(_mm256_load_ps(U1), _mm256_load_ps(U2));
+		const Direction8 wo8 = Load(wo), wi8 = Load(wi);
+
+		alignas(32) float sx[8], sy[8], sz[8], D[8], G[8], weight[8];
+		_mm256_store_ps(sx, wm8.x);
+		_mm256_store_ps(sy, wm8.y);
+		_mm256_store_ps(sz, wm8.z);
+		_mm256_store_ps(D, mf8.D(wm8));
+		_mm256_store_ps(G, mf8.G(wo8, wi8));
+		_mm256_store_ps(weight, mf8.Weight(wo8, wi8, wm8));
+
+		for (int i = 0; i < 8; i++)
+		{
+			const Microfacet mf(alphaX[i], alphaY[i]);
+			ReplayGenerator replay(U1[i], U2[i]);
+			const glm::vec3 wm = mf.sampleWm(replay);
+			const glm::vec3 s = glm::vec3(sx[i], sy[i], sz[i]);
+
+			if (!std::isfinite(sx[i]) || !std::isfinite(sy[i]) || !std::isfinite(sz[i]))
+				error.nonFinite++;
+			else
+				error.sample = std::max(error.sample, glm::length(wm - s));
+			Track(error.D, error.nonFinite, D[i], ReferenceD(mf, s));
+			Track(error.G, error.nonFinite, G[i], mf.G(wo[i], wi[i]));
+			Track(error.weight, error.nonFinite, weight[i], mf.weight(wo[i], wi[i], s));
+		}
+	}
+
+	return error;
+}
+
+bool ValidateMicrofacet8(RandomGenerator &rng, int iterations, float tolerance)
+{
+	const Microfacet8Error error = MeasureMicrofacet8(rng, iterations);
+	if (error.nonFinite == 0 && error.sample <= tolerance && error.D <= tolerance && error.G <= tolerance &&
+		error.weight <= tolerance)
+		return true;
+
+	const std::string message = "Batched microfacet evaluation is inaccurate, max errors: sample " +
+								std::to_string(error.sample) + ", D " + std::to_string(error.D) + ", G " +
+								std::to_string(error.G) + ", weight " + std::to_string(error.weight) +
+								", non-finite results " + std::to_string(error.nonFinite);
+	utils::WarningMessage(__FILE__, __LINE__, message.c_str(), "Microfacet8");
+	return false;
+}
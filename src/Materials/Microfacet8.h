@@ -0,0 +1,173 @@
+#pragma once
+
+#include <immintrin.h>
+
+#include "Materials/Microfacet.h"
+
+// 8 directions in local shading space (z along the normal), one lane per path
+struct Direction8
+{
+	__m256 x, y, z;
+};
+
+// Eight GGX distributions evaluated at once with AVX2, lane i behaves like Microfacet(alphaX[i], alphaY[i]).
+// Trigonometry, square roots and divisions are replaced by polynomials and refined rsqrt/rcp estimates, their
+// error against the scalar Microfacet is measured by MeasureMicrofacet8, which the MicrofacetCheck test runs.
+class Microfacet8
+{
+  public:
+	Microfacet8(const float *alphaX, const float *alphaY)
+		: m_AlphaX(_mm256_loadu_ps(alphaX)), m_AlphaY(_mm256_loadu_ps(alphaY))
+	{
+	}
+
+	// Samples microfacet normals from two uniform numbers per lane, lane for lane the same normal as
+	// Microfacet::sampleWm given the same U1 and U2
+	inline Direction8 SampleWm(const __m256 &U1, const __m256 &U2) const
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+
+		__m256 sinT, cosT;
+		SinCos2Pi(U2, sinT, cosT);
+
+		// isotropic lanes: phi = 2 pi U2
+		// anisotropic lanes: phi = atan(ay / ax * tan(2 pi U2 + pi / 2)) + pi [U2 > 0.5], which points along
+		// (ax sin(2 pi U2), -ay cos(2 pi U2))
+		const __m256 isotropic = _mm256_cmp_ps(m_AlphaX, m_AlphaY, _CMP_EQ_OQ);
+		const __m256 ax = _mm256_mul_ps(m_AlphaX, sinT);
+		const __m256 ay = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_mul_ps(m_AlphaY, cosT));
+		const __m256 invLength = RSqrt(_mm256_add_ps(_mm256_mul_ps(ax, ax), _mm256_mul_ps(ay, ay)));
+		const __m256 cosPhi = _mm256_blendv_ps(_mm256_mul_ps(ax, invLength), cosT, isotropic);
+		const __m256 sinPhi = _mm256_blendv_ps(_mm256_mul_ps(ay, invLength), sinT, isotropic);
+
+		// alpha^2 = 1 / (cos^2 phi / ax^2 + sin^2 phi / ay^2), equals ax^2 for isotropic lanes
+		const __m256 cx = _mm256_div_ps(cosPhi, m_AlphaX);
+		const __m256 cy = _mm256_div_ps(sinPhi, m_AlphaY);
+		const __m256 alpha2 = Rcp(_mm256_add_ps(_mm256_mul_ps(cx, cx), _mm256_mul_ps(cy, cy)));
+
+		// tan^2 theta = alpha^2 U1 / (1 - U1), written as cos^2 theta = (1 - U1) / (1 - U1 + alpha^2 U1) and
+		// sin^2 theta = alpha^2 U1 / (1 - U1 + alpha^2 U1) so U1 = 1 gives a grazing normal instead of inf / inf
+		const __m256 cos2 = _mm256_sub_ps(one, U1);
+		const __m256 sin2 = _mm256_mul_ps(U1, alpha2);
+		const __m256 invLengthTheta = RSqrt(_mm256_add_ps(cos2, sin2));
+		const __m256 cosTheta = _mm256_mul_ps(_mm256_sqrt_ps(cos2), invLengthTheta);
+		const __m256 sinTheta = _mm256_mul_ps(_mm256_sqrt_ps(sin2), invLengthTheta);
+
+		// cos theta is positive, so the normal never needs to be flipped like in the scalar version
+		return {_mm256_mul_ps(sinTheta, cosPhi), _mm256_mul_ps(sinTheta, sinPhi), cosTheta};
+	}
+
+	// GGX normal distribution D(wm), without any trigonometry for unit vectors:
+	// 1 / (pi ax ay (x^2 / ax^2 + y^2 / ay^2 + z^2)^2)
+	inline __m256 D(const Direction8 &wm) const
+	{
+		const __m256 x = _mm256_div_ps(wm.x, m_AlphaX);
+		const __m256 y = _mm256_div_ps(wm.y, m_AlphaY);
+		const __m256 s = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)),
+									   _mm256_mul_ps(wm.z, wm.z));
+		const __m256 denominator = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(PI), _mm256_mul_ps(m_AlphaX, m_AlphaY)),
+												 _mm256_mul_ps(s, s));
+		return _mm256_div_ps(_mm256_set1_ps(1.0f), denominator);
+	}
+
+	// Density of SampleWm, D(wm) cos theta(wm)
+	inline __m256 Pdf(const Direction8 &wm) const { return _mm256_mul_ps(D(wm), Abs(wm.z)); }
+
+	// Smith's lambda, alpha^2 tan^2 theta = (x^2 ax^2 + y^2 ay^2) / z^2 for unit vectors. Uses
+	// (sqrt(1 + a) - 1) / 2 = a / (2 + 2 sqrt(1 + a)) to avoid cancellation for small a.
+	inline __m256 Lambda(const Direction8 &w) const
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 x = _mm256_mul_ps(w.x, m_AlphaX);
+		const __m256 y = _mm256_mul_ps(w.y, m_AlphaY);
+		const __m256 z2 = _mm256_mul_ps(w.z, w.z);
+		const __m256 a = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), z2);
+		const __m256 root = _mm256_sqrt_ps(_mm256_add_ps(one, a));
+		const __m256 lambda = _mm256_div_ps(a, _mm256_mul_ps(_mm256_set1_ps(2.0f), _mm256_add_ps(one, root)));
+
+		// grazing directions have an infinite tangent, the scalar version returns 0 for those
+		return _mm256_blendv_ps(lambda, zero, _mm256_cmp_ps(z2, zero, _CMP_EQ_OQ));
+	}
+
+	// Smith's masking function
+	inline __m256 G1(const Direction8 &w) const { return Rcp(_mm256_add_ps(_mm256_set1_ps(1.0f), Lambda(w))); }
+
+	// Smith's masking-shadowing function
+	inline __m256 G(const Direction8 &wo, const Direction8 &wi) const { return _mm256_mul_ps(G1(wo), G1(wi)); }
+
+	// Same as Microfacet::weight, |wi . wm| G(wo, wi) / |cos theta(wi) cos theta(wm)|
+	inline __m256 Weight(const Direction8 &wo, const Direction8 &wi, const Direction8 &wm) const
+	{
+		const __m256 iDotM = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(wi.x, wm.x), _mm256_mul_ps(wi.y, wm.y)),
+										   _mm256_mul_ps(wi.z, wm.z));
+		const __m256 cosines = _mm256_max_ps(_mm256_set1_ps(1.0e-8f), Abs(_mm256_mul_ps(wi.z, wm.z)));
+		return _mm256_div_ps(_mm256_mul_ps(Abs(iDotM), G(wo, wi)), cosines);
+	}
+
+	static inline __m256 Abs(const __m256 &v) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v); }
+
+	// rcp estimate refined with a Newton-Raphson step, ~23 bits
+	static inline __m256 Rcp(const __m256 &v)
+	{
+		const __m256 r = _mm256_rcp_ps(v);
+		return _mm256_sub_ps(_mm256_add_ps(r, r), _mm256_mul_ps(_mm256_mul_ps(v, r), r));
+	}
+
+	// rsqrt estimate refined with a Newton-Raphson step, ~23 bits
+	static inline __m256 RSqrt(const __m256 &v)
+	{
+		const __m256 r = _mm256_rsqrt_ps(v);
+		const __m256 vrr = _mm256_mul_ps(_mm256_mul_ps(v, r), r);
+		return _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), r), _mm256_sub_ps(_mm256_set1_ps(3.0f), vrr));
+	}
+
+	// sin(2 pi t) & cos(2 pi t), t is reduced to a quarter turn around the nearest multiple of 0.25 and the
+	// remaining angle (|x| <= pi / 4) goes through Taylor polynomials, error below 4e-7
+	static inline void SinCos2Pi(const __m256 &t, __m256 &s, __m256 &c)
+	{
+		const __m256 q = _mm256_round_ps(_mm256_mul_ps(t, _mm256_set1_ps(4.0f)), _MM_FROUND_TO_NEAREST_INT);
+		const __m256 x = _mm256_mul_ps(_mm256_sub_ps(t, _mm256_mul_ps(q, _mm256_set1_ps(0.25f))),
+									   _mm256_set1_ps(2.0f * PI));
+		const __m256 x2 = _mm256_mul_ps(x, x);
+
+		__m256 ps = _mm256_set1_ps(-1.0f / 5040.0f);
+		ps = _mm256_add_ps(_mm256_mul_ps(ps, x2), _mm256_set1_ps(1.0f / 120.0f));
+		ps = _mm256_add_ps(_mm256_mul_ps(ps, x2), _mm256_set1_ps(-1.0f / 6.0f));
+		ps = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(ps, x2), x), x);
+
+		__m256 pc = _mm256_set1_ps(1.0f / 40320.0f);
+		pc = _mm256_add_ps(_mm256_mul_ps(pc, x2), _mm256_set1_ps(-1.0f / 720.0f));
+		pc = _mm256_add_ps(_mm256_mul_ps(pc, x2), _mm256_set1_ps(1.0f / 24.0f));
+		pc = _mm256_add_ps(_mm256_mul_ps(pc, x2), _mm256_set1_ps(-0.5f));
+		pc = _mm256_add_ps(_mm256_mul_ps(pc, x2), _mm256_set1_ps(1.0f));
+
+		// quadrant 1 & 3 swap sin and cos, quadrant 2 & 3 negate sin, quadrant 1 & 2 negate cos
+		const __m256i quadrant = _mm256_cvtps_epi32(q);
+		const __m256i one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+		const __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, one), one));
+		const __m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, two), 30));
+		const __m256 cosSign =
+			_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, one), two), 30));
+
+		s = _mm256_xor_ps(_mm256_blendv_ps(ps, pc, swap), sinSign);
+		c = _mm256_xor_ps(_mm256_blendv_ps(pc, ps, swap), cosSign);
+	}
+
+  private:
+	__m256 m_AlphaX, m_AlphaY;
+};
+
+// Largest errors of Microfacet8 against the scalar Microfacet, and the number of batched results that were NaN or inf
+struct Microfacet8Error
+{
+	float sample, D, G, weight;
+	unsigned int nonFinite;
+};
+
+// Runs Microfacet8 and the scalar Microfacet on the edge cases (U1 of 0, 1 - ulp and 1, grazing and exactly tangent
+// directions, the smallest and largest alpha) followed by random directions and roughness values.
+Microfacet8Error MeasureMicrofacet8(RandomGenerator &rng, int iterations = 4096);
+
+// Returns false and prints the largest errors if a batched result is not finite or off by more than the tolerance
+bool ValidateMicrofacet8(RandomGenerator &rng, int iterations = 4096, float tolerance = 1e-3f);
@@ -0,0 +1,186 @@
+#include "Materials/MipTexture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "Materials/TextureCache.h"
+
+#define MIP_FILE_VERSION 1
+
+using namespace glm;
+
+namespace
+{
+// Start of a tiled texture file, followed by the levels and then the texels of all levels
+struct MipFileHeader
+{
+	char magic[4];
+	unsigned int version;
+	unsigned int levels;
+	unsigned int tileSize;
+};
+
+inline unsigned int PackColor(const vec4 &color)
+{
+	const auto r = (unsigned int)(clamp(color.r, 0.0f, 1.0f) * 255.0f + 0.5f);
+	const auto g = (unsigned int)(clamp(color.g, 0.0f, 1.0f) * 255.0f + 0.5f);
+	const auto b = (unsigned int)(clamp(color.b, 0.0f, 1.0f) * 255.0f + 0.5f);
+	const auto a = (unsigned int)(clamp(color.a, 0.0f, 1.0f) * 255.0f + 0.5f);
+	return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+inline vec3 UnpackColor(unsigned int color)
+{
+	return vec3(float(color & 0xFF), float((color >> 8) & 0xFF), float((color >> 16) & 0xFF)) * (1.0f / 255.0f);
+}
+
+// interleaves the bits of x and y within a tile
+inline unsigned int Morton(unsigned int x, unsigned int y)
+{
+	return (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2) | ((x & 4) << 2) | ((y & 4) << 3);
+}
+} // namespace
+
+MipTexture::MipTexture(core::Surface *surface)
+{
+	int width = std::max(surface->GetWidth(), 1);
+	int height = std::max(surface->GetHeight(), 1);
+
+	// keep the previous level in full precision so rounding does not accumulate down the pyramid
+	std::vector<vec4> texels(width * height, vec4(0.0f));
+	if (surface->GetWidth() > 0 && surface->GetHeight() > 0)
+		std::copy(surface->GetTextureBuffer(), surface->GetTextureBuffer() + width * height, texels.begin());
+
+	unsigned int offset = 0;
+	while (true)
+	{
+		MipLevel level{};
+		level.width = width;
+		level.height = height;
+		level.tilesX = (width + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+		level.offset = offset;
+		const int tilesY = (height + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+		offset += level.tilesX * tilesY * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE;
+
+		m_Texels.resize(offset, 0);
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+				m_Texels[TexelIndex(level, x, y)] = PackColor(texels[x + y * width]);
+		}
+		m_Levels.push_back(level);
+
+		if (width == 1 && height == 1)
+			break;
+
+		// 2x2 box filter, the last row or column of odd sized levels is folded into its neighbours
+		const int nextWidth = std::max(width / 2, 1);
+		const int nextHeight = std::max(height / 2, 1);
+		std::vector<vec4> next(nextWidth * nextHeight);
+		for (int y = 0; y < nextHeight; y++)
+		{
+			const int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+			for (int x = 0; x < nextWidth; x++)
+			{
+				const int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+				next[x + y * nextWidth] = 0.25f * (texels[x0 + y0 * width] + texels[x1 + y0 * width] +
+												   texels[x0 + y1 * width] + texels[x1 + y1 * width]);
+			}
+		}
+
+		texels.swap(next);
+		width = nextWidth;
+		height = nextHeight;
+	}
+
+	m_LodOffset = 0.5f * log2f(float(GetWidth()) * float(GetHeight()));
+}
+
+MipTexture::MipTexture(TextureCache *cache, const std::string &file) : m_Cache(cache)
+{
+	m_CacheId = cache->AddTexture(file, m_Levels);
+	m_LodOffset = 0.5f * log2f(float(GetWidth()) * float(GetHeight()));
+}
+
+std::vector<unsigned int> MipTexture::ReadTexels() const
+{
+	if (m_Cache != nullptr)
+		return m_Cache->ReadTexels(m_CacheId);
+	return m_Texels;
+}
+
+bool MipTexture::Write(const std::string &file) const
+{
+	// paged textures already live in a file
+	if (m_Cache != nullptr)
+		return false;
+
+	std::ofstream stream(file, std::ios::binary);
+	if (!stream.is_open())
+		return false;
+
+	MipFileHeader header{};
+	memcpy(header.magic, "TMIP", 4);
+	header.version = MIP_FILE_VERSION;
+	header.levels = static_cast<unsigned int>(m_Levels.size());
+	header.tileSize = TEXTURE_TILE_SIZE;
+
+	stream.write(reinterpret_cast<const char *>(&header), sizeof(MipFileHeader));
+	stream.write(reinterpret_cast<const char *>(m_Levels.data()), m_Levels.size() * sizeof(MipLevel));
+	stream.write(reinterpret_cast<const char *>(m_Texels.data()), m_Texels.size() * sizeof(unsigned int));
+	return bool(stream);
+}
+
+bool MipTexture::ReadHeader(std::istream &stream, std::vector<MipLevel> &levels)
+{
+	MipFileHeader header{};
+	stream.read(reinterpret_cast<char *>(&header), sizeof(MipFileHeader));
+	if (!stream || memcmp(header.magic, "TMIP", 4) != 0 || header.version != MIP_FILE_VERSION ||
+		header.tileSize != TEXTURE_TILE_SIZE || header.levels == 0 || header.levels > 32)
+		return false;
+
+	levels.resize(header.levels);
+	stream.read(reinterpret_cast<char *>(levels.data()), levels.size() * sizeof(MipLevel));
+	return bool(stream);
+}
+
+unsigned int MipTexture::TexelIndex(const MipLevel &level, int x, int y)
+{
+	const int tile = (x / TEXTURE_TILE_SIZE) + (y / TEXTURE_TILE_SIZE) * level.tilesX;
+	return level.offset + tile * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE +
+		   Morton(x % TEXTURE_TILE_SIZE, y % TEXTURE_TILE_SIZE);
+}
+
+vec3 MipTexture::Fetch(int x, int y, int level) const
+{
+	const MipLevel &l = m_Levels[level];
+	const unsigned int idx = TexelIndex(l, clamp(x, 0, l.width - 1), clamp(y, 0, l.height - 1));
+	return UnpackColor(m_Cache != nullptr ? m_Cache->GetTexel(m_CacheId, idx) : m_Texels[idx]);
+}
+
+vec3 MipTexture::Bilinear(const vec2 &uv, int level) const
+{
+	const MipLevel &l = m_Levels[level];
+	const float s = clamp(uv.x, 0.0f, 1.0f) * float(l.width) - 0.5f;
+	const float t = clamp(uv.y, 0.0f, 1.0f) * float(l.height) - 0.5f;
+	const float fs = floorf(s), ft = floorf(t);
+	const int x = int(fs), y = int(ft);
+	const float wx = s - fs, wy = t - ft;
+
+	return mix(mix(Fetch(x, y, level), Fetch(x + 1, y, level), wx),
+			   mix(Fetch(x, y + 1, level), Fetch(x + 1, y + 1, level), wx), wy);
+}
+
+vec3 MipTexture::Sample(const vec2 &uv, float lod) const
+{
+	const float maxLevel = float(m_Levels.size() - 1);
+	lod = clamp(lod, 0.0f, maxLevel);
+	const float level = floorf(lod);
+	const float f = lod - level;
+	if (f <= 0.0f)
+		return Bilinear(uv, int(level));
+
+	return mix(Bilinear(uv, int(level)), Bilinear(uv, int(level) + 1), f);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Core/Surface.h"
+
+// Texels per tile side, a tile of 8x8 RGBA8 texels is 256 bytes so a bilinear footprint mostly stays within
+// 4 cache lines. Needs to match TILE_SIZE in programs/material.cl.
+#define TEXTURE_TILE_SIZE 8
+
+struct MipLevel
+{
+	int width, height;
+	int tilesX;			 // tiles per row, rows are padded to whole tiles
+	unsigned int offset; // first texel of the level in the texel buffer
+};
+
+class TextureCache;
+
+// Mip pyramid of RGBA8 texels. Every level is split into tiles stored one after another, texels within a tile
+// are in Morton order, so texels that are close in (u, v) are also close in memory.
+// Textures are either resident or paged in tile by tile from a file written by Write through a TextureCache.
+class MipTexture
+{
+  public:
+	explicit MipTexture(core::Surface *surface);
+
+	MipTexture(TextureCache *cache, const std::string &file);
+
+	// Trilinear lookup, lod is the fractional mip level
+	glm::vec3 Sample(const glm::vec2 &uv, float lod) const;
+
+	// Mip level for a ray cone, uvLod is the level of the hit if the texture were a single texel:
+	// 0.5 * log2(uv area / world area) + log2(cone width / |cos theta|)
+	inline float GetLod(float uvLod) const { return uvLod + m_LodOffset; }
+
+	glm::vec3 Fetch(int x, int y, int level) const;
+
+	inline int GetWidth() const { return m_Levels[0].width; }
+
+	inline int GetHeight() const { return m_Levels[0].height; }
+
+	inline int GetLevelCount() const { return int(m_Levels.size()); }
+
+	inline const std::vector<MipLevel> &GetLevels() const { return m_Levels; }
+
+	inline bool IsResident() const { return m_Cache == nullptr; }
+
+	// Texels of all levels packed as 0xAABBGGRR, the layout the kernels expect. Paged textures are read from disk.
+	std::vector<unsigned int> ReadTexels() const;
+
+	// Stores a resident pyramid as a tiled texture file, returns false if the file could not be written
+	bool Write(const std::string &file) const;
+
+	static bool ReadHeader(std::istream &stream, std::vector<MipLevel> &levels);
+
+	static unsigned int TexelIndex(const MipLevel &level, int x, int y);
+
+  private:
+	glm::vec3 Bilinear(const glm::vec2 &uv, int level) const;
+
+	std::vector<MipLevel> m_Levels;
+	std::vector<unsigned int> m_Texels;
+	float m_LodOffset;
+
+	TextureCache *m_Cache = nullptr;
+	unsigned int m_CacheId = 0;
+};
@@ -0,0 +1,151 @@
+#include "Materials/TextureCache.h"
+
+#include <algorithm>
+
+#include "Utils/Messages.h"
+
+#define RECENT_TILES 4 // tiles every thread keeps a copy of, tiles never change so a copy can not go stale
+
+namespace
+{
+constexpr unsigned int TILE_TEXELS = TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE;
+
+std::atomic<unsigned int> cacheGeneration{0};
+
+inline uint64_t TileKey(unsigned int texture, unsigned int tile) { return (uint64_t(texture) << 32) | tile; }
+
+struct RecentTile
+{
+	unsigned int generation = ~0u;
+	uint64_t key = ~uint64_t(0);
+	unsigned int texels[TILE_TEXELS];
+};
+} // namespace
+
+TextureCache::TextureCache(size_t budget) : m_Budget(budget), m_Generation(cacheGeneration++)
+{
+	// the shards split the budget, the remainder goes to the first ones so all of them together never exceed it
+	const size_t tiles = budget / (TILE_TEXELS * sizeof(unsigned int));
+	for (size_t i = 0; i < TEXTURE_CACHE_SHARDS; i++)
+		m_Shards[i].capacity = tiles / TEXTURE_CACHE_SHARDS + (i < tiles % TEXTURE_CACHE_SHARDS ? 1 : 0);
+}
+
+unsigned int TextureCache::AddTexture(const std::string &file, std::vector<MipLevel> &levels)
+{
+	std::ifstream stream(file, std::ios::binary);
+	if (!stream.is_open() || !MipTexture::ReadHeader(stream, levels))
+		utils::FatalError(__FILE__, __LINE__, ("Could not read tiled texture " + file).c_str(), "TextureCache");
+
+	const MipLevel &last = levels.back();
+	m_Files.push_back({file, stream.tellg(), last.offset + TILE_TEXELS});
+	return static_cast<unsigned int>(m_Files.size() - 1);
+}
+
+unsigned int TextureCache::GetTexel(unsigned int texture, unsigned int texel)
+{
+	thread_local RecentTile recent[RECENT_TILES];
+	thread_local unsigned int nextRecent = 0;
+
+	const uint64_t key = TileKey(texture, texel / TILE_TEXELS);
+	for (const RecentTile &r : recent)
+	{
+		if (r.key == key && r.generation == m_Generation)
+			return r.texels[texel % TILE_TEXELS];
+	}
+
+	RecentTile &r = recent[nextRecent];
+	nextRecent = (nextRecent + 1) % RECENT_TILES;
+
+	Shard &shard = m_Shards[(key ^ (key >> 32) ^ (key >> 7)) % TEXTURE_CACHE_SHARDS];
+	if (shard.capacity == 0)
+	{
+		// the budget does not cover this shard, the tile only lives in the copy of this thread
+		m_Misses++;
+		LoadTile(texture, texel / TILE_TEXELS, r.texels);
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(shard.lock);
+		auto it = shard.lookup.find(key);
+		if (it != shard.lookup.end())
+		{
+			m_Hits++;
+			shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+		}
+		else
+		{
+			m_Misses++;
+			if (shard.entries.size() < shard.capacity)
+			{
+				shard.entries.emplace_front();
+			}
+			else
+			{
+				// reuse the storage of the least recently used tile
+				shard.lookup.erase(shard.entries.back().key);
+				shard.entries.splice(shard.entries.begin(), shard.entries, std::prev(shard.entries.end()));
+			}
+
+			Entry &entry = shard.entries.front();
+			entry.key = key;
+			LoadTile(texture, texel / TILE_TEXELS, entry.texels.data());
+			shard.lookup[key] = shard.entries.begin();
+		}
+
+		std::copy(shard.entries.front().texels.begin(), shard.entries.front().texels.end(), r.texels);
+	}
+
+	r.key = key;
+	r.generation = m_Generation;
+	return r.texels[texel % TILE_TEXELS];
+}
+
+std::shared_ptr<TextureCache::Handle> TextureCache::OpenFile(unsigned int texture)
+{
+	std::lock_guard<std::mutex> lock(m_HandleLock);
+	for (auto it = m_Handles.begin(); it != m_Handles.end(); ++it)
+	{
+		if ((*it)->texture == texture)
+		{
+			m_Handles.splice(m_Handles.begin(), m_Handles, it);
+			return m_Handles.front();
+		}
+	}
+
+	// a read still using the closed handle keeps it alive until it is done
+	if (m_Handles.size() >= TEXTURE_CACHE_FILES)
+		m_Handles.pop_back();
+
+	auto handle = std::make_shared<Handle>();
+	handle->texture = texture;
+	handle->stream.open(m_Files[texture].path, std::ios::binary);
+	m_Handles.push_front(handle);
+	return handle;
+}
+
+void TextureCache::LoadTile(unsigned int texture, unsigned int tileIdx, unsigned int *texels)
+{
+	const File &file = m_Files[texture];
+	const std::shared_ptr<Handle> handle = OpenFile(texture);
+
+	std::lock_guard<std::mutex> lock(handle->lock);
+	handle->stream.seekg(file.dataOffset + std::streamoff(tileIdx) * std::streamoff(sizeof(Tile)));
+	handle->stream.read(reinterpret_cast<char *>(texels), sizeof(Tile));
+	if (!handle->stream)
+	{
+		// a truncated or removed file shows up black instead of taking the renderer down
+		handle->stream.clear();
+		std::fill(texels, texels + TILE_TEXELS, 0u);
+	}
+}
+
+std::vector<unsigned int> TextureCache::ReadTexels(unsigned int texture)
+{
+	const File &file = m_Files[texture];
+	std::vector<unsigned int> texels(file.texelCount, 0);
+
+	std::ifstream stream(file.path, std::ios::binary);
+	stream.seekg(file.dataOffset);
+	stream.read(reinterpret_cast<char *>(texels.data()), texels.size() * sizeof(unsigned int));
+	return texels;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Materials/MipTexture.h"
+
+#define TEXTURE_CACHE_SHARDS 16 // independent LRU lists, threads only contend for tiles that hash to the same shard
+#define TEXTURE_CACHE_FILES 32 // open file handles, thousands of textures stay below the descriptor limit
+
+// Keeps tiles of MipTexture files (see MipTexture::Write) within a fixed memory budget. Tiles are read from disk on
+// their first access and the least recently used tile of a shard is evicted once the shard is full. Only the most
+// recently read files are kept open. Lookups are thread safe, every thread also keeps a copy of the last few tiles it
+// touched so most bilinear footprints do not need to lock at all.
+class TextureCache
+{
+  public:
+	explicit TextureCache(size_t budget);
+
+	// Registers a tiled file, returns the id used for lookups. The levels are read from the header.
+	// Not safe to call while other threads are doing lookups.
+	unsigned int AddTexture(const std::string &file, std::vector<MipLevel> &levels);
+
+	// Texel index as returned by MipTexture::TexelIndex, packed as 0xAABBGGRR
+	unsigned int GetTexel(unsigned int texture, unsigned int texel);
+
+	// Reads all texels of a texture, bypasses the cache
+	std::vector<unsigned int> ReadTexels(unsigned int texture);
+
+	inline size_t GetBudget() const { return m_Budget; }
+
+	inline uint64_t GetHits() const { return m_Hits; }
+
+	inline uint64_t GetMisses() const { return m_Misses; }
+
+  private:
+	typedef std::array<unsigned int, TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE> Tile;
+
+	struct Entry
+	{
+		uint64_t key;
+		Tile texels;
+	};
+
+	struct Shard
+	{
+		std::mutex lock;
+		size_t capacity; // in tiles, 0 when the budget is smaller than one tile per shard
+		std::list<Entry> entries; // most recently used first
+		std::unordered_map<uint64_t, std::list<Entry>::iterator> lookup;
+	};
+
+	struct File
+	{
+		std::string path;
+		std::streamoff dataOffset;
+		unsigned int texelCount;
+	};
+
+	// An open file, stays alive while a read is using it even if it was closed in the meantime
+	struct Handle
+	{
+		unsigned int texture;
+		std::mutex lock;
+		std::ifstream stream;
+	};
+
+	// Returns the open handle of a texture, opening it and closing the least recently used one if needed
+	std::shared_ptr<Handle> OpenFile(unsigned int texture);
+
+	void LoadTile(unsigned int texture, unsigned int tileIdx, unsigned int *texels);
+
+	size_t m_Budget;
+	unsigned int m_Generation; // tells the per thread tiles of different caches apart
+	Shard m_Shards[TEXTURE_CACHE_SHARDS];
+	std::vector<File> m_Files;
+
+	std::mutex m_HandleLock;
+	std::list<std::shared_ptr<Handle>> m_Handles; // most recently used first, at most TEXTURE_CACHE_FILES
+
+	std::atomic<uint64_t> m_Hits{0}, m_Misses{0};
+};
@@ -5,7 +5,8 @@ namespace prims
 void GpuTriangleList::AddTriangle(GpuTriangle triangle)
 {
 	const auto idx = static_cast<unsigned int>(m_Triangles.size());
-	triangle.objIdx = idx;
+	triangle.lightIdx = -1;
+	triangle.uvAreaRatio = triangle.CalcUVAreaRatio(m_Attributes);
 	m_Triangles.push_back(triangle);
 	m_Aabbs.push_back(triangle.GetBounds());
 	m_PrimIndices.push_back(idx);
@@ -14,51 +15,52 @@ void GpuTriangleList::AddTriangle(GpuTriangle triangle)
 void GpuTriangleList::AddLight(GpuTriangle triangle)
 {
 	const auto idx = static_cast<unsigned int>(m_Triangles.size());
-	triangle.objIdx = idx;
+	triangle.lightIdx = static_cast<int>(m_LightIndices.size());
+	triangle.uvAreaRatio = triangle.CalcUVAreaRatio(m_Attributes);
 	m_Triangles.push_back(triangle);
 	m_LightIndices.push_back(idx);
 	m_Aabbs.push_back(triangle.GetBounds());
 	m_PrimIndices.push_back(idx);
 }
 
+void GpuTriangleList::UpdateTriangle(uint idx, GpuTriangle triangle)
+{
+	triangle.lightIdx = m_Triangles[idx].lightIdx;
+	triangle.m_Area = triangle.CalcArea();
+	triangle.uvAreaRatio = triangle.CalcUVAreaRatio(m_Attributes);
+	m_Triangles[idx] = triangle;
+	m_Aabbs[idx] = triangle.GetBounds();
+	m_Revision++;
+}
+
 void GpuTriangleList::TraceRay(core::Ray &r) const {}
 
 const std::vector<SceneObject *> &GpuTriangleList::GetLights() const { throw "This should never be called"; }
 
 void GpuTriangleList::ConstructBVH() {}
 
+std::vector<GpuTriangleIsect> GpuTriangleList::GetIsectTriangles(const std::vector<unsigned int> &primIndices) const
+{
+	// store triangles in the order of the given indices so BVH leaves can index them directly
+	std::vector<GpuTriangleIsect> isects(primIndices.size());
+	for (size_t i = 0; i < primIndices.size(); i++)
+	{
+		const uint primIdx = primIndices[i];
+		isects[i] = GpuTriangleIsect(m_Triangles[primIdx], primIdx);
+	}
+
+	return isects;
+}
+
 unsigned int GpuTriangleList::GetPrimitiveCount() { return static_cast<unsigned int>(m_PrimIndices.size()); }
 
 bool GpuTriangleList::TraceShadowRay(core::Ray &r, float tMax) const { return true; }
 
 unsigned int GpuTriangleList::TraceDebug(core::Ray &r) const { return 0; }
 
-GpuTriangle::GpuTriangle(vec3 p0, vec3 p1, vec3 p2, uint matIndex) : p0(p0), p1(p1), p2(p2), matIdx(matIndex)
-{
-	this->normal = normalize(cross(p1 - p0, p2 - p0));
-	this->n0 = this->n1 = this->n2 = normal;
-	m_Area = CalcArea();
-}
-
-GpuTriangle::GpuTriangle(vec3 p0, vec3 p1, vec3 p2, uint matIndex, vec2 t0, vec2 t1, vec2 t2)
-	: p0(p0), p1(p1), p2(p2), matIdx(matIndex), t0(t0), t1(t1), t2(t2)
-{
-	this->normal = normalize(cross(p1 - p0, p2 - p0));
-	this->n0 = this->n1 = this->n2 = normal;
-	m_Area = CalcArea();
-}
-
-GpuTriangle::GpuTriangle(vec3 p0, vec3 p1, vec3 p2, vec3 n0, vec3 n1, vec3 n2, uint matIndex)
-	: p0(p0), p1(p1), p2(p2), n0(n0), n1(n1), n2(n2), matIdx(matIndex)
-{
-	this->normal = normalize(cross(p1 - p0, p2 - p0));
-	m_Area = CalcArea();
-}
-
-GpuTriangle::GpuTriangle(vec3 p0, vec3 p1, vec3 p2, vec3 n0, vec3 n1, vec3 n2, uint matIndex, vec2 t0, vec2 t1, vec2 t2)
-	: p0(p0), p1(p1), p2(p2), n0(n0), n1(n1), n2(n2), matIdx(matIndex), t0(t0), t1(t1), t2(t2)
+GpuTriangle::GpuTriangle(vec3 p0, vec3 p1, vec3 p2, uint v0, uint v1, uint v2, uint matIndex)
+	: p0(p0), v0(v0), p1(p1), v1(v1), p2(p2), v2(v2), matIdx(matIndex), lightIdx(-1), uvAreaRatio(0.0f)
 {
-	this->normal = normalize(cross(p1 - p0, p2 - p0));
 	m_Area = CalcArea();
 }
 
@@ -76,6 +78,12 @@ bvh::AABB GpuTriangle::GetBounds() const
 	return {vec3(minX, minY, minZ) - EPSILON, vec3(maxX, maxY, maxZ) + EPSILON};
 }
 
+GpuTriangleIsect::GpuTriangleIsect(const GpuTriangle &triangle, uint primIdx)
+	: p0(triangle.p0), primIdx(primIdx), edge1(triangle.p1 - triangle.p0), dummy0(0.f), edge2(triangle.p2 - triangle.p0),
+	  dummy1(0.f)
+{
+}
+
 float GpuTriangle::CalcArea() const
 {
 	// Heron's formula
@@ -85,4 +93,12 @@ float GpuTriangle::CalcArea() const
 	const float s = (a + b + c) / 2.f;
 	return sqrtf(s * (s - a) * (s - b) * (s - c));
 }
+
+float GpuTriangle::CalcUVAreaRatio(const MeshAttributes &attributes) const
+{
+	const vec2 t0 = attributes.GetTexCoords(v0);
+	const vec2 e1 = attributes.GetTexCoords(v1) - t0, e2 = attributes.GetTexCoords(v2) - t0;
+	const float uvArea = 0.5f * glm::abs(e1.x * e2.y - e1.y * e2.x);
+	return m_Area > 0.0f ? uvArea / m_Area : 0.0f;
+}
 } // namespace prims
\ No newline at end of file
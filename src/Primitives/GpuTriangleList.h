@@ -4,6 +4,7 @@
 
 #include "Core/Surface.h"
 #include "Materials/Material.h"
+#include "Primitives/MeshAttributes.h"
 #include "Primitives/SceneObjectList.h"
 
 namespace bvh
@@ -15,52 +16,52 @@ using namespace glm;
 
 namespace prims
 {
+// Positions stay in the triangle for the BVH builds and light sampling, normals and texture coordinates are indexed
+// from the MeshAttributes of the list. Mirrored by Triangle in programs/triangle.cl.
 struct GpuTriangle
 {
-	vec3 p0;	  // 12
-	float dummy0; // 16
-
-	vec3 p1;	  // 28
-	float dummy1; // 32
-
-	vec3 p2;
-	float dummy2; // 48
+	vec3 p0; // 12
+	uint v0; // 16, vertex of p0 in the attributes
 
-	vec3 n0;
-	float dummy3; // 64
+	vec3 p1; // 28
+	uint v1; // 32
 
-	vec3 n1;
-	float dummy4; // 80
+	vec3 p2; // 44
+	uint v2; // 48
 
-	vec3 n2;
-	float dummy5; // 96
+	uint matIdx;	   // 52
+	float m_Area;	   // 56
+	int lightIdx;	   // 60, index into the light indices or -1
+	float uvAreaRatio; // 64, texture space area divided by world space area for texture lod
 
-	vec3 normal;
-	float dum; // 112
+	GpuTriangle() = default;
 
-	uint matIdx;  // 116
-	uint objIdx;  // 120
-	float m_Area; // 124
-	float dummy;  // 128
+	GpuTriangle(vec3 p0, vec3 p1, vec3 p2, uint v0, uint v1, uint v2, uint matIndex);
 
-	vec2 t0, t1, t2;  // 152
-	float d156, d160; // 160
+	vec3 GetCentroid() const;
 
-	GpuTriangle() = default;
+	bvh::AABB GetBounds() const;
 
-	GpuTriangle(vec3 p0, vec3 p1, vec3 p2, uint matIndex);
+	float CalcArea() const;
 
-	GpuTriangle(vec3 p0, vec3 p1, vec3 p2, uint matIndex, vec2 t0, vec2 t1, vec2 t2);
+	float CalcUVAreaRatio(const MeshAttributes &attributes) const;
+};
 
-	GpuTriangle(vec3 p0, vec3 p1, vec3 p2, vec3 n0, vec3 n1, vec3 n2, uint matIndex);
+// Intersection-only representation of a GpuTriangle, the full triangle is only fetched for the closest hit
+struct GpuTriangleIsect
+{
+	vec3 p0;	  // 12
+	uint primIdx; // 16
 
-	GpuTriangle(vec3 p0, vec3 p1, vec3 p2, vec3 n0, vec3 n1, vec3 n2, uint matIndex, vec2 t0, vec2 t1, vec2 t2);
+	vec3 edge1;	  // 28
+	float dummy0; // 32
 
-	vec3 GetCentroid() const;
+	vec3 edge2;	  // 44
+	float dummy1; // 48
 
-	bvh::AABB GetBounds() const;
+	GpuTriangleIsect() = default;
 
-	float CalcArea() const;
+	GpuTriangleIsect(const GpuTriangle &triangle, uint primIdx);
 };
 
 class GpuTriangleList : public WorldScene
@@ -79,10 +80,20 @@ class GpuTriangleList : public WorldScene
 	inline const std::vector<bvh::AABB> &GetAABBs() const { return m_Aabbs; }
 	inline std::vector<uint> &GetLightIndices() { return m_LightIndices; }
 
-	inline GpuTriangle &GetTriangle(uint idx) { return m_Triangles[idx]; }
+	inline const GpuTriangle &GetTriangle(uint idx) const { return m_Triangles[idx]; }
+
+	// Replaces a triangle, keeping its light index. Bumps the revision so tracers rebuild their BVH on the next reset.
+	void UpdateTriangle(uint idx, GpuTriangle triangle);
+	inline unsigned int GetRevision() const { return m_Revision; }
+
+	// every triangle indexes its vertices here, flat ones use the face normal for all three
+	inline MeshAttributes &GetAttributes() { return m_Attributes; }
+	inline const MeshAttributes &GetAttributes() const { return m_Attributes; }
 
 	std::vector<unsigned int> GetPrimitiveIndices() { return m_PrimIndices; }
 
+	std::vector<GpuTriangleIsect> GetIsectTriangles(const std::vector<unsigned int> &primIndices) const;
+
 	unsigned int GetPrimitiveCount() override;
 
 	inline bvh::AABB GetNodeBounds(unsigned int index) override { return m_Triangles[index].GetBounds(); }
@@ -98,6 +109,8 @@ class GpuTriangleList : public WorldScene
 	std::vector<bvh::AABB> m_Aabbs{};
 	std::vector<uint> m_LightIndices{};
 	std::vector<unsigned int> m_PrimIndices{};
+	MeshAttributes m_Attributes;
+	unsigned int m_Revision = 0;
 
 	const std::vector<SceneObject *> &GetLights() const override;
 
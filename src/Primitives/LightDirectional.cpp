@@ -78,7 +78,7 @@ void LightDirectional::Intersect(core::Ray &r) const
 
 bvh::AABB LightDirectional::GetBounds() const { return bvh::AABB(vec3(0.f), vec3(0.f)); }
 
-vec3 LightDirectional::GetRandomPointOnSurface(const vec3 &direction, vec3 &lNormal, RandomGenerator &rng) const
+vec3 LightDirectional::GetRandomPointOnSurface(const vec3 &direction, vec3 &lNormal, float r1, float r2) const
 {
 	vec3 other;
 	if (direction.z == 0 && direction.y == 0)
@@ -93,7 +93,7 @@ vec3 LightDirectional::GetRandomPointOnSurface(const vec3 &direction, vec3 &lNor
 	const glm::vec3 up = normalize(cross(direction, right));
 
 	lNormal = this->Direction;
-	return this->Direction * -1e33f + (rng.Rand(2.f) - 1.f) * 1e33f * up + (rng.Rand(2.f) - 1.f) * 1e33f * right;
+	return this->Direction * -1e33f + (r1 * 2.f - 1.f) * 1e33f * up + (r2 * 2.f - 1.f) * 1e33f * right;
 }
 
 glm::vec3 LightDirectional::GetNormal(const glm::vec3 &hitPoint) const { return Direction; }
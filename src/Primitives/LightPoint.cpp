@@ -102,9 +102,9 @@ bvh::AABB LightPoint::GetBounds() const
 	return {vec3(centroid - radius) - EPSILON, vec3(centroid + radius) + EPSILON};
 }
 
-vec3 LightPoint::GetRandomPointOnSurface(const vec3 &direction, vec3 &lNormal, RandomGenerator &rng) const
+vec3 LightPoint::GetRandomPointOnSurface(const vec3 &direction, vec3 &lNormal, float r1, float r2) const
 {
-	const vec3 pointOnLight = centroid + rng.RandomPointOnHemisphere(normalize(direction));
+	const vec3 pointOnLight = centroid + RandomGenerator::PointOnHemisphere(normalize(direction), r1, r2);
 	lNormal = normalize(pointOnLight - centroid);
 	return centroid + lNormal * sqrtf(this->m_RadiusSquared);
 }
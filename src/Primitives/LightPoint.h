@@ -23,7 +23,7 @@ class LightPoint : public SceneObject
 
 	bvh::AABB GetBounds() const override;
 	glm::vec3 GetRandomPointOnSurface(const glm::vec3 &direction, glm::vec3 &lNormal,
-									  RandomGenerator &rng) const override;
+									  float r1, float r2) const override;
 	glm::vec3 GetNormal(const glm::vec3 &hitPoint) const override;
 	glm::vec2 GetTexCoords(const glm::vec3 &hitPoint) const override;
 };
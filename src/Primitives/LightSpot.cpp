@@ -127,9 +127,9 @@ bvh::AABB LightSpot::GetBounds() const
 	return bvh::AABB(vec3(centroid - radius) - EPSILON, vec3(centroid + radius) + EPSILON);
 }
 
-vec3 LightSpot::GetRandomPointOnSurface(const vec3 &direction, vec3 &lNormal, RandomGenerator &rng) const
+vec3 LightSpot::GetRandomPointOnSurface(const vec3 &direction, vec3 &lNormal, float r1, float r2) const
 {
-	const vec3 point = rng.RandomPointOnHemisphere(direction);
+	const vec3 point = RandomGenerator::PointOnHemisphere(direction, r1, r2);
 	lNormal = point;
 	return centroid + point * sqrtf(this->m_RadiusSquared);
 }
@@ -0,0 +1,68 @@
+#include "Primitives/MeshAttributes.h"
+
+#include <glm/gtc/packing.hpp>
+
+namespace prims
+{
+uint EncodeNormal(const vec3 &normal)
+{
+	const float l1 = glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z);
+	if (!(l1 > 0.0f))
+		return glm::packSnorm2x16(vec2(0.0f)); // degenerate triangles, decodes to +z
+
+	// project onto the octahedron, the lower half is folded over the diagonals onto the outer triangles
+	vec2 p = vec2(normal.x, normal.y) / l1;
+	if (normal.z < 0.0f)
+	{
+		const vec2 signs = vec2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+		p = (1.0f - glm::abs(vec2(p.y, p.x))) * signs;
+	}
+
+	return glm::packSnorm2x16(p);
+}
+
+vec3 DecodeNormal(uint packed)
+{
+	const vec2 p = glm::unpackSnorm2x16(packed);
+	vec3 n = vec3(p.x, p.y, 1.0f - glm::abs(p.x) - glm::abs(p.y));
+
+	// unfolds the lower half
+	const float t = glm::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return normalize(n);
+}
+
+uint EncodeTexCoords(const vec2 &texCoords) { return glm::packUnorm2x16(texCoords); }
+
+vec2 DecodeTexCoords(uint packed) { return glm::unpackUnorm2x16(packed); }
+
+uint MeshAttributes::AddVertex(const vec3 &normal, const vec2 &texCoords)
+{
+	return AddVertex({EncodeNormal(normal), EncodeTexCoords(texCoords)});
+}
+
+uint MeshAttributes::AddVertex(const PackedVertex &vertex)
+{
+	m_Vertices.push_back(vertex);
+	return static_cast<uint>(m_Vertices.size() - 1);
+}
+
+uint MeshAttributes::Append(const MeshAttributes &other)
+{
+	const auto offset = static_cast<uint>(m_Vertices.size());
+	m_Vertices.insert(m_Vertices.end(), other.m_Vertices.begin(), other.m_Vertices.end());
+	return offset;
+}
+
+uint VertexDeduplicator::AddVertex(const vec3 &normal, const vec2 &texCoords)
+{
+	const PackedVertex vertex = {EncodeNormal(normal), EncodeTexCoords(texCoords)};
+	const uint64_t key = (uint64_t(vertex.normal) << 32u) | uint64_t(vertex.texCoords);
+
+	const auto result = m_Lookup.emplace(key, static_cast<uint>(m_Attributes.GetVertexCount()));
+	if (result.second)
+		m_Attributes.AddVertex(vertex);
+	return result.first->second;
+}
+} // namespace prims
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+namespace prims
+{
+// Shading attributes of one vertex in 8 bytes, mirrored by PackedVertex in programs/triangle.cl
+struct PackedVertex
+{
+	uint normal;	// octahedral unit vector, two 16 bit snorms with x in the low half
+	uint texCoords; // two 16 bit unorms with u in the low half
+};
+
+// Octahedral normal encoding (Cigolle et al., A Survey of Efficient Representations for Independent Unit Vectors,
+// JCGT 2014). The error stays below 0.05 degrees everywhere on the sphere.
+uint EncodeNormal(const vec3 &normal);
+vec3 DecodeNormal(uint packed);
+
+// Texture lookups clamp to [0, 1], so 16 bit unorms cover every coordinate that matters with a 1 / 65535 step,
+// 1/32 of a texel at 2048 texels, where half floats just below 1 step a whole texel
+uint EncodeTexCoords(const vec2 &texCoords);
+vec2 DecodeTexCoords(uint packed);
+
+// closest hit, loaders store vertices with the same attributes once and share them between the triangles of a model.
+// closest hit, vertices with the same attributes are stored once and shared by every triangle using them.
+class MeshAttributes
+{
+  public:
+	MeshAttributes() = default;
+
+	// Returns the index of the new vertex, loaders share vertices through a VertexDeduplicator
+	uint AddVertex(const vec3 &normal, const vec2 &texCoords);
+	uint AddVertex(const PackedVertex &vertex);
+
+	// Appends the vertices of other, returns the index its first vertex has in this store
+	uint Append(const MeshAttributes &other);
+
+	inline vec3 GetNormal(uint vertex) const { return DecodeNormal(m_Vertices[vertex].normal); }
+	inline vec2 GetTexCoords(uint vertex) const { return DecodeTexCoords(m_Vertices[vertex].texCoords); }
+
+	inline const std::vector<PackedVertex> &GetVertices() const { return m_Vertices; }
+	inline size_t GetVertexCount() const { return m_Vertices.size(); }
+
+  private:
+	std::vector<PackedVertex> m_Vertices;
+};
+
+// Stores vertices with the same attributes once while a model is loaded. Only the loader keeps it, so the lookup is
+// freed once loading is done instead of living as long as the scene.
+class VertexDeduplicator
+{
+  public:
+	explicit VertexDeduplicator(MeshAttributes &attributes) : m_Attributes(attributes) {}
+
+	// Returns the index of the vertex with these attributes, adding it if this loader did not add one yet
+	uint AddVertex(const vec3 &normal, const vec2 &texCoords);
+
+  private:
+	MeshAttributes &m_Attributes;
+	std::unordered_map<uint64_t, uint> m_Lookup; // both packed attributes as one key
+};
+} // namespace prims
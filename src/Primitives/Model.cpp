@@ -1,5 +1,6 @@
 #include "Primitives/Model.h"
 #include "Materials/MaterialManager.h"
+#include "Primitives/PrecomputedTriangle.h"
 #include "Primitives/Triangle.h"
 #include "Utils/Messages.h"
 
@@ -10,7 +11,8 @@
 #include "Utils/tiny_obj_loader.h"
 
 void prims::Load(const std::string &inputFile, uint matIndex, vec3 translation,
-                 float scale, SceneObjectList *objectList, glm::mat4 transform)
+                 float scale, SceneObjectList *objectList, glm::mat4 transform,
+                 TriangleTest test)
 {
     std::vector<uint> fMaterialsIndices;
 
@@ -92,6 +94,8 @@ void prims::Load(const std::string &inputFile, uint matIndex, vec3 translation,
         fMaterialsIndices.push_back(newMaterialIndex);
     }
 
+    // vertices with the same attributes are stored once
+    VertexDeduplicator uniqueVertices(objectList->GetAttributes());
     for (tinyobj::shape_t &s : shapes)
     {
         // loop over faces
@@ -151,59 +155,41 @@ void prims::Load(const std::string &inputFile, uint matIndex, vec3 translation,
             const Material mat =
                 MaterialManager::GetInstance()->GetMaterial(
                     tMaterialIndex);
+            vec3 positions[3];
+            for (int v = 0; v < 3; v++)
+                positions[v] =
+                    vec3(transform * vec4(vertices[v] * scale, 1.0f)) +
+                    translation;
+
+            const bool hasTexCoords = mat.textureIdx > -1 && meshHasTextures;
             Triangle *triangle;
-            if (mat.textureIdx > -1 && meshHasTextures)
+            if (meshHasNormals || hasTexCoords)
             {
-                if (meshHasNormals)
-                {
-                    triangle = new Triangle(
-                        vec3(transform * vec4(vertices[0] * scale, 1.0f)) +
-                            translation,
-                        vec3(transform * vec4(vertices[1] * scale, 1.0f)) +
-                            translation,
-                        vec3(transform * vec4(vertices[2] * scale, 1.0f)) +
-                            translation,
-                        normals[0], normals[1], normals[2], tMaterialIndex,
-                        textureCoordinates[0], textureCoordinates[1],
-                        textureCoordinates[2]);
-                }
-                else
-                {
-                    triangle = new Triangle(
-                        vec3(transform * vec4(vertices[0] * scale, 1.0f)) +
-                            translation,
-                        vec3(transform * vec4(vertices[1] * scale, 1.0f)) +
-                            translation,
-                        vec3(transform * vec4(vertices[2] * scale, 1.0f)) +
-                            translation,
-                        tMaterialIndex, textureCoordinates[0],
-                        textureCoordinates[1], textureCoordinates[2]);
-                }
+                MeshAttributes &attributes = objectList->GetAttributes();
+                const vec3 faceNormal = normalize(cross(
+                    positions[1] - positions[0], positions[2] - positions[0]));
+                uint indices[3];
+                for (int v = 0; v < 3; v++)
+                    indices[v] = uniqueVertices.AddVertex(
+                        meshHasNormals ? normals[v] : faceNormal,
+                        hasTexCoords ? textureCoordinates[v] : vec2(0.0f));
+
+                triangle = new Triangle(positions[0], positions[1],
+                                        positions[2], tMaterialIndex,
+                                        &attributes, indices[0], indices[1],
+                                        indices[2]);
             }
             else
             {
-                if (meshHasNormals)
-                {
-                    triangle = new Triangle(
-                        vec3(transform * vec4(vertices[0] * scale, 1.0f)) +
-                            translation,
-                        vec3(transform * vec4(vertices[1] * scale, 1.0f)) +
-                            translation,
-                        vec3(transform * vec4(vertices[2] * scale, 1.0f)) +
-                            translation,
-                        normals[0], normals[1], normals[2], tMaterialIndex);
-                }
-                else
-                {
-                    triangle = new Triangle(
-                        vec3(transform * vec4(vertices[0] * scale, 1.0f)) +
-                            translation,
-                        vec3(transform * vec4(vertices[1] * scale, 1.0f)) +
-                            translation,
-                        vec3(transform * vec4(vertices[2] * scale, 1.0f)) +
-                            translation,
-                        tMaterialIndex);
-                }
+                triangle = new Triangle(positions[0], positions[1],
+                                        positions[2], tMaterialIndex);
+            }
+
+            if (test == TriangleTest::Precomputed)
+            {
+                Triangle *precomputed = new PrecomputedTriangle(*triangle);
+                delete triangle;
+                triangle = precomputed;
             }
 
             if (mat.IsLight())
@@ -304,6 +290,8 @@ void prims::Load(const std::string &inputFile, uint matIndex,
         fMaterialsIndices.push_back(newMaterialIndex);
     }
 
+    // vertices with the same attributes are stored once
+    VertexDeduplicator uniqueVertices(objectList->GetAttributes());
     for (tinyobj::shape_t &s : shapes)
     {
         // loop over faces
@@ -362,60 +350,26 @@ void prims::Load(const std::string &inputFile, uint matIndex,
             const auto mat =
                 MaterialManager::GetInstance()->GetMaterial(
                     tMaterialIndex);
-            GpuTriangle triangle{};
-            if (mat.textureIdx > -1 && meshHasTextures)
-            {
-                if (meshHasNormals)
-                {
-                    triangle = GpuTriangle(
-                        vec3(transform * vec4(vertices[0] * scale, 1.0f)) +
-                            translation,
-                        vec3(transform * vec4(vertices[1] * scale, 1.0f)) +
-                            translation,
-                        vec3(transform * vec4(vertices[2] * scale, 1.0f)) +
-                            translation,
-                        normals[0], normals[1], normals[2], tMaterialIndex,
-                        textureCoordinates[0], textureCoordinates[1],
-                        textureCoordinates[2]);
-                }
-                else
-                {
-                    triangle = GpuTriangle(
-                        vec3(transform * vec4(vertices[0] * scale, 1.0f)) +
-                            translation,
-                        vec3(transform * vec4(vertices[1] * scale, 1.0f)) +
-                            translation,
-                        vec3(transform * vec4(vertices[2] * scale, 1.0f)) +
-                            translation,
-                        tMaterialIndex, textureCoordinates[0],
-                        textureCoordinates[1], textureCoordinates[2]);
-                }
-            }
-            else
-            {
-                if (meshHasNormals)
-                {
-                    triangle = GpuTriangle(
-                        vec3(transform * vec4(vertices[0] * scale, 1.0f)) +
-                            translation,
-                        vec3(transform * vec4(vertices[1] * scale, 1.0f)) +
-                            translation,
-                        vec3(transform * vec4(vertices[2] * scale, 1.0f)) +
-                            translation,
-                        normals[0], normals[1], normals[2], tMaterialIndex);
-                }
-                else
-                {
-                    triangle = GpuTriangle(
-                        vec3(transform * vec4(vertices[0] * scale, 1.0f)) +
-                            translation,
-                        vec3(transform * vec4(vertices[1] * scale, 1.0f)) +
-                            translation,
-                        vec3(transform * vec4(vertices[2] * scale, 1.0f)) +
-                            translation,
-                        tMaterialIndex);
-                }
-            }
+            vec3 positions[3];
+            for (int v = 0; v < 3; v++)
+                positions[v] =
+                    vec3(transform * vec4(vertices[v] * scale, 1.0f)) +
+                    translation;
+
+            // the kernels always decode the vertices, flat triangles store
+            // their face normal
+            const bool hasTexCoords = mat.textureIdx > -1 && meshHasTextures;
+            const vec3 faceNormal = normalize(
+                cross(positions[1] - positions[0], positions[2] - positions[0]));
+            uint indices[3];
+            for (int v = 0; v < 3; v++)
+                indices[v] = uniqueVertices.AddVertex(
+                    meshHasNormals ? normals[v] : faceNormal,
+                    hasTexCoords ? textureCoordinates[v] : vec2(0.0f));
+
+            const GpuTriangle triangle(positions[0], positions[1],
+                                       positions[2], indices[0], indices[1],
+                                       indices[2], tMaterialIndex);
 
             if (mat.IsLight())
             {
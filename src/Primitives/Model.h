@@ -9,8 +9,22 @@
 
 namespace prims
 {
+// Ray/triangle test of the triangles of a mesh
+enum class TriangleTest
+{
+	Watertight, // Triangle, never misses on shared edges
+	Precomputed // PrecomputedTriangle, fewer operations per test for 48 bytes more per triangle
+};
+
+// Triangle test of the scene meshes, set from the command line
+inline TriangleTest &SceneTriangleTest()
+{
+	static TriangleTest test = TriangleTest::Watertight;
+	return test;
+}
+
 void Load(const std::string &inputFile, uint matIndex, glm::vec3 translation, float scale, SceneObjectList *objectList,
-		  glm::mat4 transform = glm::mat4(1.0f));
+		  glm::mat4 transform = glm::mat4(1.0f), TriangleTest test = TriangleTest::Watertight);
 
 void Load(const std::string &inputFile, uint matIndex, glm::vec3 translation, float scale, GpuTriangleList *objectList,
 		  glm::mat4 transform = glm::mat4(1.0f));
@@ -61,10 +61,8 @@ bvh::AABB Plane::GetBounds() const
 	return {dimMin - oset - EPSILON, dimMax + oset + EPSILON};
 }
 
-vec3 Plane::GetRandomPointOnSurface(const vec3 &direction, vec3 &lNormal, RandomGenerator &rng) const
+vec3 Plane::GetRandomPointOnSurface(const vec3 &direction, vec3 &lNormal, float r1, float r2) const
 {
-	const float r1 = rng.Rand(1.f);
-	const float r2 = rng.Rand(1.f);
 	lNormal = dot(direction, m_Normal) > 0 ? -m_Normal : m_Normal;
 	return centroid + r1 * dimMin + r2 * dimMax;
 }
@@ -135,15 +133,17 @@ TrianglePlane::TrianglePlane(vec3 topRight, vec3 topLeft, vec3 bottomRight, uint
 	materialIdx = matIndex;
 	m_Normal = -normalize(cross(topLeft - topRight, bottomRight - topRight));
 
+	// all four corners share one vertex
+	const uint v = objectList->GetAttributes().AddVertex(m_Normal, vec2(0.0f));
 	if (m.IsLight())
 	{
-		objectList->AddLight(GpuTriangle(topRight, topLeft, bottomRight, m_Normal, m_Normal, m_Normal, matIndex));
-		objectList->AddLight(GpuTriangle(bottomRight, topLeft, bottomLeft, m_Normal, m_Normal, m_Normal, matIndex));
+		objectList->AddLight(GpuTriangle(topRight, topLeft, bottomRight, v, v, v, matIndex));
+		objectList->AddLight(GpuTriangle(bottomRight, topLeft, bottomLeft, v, v, v, matIndex));
 	}
 	else
 	{
-		objectList->AddTriangle(GpuTriangle(topRight, topLeft, bottomRight, m_Normal, m_Normal, m_Normal, matIndex));
-		objectList->AddTriangle(GpuTriangle(bottomRight, topLeft, bottomLeft, m_Normal, m_Normal, m_Normal, matIndex));
+		objectList->AddTriangle(GpuTriangle(topRight, topLeft, bottomRight, v, v, v, matIndex));
+		objectList->AddTriangle(GpuTriangle(bottomRight, topLeft, bottomLeft, v, v, v, matIndex));
 	}
 }
 
@@ -160,16 +160,17 @@ bvh::AABB TrianglePlane::GetBounds() const
 	return bounds;
 }
 
-glm::vec3 TrianglePlane::GetRandomPointOnSurface(const glm::vec3 &direction, glm::vec3 &lNormal,
-												 RandomGenerator &rng) const
+glm::vec3 TrianglePlane::GetRandomPointOnSurface(const glm::vec3 &direction, glm::vec3 &lNormal, float r1,
+												 float r2) const
 {
-	if (rng.Rand(1.f) <= .5f)
+	// the first number picks the triangle, what is left of it is stretched back to [0, 1)
+	if (r1 < .5f)
 	{
-		return m_T1->GetRandomPointOnSurface(direction, lNormal, rng);
+		return m_T1->GetRandomPointOnSurface(direction, lNormal, r1 * 2.f, r2);
 	}
 	else
 	{
-		return m_T2->GetRandomPointOnSurface(direction, lNormal, rng);
+		return m_T2->GetRandomPointOnSurface(direction, lNormal, r1 * 2.f - 1.f, r2);
 	}
 }
 
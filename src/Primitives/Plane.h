@@ -28,7 +28,7 @@ class Plane : public SceneObject
 
 	bvh::AABB GetBounds() const override;
 	glm::vec3 GetRandomPointOnSurface(const glm::vec3 &direction, glm::vec3 &lNormal,
-									  RandomGenerator &rng) const override;
+									  float r1, float r2) const override;
 	glm::vec3 GetNormal(const glm::vec3 &hitPoint) const override;
 	glm::vec2 GetTexCoords(const glm::vec3 &hitPoint) const override;
 };
@@ -53,7 +53,7 @@ class TrianglePlane : public SceneObject
 	void Intersect(core::Ray &r) const override;
 	bvh::AABB GetBounds() const override;
 	glm::vec3 GetRandomPointOnSurface(const glm::vec3 &direction, glm::vec3 &lNormal,
-									  RandomGenerator &rng) const override;
+									  float r1, float r2) const override;
 	glm::vec3 GetNormal(const glm::vec3 &hitPoint) const override;
 	glm::vec2 GetTexCoords(const glm::vec3 &hitPoint) const override;
 };
@@ -0,0 +1,40 @@
+#include "PrecomputedTriangle.h"
+
+namespace prims
+{
+#define EPSILON_T 0.000001f
+
+PrecomputedTriangle::PrecomputedTriangle(const Triangle &triangle) : Triangle(triangle)
+{
+	// a degenerate triangle gets a transform of infinities and NaNs, the tests below reject those
+	const vec3 edge1 = p1 - p0;
+	const vec3 edge2 = p2 - p0;
+	const mat4 toWorld = mat4(vec4(edge1, 0.0f), vec4(edge2, 0.0f), vec4(cross(edge1, edge2), 0.0f), vec4(p0, 1.0f));
+	const mat4 toTriangle = inverse(toWorld);
+
+	for (int i = 0; i < 3; i++)
+		m_Transform[i] = _mm_setr_ps(toTriangle[0][i], toTriangle[1][i], toTriangle[2][i], toTriangle[3][i]);
+}
+
+void PrecomputedTriangle::Intersect(core::Ray &r) const
+{
+	const __m128 origin = _mm_blend_ps(r.m_Origin4, _mm_set1_ps(1.0f), 0b1000);
+	const __m128 direction = _mm_blend_ps(r.m_Direction4, _mm_setzero_ps(), 0b1000);
+
+	// the plane of the triangle is z = 0 in triangle space
+	const float originZ = _mm_cvtss_f32(_mm_dp_ps(m_Transform[2], origin, 0xF1));
+	const float directionZ = _mm_cvtss_f32(_mm_dp_ps(m_Transform[2], direction, 0xF1));
+	const float t = -originZ / directionZ;
+	if (!(t > EPSILON_T && r.t > t))
+		return;
+
+	const __m128 hitPoint = _mm_add_ps(origin, _mm_mul_ps(_mm_set1_ps(t), direction));
+	const float u = _mm_cvtss_f32(_mm_dp_ps(m_Transform[0], hitPoint, 0xF1));
+	const float v = _mm_cvtss_f32(_mm_dp_ps(m_Transform[1], hitPoint, 0xF1));
+	if (!(u >= 0.0f && v >= 0.0f && u + v <= 1.0f))
+		return;
+
+	r.t = t;
+	r.obj = this;
+}
+} // namespace prims
@@ -18,11 +18,17 @@ class SceneObject
 	unsigned int materialIdx, objIdx; // 16
 	float m_Area;
 
+	// Point on the surface for two uniform numbers, drawn by the caller so it can use its concrete generator type
 	virtual glm::vec3 GetRandomPointOnSurface(const glm::vec3 &direction, glm::vec3 &lNormal,
-											  RandomGenerator &rng) const = 0;
+											  float r1, float r2) const = 0;
 	virtual glm::vec3 GetNormal(const glm::vec3 &hitPoint) const = 0;
+	// Normal of the surface without interpolation, the same as the shading normal for analytic shapes
+	virtual glm::vec3 GetGeometricNormal(const glm::vec3 &hitPoint) const { return GetNormal(hitPoint); }
 	virtual glm::vec2 GetTexCoords(const glm::vec3 &hitPoint) const = 0;
 
+	// Area in texture space divided by the area in world space, 0 if texture filtering is not supported
+	virtual float GetUVAreaRatio() const { return 0.0f; }
+
 	inline const glm::vec3 &GetPosition() const { return centroid; }
 
 	inline const float &GetArea() const { return m_Area; }
@@ -46,6 +46,7 @@ void SceneObjectList::TraceRay(core::Ray &r) const
 	}
 
 	r.normal = r.obj->GetNormal(r.GetHitpoint());
+	r.geometricNormal = r.obj->GetGeometricNormal(r.GetHitpoint());
 }
 
 const std::vector<SceneObject *> &SceneObjectList::GetObjects() const { return m_List; }
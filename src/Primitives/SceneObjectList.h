@@ -11,6 +11,7 @@
 #include "Primitives/LightDirectional.h"
 #include "Primitives/LightPoint.h"
 #include "Primitives/LightSpot.h"
+#include "Primitives/MeshAttributes.h"
 #include "Primitives/SceneObject.h"
 
 namespace prims
@@ -57,6 +58,9 @@ class SceneObjectList : public WorldScene
 
 	const std::vector<bvh::AABB> &GetAABBs() const;
 
+	// shared by the triangles of all meshes loaded into this list
+	inline MeshAttributes &GetAttributes() { return m_Attributes; }
+
 	std::vector<unsigned int> GetPrimitiveIndices() { return m_PrimIndices; }
 
 	inline unsigned int GetPrimitiveCount() override { return static_cast<unsigned int>(m_List.size()); }
@@ -79,6 +83,7 @@ class SceneObjectList : public WorldScene
 	std::vector<SceneObject *> m_Lights;
 	std::vector<bvh::AABB> m_Aabbs;
 	std::vector<unsigned int> m_PrimIndices;
+	MeshAttributes m_Attributes;
 };
 
 } // namespace prims
\ No newline at end of file
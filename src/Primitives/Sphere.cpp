@@ -48,9 +48,9 @@ bvh::AABB Sphere::GetBounds() const
 	return {min, max};
 }
 
-vec3 Sphere::GetRandomPointOnSurface(const vec3 &direction, vec3 &lNormal, RandomGenerator &rng) const
+vec3 Sphere::GetRandomPointOnSurface(const vec3 &direction, vec3 &lNormal, float r1, float r2) const
 {
-	const vec3 point = rng.RandomPointOnHemisphere(direction);
+	const vec3 point = RandomGenerator::PointOnHemisphere(direction, r1, r2);
 	lNormal = point;
 	return point * sqrtf(this->radiusSquared) + centroid;
 }
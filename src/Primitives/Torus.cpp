@@ -74,7 +74,7 @@ bvh::AABB Torus::GetBounds() const
 			centroid + vec3(1.f, 1.f, 1.f) * (m_OuterRadius + 2 * m_InnerRadius) + EPSILON};
 }
 
-vec3 Torus::GetRandomPointOnSurface(const vec3 &direction, vec3 &lNormal, RandomGenerator &rng) const
+vec3 Torus::GetRandomPointOnSurface(const vec3 &direction, vec3 &lNormal, float r1, float r2) const
 {
 	return glm::vec3(0.f);
 }
@@ -7,39 +7,7 @@ namespace prims
 {
 #define EPSILON_T 0.000001f
 
-Triangle::Triangle(vec3 p0, vec3 p1, vec3 p2, uint matIndex, vec2 t0, vec2 t1, vec2 t2)
-	: p0(p0), p1(p1), p2(p2), t0(t0), t1(t1), t2(t2)
-{
-	this->materialIdx = matIndex;
-	this->normal = normalize(cross(p1 - p0, p2 - p0));
-	this->n0 = this->n1 = this->n2 = normal;
-	this->centroid = (p0 + p1 + p2) / 3.f;
-
-	// Heron's formula
-	const float a = glm::length(p0 - p1);
-	const float b = glm::length(p1 - p2);
-	const float c = glm::length(p2 - p0);
-	const float s = (a + b + c) / 2.f;
-	this->m_Area = sqrtf(s * (s - a) * (s - b) * (s - c));
-}
-
-Triangle::Triangle(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 n0, glm::vec3 n1, glm::vec3 n2, uint matIndex)
-	: p0(p0), p1(p1), p2(p2), n0(n0), n1(n1), n2(n2), t0(vec3(-1.f, -1.f, -1.f))
-{
-	this->materialIdx = matIndex;
-	this->centroid = (p0 + p1 + p2) / 3.f;
-	this->normal = normalize(cross(p1 - p0, p2 - p0));
-	// Heron's formula
-	const float a = glm::length(p0 - p1);
-	const float b = glm::length(p1 - p2);
-	const float c = glm::length(p2 - p0);
-	const float s = (a + b + c) / 2.f;
-	this->m_Area = sqrtf(s * (s - a) * (s - b) * (s - c));
-}
-
-Triangle::Triangle(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 n0, glm::vec3 n1, glm::vec3 n2, uint matIndex,
-				   glm::vec2 t0, glm::vec2 t1, glm::vec2 t2)
-	: p0(p0), p1(p1), p2(p2), n0(n0), n1(n1), n2(n2), t0(t0), t1(t1), t2(t2)
+Triangle::Triangle(vec3 p0, vec3 p1, vec3 p2, uint matIndex) : p0(p0), p1(p1), p2(p2)
 {
 	this->materialIdx = matIndex;
 	this->centroid = (p0 + p1 + p2) / 3.f;
@@ -52,48 +20,61 @@ Triangle::Triangle(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 n0, glm::
 	this->m_Area = sqrtf(s * (s - a) * (s - b) * (s - c));
 }
 
-Triangle::Triangle(vec3 p0, vec3 p1, vec3 p2, uint matIndex) : p0(p0), p1(p1), p2(p2), t0(vec3(-1.f, -1.f, -1.f))
+Triangle::Triangle(vec3 p0, vec3 p1, vec3 p2, uint matIndex, const MeshAttributes *attributes, uint v0, uint v1,
+				   uint v2)
+	: Triangle(p0, p1, p2, matIndex)
 {
-	this->materialIdx = matIndex;
-	this->normal = normalize(cross(p1 - p0, p2 - p0));
-	this->n0 = this->n1 = this->n2 = normal;
-	this->t0 = vec3(-1.f, -1.f, -1.f);
-	this->centroid = (p0 + p1 + p2) / 3.f;
-	this->normal = normalize(cross(p1 - p0, p2 - p0));
-	// Heron's formula
-	const float a = glm::length(p0 - p1);
-	const float b = glm::length(p1 - p2);
-	const float c = glm::length(p2 - p0);
-	const float s = (a + b + c) / 2.f;
-	this->m_Area = sqrtf(s * (s - a) * (s - b) * (s - c));
+	this->attributes = attributes;
+	this->v0 = v0;
+	this->v1 = v1;
+	this->v2 = v2;
 }
 
+// Woop et al., Watertight Ray/Triangle Intersection, JCGT 2013. The vertices are moved into a space where the ray
+// starts at the origin and points along z, the hit is then a 2D point in triangle test on the edge functions.
+// Neighbouring triangles evaluate a shared edge exactly the same, so rays cannot slip through in between.
 void Triangle::Intersect(core::Ray &r) const
 {
-	// https://en.wikipedia.org/wiki/Möller-Trumbore_intersection_algorithm
-	const vec3 edge1 = p1 - p0;
-	const vec3 edge2 = p2 - p0;
-
-	const vec3 h = cross(r.direction, edge2);
-
-	const float a = dot(edge1, h);
-	if (a > -EPSILON_T && a < EPSILON_T)
-		return; // This ray is parallel to this triangle.
+	// rows become the x, y and z coordinates of the three vertices relative to the origin of the ray
+	__m128 rows[4] = {_mm_sub_ps(_mm_loadu_ps(&p0.x), r.m_Origin4), _mm_sub_ps(_mm_loadu_ps(&p1.x), r.m_Origin4),
+					  _mm_sub_ps(_mm_loadu_ps(&p2.x), r.m_Origin4), _mm_setzero_ps()};
+	_MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+
+	union {
+		__m128 f4;
+		float f[4];
+	} x, y, uvw, z;
+
+	x.f4 = _mm_sub_ps(rows[r.kx], _mm_mul_ps(_mm_set1_ps(r.shear.x), rows[r.kz]));
+	y.f4 = _mm_sub_ps(rows[r.ky], _mm_mul_ps(_mm_set1_ps(r.shear.y), rows[r.kz]));
+
+	// scaled barycentric coordinates, the edge functions of the three edges at once
+	const __m128 x1 = _mm_shuffle_ps(x.f4, x.f4, _MM_SHUFFLE(3, 1, 0, 2));
+	const __m128 x2 = _mm_shuffle_ps(x.f4, x.f4, _MM_SHUFFLE(3, 0, 2, 1));
+	const __m128 y1 = _mm_shuffle_ps(y.f4, y.f4, _MM_SHUFFLE(3, 1, 0, 2));
+	const __m128 y2 = _mm_shuffle_ps(y.f4, y.f4, _MM_SHUFFLE(3, 0, 2, 1));
+	uvw.f4 = _mm_sub_ps(_mm_mul_ps(x1, y2), _mm_mul_ps(y1, x2));
+
+	// on an edge the float result can have either sign, double precision decides exactly
+	if (uvw.f[0] == 0.0f || uvw.f[1] == 0.0f || uvw.f[2] == 0.0f)
+	{
+		uvw.f[0] = float(double(x.f[2]) * double(y.f[1]) - double(y.f[2]) * double(x.f[1]));
+		uvw.f[1] = float(double(x.f[0]) * double(y.f[2]) - double(y.f[0]) * double(x.f[2]));
+		uvw.f[2] = float(double(x.f[1]) * double(y.f[0]) - double(y.f[1]) * double(x.f[0]));
+	}
 
-	const float f = 1.f / a;
-	const vec3 s = r.origin - p0;
-	const float u = f * dot(s, h);
-	if (u < 0 || u > 1)
+	// inside when all three agree in sign, either sign as both sides of a triangle are hit
+	const bool negative = uvw.f[0] < 0.0f || uvw.f[1] < 0.0f || uvw.f[2] < 0.0f;
+	const bool positive = uvw.f[0] > 0.0f || uvw.f[1] > 0.0f || uvw.f[2] > 0.0f;
+	if (negative && positive)
 		return;
 
-	const vec3 q = cross(s, edge1);
-	const float v = f * dot(r.direction, q);
-	if (v < 0 || u + v > 1)
-		return;
+	const float det = uvw.f[0] + uvw.f[1] + uvw.f[2];
+	if (det == 0.0f)
+		return; // the ray is parallel to this triangle
 
-	// At this stage we can compute t to find out where the intersection point
-	// is on the line.
-	const float t = f * dot(edge2, q);
+	z.f4 = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(r.shear.z), rows[r.kz]), uvw.f4);
+	const float t = (z.f[0] + z.f[1] + z.f[2]) / det;
 
 	if (t > EPSILON_T && r.t > t) // ray intersection
 	{
@@ -128,11 +109,9 @@ bvh::AABB Triangle::GetBounds() const
 	return {vec3(minX, minY, minZ), vec3(maxX, maxY, maxZ)};
 }
 
-vec3 Triangle::GetRandomPointOnSurface(const vec3 &direction, vec3 &lNormal, RandomGenerator &rng) const
+vec3 Triangle::GetRandomPointOnSurface(const vec3 &direction, vec3 &lNormal, float r1, float r2) const
 {
 	lNormal = normal;
-	float r1 = rng.Rand(1.f);
-	float r2 = rng.Rand(1.f);
 
 	if (r1 + r2 > 1)
 	{
@@ -207,15 +186,38 @@ vec3 Triangle::GetRandomPointOnSurface(const vec3 &direction, vec3 &lNormal, Ran
 //    return ret;
 //}
 
+// the vertex attributes are only decoded here, for the closest hit
 glm::vec3 Triangle::GetNormal(const glm::vec3 &hitPoint) const
 {
+	if (attributes == nullptr)
+		return normal;
+
 	const vec3 bary = GetBarycentricCoordinatesAt(hitPoint);
+	const vec3 n0 = attributes->GetNormal(v0), n1 = attributes->GetNormal(v1), n2 = attributes->GetNormal(v2);
 	return normalize(bary.x * n0 + bary.y * n1 + bary.z * n2);
 }
 
+glm::vec3 Triangle::GetGeometricNormal(const glm::vec3 &) const { return normal; }
+
 glm::vec2 Triangle::GetTexCoords(const glm::vec3 &hitPoint) const
 {
+	if (attributes == nullptr)
+		return vec2(0.0f);
+
 	const vec3 bary = GetBarycentricCoordinatesAt(hitPoint);
+	const vec2 t0 = attributes->GetTexCoords(v0), t1 = attributes->GetTexCoords(v1), t2 = attributes->GetTexCoords(v2);
 	return bary.x * t0 + bary.y * t1 + bary.z * t2;
 }
+
+float Triangle::GetUVAreaRatio() const
+{
+	if (attributes == nullptr)
+		return 0.0f;
+
+	const vec2 t0 = attributes->GetTexCoords(v0);
+	const vec2 e1 = attributes->GetTexCoords(v1) - t0, e2 = attributes->GetTexCoords(v2) - t0;
+	const float uvArea = glm::abs(e1.x * e2.y - e1.y * e2.x);
+	const float worldArea = length(cross(p1 - p0, p2 - p0));
+	return worldArea > 0.0f ? uvArea / worldArea : 0.0f;
+}
 } // namespace prims
\ No newline at end of file
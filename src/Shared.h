@@ -1,2 +1,7 @@
 #define EPSILON (0.0001f)
-#define MBVH 1
\ No newline at end of file
+// offset of new ray origins, see utils::OffsetRayOrigin and OffsetRayOrigin in programs/ray.cl
+#define OFFSET_ORIGIN_BAND (1.0f / 32.0f) // closer to 0 than this a fixed distance is used instead of ulps
+#define OFFSET_FLOAT_SCALE (1.0f / 65536.0f)
+#define OFFSET_INT_SCALE 256.0f
+#define MBVH 1
+#define LIGHT_TREE 1 // pick lights for NEE from a light BVH instead of proportional to their area
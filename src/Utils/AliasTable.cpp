@@ -0,0 +1,88 @@
+#include "Utils/AliasTable.h"
+
+namespace utils
+{
+AliasTable::AliasTable(const std::vector<float> &weights) { Build(weights); }
+
+void AliasTable::Build(const std::vector<float> &weights)
+{
+	m_Weights = weights;
+	Rebuild();
+}
+
+void AliasTable::SetWeight(unsigned int idx, float weight)
+{
+	if (m_Weights[idx] == weight)
+		return;
+
+	m_Weights[idx] = weight;
+	m_Dirty = true;
+}
+
+void AliasTable::AddWeight(float weight)
+{
+	m_Weights.push_back(weight);
+	m_Dirty = true;
+}
+
+bool AliasTable::Update()
+{
+	if (!m_Dirty)
+		return false;
+
+	Rebuild();
+	return true;
+}
+
+void AliasTable::Rebuild()
+{
+	const auto count = static_cast<unsigned int>(m_Weights.size());
+	m_Entries.resize(count);
+	m_Dirty = false;
+
+	m_TotalWeight = 0.f;
+	for (const float weight : m_Weights)
+		m_TotalWeight += weight;
+	if (count == 0 || m_TotalWeight <= 0.f)
+	{
+		for (unsigned int i = 0; i < count; i++)
+			m_Entries[i] = {1.f, static_cast<int>(i)};
+		return;
+	}
+
+	// scale the weights so the average is 1, entries below 1 get topped up by an entry above 1
+	std::vector<float> scaled(count);
+	std::vector<unsigned int> small, large;
+	small.reserve(count);
+	large.reserve(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		scaled[i] = m_Weights[i] * float(count) / m_TotalWeight;
+		if (scaled[i] < 1.f)
+			small.push_back(i);
+		else
+			large.push_back(i);
+	}
+
+	while (!small.empty() && !large.empty())
+	{
+		const unsigned int less = small.back();
+		const unsigned int more = large.back();
+		small.pop_back();
+
+		m_Entries[less] = {scaled[less], static_cast<int>(more)};
+		scaled[more] = (scaled[more] + scaled[less]) - 1.f;
+		if (scaled[more] < 1.f)
+		{
+			large.pop_back();
+			small.push_back(more);
+		}
+	}
+
+	// whatever is left over is 1 up to rounding errors
+	for (const unsigned int i : large)
+		m_Entries[i] = {1.f, static_cast<int>(i)};
+	for (const unsigned int i : small)
+		m_Entries[i] = {1.f, static_cast<int>(i)};
+}
+} // namespace utils
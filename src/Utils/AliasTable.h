@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+namespace utils
+{
+// Needs to match AliasEntry in programs/light.cl
+struct AliasEntry
+{
+	float probability; // chance to keep this entry instead of taking the alias
+	int alias;
+};
+
+// Vose's alias method: picks an index proportional to its weight in O(1) after an O(n) build.
+// Weights can be changed or added at any time, the table is only rebuilt once per batch of changes.
+class AliasTable
+{
+  public:
+	AliasTable() = default;
+	explicit AliasTable(const std::vector<float> &weights);
+
+	void Build(const std::vector<float> &weights);
+
+	void SetWeight(unsigned int idx, float weight);
+
+	void AddWeight(float weight);
+
+	// Rebuilds the table if weights changed since the last build, returns true if it did
+	bool Update();
+
+	// Maps two uniform random numbers in [0, 1) to an index, r picks the entry and coin decides between it and its
+	// alias. Reusing the fraction of r * size as the coin would leave it only 24 - log2(size) bits.
+	inline unsigned int Sample(float r, float coin) const
+	{
+		unsigned int idx = static_cast<unsigned int>(r * float(m_Entries.size()));
+		if (idx >= m_Entries.size())
+			idx = static_cast<unsigned int>(m_Entries.size()) - 1;
+
+		const AliasEntry &entry = m_Entries[idx];
+		return coin < entry.probability ? idx : static_cast<unsigned int>(entry.alias);
+	}
+
+	// Probability of sampling idx
+	inline float Pdf(unsigned int idx) const { return m_Weights[idx] / m_TotalWeight; }
+
+	inline const std::vector<AliasEntry> &GetEntries() const { return m_Entries; }
+
+	inline unsigned int GetSize() const { return static_cast<unsigned int>(m_Entries.size()); }
+
+	inline float GetTotalWeight() const { return m_TotalWeight; }
+
+  private:
+	void Rebuild();
+
+	std::vector<float> m_Weights;
+	std::vector<AliasEntry> m_Entries;
+	float m_TotalWeight = 0.f;
+	bool m_Dirty = false;
+};
+} // namespace utils
@@ -1,4 +1,9 @@
+#pragma once
+
 #include <cfenv>
+#include <glm/glm.hpp>
+
+#include "Shared.h"
 
 // floating point error catching code
 #if defined(__APPLE__) || defined(WIN32D)
@@ -41,4 +46,27 @@ static int fedisableexcept(unsigned int excepts)
 
 #define ENABLE_FLOAT_EXCEPTIONS feenableexcept(FE_DIVBYZERO);
 #define DISABLE_FLOAT_EXCEPTIONS fedisableexcept(FE_DIVBYZERO);
-#define BADFLOAT(x) ((*(uint *)&x & 0x7f000000) == 0x7f000000)
\ No newline at end of file
+#define BADFLOAT(x) ((*(uint *)&x & 0x7f000000) == 0x7f000000)
+
+// Rays leaving a surface start a fixed number of ulps of the hit point away from it instead of EPSILON along their
+// direction, so the offset grows with the float error of the hit point (Waechter and Binder, A Fast and Robust Method
+// for Avoiding Self-Intersection, Ray Tracing Gems, 2019). The constants are in Shared.h, shared with the kernels.
+namespace utils
+{
+// p moved off its surface with normal n to the side a new ray along direction leaves to
+inline glm::vec3 OffsetRayOrigin(const glm::vec3 &p, glm::vec3 n, const glm::vec3 &direction)
+{
+    if (glm::dot(direction, n) < 0.0f)
+        n = -n;
+
+    const glm::ivec3 offset = glm::ivec3(OFFSET_INT_SCALE * n);
+    const glm::ivec3 bits = glm::floatBitsToInt(p);
+    const glm::vec3 moved = glm::intBitsToFloat(bits + glm::ivec3(bits.x < 0 ? -offset.x : offset.x,
+                                                                   bits.y < 0 ? -offset.y : offset.y,
+                                                                   bits.z < 0 ? -offset.z : offset.z));
+
+    return {glm::abs(p.x) < OFFSET_ORIGIN_BAND ? p.x + OFFSET_FLOAT_SCALE * n.x : moved.x,
+            glm::abs(p.y) < OFFSET_ORIGIN_BAND ? p.y + OFFSET_FLOAT_SCALE * n.y : moved.y,
+            glm::abs(p.z) < OFFSET_ORIGIN_BAND ? p.z + OFFSET_FLOAT_SCALE * n.z : moved.z};
+}
+} // namespace utils
@@ -0,0 +1,165 @@
+#include "Utils/ImageWriter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+
+#include <FreeImage.h>
+
+#include "Utils/Messages.h"
+
+namespace utils
+{
+namespace
+{
+bool EndsWith(const std::string &str, const std::string &suffix)
+{
+	if (str.size() < suffix.size())
+		return false;
+	return std::equal(suffix.rbegin(), suffix.rend(), str.rbegin(),
+					  [](char a, char b) { return tolower(a) == tolower(b); });
+}
+
+// PFM stores its rows bottom-up, a negative scale marks little endian floats
+bool WritePFM(const std::string &path, int width, int height, const glm::vec3 *pixels)
+{
+	FILE *file = fopen(path.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+
+	fprintf(file, "PF\n%i %i\n-1.0\n", width, height);
+	bool written = true;
+	for (int y = height - 1; y >= 0 && written; y--)
+		written = fwrite(pixels + size_t(y) * width, sizeof(glm::vec3), width, file) == size_t(width);
+	return fclose(file) == 0 && written;
+}
+
+// FreeImage scanline 0 is the bottom row
+bool WriteFreeImage(const std::string &path, int width, int height, const glm::vec3 *pixels, ImageFormat format)
+{
+	FIBITMAP *dib;
+	if (format == ImageFormat::PNG)
+	{
+		dib = FreeImage_Allocate(width, height, 24);
+		for (int y = 0; dib != nullptr && y < height; y++)
+		{
+			BYTE *line = FreeImage_GetScanLine(dib, height - 1 - y);
+			for (int x = 0; x < width; x++, line += 3)
+			{
+				const glm::vec3 col = glm::sqrt(glm::clamp(pixels[x + y * width], 0.0f, 1.0f)) * 255.99f;
+				line[FI_RGBA_RED] = BYTE(col.r);
+				line[FI_RGBA_GREEN] = BYTE(col.g);
+				line[FI_RGBA_BLUE] = BYTE(col.b);
+			}
+		}
+	}
+	else
+	{
+		dib = FreeImage_AllocateT(FIT_RGBF, width, height);
+		for (int y = 0; dib != nullptr && y < height; y++)
+		{
+			auto *line = reinterpret_cast<FIRGBF *>(FreeImage_GetScanLine(dib, height - 1 - y));
+			for (int x = 0; x < width; x++)
+			{
+				const glm::vec3 &pixel = pixels[x + y * width];
+				line[x] = {pixel.r, pixel.g, pixel.b};
+			}
+		}
+	}
+
+	if (dib == nullptr)
+		return false;
+
+	bool written;
+	if (format == ImageFormat::PNG)
+		written = FreeImage_Save(FIF_PNG, dib, path.c_str(), PNG_DEFAULT);
+	else // EXR_DEFAULT stores half floats
+		written = FreeImage_Save(FIF_EXR, dib, path.c_str(), format == ImageFormat::EXR ? EXR_DEFAULT : EXR_FLOAT);
+
+	FreeImage_Unload(dib);
+	return written;
+}
+} // namespace
+
+ImageFormat GetImageFormat(const std::string &path)
+{
+	if (EndsWith(path, ".exr"))
+		return ImageFormat::EXR;
+	if (EndsWith(path, ".png"))
+		return ImageFormat::PNG;
+	return ImageFormat::PFM;
+}
+
+bool WriteImage(const std::string &path, int width, int height, const glm::vec3 *pixels, ImageFormat format)
+{
+	if (format == ImageFormat::PFM)
+		return WritePFM(path, width, height, pixels);
+	return WriteFreeImage(path, width, height, pixels, format);
+}
+
+AsyncImageWriter::AsyncImageWriter() : m_Thread(&AsyncImageWriter::Run, this) {}
+
+AsyncImageWriter::~AsyncImageWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stop = true;
+	}
+	m_Queued.notify_one();
+	m_Thread.join();
+}
+
+void AsyncImageWriter::Write(const std::string &path, int width, int height, const glm::vec3 *pixels,
+							 ImageFormat format, float scale)
+{
+	// copied outside the lock, the writer thread keeps going meanwhile
+	Job job = {path, width, height, std::vector<glm::vec3>(pixels, pixels + size_t(width) * height), format, scale};
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto queued = std::find_if(m_Jobs.begin(), m_Jobs.end(), [&path](const Job &j) { return j.path == path; });
+		if (queued != m_Jobs.end())
+			*queued = std::move(job);
+		else
+			m_Jobs.push_back(std::move(job));
+	}
+	m_Queued.notify_one();
+}
+
+void AsyncImageWriter::Flush()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_Written.wait(lock, [this] { return m_Jobs.empty() && !m_Writing; });
+}
+
+void AsyncImageWriter::Run()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (true)
+	{
+		m_Queued.wait(lock, [this] { return m_Stop || !m_Jobs.empty(); });
+		if (m_Jobs.empty()) // stopped with nothing left to write
+			break;
+
+		Job job = std::move(m_Jobs.front());
+		m_Jobs.pop_front();
+		m_Writing = true;
+
+		lock.unlock();
+		if (job.scale != 1.0f)
+		{
+			for (glm::vec3 &pixel : job.pixels)
+				pixel *= job.scale;
+		}
+		if (!WriteImage(job.path, job.width, job.height, job.pixels.data(), job.format))
+		{
+			const std::string message = "Could not write " + job.path;
+			WarningMessage(__FILE__, __LINE__, message.c_str(), "AsyncImageWriter");
+		}
+		lock.lock();
+
+		m_Writing = false;
+		m_Written.notify_all();
+	}
+}
+} // namespace utils
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace utils
+{
+enum class ImageFormat
+{
+	PFM,	  // portable float map, 32 bit float RGB
+	EXR,	  // OpenEXR with half floats
+	EXRFloat, // OpenEXR with 32 bit floats
+	PNG		  // 8 bit, clamped and gamma corrected like the display
+};
+
+// Picks the format from the extension of path (.pfm, .exr or .png), anything else is written as PFM
+ImageFormat GetImageFormat(const std::string &path);
+
+// Writes width * height RGB pixels stored as top-down rows, returns false if the file could not be written
+bool WriteImage(const std::string &path, int width, int height, const glm::vec3 *pixels, ImageFormat format);
+
+// Writes images on a thread of its own so renderers do not wait for the disk. Write copies the pixels, a queued
+// image that was not written yet is replaced by a newer one with the same path. Pixels are multiplied by scale on
+// the writer thread, which turns summed up samples into averages.
+class AsyncImageWriter
+{
+  public:
+	AsyncImageWriter();
+
+	// Writes everything that is still queued
+	~AsyncImageWriter();
+
+	void Write(const std::string &path, int width, int height, const glm::vec3 *pixels, ImageFormat format,
+			   float scale = 1.0f);
+
+	inline void Write(const std::string &path, int width, int height, const glm::vec3 *pixels, float scale = 1.0f)
+	{
+		Write(path, width, height, pixels, GetImageFormat(path), scale);
+	}
+
+	// Blocks until every queued image is on disk
+	void Flush();
+
+  private:
+	struct Job
+	{
+		std::string path;
+		int width, height;
+		std::vector<glm::vec3> pixels;
+		ImageFormat format;
+		float scale;
+	};
+
+	void Run();
+
+	std::mutex m_Mutex;
+	std::condition_variable m_Queued, m_Written;
+	std::deque<Job> m_Jobs;
+	bool m_Writing = false;
+	bool m_Stop = false;
+	std::thread m_Thread; // last, so everything it uses is constructed before it starts
+};
+} // namespace utils
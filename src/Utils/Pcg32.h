@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Utils/RandomGenerator.h"
+
+// PCG32 (XSH RR) by Melissa O'Neill. Final, so calls through a Pcg32 & are resolved at compile time and inlined.
+// The ray tracer tiles use it as their concrete Rng.
+class Pcg32 final : public RandomGenerator
+{
+  public:
+	explicit Pcg32(uint64_t seed = 0x853c49e6748fea9bULL, uint64_t stream = 0xda3e39cb94b95bdbULL)
+	{
+		m_Inc = (stream << 1u) | 1u;
+		RandomUint();
+		m_State += seed;
+		RandomUint();
+	}
+
+	inline float Rand(float range = 1.0f) override { return sampling::ToUnitFloat(RandomUint()) * range; }
+
+	inline unsigned int RandomUint() override
+	{
+		const uint64_t old = m_State;
+		m_State = old * 6364136223846793005ULL + m_Inc;
+		const auto xorShifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+		const auto rot = uint32_t(old >> 59u);
+		return (xorShifted >> rot) | (xorShifted << ((~rot + 1u) & 31u));
+	}
+
+  private:
+	uint64_t m_State = 0;
+	uint64_t m_Inc;
+};
@@ -3,6 +3,13 @@
 #include <glm/glm.hpp>
 #include <random>
 
+namespace sampling
+{
+// Maps 32 random bits to [0, 1). Only the top 24 bits are kept, they convert to a float exactly, so rounding can never
+// produce 1 like scaling all 32 bits by 2^-32 does.
+inline float ToUnitFloat(unsigned int v) { return float(v >> 8) * 5.9604644775390625e-8f; }
+} // namespace sampling
+
 // http://www.rorydriscoll.com/2009/01/07/better-sampling/
 class RandomGenerator
 {
@@ -11,14 +18,14 @@ class RandomGenerator
 
 	virtual unsigned int RandomUint() = 0;
 
-	inline glm::vec3 uniformSampleHemisphere(const float &r1, const float &r2)
+	static inline glm::vec3 uniformSampleHemisphere(const float &r1, const float &r2)
 	{
 		const float r = sqrtf(1.0f - r1 * r1);
 		const float phi = 2.0f * 3.14159265358979323846f * r2;
 		return glm::vec3(cosf(phi) * r, r1, sinf(phi) * r);
 	}
 
-	inline void createCoordinateSystem(const glm::vec3 &N, glm::vec3 &Nt, glm::vec3 &Nb)
+	static inline void createCoordinateSystem(const glm::vec3 &N, glm::vec3 &Nt, glm::vec3 &Nb)
 	{
 		if (fabs(N.x) > fabs(N.y))
 		{
@@ -32,16 +39,16 @@ class RandomGenerator
 		Nb = cross(N, Nt);
 	}
 
-	inline glm::vec3 localToWorld(const glm::vec3 &sample, const glm::vec3 &Nt, const glm::vec3 &Nb,
-								  const glm::vec3 &normal)
+	static inline glm::vec3 localToWorld(const glm::vec3 &sample, const glm::vec3 &Nt, const glm::vec3 &Nb,
+										 const glm::vec3 &normal)
 	{
 		return glm::vec3(sample.x * Nb.x + sample.y * normal.x + sample.z * Nt.x,
 						 sample.x * Nb.y + sample.y * normal.y + sample.z * Nt.y,
 						 sample.x * Nb.z + sample.y * normal.z + sample.z * Nt.z);
 	}
 
-	inline glm::vec3 worldToLocalMicro(const glm::vec3 &vec, const glm::vec3 &rDirection, glm::vec3 &u, glm::vec3 &v,
-									   glm::vec3 &w)
+	static inline glm::vec3 worldToLocalMicro(const glm::vec3 &vec, const glm::vec3 &rDirection, glm::vec3 &u,
+											  glm::vec3 &v, glm::vec3 &w)
 	{
 		w = vec;
 		u = glm::normalize(glm::cross(fabs(vec.x) > fabs(vec.y) ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0), w));
@@ -50,18 +57,25 @@ class RandomGenerator
 		return glm::normalize(glm::vec3(glm::dot(u, wi), glm::dot(v, wi), glm::dot(w, wi)));
 	}
 
-	inline glm::vec3 localToWorldMicro(const glm::vec3 &wmLocal, const glm::vec3 &u, const glm::vec3 &v,
-									   const glm::vec3 &w)
+	static inline glm::vec3 localToWorldMicro(const glm::vec3 &wmLocal, const glm::vec3 &u, const glm::vec3 &v,
+											  const glm::vec3 &w)
 	{
 		return u * wmLocal.x + v * wmLocal.y + w * wmLocal.z;
 	}
 
 	inline glm::vec3 RandomPointOnHemisphere(const glm::vec3 &normal)
 	{
-		glm::vec3 Nt, Nb;
-		createCoordinateSystem(normal, Nt, Nb);
 		const float r1 = Rand(1.0f);
 		const float r2 = Rand(1.0f);
+		return PointOnHemisphere(normal, r1, r2);
+	}
+
+	// Uniform point on the hemisphere around normal for two given uniform numbers, lets callers that know the
+	// concrete generator type draw the numbers without a virtual call
+	static inline glm::vec3 PointOnHemisphere(const glm::vec3 &normal, float r1, float r2)
+	{
+		glm::vec3 Nt, Nb;
+		createCoordinateSystem(normal, Nt, Nb);
 		const glm::vec3 sample = uniformSampleHemisphere(r1, r2);
 		return localToWorld(sample, Nt, Nb, normal);
 	}
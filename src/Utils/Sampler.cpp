@@ -0,0 +1,137 @@
+#include "Utils/Sampler.h"
+
+#include <cmath>
+#include <vector>
+
+#include "Utils/Pcg32.h"
+
+#define BLUE_NOISE_SIGMA 1.5f
+
+namespace
+{
+// Void and cluster (Ulichney 1993) on a toroidal grid. Phase 3 is left out: the void filling of phase 2 simply
+// continues until the mask is full, which is good enough for dithering.
+class VoidAndCluster
+{
+  public:
+	VoidAndCluster() : m_Ones(N * N, 0), m_Energy(N * N, 0.0f), m_Ranks(N * N, 0)
+	{
+		for (int y = 0; y < N; y++)
+		{
+			for (int x = 0; x < N; x++)
+			{
+				const float dx = float(std::min(x, N - x)), dy = float(std::min(y, N - y));
+				m_Filter[x + y * N] = expf(-(dx * dx + dy * dy) / (2.0f * BLUE_NOISE_SIGMA * BLUE_NOISE_SIGMA));
+			}
+		}
+
+		// initial pattern of 10% ones, relaxed until the tightest cluster is the largest void
+		Pcg32 rng;
+		int ones = 0;
+		while (ones < N * N / 10)
+		{
+			const int p = int(rng.RandomUint() % (N * N));
+			if (!m_Ones[p])
+				Toggle(p), ones++;
+		}
+
+		while (true)
+		{
+			const int cluster = Find(true);
+			Toggle(cluster);
+			const int largestVoid = Find(false);
+			Toggle(largestVoid);
+			if (largestVoid == cluster)
+				break;
+		}
+
+		const std::vector<char> initialOnes = m_Ones;
+		const std::vector<float> initialEnergy = m_Energy;
+
+		// phase 1: the tightest clusters of the initial pattern get the lowest ranks
+		for (int rank = ones - 1; rank >= 0; rank--)
+		{
+			const int cluster = Find(true);
+			Toggle(cluster);
+			m_Ranks[cluster] = rank;
+		}
+
+		// phase 2: fill the largest voids
+		m_Ones = initialOnes;
+		m_Energy = initialEnergy;
+		for (int rank = ones; rank < N * N; rank++)
+		{
+			const int largestVoid = Find(false);
+			Toggle(largestVoid);
+			m_Ranks[largestVoid] = rank;
+		}
+	}
+
+	// mask values as 32 bit fixed point numbers in [0, 1)
+	std::vector<unsigned int> GetMask() const
+	{
+		std::vector<unsigned int> mask(N * N);
+		for (int i = 0; i < N * N; i++)
+			mask[i] = unsigned(m_Ranks[i]) * (0xFFFFFFFFu / (N * N) + 1u);
+		return mask;
+	}
+
+  private:
+	static constexpr int N = BlueNoiseSampler::MASK_SIZE;
+
+	void Toggle(int p)
+	{
+		m_Ones[p] = !m_Ones[p];
+		const float sign = m_Ones[p] ? 1.0f : -1.0f;
+		const int px = p % N, py = p / N;
+		for (int y = 0; y < N; y++)
+		{
+			const int fy = ((y - py) & (N - 1)) * N;
+			for (int x = 0; x < N; x++)
+				m_Energy[x + y * N] += sign * m_Filter[((x - px) & (N - 1)) + fy];
+		}
+	}
+
+	// tightest cluster among the ones or largest void among the zeros
+	int Find(bool ones) const
+	{
+		int best = -1;
+		for (int p = 0; p < N * N; p++)
+		{
+			if (bool(m_Ones[p]) != ones)
+				continue;
+			if (best < 0 || (ones ? m_Energy[p] > m_Energy[best] : m_Energy[p] < m_Energy[best]))
+				best = p;
+		}
+		return best;
+	}
+
+	float m_Filter[N * N];
+	std::vector<char> m_Ones;
+	std::vector<float> m_Energy;
+	std::vector<int> m_Ranks;
+};
+
+const unsigned int *GetBlueNoiseMask()
+{
+	// built once on first use
+	static const std::vector<unsigned int> mask = VoidAndCluster().GetMask();
+	return mask.data();
+}
+} // namespace
+
+Sampler *Sampler::Create(SamplerType type)
+{
+	switch (type)
+	{
+	case (SamplerType::Random):
+		return new RandomSampler();
+	case (SamplerType::BlueNoise):
+		return new BlueNoiseSampler();
+	case (SamplerType::Sobol):
+	default:
+		return new SobolSampler();
+	}
+}
+
+BlueNoiseSampler::BlueNoiseSampler() : m_Mask(GetBlueNoiseMask()) {}
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <immintrin.h>
+
+#include "Utils/RandomGenerator.h"
+
+enum class SamplerType
+{
+	Random = 0,
+	Sobol = 1,	   // Owen scrambled Sobol, scrambled per pixel
+	BlueNoise = 2, // Owen scrambled Sobol shared by all pixels, shifted per pixel by a blue noise mask
+};
+
+// Where a path is in its sample sequence
+struct SamplerState
+{
+	int x = 0, y = 0;
+	unsigned int index = 0;		// sample of the pixel
+	unsigned int dimension = 0; // next dimension of the sample
+};
+
+// The states of 8 paths, one per lane
+struct SamplerState8
+{
+	__m256i x, y, index, dimension;
+};
+
+namespace sampling
+{
+// Direction numbers of the first 4 Sobol dimensions (Joe & Kuo), MSB first
+struct SobolMatrices
+{
+	unsigned int v[4][32] = {};
+
+	constexpr SobolMatrices()
+	{
+		const unsigned int s[4] = {0, 1, 2, 3};
+		const unsigned int a[4] = {0, 0, 1, 1};
+		const unsigned int m[4][3] = {{1, 0, 0}, {1, 0, 0}, {1, 3, 0}, {1, 3, 1}};
+
+		for (int bit = 0; bit < 32; bit++)
+			v[0][bit] = 1u << (31 - bit); // van der Corput
+
+		for (int d = 1; d < 4; d++)
+		{
+			for (unsigned int i = 0; i < 32; i++)
+			{
+				if (i < s[d])
+				{
+					v[d][i] = m[d][i] << (31 - i);
+					continue;
+				}
+
+				v[d][i] = v[d][i - s[d]] ^ (v[d][i - s[d]] >> s[d]);
+				for (unsigned int k = 1; k < s[d]; k++)
+					v[d][i] ^= ((a[d] >> (s[d] - 1 - k)) & 1u) * v[d][i - k];
+			}
+		}
+	}
+};
+
+inline constexpr SobolMatrices sobolMatrices{};
+
+inline unsigned int Sobol(unsigned int index, unsigned int dimension)
+{
+	unsigned int result = 0;
+	for (int bit = 0; index != 0; index >>= 1, bit++)
+	{
+		if (index & 1u)
+			result ^= sobolMatrices.v[dimension][bit];
+	}
+	return result;
+}
+
+inline unsigned int ReverseBits(unsigned int x)
+{
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+	x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+inline unsigned int Hash(unsigned int x)
+{
+	// lowbias32 by Chris Wellons
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+inline unsigned int HashCombine(unsigned int seed, unsigned int v)
+{
+	return seed ^ (v + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+}
+
+// Owen scrambling of all bits at once, flips every bit depending on the bits above it (Burley 2020)
+inline unsigned int NestedUniformScramble(unsigned int x, unsigned int seed)
+{
+	x = ReverseBits(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return ReverseBits(x);
+}
+
+inline unsigned int PixelSeed(int x, int y) { return Hash(unsigned(x) ^ Hash(unsigned(y))); }
+
+// Dimension of a scrambled and shuffled Sobol point, every 4 dimensions start over with another seed
+inline unsigned int ScrambledSobol(unsigned int seed, unsigned int index, unsigned int dimension)
+{
+	const unsigned int groupSeed = Hash(HashCombine(seed, dimension / 4));
+	const unsigned int shuffled = NestedUniformScramble(index, groupSeed);
+	return NestedUniformScramble(Sobol(shuffled, dimension % 4), HashCombine(groupSeed, dimension % 4 + 1));
+}
+
+// AVX2 versions of the above, bit for bit the same results in every lane
+
+inline __m256i Mul8(const __m256i &a, unsigned int b) { return _mm256_mullo_epi32(a, _mm256_set1_epi32(int(b))); }
+
+inline __m256i Sobol8(__m256i index, const __m256i &dimension)
+{
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i row = _mm256_slli_epi32(dimension, 5);
+	__m256i result = _mm256_setzero_si256();
+	for (int bit = 0; !_mm256_testz_si256(index, index); index = _mm256_srli_epi32(index, 1), bit++)
+	{
+		const __m256i set = _mm256_cmpeq_epi32(_mm256_and_si256(index, one), one);
+		const __m256i column = _mm256_add_epi32(row, _mm256_set1_epi32(bit));
+		const __m256i v = _mm256_i32gather_epi32(reinterpret_cast<const int *>(&sobolMatrices.v[0][0]), column, 4);
+		result = _mm256_xor_si256(result, _mm256_and_si256(set, v));
+	}
+	return result;
+}
+
+inline __m256i ReverseBits8(const __m256i &x)
+{
+	// reverse the bytes, then the bits within every byte through two nibble lookups
+	const __m256i order = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6, 5, 4,
+										   11, 10, 9, 8, 15, 14, 13, 12);
+	const __m256i bytes = _mm256_shuffle_epi8(x, order);
+	const __m256i low = _mm256_setr_epi8(0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30,
+										 0xB0, 0x70, 0xF0, 0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90,
+										 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0);
+	const __m256i high = _mm256_setr_epi8(0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE, 0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7,
+										  0xF, 0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE, 0x1, 0x9, 0x5, 0xD, 0x3, 0xB,
+										  0x7, 0xF);
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+	const __m256i lo = _mm256_and_si256(bytes, nibble);
+	const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble);
+	return _mm256_or_si256(_mm256_shuffle_epi8(low, lo), _mm256_shuffle_epi8(high, hi));
+}
+
+inline __m256i Hash8(__m256i x)
+{
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+	x = Mul8(x, 0x7feb352du);
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+	x = Mul8(x, 0x846ca68bu);
+	return _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+}
+
+inline __m256i HashCombine8(const __m256i &seed, const __m256i &v)
+{
+	const __m256i mixed = _mm256_add_epi32(_mm256_add_epi32(v, _mm256_set1_epi32(int(0x9e3779b9u))),
+										   _mm256_add_epi32(_mm256_slli_epi32(seed, 6), _mm256_srli_epi32(seed, 2)));
+	return _mm256_xor_si256(seed, mixed);
+}
+
+inline __m256i NestedUniformScramble8(const __m256i &x, const __m256i &seed)
+{
+	__m256i v = _mm256_add_epi32(ReverseBits8(x), seed);
+	v = _mm256_xor_si256(v, Mul8(v, 0x6c50b47cu));
+	v = _mm256_xor_si256(v, Mul8(v, 0xb82f1e52u));
+	v = _mm256_xor_si256(v, Mul8(v, 0xc7afe638u));
+	v = _mm256_xor_si256(v, Mul8(v, 0x8d22f6e6u));
+	return ReverseBits8(v);
+}
+
+inline __m256i PixelSeed8(const __m256i &x, const __m256i &y) { return Hash8(_mm256_xor_si256(x, Hash8(y))); }
+
+inline __m256i ScrambledSobol8(const __m256i &seed, const __m256i &index, const __m256i &dimension)
+{
+	const __m256i groupSeed = Hash8(HashCombine8(seed, _mm256_srli_epi32(dimension, 2)));
+	const __m256i shuffled = NestedUniformScramble8(index, groupSeed);
+	const __m256i lane = _mm256_and_si256(dimension, _mm256_set1_epi32(3));
+	return NestedUniformScramble8(Sobol8(shuffled, lane),
+								  HashCombine8(groupSeed, _mm256_add_epi32(lane, _mm256_set1_epi32(1))));
+}
+} // namespace sampling
+
+// A sequence of sample points indexed by pixel, sample index and dimension. Every call to Rand/RandomUint returns the
+// next dimension of the current sample, so the same pixel & sample index always produce the same numbers no matter
+// which thread or tile renders it.
+// The implementations are final: code templated on the sampler type calls them without going through the vtable.
+class Sampler : public RandomGenerator
+{
+  public:
+	virtual ~Sampler() = default;
+
+	inline void StartPixel(int x, int y, unsigned int sampleIdx) { m_State = {x, y, sampleIdx, 0}; }
+
+	inline const SamplerState &GetState() const { return m_State; }
+
+	inline void SetState(const SamplerState &state) { m_State = state; }
+
+	static Sampler *Create(SamplerType type);
+
+  protected:
+	SamplerState m_State;
+};
+
+// Continues the sequence of a path in flight and stores how far it got when going out of scope
+class ScopedSamplerState
+{
+  public:
+	ScopedSamplerState(Sampler &sampler, SamplerState &state) : m_Sampler(sampler), m_State(state)
+	{
+		sampler.SetState(state);
+	}
+
+	~ScopedSamplerState() { m_State = m_Sampler.GetState(); }
+
+  private:
+	Sampler &m_Sampler;
+	SamplerState &m_State;
+};
+
+// Hashes pixel, sample index and dimension, no stratification at all
+class RandomSampler final : public Sampler
+{
+  public:
+	inline float Rand(float range = 1.0f) override { return sampling::ToUnitFloat(RandomUint()) * range; }
+
+	inline unsigned int RandomUint() override { return Sample(m_State, m_State.dimension++); }
+
+	inline unsigned int Sample(const SamplerState &state, unsigned int dimension) const
+	{
+		using namespace sampling;
+		return Hash(HashCombine(HashCombine(PixelSeed(state.x, state.y), state.index), dimension));
+	}
+
+	inline __m256i Sample8(const SamplerState8 &state) const
+	{
+		using namespace sampling;
+		return Hash8(HashCombine8(HashCombine8(PixelSeed8(state.x, state.y), state.index), state.dimension));
+	}
+};
+
+// Owen scrambled Sobol points using the hash based scrambling from Burley, "Practical Hash-based Owen Scrambling"
+// (JCGT 2020). Dimensions are padded in groups of 4, every group shuffles the sample index with its own seed.
+class SobolSampler final : public Sampler
+{
+  public:
+	inline float Rand(float range = 1.0f) override { return sampling::ToUnitFloat(RandomUint()) * range; }
+
+	inline unsigned int RandomUint() override { return Sample(m_State, m_State.dimension++); }
+
+	inline unsigned int Sample(const SamplerState &state, unsigned int dimension) const
+	{
+		using namespace sampling;
+		return ScrambledSobol(PixelSeed(state.x, state.y), state.index, dimension);
+	}
+
+	inline __m256i Sample8(const SamplerState8 &state) const
+	{
+		using namespace sampling;
+		return ScrambledSobol8(PixelSeed8(state.x, state.y), state.index, state.dimension);
+	}
+};
+
+// Blue noise dithered sampling (Georgiev & Fajardo 2016): all pixels walk the same scrambled Sobol sequence, which
+// is toroidally shifted per pixel and dimension by a 64x64 void and cluster mask. The error of neighbouring pixels
+// is then uncorrelated in a blue noise way, which looks a lot less noisy at low sample counts.
+class BlueNoiseSampler final : public Sampler
+{
+  public:
+	static constexpr int MASK_SIZE = 64; // a power of 2
+
+	BlueNoiseSampler();
+
+	inline float Rand(float range = 1.0f) override { return sampling::ToUnitFloat(RandomUint()) * range; }
+
+	inline unsigned int RandomUint() override { return Sample(m_State, m_State.dimension++); }
+
+	inline unsigned int Sample(const SamplerState &state, unsigned int dimension) const
+	{
+		// every dimension reads the mask at another offset along the R2 sequence, so dimensions get distinct masks
+		const auto ox = unsigned(float(dimension) * 0.7548776662f * float(MASK_SIZE));
+		const auto oy = unsigned(float(dimension) * 0.5698402910f * float(MASK_SIZE));
+		const unsigned int x = (unsigned(state.x) + ox) & (MASK_SIZE - 1);
+		const unsigned int y = (unsigned(state.y) + oy) & (MASK_SIZE - 1);
+
+		// the shift wraps around in 32 bit fixed point
+		return sampling::ScrambledSobol(0, state.index, dimension) + m_Mask[x + y * MASK_SIZE];
+	}
+
+	inline __m256i Sample8(const SamplerState8 &state) const
+	{
+		const __m256 dimension = _mm256_cvtepi32_ps(state.dimension);
+		const __m256 size = _mm256_set1_ps(float(MASK_SIZE));
+		const __m256 fx = _mm256_mul_ps(_mm256_mul_ps(dimension, _mm256_set1_ps(0.7548776662f)), size);
+		const __m256 fy = _mm256_mul_ps(_mm256_mul_ps(dimension, _mm256_set1_ps(0.5698402910f)), size);
+		const __m256i wrap = _mm256_set1_epi32(MASK_SIZE - 1);
+		const __m256i x = _mm256_and_si256(_mm256_add_epi32(state.x, _mm256_cvttps_epi32(fx)), wrap);
+		const __m256i y = _mm256_and_si256(_mm256_add_epi32(state.y, _mm256_cvttps_epi32(fy)), wrap);
+		const __m256i texel = _mm256_add_epi32(x, sampling::Mul8(y, MASK_SIZE));
+		const __m256i mask = _mm256_i32gather_epi32(reinterpret_cast<const int *>(m_Mask), texel, 4);
+
+		return _mm256_add_epi32(sampling::ScrambledSobol8(_mm256_setzero_si256(), state.index, state.dimension), mask);
+	}
+
+  private:
+	const unsigned int *m_Mask;
+};
+
+// Draws the next `dimensions` numbers of up to 8 paths at once, out[d * 8 + lane] is dimension d of lane. Gives the
+// same numbers as calling Rand on every path, unused lanes repeat the first path.
+template <typename S>
+inline void SampleBatch(const S &sampler, SamplerState *const *states, unsigned int lanes, unsigned int dimensions,
+						float *out)
+{
+	alignas(32) int x[8], y[8], index[8], dimension[8];
+	for (unsigned int i = 0; i < 8; i++)
+	{
+		const SamplerState &state = *states[i < lanes ? i : 0];
+		x[i] = state.x, y[i] = state.y;
+		index[i] = int(state.index), dimension[i] = int(state.dimension);
+	}
+
+	SamplerState8 state8 = {_mm256_load_si256(reinterpret_cast<const __m256i *>(x)),
+							_mm256_load_si256(reinterpret_cast<const __m256i *>(y)),
+							_mm256_load_si256(reinterpret_cast<const __m256i *>(index)),
+							_mm256_load_si256(reinterpret_cast<const __m256i *>(dimension))};
+
+	for (unsigned int d = 0; d < dimensions; d++)
+	{
+		// the top 24 bits like sampling::ToUnitFloat, they fit a signed int and convert exactly
+		const __m256i v = _mm256_srli_epi32(sampler.Sample8(state8), 8);
+		const __m256 u = _mm256_mul_ps(_mm256_cvtepi32_ps(v), _mm256_set1_ps(5.9604644775390625e-8f));
+		_mm256_storeu_ps(out + d * 8, u);
+		state8.dimension = _mm256_add_epi32(state8.dimension, _mm256_set1_epi32(1));
+	}
+
+	for (unsigned int i = 0; i < lanes; i++)
+		states[i]->dimension += dimensions;
+}
@@ -0,0 +1,145 @@
+#include "Utils/Stats.h"
+
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace utils
+{
+namespace stats
+{
+namespace
+{
+// only touched when a thread starts counting and once per frame
+std::mutex registryMutex;
+std::vector<ThreadStats *> registry;
+
+// totals up to the previous EndFrame
+FrameStats previous;
+} // namespace
+
+const char *GetCounterName(Counter counter)
+{
+	switch (counter)
+	{
+	case (Counter::Paths):
+		return "paths";
+	case (Counter::PrimaryRays):
+		return "primary_rays";
+	case (Counter::BounceRays):
+		return "bounce_rays";
+	case (Counter::ShadowRays):
+		return "shadow_rays";
+	case (Counter::OccludedShadowRays):
+		return "occluded_shadow_rays";
+	case (Counter::NodeVisits):
+		return "node_visits";
+	case (Counter::PrimitiveTests):
+		return "primitive_tests";
+	case (Counter::RouletteTests):
+		return "roulette_tests";
+	case (Counter::RouletteKills):
+		return "roulette_kills";
+	default:
+		return "unknown";
+	}
+}
+
+const char *GetStageName(Stage stage)
+{
+	switch (stage)
+	{
+	case (Stage::Camera):
+		return "camera";
+	case (Stage::Trace):
+		return "trace";
+	case (Stage::Shade):
+		return "shade";
+	case (Stage::Accumulate):
+		return "accumulate";
+	case (Stage::Present):
+		return "present";
+	case (Stage::BVHRefit):
+		return "bvh_refit";
+	case (Stage::BVHRebuild):
+		return "bvh_rebuild";
+	default:
+		return "unknown";
+	}
+}
+
+std::string FrameStats::ToJSON() const
+{
+	char buffer[128];
+	std::string json;
+	json.reserve(1024);
+
+	snprintf(buffer, sizeof(buffer), "{\"frame\":%i,\"frame_ms\":%.3f", frame, frameMs);
+	json += buffer;
+	for (int i = 0; i < int(Counter::Count); i++)
+	{
+		snprintf(buffer, sizeof(buffer), ",\"%s\":%llu", GetCounterName(Counter(i)),
+				 static_cast<unsigned long long>(counters[i]));
+		json += buffer;
+	}
+
+	snprintf(buffer, sizeof(buffer), ",\"occluded_rate\":%.4f,\"roulette_kill_rate\":%.4f,\"avg_path_length\":%.3f",
+			 Ratio(Counter::OccludedShadowRays, Counter::ShadowRays),
+			 Ratio(Counter::RouletteKills, Counter::RouletteTests), GetAveragePathLength());
+	json += buffer;
+
+	json += ",\"stage_ms\":{";
+	for (int i = 0; i < int(Stage::Count); i++)
+	{
+		snprintf(buffer, sizeof(buffer), "%s\"%s\":%.3f", i > 0 ? "," : "", GetStageName(Stage(i)), stageMs[i]);
+		json += buffer;
+	}
+	json += "}}";
+	return json;
+}
+
+ThreadStats::ThreadStats()
+{
+	for (auto &counter : counters)
+		counter.store(0, std::memory_order_relaxed);
+	for (auto &time : stageNs)
+		time.store(0, std::memory_order_relaxed);
+}
+
+ThreadStats *RegisterThread()
+{
+	auto *local = new ThreadStats();
+	std::lock_guard<std::mutex> lock(registryMutex);
+	registry.push_back(local);
+	return local;
+}
+
+FrameStats EndFrame(float frameMs)
+{
+	FrameStats totals;
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (const ThreadStats *thread : registry)
+		{
+			for (int i = 0; i < int(Counter::Count); i++)
+				totals.counters[i] += thread->counters[i].load(std::memory_order_relaxed);
+			for (int i = 0; i < int(Stage::Count); i++)
+				totals.stageMs[i] += double(thread->stageNs[i].load(std::memory_order_relaxed)) * 1e-6;
+		}
+	}
+
+	// counters only grow, the difference with the previous totals is this frame
+	FrameStats frame = totals;
+	frame.frame = previous.frame + 1;
+	frame.frameMs = frameMs;
+	for (int i = 0; i < int(Counter::Count); i++)
+		frame.counters[i] -= previous.counters[i];
+	for (int i = 0; i < int(Stage::Count); i++)
+		frame.stageMs[i] -= previous.stageMs[i];
+
+	totals.frame = frame.frame;
+	previous = totals;
+	return frame;
+}
+} // namespace stats
+} // namespace utils
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "Utils/Timer.h"
+
+// Render counters and stage timers, 0 compiles every Add and ScopedTimer away
+#define STATS 1
+
+namespace utils
+{
+namespace stats
+{
+enum class Counter
+{
+	Paths, // camera samples started
+	PrimaryRays,
+	BounceRays,
+	ShadowRays,
+	OccludedShadowRays,
+	NodeVisits,
+	PrimitiveTests,
+	RouletteTests,
+	RouletteKills,
+	Count
+};
+
+enum class Stage
+{
+	Camera,
+	Trace,
+	Shade,
+	Accumulate, // adding samples to the frame buffer and resolving it for display
+	Present,
+	BVHRefit,
+	BVHRebuild,
+	Count
+};
+
+// snake_case names, used as JSON keys and labels
+const char *GetCounterName(Counter counter);
+const char *GetStageName(Stage stage);
+
+// Totals of all threads over one frame. Stage times are summed over threads, so they can exceed the frame time.
+struct FrameStats
+{
+	int frame = 0;
+	float frameMs = 0.0f;
+	uint64_t counters[int(Counter::Count)] = {};
+	double stageMs[int(Stage::Count)] = {};
+
+	inline uint64_t Get(Counter counter) const { return counters[int(counter)]; }
+
+	inline double GetMs(Stage stage) const { return stageMs[int(stage)]; }
+
+	// a / b, 0 when nothing was counted
+	inline double Ratio(Counter a, Counter b) const { return Get(b) > 0 ? double(Get(a)) / double(Get(b)) : 0.0; }
+
+	inline uint64_t GetRays() const
+	{
+		return Get(Counter::PrimaryRays) + Get(Counter::BounceRays) + Get(Counter::ShadowRays);
+	}
+
+	// Traced segments per path, shadow rays not included
+	inline double GetAveragePathLength() const
+	{
+		return Get(Counter::Paths) > 0
+				   ? double(Get(Counter::PrimaryRays) + Get(Counter::BounceRays)) / double(Get(Counter::Paths))
+				   : 0.0;
+	}
+
+	// Single line JSON object
+	std::string ToJSON() const;
+};
+
+// Counters of a single thread. The owning thread is the only writer, so a relaxed load and store is enough and
+// the hot paths never execute a locked instruction. Frames are collected while the writers keep going.
+struct ThreadStats
+{
+	std::atomic<uint64_t> counters[int(Counter::Count)];
+	std::atomic<uint64_t> stageNs[int(Stage::Count)];
+
+	ThreadStats();
+
+	inline void Add(Counter counter, uint64_t n)
+	{
+		std::atomic<uint64_t> &value = counters[int(counter)];
+		value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	inline void AddTime(Stage stage, uint64_t ns)
+	{
+		std::atomic<uint64_t> &value = stageNs[int(stage)];
+		value.store(value.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+	}
+};
+
+// Allocates the counters of a new thread, they are kept for the lifetime of the process
+ThreadStats *RegisterThread();
+
+// Counters of the calling thread
+inline ThreadStats &Local()
+{
+	static thread_local ThreadStats *local = RegisterThread();
+	return *local;
+}
+
+// Traversal work of a single ray. Traversals count into a local and add it once per trace, so the inner loops
+// don't touch the thread counters.
+struct TraversalCounts
+{
+	uint32_t nodeVisits = 0;
+	uint32_t primitiveTests = 0;
+};
+
+#if STATS
+inline void Add(Counter counter, uint64_t n = 1) { Local().Add(counter, n); }
+
+inline void Add(const TraversalCounts &counts)
+{
+	ThreadStats &local = Local();
+	local.Add(Counter::NodeVisits, counts.nodeVisits);
+	local.Add(Counter::PrimitiveTests, counts.primitiveTests);
+}
+#else
+inline void Add(Counter, uint64_t = 1) {}
+
+inline void Add(const TraversalCounts &) {}
+#endif
+
+// Adds the time until the end of the scope to a stage of the calling thread
+class ScopedTimer
+{
+  public:
+#if STATS
+	inline explicit ScopedTimer(Stage stage) : m_Stage(stage), m_Start(Timer::get()) {}
+
+	inline ~ScopedTimer()
+	{
+		const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Timer::get() - m_Start);
+		Local().AddTime(m_Stage, uint64_t(elapsed.count()));
+	}
+
+  private:
+	Stage m_Stage;
+	Timer::TimePoint m_Start;
+#else
+	inline explicit ScopedTimer(Stage) {}
+#endif
+};
+
+// Sums up the counters of all threads and returns everything that was counted since the previous call.
+// Meant to be called once per frame by a single thread.
+FrameStats EndFrame(float frameMs);
+} // namespace stats
+} // namespace utils
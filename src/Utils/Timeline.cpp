@@ -0,0 +1,163 @@
+#include "Utils/Timeline.h"
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <vector>
+
+#define MAX_EVENTS_PER_THREAD (1u << 20u) // later events are dropped, keeps long sessions from eating all memory
+
+namespace utils
+{
+namespace timeline
+{
+std::atomic<bool> recording{false};
+
+namespace
+{
+struct Event
+{
+	const char *name;
+	const char *category;
+	int64_t start, duration;
+	int process, track;
+};
+
+// Events of a single thread, its lock is only contended while the trace is written
+struct ThreadTimeline
+{
+	std::mutex mutex;
+	std::vector<Event> events;
+	size_t dropped = 0;
+	int track;
+};
+
+const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+std::mutex registryMutex;
+std::vector<ThreadTimeline *> registry;
+std::vector<std::tuple<int, int, std::string>> trackNames;
+std::set<std::string> names;
+
+ThreadTimeline &Local()
+{
+	static thread_local ThreadTimeline *local = [] {
+		auto *thread = new ThreadTimeline();
+		std::lock_guard<std::mutex> lock(registryMutex);
+		thread->track = int(registry.size());
+		registry.push_back(thread);
+		return thread;
+	}();
+	return *local;
+}
+
+void Record(const Event &event)
+{
+	ThreadTimeline &thread = Local();
+	std::lock_guard<std::mutex> lock(thread.mutex);
+	if (thread.events.size() < MAX_EVENTS_PER_THREAD)
+		thread.events.push_back(event);
+	else
+		thread.dropped++;
+}
+
+// Names are identifiers and file names, only quotes and backslashes need escaping
+std::string Escape(const char *str)
+{
+	std::string escaped;
+	for (; *str != '\0'; str++)
+	{
+		if (*str == '"' || *str == '\\')
+			escaped += '\\';
+		escaped += *str;
+	}
+	return escaped;
+}
+} // namespace
+
+void Start() { recording.store(true, std::memory_order_relaxed); }
+
+void Stop() { recording.store(false, std::memory_order_relaxed); }
+
+int64_t Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+const char *Intern(const std::string &name)
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	return names.insert(name).first->c_str();
+}
+
+void SetThreadName(const std::string &name) { SetTrackName(CPU_PROCESS, Local().track, name); }
+
+void SetTrackName(int process, int track, const std::string &name)
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	for (auto &trackName : trackNames)
+	{
+		if (std::get<0>(trackName) == process && std::get<1>(trackName) == track)
+		{
+			std::get<2>(trackName) = name;
+			return;
+		}
+	}
+	trackNames.emplace_back(process, track, name);
+}
+
+void AddEvent(const char *name, const char *category, int64_t start, int64_t duration, int process, int track)
+{
+	if (IsRecording())
+		Record({name, category, start, duration, process, track});
+}
+
+#if TIMELINE
+void ScopedEvent::End()
+{
+	const int64_t end = Now();
+	Record({m_Name, m_Category, m_Start, end - m_Start, CPU_PROCESS, Local().track});
+}
+#endif
+
+bool Write(const std::string &path)
+{
+	FILE *file = fopen(path.c_str(), "w");
+	if (file == nullptr)
+		return false;
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%i,\"args\":{\"name\":\"CPU\"}},\n", CPU_PROCESS);
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%i,\"args\":{\"name\":\"OpenCL\"}}", DEVICE_PROCESS);
+	for (const auto &trackName : trackNames)
+	{
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%i,\"tid\":%i,\"args\":{\"name\":\"%s\"}}",
+				std::get<0>(trackName), std::get<1>(trackName), Escape(std::get<2>(trackName).c_str()).c_str());
+	}
+
+	size_t dropped = 0;
+	for (ThreadTimeline *thread : registry)
+	{
+		std::lock_guard<std::mutex> threadLock(thread->mutex);
+		dropped += thread->dropped;
+		for (const Event &event : thread->events)
+		{
+			// microseconds with nanosecond precision
+			fprintf(file,
+					",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%i,\"tid\":%i,\"ts\":%.3f,\"dur\":%.3f}",
+					Escape(event.name).c_str(), event.category, event.process, event.track,
+					double(event.start) * 1e-3, double(event.duration) * 1e-3);
+		}
+	}
+	fprintf(file, "\n]}\n");
+
+	if (dropped > 0)
+		printf("Timeline: %zu events were dropped, a thread reached the limit of %u events.\n", dropped,
+			   MAX_EVENTS_PER_THREAD);
+	return fclose(file) == 0;
+}
+} // namespace timeline
+} // namespace utils
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Begin / end events for a Chrome trace (chrome://tracing, ui.perfetto.dev), 0 compiles every ScopedEvent away
+#define TIMELINE 1
+
+namespace utils
+{
+namespace timeline
+{
+// Tracks of the trace file: CPU threads are threads of process 0, OpenCL devices are tracks of process 1
+constexpr int CPU_PROCESS = 0;
+constexpr int DEVICE_PROCESS = 1;
+
+extern std::atomic<bool> recording;
+
+// Events are only recorded between Start and Stop
+void Start();
+void Stop();
+
+inline bool IsRecording() { return recording.load(std::memory_order_relaxed); }
+
+// Nanoseconds since the process started, the time base of every event
+int64_t Now();
+
+// Returns a copy of name that lives as long as the process, for names that are not string literals
+const char *Intern(const std::string &name);
+
+// Names the track of the calling thread
+void SetThreadName(const std::string &name);
+
+// Names an explicit track, e.g. a device
+void SetTrackName(int process, int track, const std::string &name);
+
+// Records an event on an explicit track, e.g. kernels on a device. name and category need to outlive the trace.
+void AddEvent(const char *name, const char *category, int64_t start, int64_t duration, int process, int track);
+
+// Records the lifetime of the scope on the track of the calling thread
+class ScopedEvent
+{
+  public:
+#if TIMELINE
+	inline ScopedEvent(const char *name, const char *category)
+		: m_Name(name), m_Category(category), m_Start(IsRecording() ? Now() : -1)
+	{
+	}
+
+	inline ~ScopedEvent()
+	{
+		if (m_Start >= 0)
+			End();
+	}
+
+  private:
+	void End();
+
+	const char *m_Name;
+	const char *m_Category;
+	int64_t m_Start;
+#else
+	inline ScopedEvent(const char *, const char *) {}
+#endif
+};
+
+// Writes everything recorded so far as Chrome trace JSON, returns false if the file could not be written
+bool Write(const std::string &path);
+} // namespace timeline
+} // namespace utils
@@ -25,9 +25,12 @@
 #include <memory>
 #include <mutex>
 #include <queue>
+#include <string>
 #include <thread>
 #include <vector>
 
+#include "Utils/Timeline.h"
+
 // thread pool to run user's functors with signature
 //      ret func(int id, other_params)
 // where id is the index of the thread that runs the functor
@@ -198,8 +201,10 @@ class ThreadPool
             std::make_shared<std::packaged_task<decltype(f(0, rest...))(int)>>(
                 std::bind(std::forward<F>(f), std::placeholders::_1,
                           std::forward<Rest>(rest)...));
-        auto _f =
-            new std::function<void(int id)>([pck](int id) { (*pck)(id); });
+        auto _f = new std::function<void(int id)>([pck](int id) {
+            utils::timeline::ScopedEvent event("task", "pool");
+            (*pck)(id);
+        });
         this->q.push(_f);
         std::unique_lock<std::mutex> lock(this->mutex);
         this->cv.notify_one();
@@ -213,8 +218,10 @@ class ThreadPool
     {
         auto pck = std::make_shared<std::packaged_task<decltype(f(0))(int)>>(
             std::forward<F>(f));
-        auto _f =
-            new std::function<void(int id)>([pck](int id) { (*pck)(id); });
+        auto _f = new std::function<void(int id)>([pck](int id) {
+            utils::timeline::ScopedEvent event("task", "pool");
+            (*pck)(id);
+        });
         this->q.push(_f);
         std::unique_lock<std::mutex> lock(this->mutex);
         this->cv.notify_one();
@@ -233,6 +240,7 @@ class ThreadPool
         std::shared_ptr<std::atomic<bool>> flag(
             this->flags[i]); // a copy of the shared ptr to the flag
         auto f = [this, i, flag /* a copy of the shared ptr to the flag */]() {
+            utils::timeline::SetThreadName("Pool thread " + std::to_string(i));
             std::atomic<bool> &_flag = *flag;
             std::function<void(int id)> *_f;
             bool isPop = this->q.pop(_f);
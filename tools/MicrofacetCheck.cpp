@@ -0,0 +1,21 @@
+// Checks the AVX2 microfacet code against the scalar version, run through ctest.
+
+#include <cstdio>
+
+#include "Materials/Microfacet8.h"
+#include "Utils/Pcg32.h"
+
+int main()
+{
+	constexpr float tolerance = 1e-3f;
+
+	Pcg32 rng;
+	const Microfacet8Error error = MeasureMicrofacet8(rng, 1 << 16);
+
+	printf("Microfacet8 max errors: sample %g, D %g, G %g, weight %g, non-finite results %u (tolerance %g)\n",
+		   error.sample, error.D, error.G, error.weight, error.nonFinite, tolerance);
+
+	const bool passed = error.nonFinite == 0 && error.sample <= tolerance && error.D <= tolerance &&
+						error.G <= tolerance && error.weight <= tolerance;
+	return passed ? 0 : 1;
+}